@@ -0,0 +1,59 @@
+/**
+ * @file benchmarks/benchmark.h
+ * @brief Minimal helpers for writing microbenchmarks.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+namespace yaramod {
+namespace benchmarks {
+
+/**
+ * Prevents the compiler from optimizing away computation of the value.
+ */
+template <typename T>
+inline void doNotOptimize(const T& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	asm volatile("" : : "r,m"(value) : "memory");
+#else
+	static volatile const T* sink;
+	sink = &value;
+#endif
+}
+
+/**
+ * Runs `func` the given number of times and prints the average time of one iteration.
+ *
+ * @param name Name of the measured operation.
+ * @param iterations Number of iterations.
+ * @param func Measured operation.
+ *
+ * @return Average time of one iteration in nanoseconds.
+ */
+template <typename Fn>
+double measure(const std::string& name, std::uint64_t iterations, Fn&& func)
+{
+	// Warm up caches and branch predictors
+	for (std::uint64_t i = 0; i < iterations / 10 + 1; ++i)
+		func();
+
+	auto start = std::chrono::steady_clock::now();
+	for (std::uint64_t i = 0; i < iterations; ++i)
+		func();
+	auto end = std::chrono::steady_clock::now();
+
+	auto nsPerIteration = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+	std::cout << std::left << std::setw(48) << name << std::right << std::setw(14) << std::fixed << std::setprecision(2) << nsPerIteration << " ns/iter" << std::endl;
+	return nsPerIteration;
+}
+
+} // namespace benchmarks
+} // namespace yaramod
@@ -0,0 +1,65 @@
+/**
+ * @file benchmarks/fingerprint_benchmark.cpp
+ * @brief Benchmark of structural fingerprints of rules.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#include <sstream>
+
+#include <yaramod/yaramod.h>
+
+#include "benchmark.h"
+
+using namespace yaramod;
+using namespace yaramod::benchmarks;
+
+namespace {
+
+std::string ruleset(std::size_t rules)
+{
+	std::ostringstream os;
+	os << "import \"pe\"\n\n";
+	for (std::size_t i = 0; i < rules; ++i)
+	{
+		os << "rule rule_" << i << "\n{\n\tstrings:\n"
+			<< "\t\t$s1 = \"string " << i << "\" ascii wide\n"
+			<< "\t\t$s2 = { 4D 5A ?? 00 [2-4] " << std::hex << std::setw(2) << std::setfill('0') << (i % 256) << std::dec << " }\n"
+			<< "\t\t$s3 = /abc[0-9]+def/\n"
+			<< "\tcondition:\n\t\t"
+			<< "uint16(0) == 0x5A4D and ($s1 or #s2 > " << i % 10 << ") and $s3 in (0 .. filesize)"
+			<< " and pe.number_of_sections > 2 and for any i in (0 .. pe.number_of_sections - 1) : ( pe.sections[i].name == \".text\" )"
+			<< "\n}\n\n";
+	}
+	return os.str();
+}
+
+}
+
+int main()
+{
+	auto input = ruleset(10000);
+	std::cout << "== Ruleset with " << input.length() << " bytes" << std::endl;
+
+	Yaramod yaramod;
+	std::istringstream is(input);
+	auto file = yaramod.parseStream(is);
+
+	measure("Rule::fingerprint() without cached hashes", 20, [&]() {
+		StructuralHashCache::invalidateAll();
+		for (const auto& rule : file->getRules())
+			doNotOptimize(rule->fingerprint());
+	});
+
+	measure("Rule::fingerprint() with cached hashes", 20, [&]() {
+		for (const auto& rule : file->getRules())
+			doNotOptimize(rule->fingerprint());
+	});
+
+	measure("Expression::structuralHash() without cached hashes", 20, [&]() {
+		StructuralHashCache::invalidateAll();
+		for (const auto& rule : file->getRules())
+			doNotOptimize(rule->getCondition()->structuralHash());
+	});
+
+	return 0;
+}
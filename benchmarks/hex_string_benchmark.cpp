@@ -0,0 +1,76 @@
+/**
+ * @file benchmarks/hex_string_benchmark.cpp
+ * @brief Benchmark of parsing of hex strings.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#include <iomanip>
+#include <sstream>
+
+#include <yaramod/yaramod.h>
+
+#include "benchmark.h"
+
+using namespace yaramod;
+using namespace yaramod::benchmarks;
+
+namespace {
+
+std::string hexHeavyRuleset(std::size_t rules, std::size_t stringsPerRule, std::size_t bytesPerString)
+{
+	std::ostringstream os;
+	std::uint32_t state = 0x12345678;
+	auto nextByte = [&]() {
+		state = state * 1664525u + 1013904223u;
+		return static_cast<unsigned>(state >> 24);
+	};
+
+	os << std::hex << std::uppercase << std::setfill('0');
+	for (std::size_t i = 0; i < rules; ++i)
+	{
+		os << "rule rule_" << i << "\n{\n\tstrings:\n";
+		for (std::size_t j = 0; j < stringsPerRule; ++j)
+		{
+			os << "\t\t$h" << j << " = {";
+			for (std::size_t k = 0; k < bytesPerString; ++k)
+			{
+				// Mostly plain bytes with occasional wildcards, jumps and alternations
+				if (k % 24 == 23)
+					os << " ??";
+				else if (k % 40 == 39)
+					os << " [2-4]";
+				else if (k % 64 == 63)
+					os << " ( " << std::setw(2) << nextByte() << " | " << std::setw(2) << nextByte() << " )";
+				else
+					os << ' ' << std::setw(2) << nextByte();
+			}
+			os << " }\n";
+		}
+		os << "\tcondition:\n\t\tany of them\n}\n\n";
+	}
+	return os.str();
+}
+
+}
+
+int main()
+{
+	auto input = hexHeavyRuleset(200, 10, 128);
+	std::cout << "== Ruleset with " << input.length() << " bytes" << std::endl;
+
+	Yaramod yaramod;
+	measure("parse hex heavy ruleset", 5, [&]() {
+		std::istringstream is(input);
+		auto file = yaramod.parseStream(is);
+		doNotOptimize(file);
+	});
+
+	std::istringstream is(input);
+	auto file = yaramod.parseStream(is);
+	measure("print hex heavy ruleset", 5, [&]() {
+		auto text = file->getTextFormatted();
+		doNotOptimize(text);
+	});
+
+	return 0;
+}
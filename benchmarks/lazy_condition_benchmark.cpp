@@ -0,0 +1,69 @@
+/**
+ * @file benchmarks/lazy_condition_benchmark.cpp
+ * @brief Benchmark of parsing with lazily parsed conditions.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#include <sstream>
+
+#include <yaramod/yaramod.h>
+
+#include "benchmark.h"
+
+using namespace yaramod;
+using namespace yaramod::benchmarks;
+
+namespace {
+
+std::string conditionHeavyRuleset(std::size_t rules)
+{
+	std::ostringstream os;
+	os << "import \"pe\"\nimport \"math\"\n\n";
+	for (std::size_t i = 0; i < rules; ++i)
+	{
+		os << "rule rule_" << i << "\n{\n\tmeta:\n\t\tauthor = \"author\"\n\t\tversion = " << i
+			<< "\n\tstrings:\n\t\t$s0 = \"string " << i << "\"\n\t\t$s1 = { 4D 5A ?? 00 }\n\tcondition:\n"
+			<< "\t\tpe.number_of_sections > 2 and\n"
+			<< "\t\tfor any i in (0 .. pe.number_of_sections - 1) : (\n"
+			<< "\t\t\tpe.sections[i].name == \".text\" and\n"
+			<< "\t\t\tmath.entropy(pe.sections[i].raw_data_offset, pe.sections[i].raw_data_size) > 7.0\n"
+			<< "\t\t) and\n"
+			<< "\t\t(#s0 > 2 or $s1 at pe.entry_point) and\n"
+			<< "\t\tfilesize < 2MB";
+		if (i > 0)
+			os << " and not rule_" << (i - 1);
+		os << "\n}\n\n";
+	}
+	return os.str();
+}
+
+}
+
+int main()
+{
+	auto input = conditionHeavyRuleset(2000);
+	std::cout << "== Ruleset with " << input.length() << " bytes" << std::endl;
+
+	Yaramod yaramod;
+	measure("parse ruleset", 5, [&]() {
+		std::istringstream is(input);
+		auto file = yaramod.parseStream(is);
+		doNotOptimize(file);
+	});
+
+	measure("parse ruleset with lazy conditions", 5, [&]() {
+		std::istringstream is(input);
+		auto file = yaramod.parseStream(is, ParserMode::LazyConditions);
+		doNotOptimize(file);
+	});
+
+	measure("parse ruleset with lazy conditions and load them", 5, [&]() {
+		std::istringstream is(input);
+		auto file = yaramod.parseStream(is, ParserMode::LazyConditions);
+		for (const auto& rule : file->getRules())
+			doNotOptimize(rule->getCondition());
+		doNotOptimize(file);
+	});
+
+	return 0;
+}
@@ -0,0 +1,145 @@
+/**
+ * @file benchmarks/literal_benchmark.cpp
+ * @brief Microbenchmark of parsing and formatting of numeric literals.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#include <sstream>
+#include <vector>
+
+#include <yaramod/types/literal.h>
+#include <yaramod/utils/utils.h>
+#include <yaramod/yaramod.h>
+
+#include "benchmark.h"
+
+using namespace yaramod;
+using namespace yaramod::benchmarks;
+
+namespace {
+
+// Reference implementation based on string streams to compare against.
+template <typename T>
+std::string streamNumToStr(const T num, std::ios_base &(*format)(std::ios_base&) = std::dec, bool showbase = false)
+{
+	std::ostringstream os;
+	if (showbase)
+		os << format << std::showbase << num;
+	else
+		os << format << num;
+	return os.str();
+}
+
+template <typename T>
+bool streamStrToNum(const std::string& str, T& num, std::ios_base &(*format)(std::ios_base&) = std::dec)
+{
+	std::istringstream is(str);
+	T tmp = 0;
+	is >> format >> tmp;
+	if (!is.fail() && is.eof())
+	{
+		num = tmp;
+		return true;
+	}
+	return false;
+}
+
+std::string integerHeavyRuleset(std::size_t rules)
+{
+	std::ostringstream os;
+	os << "import \"pe\"\nimport \"math\"\n\n";
+	for (std::size_t i = 0; i < rules; ++i)
+	{
+		os << "rule rule_" << i << "\n{\n\tcondition:\n\t\tuint16(0) == 0x5A4D and\n\t\tuint32(uint32(0x3C)) == 0x00004550 and\n"
+			<< "\t\tfilesize < " << (i % 64) + 1 << "MB and filesize > " << i << "KB and\n"
+			<< "\t\tfor any i in (" << i << ", " << i * 3 << ", " << i * 7 << ", 0x" << std::hex << i * 0x1234 << std::dec << ") : ( uint32(i) == 0x" << std::hex << i * 0xDEAD << std::dec << " ) and\n"
+			<< "\t\tpe.number_of_sections > " << i % 16 << " and math.entropy(0, 1024) >= 7.25\n}\n\n";
+	}
+	return os.str();
+}
+
+}
+
+int main()
+{
+	const std::uint64_t iterations = 1000000;
+
+	std::vector<std::string> decimals, hexadecimals;
+	for (std::int64_t i = 0; i < 1024; ++i)
+	{
+		decimals.push_back(std::to_string(i * 7919));
+		hexadecimals.push_back("0x" + streamNumToStr(i * 0x9E3779B1, std::hex));
+	}
+
+	std::size_t index = 0;
+	std::cout << "== Parsing" << std::endl;
+	measure("stringstream decimal", iterations, [&]() {
+		std::int64_t n = 0;
+		streamStrToNum(decimals[index++ % decimals.size()], n);
+		doNotOptimize(n);
+	});
+	measure("strToNum decimal", iterations, [&]() {
+		std::int64_t n = 0;
+		strToNum(decimals[index++ % decimals.size()], n);
+		doNotOptimize(n);
+	});
+	measure("stringstream hexadecimal", iterations, [&]() {
+		std::int64_t n = 0;
+		streamStrToNum(hexadecimals[index++ % hexadecimals.size()], n, std::hex);
+		doNotOptimize(n);
+	});
+	measure("strToNum hexadecimal", iterations, [&]() {
+		std::int64_t n = 0;
+		strToNum(hexadecimals[index++ % hexadecimals.size()], n, std::hex);
+		doNotOptimize(n);
+	});
+
+	std::cout << "== Formatting" << std::endl;
+	std::int64_t value = 0;
+	measure("stringstream decimal", iterations, [&]() {
+		auto str = streamNumToStr(value++ * 7919);
+		doNotOptimize(str);
+	});
+	measure("numToStr decimal", iterations, [&]() {
+		auto str = numToStr(value++ * 7919);
+		doNotOptimize(str);
+	});
+	measure("stringstream hexadecimal with base", iterations, [&]() {
+		auto str = streamNumToStr(value++ * 7919, std::hex, true);
+		doNotOptimize(str);
+	});
+	measure("numToStr hexadecimal with base", iterations, [&]() {
+		auto str = numToStr(value++ * 7919, std::hex, true);
+		doNotOptimize(str);
+	});
+	double fvalue = 0.0;
+	measure("stringstream double", iterations, [&]() {
+		auto str = streamNumToStr(fvalue += 0.37);
+		doNotOptimize(str);
+	});
+	measure("numToStr double", iterations, [&]() {
+		auto str = numToStr(fvalue += 0.37);
+		doNotOptimize(str);
+	});
+	measure("Literal::getText integer", iterations, [&]() {
+		auto str = Literal(value++ * 7919).getText();
+		doNotOptimize(str);
+	});
+
+	std::cout << "== Whole ruleset" << std::endl;
+	auto input = integerHeavyRuleset(2000);
+	Yaramod yaramod;
+	measure("parse integer heavy ruleset", 10, [&]() {
+		std::istringstream is(input);
+		auto file = yaramod.parseStream(is);
+		doNotOptimize(file);
+	});
+	std::istringstream is(input);
+	auto file = yaramod.parseStream(is);
+	measure("print integer heavy ruleset", 10, [&]() {
+		auto text = file->getText();
+		doNotOptimize(text);
+	});
+
+	return 0;
+}
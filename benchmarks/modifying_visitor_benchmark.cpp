@@ -0,0 +1,104 @@
+/**
+ * @file benchmarks/modifying_visitor_benchmark.cpp
+ * @brief Benchmark of ModifyingVisitor on long chains of operations.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#include <sstream>
+
+#include <yaramod/yaramod.h>
+#include <yaramod/utils/modifying_visitor.h>
+
+#include "benchmark.h"
+
+using namespace yaramod;
+using namespace yaramod::benchmarks;
+
+namespace {
+
+class OddStringRemover : public ModifyingVisitor
+{
+public:
+	using ModifyingVisitor::visit;
+
+	virtual VisitResult visit(StringExpression* expr) override
+	{
+		if ((expr->getId().back() - '0') % 2 == 1)
+			return VisitAction::Delete;
+
+		return {};
+	}
+};
+
+class StringRenamer : public ModifyingVisitor
+{
+public:
+	using ModifyingVisitor::visit;
+
+	virtual VisitResult visit(StringExpression* expr) override
+	{
+		TokenStreamContext context{expr};
+		auto output = YaraExpressionBuilder{std::make_shared<StringExpression>(expr->getId() + "_renamed")}.get();
+		cleanUpTokenStreams(context, output.get());
+		return output;
+	}
+};
+
+std::string longChainRuleset(std::size_t rules, std::size_t terms)
+{
+	std::ostringstream os;
+	for (std::size_t i = 0; i < rules; ++i)
+	{
+		os << "rule rule_" << i << "\n{\n\tstrings:\n";
+		for (std::size_t j = 0; j < 10; ++j)
+			os << "\t\t$s" << j << " = \"string " << j << "\"\n";
+		os << "\tcondition:\n\t\t";
+		for (std::size_t j = 0; j < terms; ++j)
+		{
+			if (j > 0)
+				os << (j % 8 == 0 ? " or\n\t\t" : " or ");
+			os << "$s" << j % 10;
+		}
+		os << "\n}\n\n";
+	}
+	return os.str();
+}
+
+template <typename VisitorType>
+void modifyAll(YaraFile* file)
+{
+	VisitorType visitor;
+	for (const auto& rule : file->getRules())
+		rule->setCondition(visitor.modify(rule->getCondition(), boolVal(true).get()));
+}
+
+}
+
+int main()
+{
+	auto input = longChainRuleset(10, 5000);
+	std::cout << "== Ruleset with " << input.length() << " bytes" << std::endl;
+
+	Yaramod yaramod;
+	measure("parse ruleset", 5, [&]() {
+		std::istringstream is(input);
+		auto file = yaramod.parseStream(is);
+		doNotOptimize(file);
+	});
+
+	measure("parse ruleset and remove half of strings", 5, [&]() {
+		std::istringstream is(input);
+		auto file = yaramod.parseStream(is);
+		modifyAll<OddStringRemover>(file.get());
+		doNotOptimize(file);
+	});
+
+	measure("parse ruleset and rename all strings", 5, [&]() {
+		std::istringstream is(input);
+		auto file = yaramod.parseStream(is);
+		modifyAll<StringRenamer>(file.get());
+		doNotOptimize(file);
+	});
+
+	return 0;
+}
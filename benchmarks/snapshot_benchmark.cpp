@@ -0,0 +1,79 @@
+/**
+ * @file benchmarks/snapshot_benchmark.cpp
+ * @brief Benchmark of loading snapshots of parsed YARA files.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#include <cstdio>
+#include <sstream>
+
+#include <yaramod/utils/serialization.h>
+#include <yaramod/yaramod.h>
+
+#include "benchmark.h"
+
+using namespace yaramod;
+using namespace yaramod::benchmarks;
+
+namespace {
+
+std::string ruleset(std::size_t rules)
+{
+	std::ostringstream os;
+	os << "import \"pe\"\nimport \"math\"\n\n";
+	for (std::size_t i = 0; i < rules; ++i)
+	{
+		os << "// Rule number " << i << "\nrule rule_" << i << " : tag\n{\n\tmeta:\n\t\tauthor = \"author\"\n\t\tversion = " << i
+			<< "\n\tstrings:\n\t\t$s0 = \"string " << i << "\" ascii wide\n\t\t$s1 = { 4D 5A ?? 00 [2-4] 50 45 }\n"
+			<< "\t\t$s2 = /abc[0-9]+def/i\n\tcondition:\n"
+			<< "\t\tpe.number_of_sections > 2 and\n"
+			<< "\t\tfor any i in (0 .. pe.number_of_sections - 1) : (\n"
+			<< "\t\t\tpe.sections[i].name == \".text\" and\n"
+			<< "\t\t\tmath.entropy(pe.sections[i].raw_data_offset, pe.sections[i].raw_data_size) > 7.0\n"
+			<< "\t\t) and\n"
+			<< "\t\t(#s0 > 2 or $s1 at pe.entry_point or $s2) and\n"
+			<< "\t\tfilesize < 2MB";
+		if (i > 0)
+			os << " and not rule_" << (i - 1);
+		os << "\n}\n\n";
+	}
+	return os.str();
+}
+
+}
+
+int main()
+{
+	auto input = ruleset(2000);
+	const std::string path = "snapshot_benchmark.yrmd";
+
+	Yaramod yaramod;
+	std::istringstream is(input);
+	auto parsed = yaramod.parseStream(is);
+	parsed->saveSnapshot(path);
+	auto data = serialize(*parsed);
+	std::cout << "== Ruleset with " << input.length() << " bytes, snapshot with " << data.length() << " bytes" << std::endl;
+
+	measure("parse ruleset", 5, [&]() {
+		std::istringstream is(input);
+		auto file = yaramod.parseStream(is);
+		doNotOptimize(file);
+	});
+
+	measure("save snapshot", 5, [&]() {
+		parsed->saveSnapshot(path);
+	});
+
+	measure("load snapshot", 5, [&]() {
+		auto file = YaraFile::loadSnapshot(path);
+		doNotOptimize(file);
+	});
+
+	measure("deserialize snapshot from memory", 5, [&]() {
+		auto file = deserializeYaraFile(data);
+		doNotOptimize(file);
+	});
+
+	std::remove(path.c_str());
+	return 0;
+}
@@ -0,0 +1,95 @@
+/**
+ * @file benchmarks/static_visitor_benchmark.cpp
+ * @brief Benchmark of StaticVisitor against ObservingVisitor.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#include <sstream>
+
+#include <yaramod/yaramod.h>
+#include <yaramod/utils/observing_visitor.h>
+#include <yaramod/utils/static_visitor.h>
+
+#include "benchmark.h"
+
+using namespace yaramod;
+using namespace yaramod::benchmarks;
+
+namespace {
+
+class ObservingIntSum : public ObservingVisitor
+{
+public:
+	virtual VisitResult visit(IntLiteralExpression* expr) override
+	{
+		sum += expr->getValue();
+		return {};
+	}
+
+	std::uint64_t sum = 0;
+};
+
+class StaticIntSum : public StaticVisitor<StaticIntSum>
+{
+public:
+	using StaticVisitor<StaticIntSum>::visit;
+
+	void visit(IntLiteralExpression* expr)
+	{
+		sum += expr->getValue();
+	}
+
+	std::uint64_t sum = 0;
+};
+
+std::string largeConditionRuleset(std::size_t rules, std::size_t terms)
+{
+	std::ostringstream os;
+	os << "import \"pe\"\n\n";
+	for (std::size_t i = 0; i < rules; ++i)
+	{
+		os << "rule rule_" << i << "\n{\n\tstrings:\n\t\t$s = \"string " << i << "\"\n\tcondition:\n\t\t";
+		for (std::size_t j = 0; j < terms; ++j)
+		{
+			if (j > 0)
+				os << (j % 3 == 0 ? " or\n\t\t" : " and\n\t\t");
+			switch (j % 4)
+			{
+				case 0: os << "(filesize > " << j << " and #s < " << j + 1 << ")"; break;
+				case 1: os << "pe.sections[" << j % 8 << "].virtual_size + 0x10 == " << j; break;
+				case 2: os << "not $s at pe.entry_point + " << j; break;
+				case 3: os << "for any i in (0 .. pe.number_of_sections - 1) : ( pe.sections[i].raw_data_size > " << j << " )"; break;
+			}
+		}
+		os << "\n}\n\n";
+	}
+	return os.str();
+}
+
+}
+
+int main()
+{
+	auto input = largeConditionRuleset(100, 200);
+	std::cout << "== Ruleset with " << input.length() << " bytes" << std::endl;
+
+	Yaramod yaramod;
+	std::istringstream is(input);
+	auto file = yaramod.parseStream(is);
+
+	measure("ObservingVisitor", 50, [&]() {
+		ObservingIntSum visitor;
+		for (const auto& rule : file->getRules())
+			visitor.observe(rule->getCondition());
+		doNotOptimize(visitor.sum);
+	});
+
+	measure("StaticVisitor", 50, [&]() {
+		StaticIntSum visitor;
+		for (const auto& rule : file->getRules())
+			visitor.observe(rule->getCondition());
+		doNotOptimize(visitor.sum);
+	});
+
+	return 0;
+}
@@ -0,0 +1,137 @@
+/**
+ * @file benchmarks/string_benchmark.cpp
+ * @brief Benchmark of escaping and unescaping of string literals.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+#include <yaramod/utils/utils.h>
+#include <yaramod/yaramod.h>
+
+#include "benchmark.h"
+
+using namespace yaramod;
+using namespace yaramod::benchmarks;
+
+namespace {
+
+// Byte by byte implementation used before vectorization, kept as a reference.
+std::string referenceEscapeString(const std::string& str)
+{
+	std::string result;
+	for (const char c : str)
+	{
+		switch (c)
+		{
+			case '\n': result += "\\n"; break;
+			case '\t': result += "\\t"; break;
+			case '\\':
+			case '\"': result += '\\'; result += c; break;
+			default:
+				if (0x20 <= static_cast<unsigned char>(c) && static_cast<unsigned char>(c) <= 0x7E)
+					result += c;
+				else
+				{
+					std::ostringstream writer;
+					writer << std::setw(2) << std::setfill('0') << std::hex << static_cast<std::uint32_t>(static_cast<std::uint8_t>(c));
+					result += "\\x" + writer.str();
+				}
+				break;
+		}
+	}
+	return result;
+}
+
+/**
+ * Meta values in the form they usually appear in real rulesets.
+ */
+std::vector<std::string> metaValueCorpus()
+{
+	std::vector<std::string> corpus = {
+		"Detects suspicious PowerShell downloader using Invoke-WebRequest with encoded command",
+		"https://www.virustotal.com/gui/file/44d88612fea8a8f36de82e1278abb02f/detection",
+		"44d88612fea8a8f36de82e1278abb02f",
+		"275a021bbfb6489e54d471899f7db9d1663fc695ec2fe2a2c4538aabf651fd0f",
+		"Author Name <author.name@example.com>",
+		"2021-01-20",
+		"C:\\Windows\\System32\\drivers\\etc\\hosts",
+		"Loader drops \"payload.dll\" into %TEMP%\\\tand executes it\nvia rundll32",
+		"Win32/Agent.ABC trojan",
+		"\x4d\x5a\x90\x00\x03\x00\x00\x00\x04\x00\x00\x00\xff\xff\x00\x00",
+	};
+
+	std::string base64;
+	const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	for (std::size_t i = 0; i < 4096; ++i)
+		base64 += alphabet[(i * 2654435761u) % 64];
+	corpus.push_back(base64 + "==");
+
+	return corpus;
+}
+
+}
+
+int main()
+{
+	auto corpus = metaValueCorpus();
+	std::vector<std::string> escapedCorpus;
+	std::size_t totalBytes = 0;
+	for (const auto& value : corpus)
+	{
+		auto escaped = escapeString(value);
+		if (escaped != referenceEscapeString(value) || unescapeString(escaped) != value)
+		{
+			std::cerr << "Mismatch for value '" << escaped << "'" << std::endl;
+			return 1;
+		}
+		escapedCorpus.push_back(escaped);
+		totalBytes += value.length();
+	}
+
+	const std::uint64_t iterations = 20000;
+	std::cout << "== Corpus of " << corpus.size() << " meta values, " << totalBytes << " bytes" << std::endl;
+	measure("reference escapeString", iterations, [&]() {
+		for (const auto& value : corpus)
+		{
+			auto str = referenceEscapeString(value);
+			doNotOptimize(str);
+		}
+	});
+	measure("escapeString", iterations, [&]() {
+		for (const auto& value : corpus)
+		{
+			auto str = escapeString(value);
+			doNotOptimize(str);
+		}
+	});
+	measure("unescapeString", iterations, [&]() {
+		for (const auto& value : escapedCorpus)
+		{
+			auto str = unescapeString(value);
+			doNotOptimize(str);
+		}
+	});
+
+	std::ostringstream rules;
+	for (std::size_t i = 0; i < 500; ++i)
+	{
+		rules << "rule rule_" << i << "\n{\n\tmeta:\n";
+		for (std::size_t j = 0; j < escapedCorpus.size(); ++j)
+			rules << "\t\tvalue_" << j << " = \"" << escapedCorpus[j] << "\"\n";
+		rules << "\tcondition:\n\t\ttrue\n}\n\n";
+	}
+	auto input = rules.str();
+
+	std::cout << "== Ruleset with " << input.length() << " bytes" << std::endl;
+	Yaramod yaramod;
+	measure("parse meta heavy ruleset", 5, [&]() {
+		std::istringstream is(input);
+		auto file = yaramod.parseStream(is);
+		doNotOptimize(file);
+	});
+
+	return 0;
+}
@@ -7,6 +7,7 @@
 #pragma once
 
 #include <climits>
+#include <cstdint>
 #include <fstream>
 #include <memory>
 #include <unordered_map>
@@ -33,14 +34,27 @@
 namespace yaramod {
 
 /**
- * Specifies different parsing modes.
+ * Specifies different parsing modes. Modes other than regular one are flags
+ * which can be combined, e.g. `ParserMode::Lean | ParserMode::LazyConditions`.
  */
-enum class ParserMode
+enum class ParserMode : std::uint32_t
 {
-	Regular, ///< In this mode, parser behaves like regular YARA parser
-	IncludeGuarded ///< Parser provides protection against inclusion of the same file multiple times
+	Regular = 0x00, ///< In this mode, parser behaves like regular YARA parser
+	IncludeGuarded = 0x01, ///< Parser provides protection against inclusion of the same file multiple times
+	Lean = 0x02, ///< Parser skips comments and layout tokens, formatted text of parsed file is not available
+	LazyConditions = 0x04 ///< Parser only records the source of rule conditions, they are parsed on their first access
 };
 
+inline ParserMode operator|(ParserMode lhs, ParserMode rhs)
+{
+	return static_cast<ParserMode>(static_cast<std::uint32_t>(lhs) | static_cast<std::uint32_t>(rhs));
+}
+
+inline ParserMode operator&(ParserMode lhs, ParserMode rhs)
+{
+	return static_cast<ParserMode>(static_cast<std::uint32_t>(lhs) & static_cast<std::uint32_t>(rhs));
+}
+
 /**
  * Result of including a file.
  */
@@ -64,6 +78,18 @@ public:
 	ParserError(const ParserError&) = default;
 };
 
+/**
+ * Source of the rule condition recorded in ParserMode::LazyConditions.
+ */
+struct LazyCondition
+{
+	std::string text; ///< Text of the condition following the colon
+	Location location; ///< Location right after the colon
+	std::size_t ruleIndex; ///< Index of the rule in the parsed file
+};
+
+class LazyConditionContext;
+
 /**
  * Class representing handler of pog parser.
  * It also serves as context storage for parsing.
@@ -75,6 +101,8 @@ public:
  */
 class ParserDriver
 {
+	friend class LazyConditionContext;
+
 public:
 	/// @name Constructors
 	/// @{
@@ -101,6 +129,10 @@ public:
 	/// @name Detection methods
 	/// @{
 	bool isValid() const;
+	bool isIncludeGuarded() const { return hasMode(ParserMode::IncludeGuarded); }
+	bool isLean() const { return hasMode(ParserMode::Lean); }
+	bool isLazy() const { return hasMode(ParserMode::LazyConditions); }
+	bool hasMode(ParserMode mode) const { return (_mode & mode) == mode; }
 	/// @}
 
 	/// @name Methods for handling comments
@@ -142,6 +174,12 @@ protected:
 	void checkStringModifier(const std::vector<std::shared_ptr<StringModifier>>& previousMods, const std::shared_ptr<StringModifier>& newMod);
 	/// @}
 
+	/// @name Methods for handling lazily parsed conditions
+	/// @{
+	void conditionEnter();
+	Expression::Ptr parseLazyCondition(const Rule& rule, const std::shared_ptr<TokenStream>& tokenStream, const LazyCondition& condition, const LazyConditionContext& context);
+	/// @}
+
 	/// @name Methods for parser maintainance
 	/// @{
 	void defineTokens();
@@ -194,6 +232,7 @@ private:
 
 	bool _sectionStrings = false; ///< flag used to determine if we parse section after 'strings:'
 	bool _escapedContent = false; ///< flag used to determine if a currently parsed literal contains hexadecimal byte (such byte must be unescaped in getPureText())
+	bool _conditionColon = false; ///< flag used to determine if the next colon starts the rule condition
 
 	ParserMode _mode; ///< Parser mode.
 
@@ -217,6 +256,12 @@ private:
 	std::shared_ptr<TokenStream> _lastRuleTokenStream; ///< Holds token stream at the point of where last parsed rule starts
 	std::uint64_t _anonStringCounter; ///< Internal counter for generating pseudo identifiers of anonymous strings
 	Location _errorLocation; ///< Last known location before error in parsing happened.
+
+	std::shared_ptr<LazyConditionContext> _lazyContext; ///< Context shared by lazily parsed conditions of the parsed file
+	std::optional<LazyCondition> _lazyCondition; ///< Source of the last recorded condition
+	const Rule* _lazyRule = nullptr; ///< Rule whose lazily recorded condition is being parsed
+	const LazyCondition* _lazyRuleCondition = nullptr; ///< Source of the condition which is being parsed
+	const LazyConditionContext* _lazyRuleContext = nullptr; ///< Context of the condition which is being parsed
 };
 
 } // namespace yaramod
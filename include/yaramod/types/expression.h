@@ -14,6 +14,7 @@
 #include "yaramod/utils/visitor_result.h"
 #include "yaramod/types/token_stream.h"
 #include "yaramod/types/expression_type.h"
+#include "yaramod/types/structural_hash.h"
 
 namespace yaramod {
 
@@ -31,6 +32,69 @@ public:
 	///< Type of the expression.
 	using Type = ExpressionType;
 
+	/**
+	 * Kind of the expression. Each class of expression which can be visited
+	 * has its own kind named after it, so the class of the expression can be
+	 * determined without virtual call or dynamic_cast.
+	 */
+	enum class Kind
+	{
+		Undefined,
+		String,
+		StringWildcard,
+		StringAt,
+		StringInRange,
+		StringCount,
+		StringOffset,
+		StringLength,
+		Not,
+		UnaryMinus,
+		BitwiseNot,
+		And,
+		Or,
+		Lt,
+		Gt,
+		Le,
+		Ge,
+		Eq,
+		Neq,
+		Contains,
+		Matches,
+		Plus,
+		Minus,
+		Multiply,
+		Divide,
+		Modulo,
+		BitwiseXor,
+		BitwiseAnd,
+		BitwiseOr,
+		ShiftLeft,
+		ShiftRight,
+		ForDict,
+		ForArray,
+		ForString,
+		Of,
+		Iterable,
+		Set,
+		Range,
+		Id,
+		StructAccess,
+		ArrayAccess,
+		FunctionCall,
+		BoolLiteral,
+		StringLiteral,
+		IntLiteral,
+		DoubleLiteral,
+		Filesize,
+		Entrypoint,
+		All,
+		Any,
+		Them,
+		Parentheses,
+		IntFunction,
+		Regexp
+	};
+
 	/// @name Constructors
 	/// @{
 	Expression()
@@ -57,6 +121,7 @@ public:
 	/// @name Getter methods
 	/// @{
 	Expression::Type getType() const { return _type; }
+	Expression::Kind getKind() const { return _kind; }
 	std::string getTypeString() const
 	{
 		switch(_type)
@@ -81,6 +146,8 @@ public:
 	}
 	virtual TokenIt getFirstTokenIt() const = 0;
 	virtual TokenIt getLastTokenIt() const = 0;
+	StructuralHash structuralHash() const;
+	StructuralHash structuralHash(const std::vector<std::string>& stringIds) const;
 	/// @}
 	
 
@@ -153,10 +220,86 @@ public:
 	}
 
 protected:
+	/**
+	 * Moves all subexpressions owned by this expression into @p subexpressions.
+	 * Expressions owning subexpressions override it and call destroySubexpressions()
+	 * from their destructors.
+	 *
+	 * @param subexpressions Storage for subexpressions.
+	 */
+	virtual void releaseSubexpressions(std::vector<Expression::Ptr>& /*subexpressions*/) {}
+
+	/**
+	 * Destroys subexpressions of this expression using explicit stack instead of recursion
+	 * so very deep expressions can not exhaust the call stack when being destroyed.
+	 */
+	void destroySubexpressions()
+	{
+		std::vector<Expression::Ptr> pending;
+		releaseSubexpressions(pending);
+		while (!pending.empty())
+		{
+			auto expr = std::move(pending.back());
+			pending.pop_back();
+			// Take over subexpressions of the expression which is about to be destroyed,
+			// its own destructor then has nothing left to destroy
+			if (expr && expr.use_count() == 1)
+				expr->releaseSubexpressions(pending);
+		}
+	}
+
+	/**
+	 * Replaces subexpression or subexpressions with the new ones. Cached structural hashes
+	 * are invalidated only if they really change.
+	 */
+	template <typename T, typename U>
+	void assignSubexpression(T& target, U&& value)
+	{
+		if (target != value)
+		{
+			auto old = std::move(target);
+			target = std::forward<U>(value);
+			unlinkSubexpression(old);
+			invalidateStructuralHash();
+		}
+	}
+
+	/**
+	 * Invalidates the cached structural hash of this expression and of all expressions
+	 * whose cached hashes depend on it. Modification is counted only if the hash of
+	 * the expression was ever computed, see StructuralModificationCounter.
+	 */
+	void invalidateStructuralHash()
+	{
+		if (auto cache = _structuralHashCache.get())
+		{
+			StructuralModificationCounter::increment();
+			StructuralHashCache::invalidate(cache);
+		}
+	}
+
 	std::shared_ptr<TokenStream> _tokenStream;
+	Kind _kind = Kind::Undefined; ///< Kind of the expression, set by constructors of concrete expressions
 
 private:
+	friend class StructuralHashCache;
+	friend class StructuralHashComputation;
+
+	void unlinkSubexpression(const Expression::Ptr& expr) const
+	{
+		if (auto cache = expr ? expr->_structuralHashCache.get() : nullptr)
+			cache->unlink(_structuralHashCache.get());
+	}
+	void unlinkSubexpression(const std::vector<Expression::Ptr>& exprs) const
+	{
+		for (const auto& expr : exprs)
+			unlinkSubexpression(expr);
+	}
+	template <typename T>
+	void unlinkSubexpression(const T& /*other*/) const {}
+
 	Type _type; ///< Type of the expression
+	mutable StructuralHashCacheRef _structuralHashCache; ///< Cached structural hash of the expression
 };
 
 }
@@ -28,9 +28,9 @@ namespace yaramod {
 class StringExpression : public Expression
 {
 public:
-	StringExpression(const std::string& id) { _id = _tokenStream->emplace_back(TokenType::STRING_ID, id); }
-	StringExpression(std::string&& id) { _id = _tokenStream->emplace_back(TokenType::STRING_ID, std::move(id)); }
-	StringExpression(TokenIt id) : _id(id) {}
+	StringExpression(const std::string& id) { _kind = Kind::String; _id = _tokenStream->emplace_back(TokenType::STRING_ID, id); }
+	StringExpression(std::string&& id) { _kind = Kind::String; _id = _tokenStream->emplace_back(TokenType::STRING_ID, std::move(id)); }
+	StringExpression(TokenIt id) : _id(id) { _kind = Kind::String; }
 
 	virtual VisitResult accept(Visitor* v) override
 	{
@@ -70,9 +70,10 @@ public:
 	template <typename Str>
 	StringWildcardExpression(Str&& id)
 	{
+		_kind = Kind::StringWildcard;
 		_id = _tokenStream->emplace_back(TokenType::STRING_ID, std::forward<Str>(id));
 	}
-	StringWildcardExpression(TokenIt it) : _id(it) {}
+	StringWildcardExpression(TokenIt it) : _id(it) { _kind = Kind::StringWildcard; }
 
 	virtual VisitResult accept(Visitor* v) override
 	{
@@ -111,6 +112,7 @@ public:
 	StringAtExpression(const std::string& id, ExpPtr&& at)
 		: _at(std::forward<ExpPtr>(at))
 	{
+		_kind = Kind::StringAt;
 		_id = _tokenStream->emplace_back(TokenType::STRING_ID, id);
 		_at_symbol = _tokenStream->emplace_back(TokenType::OP_AT, "at");
 		_tokenStream->moveAppend(_at->getTokenStream());
@@ -122,6 +124,7 @@ public:
 		, _at_symbol(at_symbol)
 		, _at(std::forward<ExpPtr>(at))
 	{
+		_kind = Kind::StringAt;
 	}
 
 	virtual VisitResult accept(Visitor* v) override
@@ -134,8 +137,8 @@ public:
 
 	void setId(const std::string& id) { _id->setValue(id); }
 	void setId(std::string&& id) { _id->setValue(std::move(id)); }
-	void setAtExpression(const Expression::Ptr& at) { _at = at; }
-	void setAtExpression(Expression::Ptr&& at) { _at = std::move(at); }
+	void setAtExpression(const Expression::Ptr& at) { assignSubexpression(_at, at); }
+	void setAtExpression(Expression::Ptr&& at) { assignSubexpression(_at, std::move(at)); }
 
 	virtual TokenIt getFirstTokenIt() const override { return _id; }
 	virtual TokenIt getLastTokenIt() const override { return _at->getLastTokenIt(); }
@@ -145,6 +148,15 @@ public:
 		return getId() + " " + _at_symbol->getString() + " " + _at->getText(indent);
 	}
 
+	StringAtExpression(StringAtExpression&&) = default;
+	virtual ~StringAtExpression() override { destroySubexpressions(); }
+
+protected:
+	virtual void releaseSubexpressions(std::vector<Expression::Ptr>& subexpressions) override
+	{
+		subexpressions.push_back(std::move(_at));
+	}
+
 private:
 	TokenIt _id; ///< Identifier of the string
 	TokenIt _at_symbol; ///< Token holding "at"
@@ -165,6 +177,7 @@ public:
 	template <typename ExpPtr>
 	StringInRangeExpression(const std::string& id, ExpPtr&& range)
 	{
+		_kind = Kind::StringInRange;
 		_id = _tokenStream->emplace_back(TokenType::STRING_ID, id);
 		_in_symbol = _tokenStream->emplace_back(TokenType::OP_IN, "in");
 		_range = std::forward<ExpPtr>(range);
@@ -177,6 +190,7 @@ public:
 		, _in_symbol(in_symbol)
 		, _range(std::forward<ExpPtr>(range))
 	{
+		_kind = Kind::StringInRange;
 	}
 
 	virtual VisitResult accept(Visitor* v) override
@@ -189,8 +203,8 @@ public:
 
 	void setId(const std::string& id) { _id->setValue(id); }
 	void setId(std::string&& id) { _id->setValue(std::move(id)); }
-	void setRangeExpression(const Expression::Ptr& range) { _range = range; }
-	void setRangeExpression(Expression::Ptr&& range) { _range = std::move(range); }
+	void setRangeExpression(const Expression::Ptr& range) { assignSubexpression(_range, range); }
+	void setRangeExpression(Expression::Ptr&& range) { assignSubexpression(_range, std::move(range)); }
 
 	virtual TokenIt getFirstTokenIt() const override { return _id; }
 	virtual TokenIt getLastTokenIt() const override { return _range->getLastTokenIt(); }
@@ -200,6 +214,15 @@ public:
 		return getId() + " " + _in_symbol->getString() + " " + _range->getText(indent);
 	}
 
+	StringInRangeExpression(StringInRangeExpression&&) = default;
+	virtual ~StringInRangeExpression() override { destroySubexpressions(); }
+
+protected:
+	virtual void releaseSubexpressions(std::vector<Expression::Ptr>& subexpressions) override
+	{
+		subexpressions.push_back(std::move(_range));
+	}
+
 private:
 	TokenIt _id; ///< Identifier of the string
 	TokenIt _in_symbol; ///< Token holding "at"
@@ -218,11 +241,12 @@ private:
 class StringCountExpression : public Expression
 {
 public:
-	StringCountExpression(TokenIt id) : _id(id) {}
+	StringCountExpression(TokenIt id) : _id(id) { _kind = Kind::StringCount; }
 
 	template <typename Str>
 	StringCountExpression(Str&& id)
 	{
+		_kind = Kind::StringCount;
 		_id = _tokenStream->emplace_back(TokenType::STRING_COUNT, std::forward<Str>(id));
 	}
 
@@ -267,22 +291,26 @@ public:
 	StringOffsetExpression(TokenIt id)
 		: _id(id)
 	{
+		_kind = Kind::StringOffset;
 	}
 	template <typename ExpPtr>
 	StringOffsetExpression(TokenIt id, ExpPtr&& expr)
 		: _id(id)
 		, _expr(std::forward<ExpPtr>(expr))
 	{
+		_kind = Kind::StringOffset;
 	}
 	template <typename Str>
 	StringOffsetExpression(Str&& id)
 	{
+		_kind = Kind::StringOffset;
 		_id = _tokenStream->emplace_back(TokenType::STRING_OFFSET, std::forward<Str>(id));
 	}
 	template <typename Str, typename ExpPtr>
 	StringOffsetExpression(Str&& id, ExpPtr&& expr)
 		: _expr(std::forward<ExpPtr>(expr))
 	{
+		_kind = Kind::StringOffset;
 		_id = _tokenStream->emplace_back(TokenType::STRING_OFFSET, std::forward<Str>(id));
 	}
 
@@ -296,8 +324,8 @@ public:
 
 	void setId(const std::string& id) { _id->setValue(id); }
 	void setId(std::string&& id) { _id->setValue(std::move(id)); }
-	void setIndexExpression(const Expression::Ptr& expr) { _expr = expr; }
-	void setIndexExpression(Expression::Ptr&& expr) { _expr = std::move(expr); }
+	void setIndexExpression(const Expression::Ptr& expr) { assignSubexpression(_expr, expr); }
+	void setIndexExpression(Expression::Ptr&& expr) { assignSubexpression(_expr, std::move(expr)); }
 
 	virtual std::string getText(const std::string& indent = std::string{}) const override
 	{
@@ -310,6 +338,15 @@ public:
 	virtual TokenIt getFirstTokenIt() const override { return _id; }
 	virtual TokenIt getLastTokenIt() const override { return _expr ? _expr->getLastTokenIt() : _id; }
 
+	StringOffsetExpression(StringOffsetExpression&&) = default;
+	virtual ~StringOffsetExpression() override { destroySubexpressions(); }
+
+protected:
+	virtual void releaseSubexpressions(std::vector<Expression::Ptr>& subexpressions) override
+	{
+		subexpressions.push_back(std::move(_expr));
+	}
+
 private:
 	TokenIt _id; ///< Identifier of the string
 	Expression::Ptr _expr; ///< Index expression if any
@@ -331,22 +368,26 @@ public:
 	StringLengthExpression(TokenIt id)
 		: _id(id)
 	{
+		_kind = Kind::StringLength;
 	}
 	template <typename ExpPtr>
 	StringLengthExpression(TokenIt id, ExpPtr&& expr)
 		: _id(id)
 		, _expr(std::forward<ExpPtr>(expr))
 	{
+		_kind = Kind::StringLength;
 	}
 	template <typename Str>
 	StringLengthExpression(Str&& id)
 	{
+		_kind = Kind::StringLength;
 		_id = _tokenStream->emplace_back(TokenType::STRING_LENGTH, std::forward<Str>(id));
 	}
 	template <typename Str, typename ExpPtr>
 	StringLengthExpression(Str&& id, ExpPtr&& expr)
 		: _expr(std::forward<ExpPtr>(expr))
 	{
+		_kind = Kind::StringLength;
 		_id = _tokenStream->emplace_back(TokenType::STRING_LENGTH, std::forward<Str>(id));
 	}
 
@@ -360,8 +401,8 @@ public:
 
 	void setId(const std::string& id) { _id->setValue(id); }
 	void setId(std::string&& id) { _id->setValue(std::move(id)); }
-	void setIndexExpression(const Expression::Ptr& expr) { _expr = expr; }
-	void setIndexExpression(Expression::Ptr&& expr) { _expr = std::move(expr); }
+	void setIndexExpression(const Expression::Ptr& expr) { assignSubexpression(_expr, expr); }
+	void setIndexExpression(Expression::Ptr&& expr) { assignSubexpression(_expr, std::move(expr)); }
 
 	virtual TokenIt getFirstTokenIt() const override { return _id; }
 	virtual TokenIt getLastTokenIt() const override { return _expr ? _expr->getLastTokenIt() : _id; }
@@ -374,6 +415,15 @@ public:
 		return _expr ? getId() + '[' + _expr->getText(indent) + ']' : getId();
 	}
 
+	StringLengthExpression(StringLengthExpression&&) = default;
+	virtual ~StringLengthExpression() override { destroySubexpressions(); }
+
+protected:
+	virtual void releaseSubexpressions(std::vector<Expression::Ptr>& subexpressions) override
+	{
+		subexpressions.push_back(std::move(_expr));
+	}
+
 private:
 	TokenIt _id; ///< Identifier of the string
 	Expression::Ptr _expr; ///< Index expression if any
@@ -385,18 +435,16 @@ private:
 class UnaryOpExpression : public Expression
 {
 public:
-	virtual std::string getText(const std::string& indent = std::string{}) const override
-	{
-		if (_op->getType() == TokenType::NOT)
-			return _op->getString() + " " + _expr->getText(indent);
-		else
-			return _op->getString() + _expr->getText(indent);
-	}
+	virtual std::string getText(const std::string& indent = std::string{}) const override;
 
+	TokenIt getOperator() const { return _op; }
 	const Expression::Ptr& getOperand() const { return _expr; }
 
-	void setOperand(const Expression::Ptr& expr) { _expr = expr; }
-	void setOperand(Expression::Ptr&& expr) { _expr = std::move(expr); }
+	void setOperand(const Expression::Ptr& expr) { assignSubexpression(_expr, expr); }
+	void setOperand(Expression::Ptr&& expr) { assignSubexpression(_expr, std::move(expr)); }
+
+	UnaryOpExpression(UnaryOpExpression&&) = default;
+	virtual ~UnaryOpExpression() override { destroySubexpressions(); }
 
 protected:
 	template <typename ExpPtr>
@@ -412,7 +460,19 @@ protected:
 		_op = _tokenStream->emplace_back(type, op);
 	}
 	virtual TokenIt getFirstTokenIt() const override { return _op; }
-	virtual TokenIt getLastTokenIt() const override { return _expr->getLastTokenIt(); }
+	virtual TokenIt getLastTokenIt() const override
+	{
+		// Chains of unary operations are walked without recursion
+		const Expression* expr = _expr.get();
+		while (auto unary = expr->as<UnaryOpExpression>())
+			expr = unary->getOperand().get();
+		return expr->getLastTokenIt();
+	}
+
+	virtual void releaseSubexpressions(std::vector<Expression::Ptr>& subexpressions) override
+	{
+		subexpressions.push_back(std::move(_expr));
+	}
 
 private:
 	TokenIt _op; ///< Unary operation symbol, std::string
@@ -431,7 +491,7 @@ class NotExpression : public UnaryOpExpression
 {
 public:
 	template <typename ExpPtr>
-	NotExpression(TokenIt op, ExpPtr&& expr) : UnaryOpExpression(op, std::forward<ExpPtr>(expr)) {}
+	NotExpression(TokenIt op, ExpPtr&& expr) : UnaryOpExpression(op, std::forward<ExpPtr>(expr)) { _kind = Kind::Not; }
 
 	virtual VisitResult accept(Visitor* v) override
 	{
@@ -452,7 +512,7 @@ class UnaryMinusExpression : public UnaryOpExpression
 {
 public:
 	template <typename ExpPtr>
-	UnaryMinusExpression(TokenIt op, ExpPtr&& expr) : UnaryOpExpression(op, std::forward<ExpPtr>(expr)) {}
+	UnaryMinusExpression(TokenIt op, ExpPtr&& expr) : UnaryOpExpression(op, std::forward<ExpPtr>(expr)) { _kind = Kind::UnaryMinus; }
 
 	virtual VisitResult accept(Visitor* v) override
 	{
@@ -473,7 +533,7 @@ class BitwiseNotExpression : public UnaryOpExpression
 {
 public:
 	template <typename ExpPtr>
-	BitwiseNotExpression(TokenIt op, ExpPtr&& expr) : UnaryOpExpression(op, std::forward<ExpPtr>(expr)) {}
+	BitwiseNotExpression(TokenIt op, ExpPtr&& expr) : UnaryOpExpression(op, std::forward<ExpPtr>(expr)) { _kind = Kind::BitwiseNot; }
 
 	virtual VisitResult accept(Visitor* v) override
 	{
@@ -487,22 +547,43 @@ public:
 class BinaryOpExpression : public Expression
 {
 public:
-	virtual std::string getText(const std::string& indent = std::string{}) const override
-	{
-		return _left->getText(indent) + ' ' + _op->getString() + (_linebreak ? "\n" + indent : " ") + _right->getText(indent);
-	}
+	virtual std::string getText(const std::string& indent = std::string{}) const override;
 
 	TokenIt getOperator() const { return _op; }
 	const Expression::Ptr& getLeftOperand() const { return _left; }
 	const Expression::Ptr& getRightOperand() const { return _right; }
+	bool hasLinebreak() const { return _linebreak; }
+
+	virtual TokenIt getFirstTokenIt() const override
+	{
+		// Long chains of operations are nested in left operands so they are walked without recursion
+		const Expression* expr = _left.get();
+		while (auto binary = expr->as<BinaryOpExpression>())
+			expr = binary->getLeftOperand().get();
+		return expr->getFirstTokenIt();
+	}
+
+	virtual TokenIt getLastTokenIt() const override
+	{
+		const Expression* expr = _right.get();
+		while (true)
+		{
+			if (auto binary = expr->as<BinaryOpExpression>())
+				expr = binary->getRightOperand().get();
+			else if (auto unary = expr->as<UnaryOpExpression>())
+				expr = unary->getOperand().get();
+			else
+				return expr->getLastTokenIt();
+		}
+	}
 
-	virtual TokenIt getFirstTokenIt() const override { return _left->getFirstTokenIt(); }
-	virtual TokenIt getLastTokenIt() const override { return _right->getLastTokenIt(); }
+	void setLeftOperand(const Expression::Ptr& left) { assignSubexpression(_left, left); }
+	void setLeftOperand(Expression::Ptr&& left) { assignSubexpression(_left, std::move(left)); }
+	void setRightOperand(const Expression::Ptr& right) { assignSubexpression(_right, right); }
+	void setRightOperand(Expression::Ptr&& right) { assignSubexpression(_right, std::move(right)); }
 
-	void setLeftOperand(const Expression::Ptr& left) { _left = left; }
-	void setLeftOperand(Expression::Ptr&& left) { _left = std::move(left); }
-	void setRightOperand(const Expression::Ptr& right) { _right = right; }
-	void setRightOperand(Expression::Ptr&& right) { _right = std::move(right); }
+	BinaryOpExpression(BinaryOpExpression&&) = default;
+	virtual ~BinaryOpExpression() override { destroySubexpressions(); }
 
 protected:
 	template <typename ExpPtr1, typename ExpPtr2>
@@ -522,6 +603,12 @@ protected:
 		_op = _tokenStream->emplace_back(type, op);
 	}
 
+	virtual void releaseSubexpressions(std::vector<Expression::Ptr>& subexpressions) override
+	{
+		subexpressions.push_back(std::move(_left));
+		subexpressions.push_back(std::move(_right));
+	}
+
 private:
 	TokenIt _op; ///< Binary operation symbol, std::string
 	Expression::Ptr _left, _right; ///< Expressions to apply operation on
@@ -540,7 +627,7 @@ class AndExpression : public BinaryOpExpression
 {
 public:
 	template <typename ExpPtr1, typename ExpPtr2>
-	AndExpression(ExpPtr1&& left, TokenIt and_op, ExpPtr2&& right, bool linebreak = false) : BinaryOpExpression(std::forward<ExpPtr1>(left), and_op, std::forward<ExpPtr2>(right), linebreak) {}
+	AndExpression(ExpPtr1&& left, TokenIt and_op, ExpPtr2&& right, bool linebreak = false) : BinaryOpExpression(std::forward<ExpPtr1>(left), and_op, std::forward<ExpPtr2>(right), linebreak) { _kind = Kind::And; }
 
 	virtual VisitResult accept(Visitor* v) override
 	{
@@ -560,7 +647,7 @@ class OrExpression : public BinaryOpExpression
 {
 public:
 	template <typename ExpPtr1, typename ExpPtr2>
-	OrExpression(ExpPtr1&& left, TokenIt op_or, ExpPtr2&& right, bool linebreak = false) : BinaryOpExpression(std::forward<ExpPtr1>(left), op_or, std::forward<ExpPtr2>(right), linebreak) {}
+	OrExpression(ExpPtr1&& left, TokenIt op_or, ExpPtr2&& right, bool linebreak = false) : BinaryOpExpression(std::forward<ExpPtr1>(left), op_or, std::forward<ExpPtr2>(right), linebreak) { _kind = Kind::Or; }
 
 	virtual VisitResult accept(Visitor* v) override
 	{
@@ -580,7 +667,7 @@ class LtExpression : public BinaryOpExpression
 {
 public:
 	template <typename ExpPtr1, typename ExpPtr2>
-	LtExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) {}
+	LtExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) { _kind = Kind::Lt; }
 
 	virtual VisitResult accept(Visitor* v) override
 	{
@@ -600,7 +687,7 @@ class GtExpression : public BinaryOpExpression
 {
 public:
 	template <typename ExpPtr1, typename ExpPtr2>
-	GtExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) {}
+	GtExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) { _kind = Kind::Gt; }
 
 	virtual VisitResult accept(Visitor* v) override
 	{
@@ -620,7 +707,7 @@ class LeExpression : public BinaryOpExpression
 {
 public:
 	template <typename ExpPtr1, typename ExpPtr2>
-	LeExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) {}
+	LeExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) { _kind = Kind::Le; }
 
 	virtual VisitResult accept(Visitor* v) override
 	{
@@ -640,7 +727,7 @@ class GeExpression : public BinaryOpExpression
 {
 public:
 	template <typename ExpPtr1, typename ExpPtr2>
-	GeExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) {}
+	GeExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) { _kind = Kind::Ge; }
 
 	virtual VisitResult accept(Visitor* v) override
 	{
@@ -660,7 +747,7 @@ class EqExpression : public BinaryOpExpression
 {
 public:
 	template <typename ExpPtr1, typename ExpPtr2>
-	EqExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) {}
+	EqExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) { _kind = Kind::Eq; }
 
 	virtual VisitResult accept(Visitor* v) override
 	{
@@ -680,7 +767,7 @@ class NeqExpression : public BinaryOpExpression
 {
 public:
 	template <typename ExpPtr1, typename ExpPtr2>
-	NeqExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) {}
+	NeqExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) { _kind = Kind::Neq; }
 
 	virtual VisitResult accept(Visitor* v) override
 	{
@@ -700,7 +787,7 @@ class ContainsExpression : public BinaryOpExpression
 {
 public:
 	template <typename ExpPtr1, typename ExpPtr2>
-	ContainsExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) {}
+	ContainsExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) { _kind = Kind::Contains; }
 
 	virtual VisitResult accept(Visitor* v) override
 	{
@@ -720,7 +807,7 @@ class MatchesExpression : public BinaryOpExpression
 {
 public:
 	template <typename ExpPtr1, typename ExpPtr2>
-	MatchesExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) {}
+	MatchesExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) { _kind = Kind::Matches; }
 
 	virtual VisitResult accept(Visitor* v) override
 	{
@@ -741,7 +828,7 @@ class PlusExpression : public BinaryOpExpression
 {
 public:
 	template <typename ExpPtr1, typename ExpPtr2>
-	PlusExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) {}
+	PlusExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) { _kind = Kind::Plus; }
 
 	virtual VisitResult accept(Visitor* v) override
 	{
@@ -762,7 +849,7 @@ class MinusExpression : public BinaryOpExpression
 {
 public:
 	template <typename ExpPtr1, typename ExpPtr2>
-	MinusExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) {}
+	MinusExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) { _kind = Kind::Minus; }
 
 	virtual VisitResult accept(Visitor* v) override
 	{
@@ -783,7 +870,7 @@ class MultiplyExpression : public BinaryOpExpression
 {
 public:
 	template <typename ExpPtr1, typename ExpPtr2>
-	MultiplyExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) {}
+	MultiplyExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) { _kind = Kind::Multiply; }
 
 	virtual VisitResult accept(Visitor* v) override
 	{
@@ -804,7 +891,7 @@ class DivideExpression : public BinaryOpExpression
 {
 public:
 	template <typename ExpPtr1, typename ExpPtr2>
-	DivideExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) {}
+	DivideExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) { _kind = Kind::Divide; }
 
 	virtual VisitResult accept(Visitor* v) override
 	{
@@ -825,7 +912,7 @@ class ModuloExpression : public BinaryOpExpression
 {
 public:
 	template <typename ExpPtr1, typename ExpPtr2>
-	ModuloExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) {}
+	ModuloExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) { _kind = Kind::Modulo; }
 
 	virtual VisitResult accept(Visitor* v) override
 	{
@@ -846,7 +933,7 @@ class BitwiseXorExpression : public BinaryOpExpression
 {
 public:
 	template <typename ExpPtr1, typename ExpPtr2>
-	BitwiseXorExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) {}
+	BitwiseXorExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) { _kind = Kind::BitwiseXor; }
 
 	virtual VisitResult accept(Visitor* v) override
 	{
@@ -866,7 +953,7 @@ class BitwiseAndExpression : public BinaryOpExpression
 {
 public:
 	template <typename ExpPtr1, typename ExpPtr2>
-	BitwiseAndExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) {}
+	BitwiseAndExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) { _kind = Kind::BitwiseAnd; }
 
 	virtual VisitResult accept(Visitor* v) override
 	{
@@ -886,7 +973,7 @@ class BitwiseOrExpression : public BinaryOpExpression
 {
 public:
 	template <typename ExpPtr1, typename ExpPtr2>
-	BitwiseOrExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) {}
+	BitwiseOrExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) { _kind = Kind::BitwiseOr; }
 
 	virtual VisitResult accept(Visitor* v) override
 	{
@@ -906,7 +993,7 @@ class ShiftLeftExpression : public BinaryOpExpression
 {
 public:
 	template <typename ExpPtr1, typename ExpPtr2>
-	ShiftLeftExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) {}
+	ShiftLeftExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) { _kind = Kind::ShiftLeft; }
 
 	virtual VisitResult accept(Visitor* v) override
 	{
@@ -926,7 +1013,7 @@ class ShiftRightExpression : public BinaryOpExpression
 {
 public:
 	template <typename ExpPtr1, typename ExpPtr2>
-	ShiftRightExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) {}
+	ShiftRightExpression(ExpPtr1&& left, TokenIt op, ExpPtr2&& right) : BinaryOpExpression(std::forward<ExpPtr1>(left), op, std::forward<ExpPtr2>(right)) { _kind = Kind::ShiftRight; }
 
 	virtual VisitResult accept(Visitor* v) override
 	{
@@ -950,12 +1037,15 @@ public:
 	const Expression::Ptr& getIterable() const { return _iterable; }
 	const Expression::Ptr& getBody() const { return _expr; }
 
-	void setVariable(const Expression::Ptr& forExpr) { _forExpr = forExpr; }
-	void setVariable(Expression::Ptr&& forExpr) { _forExpr = std::move(forExpr); }
-	void setIterable(const Expression::Ptr& iterable) { _iterable = iterable; }
-	void setIterable(Expression::Ptr&& iterable) { _iterable = std::move(iterable); }
-	void setBody(const Expression::Ptr& expr) { _expr = expr; }
-	void setBody(Expression::Ptr&& expr) { _expr = std::move(expr); }
+	void setVariable(const Expression::Ptr& forExpr) { assignSubexpression(_forExpr, forExpr); }
+	void setVariable(Expression::Ptr&& forExpr) { assignSubexpression(_forExpr, std::move(forExpr)); }
+	void setIterable(const Expression::Ptr& iterable) { assignSubexpression(_iterable, iterable); }
+	void setIterable(Expression::Ptr&& iterable) { assignSubexpression(_iterable, std::move(iterable)); }
+	void setBody(const Expression::Ptr& expr) { assignSubexpression(_expr, expr); }
+	void setBody(Expression::Ptr&& expr) { assignSubexpression(_expr, std::move(expr)); }
+
+	ForExpression(ForExpression&&) = default;
+	virtual ~ForExpression() override { destroySubexpressions(); }
 
 protected:
 	template <typename ExpPtr1, typename ExpPtr2, typename ExpPtr3>
@@ -976,6 +1066,13 @@ protected:
 	{
 	}
 
+	virtual void releaseSubexpressions(std::vector<Expression::Ptr>& subexpressions) override
+	{
+		subexpressions.push_back(std::move(_forExpr));
+		subexpressions.push_back(std::move(_iterable));
+		subexpressions.push_back(std::move(_expr));
+	}
+
 	Expression::Ptr _forExpr, _iterable, _expr;
 	TokenIt _of_in;
 };
@@ -1001,15 +1098,16 @@ public:
 		, _left_bracket(left_bracket)
 		, _right_bracket(right_bracket)
 	{
+		_kind = Kind::ForDict;
 	}
 
 	const std::string& getId1() const { return _id1->getString(); }
 	const std::string& getId2() const { return _id2->getString(); }
 
-	void setId1(const std::string& id) { _id1->setValue(id); }
-	void setId1(std::string&& id) { _id1->setValue(std::move(id)); }
-	void setId2(const std::string& id) { _id2->setValue(id); }
-	void setId2(std::string&& id) { _id2->setValue(std::move(id)); }
+	void setId1(const std::string& id) { _id1->setValue(id); invalidateStructuralHash(); }
+	void setId1(std::string&& id) { _id1->setValue(std::move(id)); invalidateStructuralHash(); }
+	void setId2(const std::string& id) { _id2->setValue(id); invalidateStructuralHash(); }
+	void setId2(std::string&& id) { _id2->setValue(std::move(id)); invalidateStructuralHash(); }
 
 	virtual VisitResult accept(Visitor* v) override
 	{
@@ -1057,12 +1155,13 @@ public:
 		, _left_bracket(left_bracket)
 		, _right_bracket(right_bracket)
 	{
+		_kind = Kind::ForArray;
 	}
 
 	const std::string& getId() const { return _id->getString(); }
 
-	void setId(const std::string& id) { _id->setValue(id); }
-	void setId(std::string&& id) { _id->setValue(std::move(id)); }
+	void setId(const std::string& id) { _id->setValue(id); invalidateStructuralHash(); }
+	void setId(std::string&& id) { _id->setValue(std::move(id)); invalidateStructuralHash(); }
 
 	virtual VisitResult accept(Visitor* v) override
 	{
@@ -1110,6 +1209,7 @@ public:
 		, _left_bracket(left_bracket)
 		, _right_bracket(right_bracket)
 	{
+		_kind = Kind::ForString;
 	}
 
 	virtual VisitResult accept(Visitor* v) override
@@ -1153,6 +1253,7 @@ public:
 	OfExpression(ExpPtr1&& forExpr, TokenIt of, ExpPtr2&& set)
 		: ForExpression(std::forward<ExpPtr1>(forExpr), of, std::forward<ExpPtr2>(set))
 	{
+		_kind = Kind::Of;
 	}
 
 	virtual VisitResult accept(Visitor* v) override
@@ -1191,6 +1292,7 @@ public:
 		, _elements(std::forward<ExpPtrVector>(elements))
 		, _right_square_bracket(right_square_bracket)
 	{
+		_kind = Kind::Iterable;
 	}
 
 	virtual VisitResult accept(Visitor* v) override
@@ -1219,12 +1321,22 @@ public:
 
 	void setElements(const std::vector<Expression::Ptr>& elements)
 	{
-		_elements = elements;
+		assignSubexpression(_elements, elements);
 	}
 
 	void setElements(std::vector<Expression::Ptr>&& elements)
 	{
-		_elements = std::move(elements);
+		assignSubexpression(_elements, std::move(elements));
+	}
+
+	IterableExpression(IterableExpression&&) = default;
+	virtual ~IterableExpression() override { destroySubexpressions(); }
+
+protected:
+	virtual void releaseSubexpressions(std::vector<Expression::Ptr>& subexpressions) override
+	{
+		for (auto& expr : _elements)
+			subexpressions.push_back(std::move(expr));
 	}
 
 private:
@@ -1257,6 +1369,7 @@ public:
 		, _elements(std::forward<ExpPtrVector>(elements))
 		, _right_bracket(right_bracket)
 	{
+		_kind = Kind::Set;
 	}
 
 	virtual VisitResult accept(Visitor* v) override
@@ -1285,12 +1398,22 @@ public:
 
 	void setElements(const std::vector<Expression::Ptr>& elements)
 	{
-		_elements = elements;
+		assignSubexpression(_elements, elements);
 	}
 
 	void setElements(std::vector<Expression::Ptr>&& elements)
 	{
-		_elements = std::move(elements);
+		assignSubexpression(_elements, std::move(elements));
+	}
+
+	SetExpression(SetExpression&&) = default;
+	virtual ~SetExpression() override { destroySubexpressions(); }
+
+protected:
+	virtual void releaseSubexpressions(std::vector<Expression::Ptr>& subexpressions) override
+	{
+		for (auto& expr : _elements)
+			subexpressions.push_back(std::move(expr));
 	}
 
 private:
@@ -1322,6 +1445,7 @@ public:
 		, _high(std::forward<ExpPtr2>(high))
 		, _right_bracket(right_bracket)
 	{
+		_kind = Kind::Range;
 	}
 	virtual VisitResult accept(Visitor* v) override
 	{
@@ -1339,10 +1463,20 @@ public:
 	virtual TokenIt getFirstTokenIt() const override { return _left_bracket; }
 	virtual TokenIt getLastTokenIt() const override { return _right_bracket; }
 
-	void setLow(const Expression::Ptr& low) { _low = low; }
-	void setLow(Expression::Ptr&& low) { _low = std::move(low); }
-	void setHigh(const Expression::Ptr& high) { _high = high; }
-	void setHigh(Expression::Ptr&& high) { _high = std::move(high); }
+	void setLow(const Expression::Ptr& low) { assignSubexpression(_low, low); }
+	void setLow(Expression::Ptr&& low) { assignSubexpression(_low, std::move(low)); }
+	void setHigh(const Expression::Ptr& high) { assignSubexpression(_high, high); }
+	void setHigh(Expression::Ptr&& high) { assignSubexpression(_high, std::move(high)); }
+
+	RangeExpression(RangeExpression&&) = default;
+	virtual ~RangeExpression() override { destroySubexpressions(); }
+
+protected:
+	virtual void releaseSubexpressions(std::vector<Expression::Ptr>& subexpressions) override
+	{
+		subexpressions.push_back(std::move(_low));
+		subexpressions.push_back(std::move(_high));
+	}
 
 private:
 	TokenIt _left_bracket; ///< '('
@@ -1372,6 +1506,7 @@ public:
 		: _symbol(symbolToken->getSymbol())
 		, _symbolToken(symbolToken)
 	{
+		_kind = Kind::Id;
 	}
 
 	virtual VisitResult accept(Visitor* v) override
@@ -1408,6 +1543,7 @@ protected:
 	IdExpression(const std::shared_ptr<Symbol>& symbol)
 		: _symbol(symbol)
 	{
+		_kind = Kind::Id;
 	}
 
 	std::shared_ptr<Symbol> _symbol; ///< Symbol of the identifier
@@ -1433,6 +1569,7 @@ public:
 		, _structure(std::forward<ExpPtr>(structure))
 		, _dot(dot)
 	{
+		_kind = Kind::StructAccess;
 	}
 
 	virtual VisitResult accept(Visitor* v) override
@@ -1452,8 +1589,17 @@ public:
 	virtual TokenIt getFirstTokenIt() const override { return _structure->getFirstTokenIt(); }
 	virtual TokenIt getLastTokenIt() const override { return _symbolToken; }
 
-	void setStructure(const Expression::Ptr& structure) { _structure = structure; }
-	void setStructure(Expression::Ptr&& structure) { _structure = std::move(structure); }
+	void setStructure(const Expression::Ptr& structure) { assignSubexpression(_structure, structure); }
+	void setStructure(Expression::Ptr&& structure) { assignSubexpression(_structure, std::move(structure)); }
+
+	StructAccessExpression(StructAccessExpression&&) = default;
+	virtual ~StructAccessExpression() override { destroySubexpressions(); }
+
+protected:
+	virtual void releaseSubexpressions(std::vector<Expression::Ptr>& subexpressions) override
+	{
+		subexpressions.push_back(std::move(_structure));
+	}
 
 private:
 	Expression::Ptr _structure; ///< Structure identifier expression
@@ -1481,6 +1627,7 @@ public:
 		, _accessor(std::forward<ExpPtr2>(accessor))
 		, _right_bracket(right_bracket)
 	{
+		_kind = Kind::ArrayAccess;
 		_symbolToken = std::static_pointer_cast<const IdExpression>(_array)->getSymbolToken();
 	}
 	template <typename ExpPtr1, typename ExpPtr2>
@@ -1491,6 +1638,7 @@ public:
 		, _accessor(std::forward<ExpPtr2>(accessor))
 		, _right_bracket(right_bracket)
 	{
+		_kind = Kind::ArrayAccess;
 	}
 
 	virtual VisitResult accept(Visitor* v) override
@@ -1509,10 +1657,20 @@ public:
 	virtual TokenIt getFirstTokenIt() const override { return _array->getFirstTokenIt(); }
 	virtual TokenIt getLastTokenIt() const override { return _right_bracket; }
 
-	void setArray(const Expression::Ptr& array) { _array = array; }
-	void setArray(Expression::Ptr&& array) { _array = std::move(array); }
-	void setAccessor(const Expression::Ptr& accessor) { _accessor = accessor; }
-	void setAccessor(Expression::Ptr&& accessor) { _accessor = std::move(accessor); }
+	void setArray(const Expression::Ptr& array) { assignSubexpression(_array, array); }
+	void setArray(Expression::Ptr&& array) { assignSubexpression(_array, std::move(array)); }
+	void setAccessor(const Expression::Ptr& accessor) { assignSubexpression(_accessor, accessor); }
+	void setAccessor(Expression::Ptr&& accessor) { assignSubexpression(_accessor, std::move(accessor)); }
+
+	ArrayAccessExpression(ArrayAccessExpression&&) = default;
+	virtual ~ArrayAccessExpression() override { destroySubexpressions(); }
+
+protected:
+	virtual void releaseSubexpressions(std::vector<Expression::Ptr>& subexpressions) override
+	{
+		subexpressions.push_back(std::move(_array));
+		subexpressions.push_back(std::move(_accessor));
+	}
 
 private:
 	Expression::Ptr _array; ///< Array identifier expression
@@ -1541,6 +1699,7 @@ public:
 		, _args(std::forward<ExpPtrVector>(args))
 		, _right_bracket(right_bracket)
 	{
+		_kind = Kind::FunctionCall;
 	}
 
 	virtual VisitResult accept(Visitor* v) override
@@ -1574,10 +1733,21 @@ public:
 	virtual TokenIt getFirstTokenIt() const override { return _func->getFirstTokenIt(); }
 	virtual TokenIt getLastTokenIt() const override { return _right_bracket; }
 
-	void setFunction(const Expression::Ptr& func) { _func = func; }
-	void setFunction(Expression::Ptr&& func) { _func = std::move(func); }
-	void setArguments(const std::vector<Expression::Ptr>& args) { _args = args; }
-	void setArguments(std::vector<Expression::Ptr>&& args) { _args = std::move(args); }
+	void setFunction(const Expression::Ptr& func) { assignSubexpression(_func, func); }
+	void setFunction(Expression::Ptr&& func) { assignSubexpression(_func, std::move(func)); }
+	void setArguments(const std::vector<Expression::Ptr>& args) { assignSubexpression(_args, args); }
+	void setArguments(std::vector<Expression::Ptr>&& args) { assignSubexpression(_args, std::move(args)); }
+
+	FunctionCallExpression(FunctionCallExpression&&) = default;
+	virtual ~FunctionCallExpression() override { destroySubexpressions(); }
+
+protected:
+	virtual void releaseSubexpressions(std::vector<Expression::Ptr>& subexpressions) override
+	{
+		subexpressions.push_back(std::move(_func));
+		for (auto& expr : _args)
+			subexpressions.push_back(std::move(expr));
+	}
 
 private:
 	Expression::Ptr _func; ///< Function identifier expression
@@ -1643,11 +1813,13 @@ public:
 	BoolLiteralExpression(TokenIt value)
 		: LiteralExpression<bool>(value)
 	{
+		_kind = Kind::BoolLiteral;
 	}
 
 	BoolLiteralExpression(bool value)
 		: LiteralExpression<bool>()
 	{
+		_kind = Kind::BoolLiteral;
 		if (value)
 			_value = _tokenStream->emplace_back(TokenType::BOOL_TRUE, value, "true");
 		else
@@ -1658,6 +1830,7 @@ public:
 	BoolLiteralExpression(const std::shared_ptr<TokenStream>& ts, TokenIt value)
 		: LiteralExpression<bool>(ts, value)
 	{
+		_kind = Kind::BoolLiteral;
 	}
 
 	virtual LiteralType getValue() const override
@@ -1686,10 +1859,12 @@ public:
 	StringLiteralExpression(TokenIt value)
 		: LiteralExpression<std::string>(value)
 	{
+		_kind = Kind::StringLiteral;
 	}
 	StringLiteralExpression(const std::shared_ptr<TokenStream>& ts, TokenIt value)
 		: LiteralExpression<std::string>(ts, value)
 	{
+		_kind = Kind::StringLiteral;
 	}
 
 	virtual LiteralType getValue() const override
@@ -1719,11 +1894,13 @@ public:
 	IntLiteralExpression(TokenIt value)
 		: LiteralExpression<uint64_t>(value)
 	{
+		_kind = Kind::IntLiteral;
 	}
 
 	IntLiteralExpression(const std::shared_ptr<TokenStream>& ts, TokenIt value)
 		: LiteralExpression<uint64_t>(ts, value)
 	{
+		_kind = Kind::IntLiteral;
 	}
 
 	virtual LiteralType getValue() const override
@@ -1753,11 +1930,13 @@ public:
 	DoubleLiteralExpression(TokenIt value)
 		: LiteralExpression<double>(value)
 	{
+		_kind = Kind::DoubleLiteral;
 	}
 
 	DoubleLiteralExpression(const std::shared_ptr<TokenStream>& ts, TokenIt value)
 		: LiteralExpression<double>(ts, value)
 	{
+		_kind = Kind::DoubleLiteral;
 	}
 
 	virtual LiteralType getValue() const override
@@ -1816,10 +1995,12 @@ public:
 	FilesizeExpression(TokenIt t)
 		: KeywordExpression(t)
 	{
+		_kind = Kind::Filesize;
 	}
 	FilesizeExpression(const std::shared_ptr<TokenStream>& ts, TokenIt t)
 		: KeywordExpression(ts, t)
 	{
+		_kind = Kind::Filesize;
 	}
 
 	virtual VisitResult accept(Visitor* v) override
@@ -1843,10 +2024,12 @@ public:
 	EntrypointExpression(TokenIt t)
 		: KeywordExpression(t)
 	{
+		_kind = Kind::Entrypoint;
 	}
 	EntrypointExpression(const std::shared_ptr<TokenStream>& ts, TokenIt t)
 		: KeywordExpression(ts, t)
 	{
+		_kind = Kind::Entrypoint;
 	}
 
 	virtual VisitResult accept(Visitor* v) override
@@ -1871,10 +2054,12 @@ public:
 	AllExpression(TokenIt t)
 		: KeywordExpression(t)
 	{
+		_kind = Kind::All;
 	}
 	AllExpression(const std::shared_ptr<TokenStream>& ts, TokenIt t)
 		: KeywordExpression(ts, t)
 	{
+		_kind = Kind::All;
 	}
 
 	virtual VisitResult accept(Visitor* v) override
@@ -1899,10 +2084,12 @@ public:
 	AnyExpression(TokenIt t)
 		: KeywordExpression(t)
 	{
+		_kind = Kind::Any;
 	}
 	AnyExpression(const std::shared_ptr<TokenStream>& ts, TokenIt t)
 		: KeywordExpression(ts, t)
 	{
+		_kind = Kind::Any;
 	}
 
 	virtual VisitResult accept(Visitor* v) override
@@ -1927,10 +2114,12 @@ public:
 	ThemExpression(TokenIt t)
 		: KeywordExpression(t)
 	{
+		_kind = Kind::Them;
 	}
 	ThemExpression(const std::shared_ptr<TokenStream>& ts, TokenIt t)
 		: KeywordExpression(ts, t)
 	{
+		_kind = Kind::Them;
 	}
 
 	virtual VisitResult accept(Visitor* v) override
@@ -1967,6 +2156,7 @@ public:
 		, _left_bracket(left_bracket)
 		, _right_bracket(right_bracket)
 	{
+		_kind = Kind::Parentheses;
 	}
 
 	virtual VisitResult accept(Visitor* v) override
@@ -1974,24 +2164,25 @@ public:
 		return v->visit(this);
 	}
 
-	virtual std::string getText(const std::string& indent = std::string{}) const override
-	{
-		if (_linebreak)
-		{
-			auto newIndent = indent + '\t';
-			return _left_bracket->getString() + '\n' + newIndent + _expr->getText(newIndent) + '\n' + indent + _right_bracket->getString();
-		}
-
-		return _left_bracket->getString() + _expr->getText(indent) + _right_bracket->getString();
-	}
+	virtual std::string getText(const std::string& indent = std::string{}) const override;
 
 	const Expression::Ptr& getEnclosedExpression() const { return _expr; }
+	bool hasLinebreak() const { return _linebreak; }
 
 	virtual TokenIt getFirstTokenIt() const override { return _left_bracket; }
 	virtual TokenIt getLastTokenIt() const override { return _right_bracket; }
 
-	void setEnclosedExpression(const Expression::Ptr& expr) { _expr = expr; }
-	void setEnclosedExpression(Expression::Ptr&& expr) { _expr = std::move(expr); }
+	void setEnclosedExpression(const Expression::Ptr& expr) { assignSubexpression(_expr, expr); }
+	void setEnclosedExpression(Expression::Ptr&& expr) { assignSubexpression(_expr, std::move(expr)); }
+
+	ParenthesesExpression(ParenthesesExpression&&) = default;
+	virtual ~ParenthesesExpression() override { destroySubexpressions(); }
+
+protected:
+	virtual void releaseSubexpressions(std::vector<Expression::Ptr>& subexpressions) override
+	{
+		subexpressions.push_back(std::move(_expr));
+	}
 
 private:
 	Expression::Ptr _expr; ///< Enclosed expression
@@ -2029,6 +2220,7 @@ public:
 		, _left_bracket(left_bracket)
 		, _right_bracket(right_bracket)
 	{
+		_kind = Kind::IntFunction;
 	}
 
 	virtual VisitResult accept(Visitor* v) override
@@ -2049,8 +2241,17 @@ public:
 
 	void setFunction(const std::string& func) { _func->setValue(func); }
 	void setFunction(std::string&& func) { _func->setValue(std::move(func)); }
-	void setArgument(const Expression::Ptr& expr) { _expr = expr; }
-	void setArgument(Expression::Ptr&& expr) { _expr = std::move(expr); }
+	void setArgument(const Expression::Ptr& expr) { assignSubexpression(_expr, expr); }
+	void setArgument(Expression::Ptr&& expr) { assignSubexpression(_expr, std::move(expr)); }
+
+	IntFunctionExpression(IntFunctionExpression&&) = default;
+	virtual ~IntFunctionExpression() override { destroySubexpressions(); }
+
+protected:
+	virtual void releaseSubexpressions(std::vector<Expression::Ptr>& subexpressions) override
+	{
+		subexpressions.push_back(std::move(_expr));
+	}
 
 private:
 	TokenIt _func; ///< Function identifier
@@ -2080,6 +2281,7 @@ public:
 	RegexpExpression(S&& regexp)
 		: _regexp(std::forward<S>(regexp))
 	{
+		_kind = Kind::Regexp;
 		_tokenStream = _regexp->getTokenStream();
 	}
 
@@ -2095,11 +2297,95 @@ public:
 	virtual TokenIt getFirstTokenIt() const override { return _regexp->getFirstTokenIt(); }
 	virtual TokenIt getLastTokenIt() const override { return _regexp->getLastTokenIt(); }
 
-	void setRegexpString(const std::shared_ptr<String>& regexp) { _regexp = regexp; }
-	void setRegexpString(std::shared_ptr<String>&& regexp) { _regexp = std::move(regexp); }
+	void setRegexpString(const std::shared_ptr<String>& regexp) { assignSubexpression(_regexp, regexp); }
+	void setRegexpString(std::shared_ptr<String>&& regexp) { assignSubexpression(_regexp, std::move(regexp)); }
 
 private:
 	std::shared_ptr<String> _regexp; ///< Regular expression string
 };
 
+/**
+ * Returns text of the expression. Operations and parentheses nested in each other
+ * are processed using explicit stack instead of recursion so even very deep expressions
+ * can be turned into text. Other expressions are turned into text by their getText().
+ *
+ * @param expr Expression.
+ * @param indent Indentation of the expression.
+ *
+ * @return Text of the expression.
+ */
+inline std::string getTextIteratively(const Expression* expr, const std::string& indent)
+{
+	// Each item is either an expression with number of tabs added to the indentation or a text
+	struct Item
+	{
+		const Expression* expr;
+		std::size_t tabs;
+		std::string text;
+	};
+
+	std::string result;
+	std::vector<Item> stack{{expr, 0, {}}};
+	while (!stack.empty())
+	{
+		auto item = std::move(stack.back());
+		stack.pop_back();
+		if (!item.expr)
+		{
+			result += item.text;
+			continue;
+		}
+
+		if (auto binary = item.expr->as<BinaryOpExpression>())
+		{
+			auto separator = binary->hasLinebreak() ? '\n' + indent + std::string(item.tabs, '\t') : std::string{" "};
+			stack.push_back({binary->getRightOperand().get(), item.tabs, {}});
+			stack.push_back({nullptr, 0, ' ' + binary->getOperator()->getString() + separator});
+			stack.push_back({binary->getLeftOperand().get(), item.tabs, {}});
+		}
+		else if (auto unary = item.expr->as<UnaryOpExpression>())
+		{
+			result += unary->getOperator()->getString();
+			if (unary->getOperator()->getType() == TokenType::NOT)
+				result += ' ';
+			stack.push_back({unary->getOperand().get(), item.tabs, {}});
+		}
+		else if (auto parentheses = item.expr->as<ParenthesesExpression>())
+		{
+			auto rightBracket = parentheses->getLastTokenIt()->getString();
+			if (parentheses->hasLinebreak())
+			{
+				result += parentheses->getFirstTokenIt()->getString() + '\n' + indent + std::string(item.tabs + 1, '\t');
+				stack.push_back({nullptr, 0, '\n' + indent + std::string(item.tabs, '\t') + rightBracket});
+				stack.push_back({parentheses->getEnclosedExpression().get(), item.tabs + 1, {}});
+			}
+			else
+			{
+				result += parentheses->getFirstTokenIt()->getString();
+				stack.push_back({nullptr, 0, rightBracket});
+				stack.push_back({parentheses->getEnclosedExpression().get(), item.tabs, {}});
+			}
+		}
+		else
+			result += item.expr->getText(indent + std::string(item.tabs, '\t'));
+	}
+
+	return result;
+}
+
+inline std::string UnaryOpExpression::getText(const std::string& indent) const
+{
+	return getTextIteratively(this, indent);
+}
+
+inline std::string BinaryOpExpression::getText(const std::string& indent) const
+{
+	return getTextIteratively(this, indent);
+}
+
+inline std::string ParenthesesExpression::getText(const std::string& indent) const
+{
+	return getTextIteratively(this, indent);
+}
+
 }
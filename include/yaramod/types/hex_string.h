@@ -7,6 +7,7 @@
 #pragma once
 
 #include <cassert>
+#include <cstdint>
 #include <memory>
 #include <numeric>
 #include <optional>
@@ -61,6 +62,46 @@ protected:
 	Type _type; ///< Type of the unit
 };
 
+/**
+ * Normalized element of the hex string. Pairs of nibbles and wildcards
+ * are joined into masked bytes and jumps without low bound start at 0,
+ * so the hex string can be processed without walking its units.
+ */
+struct HexStringElement
+{
+	enum class Kind
+	{
+		Byte,
+		Jump,
+		Alternation
+	};
+
+	/// @name Constructors
+	/// @{
+	explicit HexStringElement(Kind kind) : kind(kind) {}
+	static HexStringElement byte(std::uint8_t value, std::uint8_t mask);
+	static HexStringElement jump(std::uint64_t low, std::optional<std::uint64_t> high);
+	/// @}
+
+	/// @name Detection methods
+	/// @{
+	bool isByte() const { return kind == Kind::Byte; }
+	bool isJump() const { return kind == Kind::Jump; }
+	bool isAlternation() const { return kind == Kind::Alternation; }
+	bool isFullWildcard() const { return isByte() && mask == 0x00; }
+	/// @}
+
+	bool operator==(const HexStringElement& other) const;
+	bool operator!=(const HexStringElement& other) const { return !(*this == other); }
+
+	Kind kind;
+	std::uint8_t value = 0; ///< Value of byte with masked out bits set to zero
+	std::uint8_t mask = 0; ///< @c 0xFF for fixed byte, @c 0xF0 or @c 0x0F for fixed nibble, @c 0x00 for wildcard
+	std::uint64_t jumpLow = 0; ///< Low bound of jump
+	std::optional<std::uint64_t> jumpHigh; ///< High bound of jump, missing if jump is unbounded
+	std::vector<std::vector<HexStringElement>> alternatives; ///< Alternatives of alternation
+};
+
 class YaraRuleBuilder;
 
 /**
@@ -95,6 +136,7 @@ public:
 	/// @name Getters
 	/// @{
 	const std::vector<std::shared_ptr<HexStringUnit>>& getUnits() const { return _units; }
+	std::vector<HexStringElement> getElements() const;
 	std::size_t getLength() const;
 	/// @}
 
@@ -15,6 +15,7 @@
 #include <variant>
 
 #include "yaramod/yaramod_error.h"
+#include "yaramod/types/structural_hash.h"
 #include "yaramod/types/symbol.h"
 
 namespace yaramod {
@@ -60,6 +61,7 @@ public:
 	bool isString() const { return is<std::string>(); }
 	bool isBool() const { return is<bool>(); }
 	bool isInt() const { return is<std::int64_t>() || is<std::uint64_t>(); }
+	bool isUInt() const { return is<std::uint64_t>(); }
 	bool isFloat() const { return is<double>(); }
 	bool isSymbol() const { return is<std::shared_ptr<Symbol>>(); }
 	bool isLiteralReference() const { return is<ReferenceType>(); }
@@ -75,6 +77,7 @@ public:
 	const std::shared_ptr<Symbol>& getSymbol() const { assert(isSymbol()); return std::get<std::shared_ptr<Symbol>>(_value); }
 	ReferenceType getLiteralReference() const { assert(isLiteralReference()); return std::get<ReferenceType>(_value); }
 	std::string getFormattedValue() const;
+	bool hasFormattedValue() const { return _formatted_value.has_value(); }
 	/// @}
 
 	/// @name Setter methods
@@ -93,10 +96,17 @@ public:
 	/// @name String representation
 	/// @{
 	void markEscaped() {  _escaped = true; }
+	bool isEscaped() const { return _escaped; }
 	std::string getText(bool pure = false) const;
 	std::string getPureText() const;
 	/// @}
 
+	/// @name Structural hash methods
+	/// @{
+	void useInStructuralHash() const;
+	void invalidateStructuralHashes() const { _structuralHashDependency.modify(); }
+	/// @}
+
 	friend std::ostream& operator<<(std::ostream& os, const Literal& literal)
 	{
 		if (literal._formatted_value.has_value())
@@ -123,6 +133,7 @@ private:
 	bool is() const { return std::holds_alternative<T>(_value); }
 
 	bool _escaped = false;
+	StructuralHashDependency _structuralHashDependency; ///< Set if the value is used by cached structural hashes
 	/// For an integral literal x there are two options:
 	/// i.  x it is unformatted: _formatted_value is empty  AND  _value contains x
 	/// ii. x it is formatted:   _formatted_value contains x's string representation  AND  _value contains pure x
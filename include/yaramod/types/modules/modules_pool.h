@@ -6,6 +6,10 @@
 
 #pragma once
 
+#include <algorithm>
+#include <string>
+#include <vector>
+
 #include "yaramod/types/modules/module.h"
 #include "yaramod/types/modules/modules.h"
 
@@ -42,6 +46,19 @@ public:
 		return itr->second;
 	}
 
+	/**
+	 * Returns names of all known modules sorted alphabetically.
+	 */
+	std::vector<std::string> getModuleNames() const
+	{
+		std::vector<std::string> result;
+		result.reserve(_knownModules.size());
+		for (const auto& [name, module] : _knownModules)
+			result.push_back(name);
+		std::sort(result.begin(), result.end());
+		return result;
+	}
+
 private:
 	std::unordered_map<std::string, std::shared_ptr<Module>> _knownModules = {
 		{ "androguard", std::make_shared<AndroguardModule>() },
@@ -9,6 +9,7 @@
 #include <memory>
 #include <optional>
 #include <sstream>
+#include <string_view>
 #include <utility>
 #include <vector>
 
@@ -138,6 +139,25 @@ public:
 			_characters.push_back(_tokenStream->emplace_back(TokenType::REGEXP_CHAR, std::string(1, c)));
 	}
 
+	/**
+	 * Start of line and word boundaries do not match any characters. They may be stored
+	 * as plain text units since start of line does not have its own unit.
+	 */
+	bool isAssertion() const
+	{
+		auto text = getText();
+		return text == "^" || text == "\\b" || text == "\\B";
+	}
+
+	/**
+	 * Escaped character classes like `\w` may also be stored as plain text units.
+	 */
+	bool isClassEscape() const
+	{
+		auto text = getText();
+		return text.length() == 2 && text[0] == '\\' && std::string_view{"wWsSdD"}.find(text[1]) != std::string_view::npos;
+	}
+
 private:
 	std::vector<TokenIt> _characters; ///< Text
 };
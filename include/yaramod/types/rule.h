@@ -6,7 +6,10 @@
 
 #pragma once
 
+#include <atomic>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <vector>
 
@@ -29,6 +32,7 @@ class Rule
 {
 public:
 	using StringsTrie = Trie<std::shared_ptr<String>>;
+	using ConditionLoader = std::function<Expression::Ptr(const Rule&)>;
 
 	/**
 	 * Rule modifier for specifying if rule is
@@ -69,18 +73,24 @@ public:
 	std::vector<Meta>& getMetas();
 	const std::vector<Meta>& getMetas() const;
 	std::vector<const String*> getStrings() const;
+	std::vector<const String*> getStringsInDefinitionOrder() const;
 	const std::shared_ptr<StringsTrie>& getStringsTrie() const;
 	std::vector<Variable>& getVariables();
 	const std::vector<Variable>& getVariables() const;
 	const Expression::Ptr& getCondition() const;
 	std::vector<std::string> getTags() const;
+	const std::vector<TokenIt>& getTagTokens() const { return _tags; }
+	const std::optional<TokenIt>& getPrivateTokenIt() const { return _mod_private; }
+	const std::optional<TokenIt>& getGlobalTokenIt() const { return _mod_global; }
 	const std::shared_ptr<Symbol>& getSymbol() const;
+	TokenIt getNameTokenIt() const { return _name; }
 	Meta* getMetaWithName(const std::string& key);
 	const Meta* getMetaWithName(const std::string& key) const;
 	const Location& getLocation() const { return _location; }
 	TokenStream* getTokenStream() const { return _tokenStream.get(); }
 	TokenIt getFirstTokenIt() const;
 	TokenIt getLastTokenIt() const;
+	StructuralHash fingerprint() const;
 	/// @}
 
 	/// @name Setter methods
@@ -90,6 +100,7 @@ public:
 	void setVariables(const std::vector<Variable>& variables);
 	void setTags(const std::vector<std::string>& tags);
 	void setCondition(const Expression::Ptr& condition);
+	void setConditionLoader(ConditionLoader&& loader);
 	void setLocation(const Location& location) { _location = location; }
 	void setModifier(const Modifier& modifier);
 	/// @}
@@ -98,6 +109,7 @@ public:
 	/// {
 	bool isGlobal() const;
 	bool isPrivate() const;
+	bool isConditionLoaded() const;
 	/// }
 
 	/// @name Manipulation methods
@@ -110,6 +122,20 @@ public:
 	/// @}
 
 private:
+	/**
+	 * Condition which was not parsed yet. It is shared by copies of the rule,
+	 * so it is parsed only once even if it is accessed from multiple threads.
+	 */
+	struct PendingCondition
+	{
+		PendingCondition(ConditionLoader&& loader) : loader(std::move(loader)) {}
+
+		std::once_flag once; ///< Guards the loading
+		std::atomic<bool> loaded{false}; ///< Set once the condition is loaded
+		ConditionLoader loader; ///< Creates condition expression
+		Expression::Ptr condition; ///< Loaded condition expression
+	};
+
 	void removeTags(TokenType type);
 
 	std::shared_ptr<TokenStream> _tokenStream; ///< tokenStream containing all the data in this Rule
@@ -120,6 +146,7 @@ private:
 	std::shared_ptr<StringsTrie> _strings; ///< Strings
 	std::vector<Variable> _variables; ///< Variables
 	Expression::Ptr _condition; ///< Condition expression
+	std::shared_ptr<PendingCondition> _pendingCondition; ///< Condition parsed on first access if it was not parsed yet
 	std::vector<TokenIt> _tags; ///< Tags
 	Location _location; ///< Which file was this rule included from and its textual position
 };
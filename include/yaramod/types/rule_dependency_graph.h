@@ -0,0 +1,103 @@
+/**
+ * @file src/types/rule_dependency_graph.h
+ * @brief Declaration of class RuleDependencyGraph.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "yaramod/types/rule.h"
+
+namespace yaramod {
+
+class YaraFile;
+
+/**
+ * Graph of references between rules through their conditions. Rules are identified
+ * by their names and a rule may reference a rule which is not in the graph, which
+ * is reported as undefined reference.
+ *
+ * Graph of YARA file returned by YaraFile::getDependencyGraph() is updated whenever
+ * rules are added or removed through the YARA file and it is refreshed on the next access
+ * after any modification, so it also reflects renamed rules and modified conditions.
+ * Other graphs need to be updated using updateRule() or refresh().
+ */
+class RuleDependencyGraph
+{
+public:
+	/**
+	 * Reference of a rule to a rule which is not in the graph.
+	 */
+	struct UndefinedReference
+	{
+		std::string rule; ///< Name of the referencing rule
+		std::string name; ///< Name of the referenced rule
+	};
+
+	/// @name Constructors
+	/// @{
+	RuleDependencyGraph() = default;
+	explicit RuleDependencyGraph(const YaraFile& file);
+	/// @}
+
+	/// @name Modification methods
+	/// @{
+	void addRule(const Rule& rule);
+	void updateRule(const Rule& rule);
+	void removeRule(const std::string& name);
+	void refresh(const std::vector<std::shared_ptr<Rule>>& rules);
+	/// @}
+
+	/// @name Getter methods
+	/// @{
+	std::size_t getRulesCount() const { return _nodes.size(); }
+	std::vector<std::string> getDependencies(const std::string& name) const;
+	std::vector<std::string> getDependents(const std::string& name) const;
+	std::vector<std::string> getTransitiveDependencies(const std::string& name) const;
+	std::vector<std::string> getTransitiveDependents(const std::string& name) const;
+	std::vector<std::string> getTopologicalOrder() const;
+	/// @}
+
+	/// @name Detection methods
+	/// @{
+	bool hasRule(const std::string& name) const { return _nodes.find(name) != _nodes.end(); }
+	std::vector<std::vector<std::string>> findCycles() const;
+	std::vector<UndefinedReference> findUndefinedReferences() const;
+	std::vector<std::string> findUnreferencedPrivateRules() const;
+	/// @}
+
+private:
+	/**
+	 * Rule in the graph.
+	 */
+	struct Node
+	{
+		std::size_t sequence = 0; ///< Order of addition, used to keep results in order of rules
+		const Rule* rule = nullptr; ///< Rule which the node was created from, only used to find it again
+		StructuralHash state; ///< Hash of the condition and variables of the rule when the node was created
+		bool isPrivate = false;
+		bool isGlobal = false;
+		std::vector<std::string> dependencies; ///< Names of referenced rules in order of their first reference
+	};
+
+	using NodeEntry = std::pair<const std::string, Node>;
+
+	void replaceRule(const std::string& name, const Rule& rule);
+	StructuralHash getState(const Rule& rule) const;
+	std::vector<std::string> getReferencedRules(const Rule& rule) const;
+	std::vector<const NodeEntry*> getNodesInOrder() const;
+	std::vector<std::vector<std::size_t>> getEdges(const std::vector<const NodeEntry*>& nodes) const;
+	std::vector<std::vector<std::size_t>> getComponents(const std::vector<std::vector<std::size_t>>& edges) const;
+	std::vector<std::string> getReachable(const std::string& name, bool dependents) const;
+
+	const YaraFile* _file = nullptr; ///< YARA file used to tell references to rules apart from other symbols
+	std::unordered_map<std::string, Node> _nodes; ///< Rules by their names
+	std::unordered_map<std::string, std::vector<std::string>> _dependents; ///< Names of rules referencing the name
+	std::size_t _nextSequence = 0;
+};
+
+}
@@ -11,6 +11,7 @@
 #include <vector>
 
 #include "yaramod/types/string_modifier.h"
+#include "yaramod/types/structural_hash.h"
 #include "yaramod/types/token_stream.h"
 #include "yaramod/yaramod_error.h"
 
@@ -111,6 +112,11 @@ public:
 		return {};
 	}
 
+	const std::optional<TokenIt>& getIdentifierIt() const { return _id; }
+	const std::optional<TokenIt>& getAssignIt() const { return _assignToken; }
+
+	const std::unordered_map<StringModifier::Type, std::shared_ptr<StringModifier>>& getModifiers() const { return _mods; }
+
 	std::string getModifiersText() const
 	{
 		if (_mods.empty())
@@ -154,6 +160,8 @@ public:
 
 	virtual TokenIt getFirstTokenIt() const = 0;
 	virtual TokenIt getLastTokenIt() const = 0;
+
+	StructuralHash structuralHash() const;
 	/// @}
 
 	/// @name Setter methods
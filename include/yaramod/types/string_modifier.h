@@ -134,6 +134,9 @@ public:
 	 */
 	bool isSingleKey() const { return _low && !_high; }
 
+	const std::optional<std::uint32_t>& getLow() const { return _low; }
+	const std::optional<std::uint32_t>& getHigh() const { return _high; }
+
 	virtual std::string getText() const override
 	{
 		if (isRange())
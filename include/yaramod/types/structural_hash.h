@@ -0,0 +1,185 @@
+/**
+ * @file src/types/structural_hash.h
+ * @brief Declaration of structural hashes of rules and expressions.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace yaramod {
+
+/**
+ * 128-bit hash of the structure of rule or expression which does not depend on its formatting.
+ */
+struct StructuralHash
+{
+	std::uint64_t high = 0;
+	std::uint64_t low = 0;
+
+	std::string getText() const;
+
+	bool operator==(const StructuralHash& other) const { return high == other.high && low == other.low; }
+	bool operator!=(const StructuralHash& other) const { return !(*this == other); }
+	bool operator<(const StructuralHash& other) const { return high < other.high || (high == other.high && low < other.low); }
+};
+
+/**
+ * Computes StructuralHash from values fed one after another. The result is the same
+ * on all platforms, so it can be stored and compared later.
+ */
+class StructuralHasher
+{
+public:
+	/// @name Addition methods
+	/// @{
+	void add(std::uint64_t value);
+	void add(const std::string& value);
+	void add(const StructuralHash& value);
+	/// @}
+
+	/// @name Getter methods
+	/// @{
+	StructuralHash get() const;
+	/// @}
+
+private:
+	std::uint64_t _high = 0x6a09e667f3bcc908;
+	std::uint64_t _low = 0xbb67ae8584caa73b;
+	std::uint64_t _count = 0;
+};
+
+/**
+ * Global count of modifications of rules, expressions and tokens which may change structural
+ * hashes of rules. Anything computed from structural hashes of many rules can be kept as long
+ * as the count stays the same, see YaraFile::getDependencyGraph(). Modifications of expressions
+ * whose hashes were never computed are not counted.
+ */
+class StructuralModificationCounter
+{
+public:
+	static std::uint64_t get() { return _count.load(std::memory_order_acquire); }
+	static void increment() { _count.fetch_add(1, std::memory_order_acq_rel); }
+
+private:
+	static inline std::atomic<std::uint64_t> _count = 0;
+};
+
+class Expression;
+
+/**
+ * Cached structural hash of a single expression. Expressions don't know their parents, so
+ * the computation of a hash links the cache of each subexpression to the cache of the expression
+ * whose hash depends on it. Modification of an expression invalidates its cached hash and
+ * the cached hashes along these links up to the root, so cached hashes of other expressions
+ * are kept. Tokens don't know their expressions at all, so modification of a token whose value
+ * was used by a cached hash invalidates all of them (see StructuralHashDependency).
+ *
+ * Caches are allocated only for expressions whose hashes are computed (see StructuralHashCacheRef).
+ * They are referenced from their expressions and from caches of subexpressions, so they are
+ * reference counted and outlive their expressions if needed. Each cache is guarded by its own
+ * lock, so hashes can be computed from multiple threads at once.
+ */
+class StructuralHashCache
+{
+public:
+	/// @name Constructors
+	/// @{
+	StructuralHashCache(const StructuralHashCache&) = delete;
+	StructuralHashCache& operator=(const StructuralHashCache&) = delete;
+	/// @}
+
+	/// @name Getter methods
+	/// @{
+	std::optional<StructuralHash> get(std::uint64_t context);
+	/// @}
+
+	/// @name Setter methods
+	/// @{
+	void set(const StructuralHash& hash, std::uint64_t context);
+	bool link(StructuralHashCache* parent, bool inner);
+	void unlink(const StructuralHashCache* parent);
+	/// @}
+
+	static void invalidate(StructuralHashCache* cache);
+	static void invalidateAll();
+
+private:
+	friend class StructuralHashCacheRef;
+
+	StructuralHashCache(const Expression* owner) : _owner(owner) {}
+
+	void acquire();
+	static void release(StructuralHashCache* cache);
+	void lock();
+	void unlock();
+
+	static inline std::atomic<std::uint64_t> _currentGeneration = 1; ///< Incremented whenever all cached hashes are invalidated
+
+	std::atomic<std::size_t> _references = 1;
+	std::atomic_flag _lock = ATOMIC_FLAG_INIT;
+	bool _valid = false; ///< Set if the expression and all its subexpressions were not modified since the computation
+	bool _shared = false; ///< Set if the expression was found in more expressions, its hash and hashes of its parents are never cached
+	StructuralHash _hash;
+	std::uint64_t _context = 0; ///< Context in which the hash was computed
+	std::uint64_t _generation = 0; ///< Generation at the time of computation of the hash, 0 if there is no hash
+	const Expression* _owner; ///< Expression the cache belongs to, null after its destruction
+	StructuralHashCache* _parent = nullptr; ///< Cache of the expression whose cached hash depends on this one
+};
+
+/**
+ * Reference from an expression to its StructuralHashCache, which is allocated on the first
+ * computation of its hash. Copies of expressions don't share caches.
+ */
+class StructuralHashCacheRef
+{
+public:
+	/// @name Constructors
+	/// @{
+	StructuralHashCacheRef() = default;
+	StructuralHashCacheRef(const StructuralHashCacheRef&) {}
+	StructuralHashCacheRef& operator=(const StructuralHashCacheRef&) = delete;
+	~StructuralHashCacheRef();
+	/// @}
+
+	/// @name Getter methods
+	/// @{
+	StructuralHashCache* get() const { return _cache.load(std::memory_order_acquire); }
+	StructuralHashCache& getOrCreate(const Expression* owner);
+	/// @}
+
+private:
+	std::atomic<StructuralHashCache*> _cache = nullptr;
+};
+
+/**
+ * Flag of a literal whose value was used by a cached structural hash. Modification of such
+ * literal invalidates all cached hashes. Copies of literals are not flagged.
+ */
+class StructuralHashDependency
+{
+public:
+	/// @name Constructors
+	/// @{
+	StructuralHashDependency() = default;
+	StructuralHashDependency(const StructuralHashDependency&) {}
+	StructuralHashDependency& operator=(const StructuralHashDependency&) { modify(); return *this; }
+	/// @}
+
+	void use() const { _used.store(true, std::memory_order_relaxed); }
+	void modify() const
+	{
+		if (_used.exchange(false, std::memory_order_relaxed))
+			StructuralHashCache::invalidateAll();
+	}
+
+private:
+	mutable std::atomic<bool> _used = false;
+};
+
+}
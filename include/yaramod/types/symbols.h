@@ -83,6 +83,11 @@ public:
 		_initArgs(args...);
 	}
 
+	FunctionSymbol(const std::string& name, ExpressionType returnType, const std::vector<std::vector<ExpressionType>>& overloads)
+		: Symbol(Symbol::Type::Function, name, ExpressionType::Object), _returnType(returnType), _argTypesOverloads(overloads)
+	{
+	}
+
 	ExpressionType getReturnType() const { return _returnType; }
 	const std::vector<std::vector<ExpressionType>>& getAllOverloads() const { return _argTypesOverloads; }
 
@@ -145,6 +150,11 @@ class StructureSymbol : public Symbol
 public:
 	StructureSymbol(const std::string& name) : Symbol(Symbol::Type::Structure, name, ExpressionType::Object) {}
 
+	const std::unordered_map<std::string, std::shared_ptr<Symbol>>& getAttributes() const
+	{
+		return _attributes;
+	}
+
 	std::optional<std::shared_ptr<Symbol>> getAttribute(const std::string& name) const
 	{
 		auto itr = _attributes.find(name);
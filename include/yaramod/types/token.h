@@ -57,7 +57,11 @@ public:
 
 	/// @name Setter methods
 	/// @{
-	void setValue(const Literal& new_value) { _value = std::make_shared<Literal>(new_value); }
+	void setValue(const Literal& new_value)
+	{
+		_value->invalidateStructuralHashes();
+		_value = std::make_shared<Literal>(new_value);
+	}
 
 	void setValue(const std::string& value) { _value->setValue(value); }
 	void setValue(std::string&& value) { _value->setValue(std::move(value)); }
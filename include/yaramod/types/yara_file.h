@@ -6,16 +6,33 @@
 
 #pragma once
 
+#include <algorithm>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
 #include "yaramod/types/modules/modules_pool.h"
 #include "yaramod/types/rule.h"
+#include "yaramod/types/rule_dependency_graph.h"
 
 namespace yaramod {
 
+class ModifyingVisitor;
+class Visitor;
+
 /**
  * Class representing YARA file with all the imports and
  * rules it contains.
+ *
+ * Reading of the file from multiple threads at once is safe as long as no thread modifies it.
+ * This covers conditions (Rule::getCondition()), strings, metas, getters of literals and tokens
+ * and symbols which are shared among rules. Conditions which were not parsed yet are parsed
+ * on their first access. Concurrent first accesses are serialized, so each condition is parsed
+ * only once, but parsing inserts tokens of the condition into the token stream, so the token
+ * stream of the whole file (like getText()) must not be read at the same time. Call loadConditions()
+ * first if you need that. See forEachRuleParallel() for running visitors in parallel.
  */
 class YaraFile
 {
@@ -52,6 +69,14 @@ public:
 	const std::vector<std::shared_ptr<Module>>& getImports() const;
 	const std::vector<std::shared_ptr<Rule>>& getRules() const;
 	TokenStream* getTokenStream() const;
+	Features getFeatures() const { return _Features; }
+	RuleDependencyGraph& getDependencyGraph();
+	const RuleDependencyGraph& getDependencyGraph() const;
+	/// @}
+
+	/// @name Setter methods
+	/// @{
+	void setLean(bool lean) { _lean = lean; }
 	/// @}
 
 	/// @name Removing methods
@@ -72,6 +97,11 @@ public:
 		for (auto rem_itr = itr; rem_itr != _rules.end(); ++rem_itr)
 		{
 			_ruleTable.erase(_ruleTable.find((*rem_itr)->getName()));
+			{
+				std::lock_guard<std::mutex> lock(_dependencyGraphMutex);
+				if (_dependencyGraph)
+					_dependencyGraph->removeRule((*rem_itr)->getName());
+			}
 			auto behind = _tokenStream->erase((*rem_itr)->getFirstTokenIt(), std::next((*rem_itr)->getLastTokenIt()));
 			while (behind != _tokenStream->end() && behind->getType() == TokenType::NEW_LINE)
 				behind = _tokenStream->erase(behind);
@@ -80,30 +110,146 @@ public:
 	}
 	/// @}
 
+	/// @name Parallel processing methods
+	/// @{
+	/**
+	 * Runs visitors over conditions of all rules in parallel. Rules are split into contiguous
+	 * ranges, one for each thread, and each range is visited by its own visitor created
+	 * by @p visitorFactory on the calling thread. Visitors derived from ModifyingVisitor replace
+	 * conditions with the result of ModifyingVisitor::modify(), condition deleted as a whole
+	 * is replaced with `true`. Other visitors only observe conditions. Once all threads finish,
+	 * @p reducer is called from the calling thread with each visitor in the order of the ranges.
+	 *
+	 * Tokens of each condition are moved into their own token stream for the time of the visit
+	 * of modifying visitors, so each visitor may only modify the condition it currently visits.
+	 * If any visitor throws, the first exception is rethrown once all threads finish.
+	 *
+	 * @param visitorFactory Callable returning a new visitor.
+	 * @param reducer Callable accepting visitor which visited all rules of its range.
+	 * @param threads Number of threads, @c 0 means the number of hardware threads.
+	 */
+	template <typename VisitorFactory, typename Reducer>
+	void forEachRuleParallel(VisitorFactory&& visitorFactory, Reducer&& reducer, std::size_t threads = 0)
+	{
+		using VisitorType = std::decay_t<decltype(visitorFactory())>;
+		constexpr bool modifying = std::is_base_of_v<ModifyingVisitor, VisitorType>;
+
+		if (threads == 0)
+			threads = std::max(std::thread::hardware_concurrency(), 1u);
+		threads = std::max<std::size_t>(std::min(threads, _rules.size()), 1);
+
+		std::vector<VisitorType> visitors;
+		visitors.reserve(threads);
+		for (std::size_t i = 0; i < threads; ++i)
+			visitors.push_back(visitorFactory());
+
+		// Token streams are not thread-safe so everything that modifies them is done in advance
+		std::vector<DetachedCondition> detached;
+		if constexpr (modifying)
+			detached = detachConditions();
+		else
+			loadConditions();
+
+		std::vector<std::exception_ptr> errors(threads);
+		std::vector<std::thread> workers;
+		workers.reserve(threads);
+		auto rangeSize = (_rules.size() + threads - 1) / threads;
+		for (std::size_t i = 0; i < threads; ++i)
+		{
+			workers.emplace_back([&, i]() {
+				try
+				{
+					auto end = std::min((i + 1) * rangeSize, _rules.size());
+					for (auto ruleIndex = i * rangeSize; ruleIndex < end; ++ruleIndex)
+					{
+						if constexpr (modifying)
+							modifyCondition(*_rules[ruleIndex], visitors[i]);
+						else
+							observeCondition(*_rules[ruleIndex], visitors[i]);
+					}
+				}
+				catch (...)
+				{
+					errors[i] = std::current_exception();
+				}
+			});
+		}
+
+		for (auto& worker : workers)
+			worker.join();
+
+		if constexpr (modifying)
+			attachConditions(std::move(detached));
+
+		for (const auto& error : errors)
+		{
+			if (error)
+				std::rethrow_exception(error);
+		}
+
+		for (auto& visitor : visitors)
+			reducer(visitor);
+	}
+	/// @}
+
 	/// @name Symbol methods
 	/// @{
 	std::shared_ptr<Symbol> findSymbol(const std::string& name) const;
 	/// @}
 
+	/// @name Snapshot methods
+	/// @{
+	void saveSnapshot(const std::string& path) const;
+	static std::unique_ptr<YaraFile> loadSnapshot(const std::string& path, Features features = Features::AllCurrent);
+	/// @}
+
+	/// @name Condition methods
+	/// @{
+	void loadConditions() const;
+	/// @}
+
 	/// @name Detection methods
 	/// @{
 	bool hasImports() const;
 	bool hasRules() const;
 	bool hasRule(const std::string& name) const;
+	bool isLean() const { return _lean; }
 	/// @}
 
 private:
+	/**
+	 * Condition moved out of the token stream of its rule.
+	 */
+	struct DetachedCondition
+	{
+		std::shared_ptr<TokenStream> tokenStream; ///< Token stream the condition was moved from
+		TokenIt position; ///< Token the condition preceded
+		std::shared_ptr<TokenStream> detachedTokenStream; ///< Token stream the condition was moved to
+	};
+
 	void initializeVTSymbols();
 
+	/// @name Methods for parallel processing
+	/// @{
+	std::vector<DetachedCondition> detachConditions();
+	void attachConditions(std::vector<DetachedCondition>&& detached);
+	static void observeCondition(const Rule& rule, Visitor& visitor);
+	static void modifyCondition(Rule& rule, ModifyingVisitor& visitor);
+	/// @}
+
 	std::shared_ptr<TokenStream> _tokenStream; ///< tokenStream containing all the data in this Rule
 	std::vector<std::shared_ptr<Module>> _imports; ///< Imported modules
 	std::vector<std::shared_ptr<Rule>> _rules; ///< Rules
 
 	std::unordered_map<std::string, Module*> _importTable;
 	std::unordered_map<std::string, Rule*> _ruleTable;
+	mutable std::unique_ptr<RuleDependencyGraph> _dependencyGraph; ///< Dependency graph of rules, built on its first access
+	mutable std::uint64_t _dependencyGraphModifications = 0; ///< Count of structural modifications at the last refresh of the dependency graph
+	mutable std::mutex _dependencyGraphMutex; ///< Guards building, updating and refreshing of the dependency graph
 
 	Features _Features; ///< Determines which symbols are needed
 	std::vector<std::shared_ptr<Symbol>> _vtSymbols; ///< Virust Total symbols
+	bool _lean; ///< Parsed in lean mode without comments and layout tokens
 };
 
 }
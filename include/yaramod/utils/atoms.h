@@ -0,0 +1,67 @@
+/**
+ * @file src/utils/atoms.h
+ * @brief Declaration of atom extraction from strings of YARA rules.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "yaramod/types/yara_file.h"
+
+namespace yaramod {
+
+/**
+ * Atom is a short sequence of bytes which YARA looks for in the scanned data
+ * before it verifies the whole string. Some bits of bytes may be masked out.
+ * Quality of the atom estimates how rarely it occurs in the scanned data and
+ * it is computed using the same heuristic as YARA uses for selection of atoms.
+ */
+struct Atom
+{
+	static constexpr std::size_t MaxLength = 4; ///< Maximal length of atom in bytes
+	static constexpr int MaxQuality = 88; ///< Quality of atom made of @c MaxLength distinct uncommon bytes
+
+	std::vector<std::uint8_t> bytes;
+	std::vector<std::uint8_t> masks; ///< @c 0xFF for fixed bytes, @c 0xF0 or @c 0x0F for fixed nibbles, @c 0x00 for wildcards
+	int quality = 0;
+
+	std::string getText() const;
+};
+
+/**
+ * Atoms of a single string. YARA looks for all of the atoms since each of them
+ * covers different alternative of the string, so the worst of them determines
+ * the quality of the whole string. Strings without any atoms, like `/.*abc/` or
+ * `{ ?? ?? }`, have quality @c 0 and they are verified at every offset of the scanned data.
+ */
+struct StringAtoms
+{
+	std::string id;
+	std::vector<Atom> atoms;
+	int quality = 0; ///< Quality of the worst atom
+};
+
+/**
+ * Atoms of all strings of a single rule. Quality of the rule is the quality
+ * of its worst string or @c Atom::MaxQuality if it has no strings.
+ */
+struct RuleAtoms
+{
+	std::string name;
+	std::vector<StringAtoms> strings;
+	int quality = Atom::MaxQuality;
+};
+
+/// @name Atom extraction
+/// @{
+int getAtomQuality(const std::vector<std::uint8_t>& bytes, const std::vector<std::uint8_t>& masks);
+StringAtoms extractAtoms(const String& string);
+RuleAtoms extractAtoms(const Rule& rule);
+std::vector<RuleAtoms> extractAtoms(const YaraFile& file);
+/// @}
+
+}
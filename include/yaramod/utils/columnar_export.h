@@ -0,0 +1,62 @@
+/**
+ * @file src/utils/columnar_export.h
+ * @brief Declaration of columnar export of YARA files.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "yaramod/types/yara_file.h"
+
+namespace yaramod {
+
+/**
+ * Contents of all rules of YARA file stored in columns instead of objects,
+ * so they can be processed in bulk. Each group of columns forms a table with
+ * rows of the same length. Rows of all tables except the table of rules refer
+ * to their rule using its index in the YARA file.
+ */
+struct YaraFileColumns
+{
+	/// @name Rules, one row for each rule
+	/// @{
+	std::vector<std::string> ruleNames;
+	std::vector<std::string> ruleModifiers; ///< `global`, `private`, `private global` or empty
+	/// @}
+
+	/// @name Tags, one row for each tag of each rule
+	/// @{
+	std::vector<std::size_t> tagRules;
+	std::vector<std::string> tags;
+	/// @}
+
+	/// @name Metas, one row for each meta of each rule
+	/// @{
+	std::vector<std::size_t> metaRules;
+	std::vector<std::string> metaKeys;
+	std::vector<std::string> metaValues; ///< Pure text of values without quotes
+	/// @}
+
+	/// @name Strings, one row for each string of each rule
+	/// @{
+	std::vector<std::size_t> stringRules;
+	std::vector<std::string> stringIds;
+	std::vector<std::string> stringTypes; ///< `plain`, `hex` or `regexp`
+	std::vector<std::string> stringModifiers; ///< Modifiers separated by spaces
+	std::vector<std::string> stringTexts; ///< Pure text of strings
+	/// @}
+
+	/// @name Modules, one row for each imported module used in condition of each rule
+	/// @{
+	std::vector<std::size_t> moduleRules;
+	std::vector<std::string> modules;
+	/// @}
+};
+
+YaraFileColumns exportColumns(const YaraFile& file);
+
+}
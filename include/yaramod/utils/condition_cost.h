@@ -0,0 +1,173 @@
+/**
+ * @file src/utils/condition_cost.h
+ * @brief Declaration of static estimation of cost of conditions.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "yaramod/types/yara_file.h"
+#include "yaramod/utils/observing_visitor.h"
+
+namespace yaramod {
+
+/**
+ * Observing visitor which estimates worst-case cost of evaluation of conditions.
+ * Cost is expressed in units where evaluation of a single simple expression,
+ * like comparison of two integers, costs @c 1. Both operands of `and` and `or`
+ * are counted since neither of them can be skipped in the worst case.
+ *
+ * Loops cost the cost of their body multiplied by the number of iterations.
+ * Number of iterations over ranges is computed from their bounds if they can be
+ * evaluated, `filesize` is replaced with the assumed size of the scanned file and
+ * `#a` with the assumed number of matches of a string. Module arrays and dictionaries
+ * have assumed length. Calls of module functions cost the cost of the function
+ * and functions processing data of the file, like `hash.md5(0, filesize)`, also cost
+ * the number of processed bytes multiplied by their cost per byte.
+ */
+class ConditionCostEstimator : public ObservingVisitor
+{
+public:
+	/**
+	 * Cost of a call of module function.
+	 */
+	struct FunctionCost
+	{
+		double base = 1.0; ///< Cost of a single call
+		double perByte = 0.0; ///< Cost of each processed byte of the file
+	};
+
+	/// @name Constructors
+	/// @{
+	ConditionCostEstimator();
+	/// @}
+
+	/// @name Estimation methods
+	/// @{
+	double estimate(const Rule& rule);
+	double estimate(const Expression::Ptr& expr);
+	double estimate(const Expression::Ptr& expr, const Rule& rule);
+	/// @}
+
+	/// @name Getter methods
+	/// @{
+	FunctionCost getFunctionCost(const std::string& name) const;
+	std::uint64_t getFileSize() const { return _fileSize; }
+	std::uint64_t getMatchesPerString() const { return _matchesPerString; }
+	std::uint64_t getArrayLength() const { return _arrayLength; }
+	std::uint64_t getUnknownIterations() const { return _unknownIterations; }
+	/// @}
+
+	/// @name Setter methods
+	/// @{
+	void setFunctionCost(const std::string& name, const FunctionCost& cost) { _functionCosts[name] = cost; }
+	void setFileSize(std::uint64_t fileSize) { _fileSize = fileSize; }
+	void setMatchesPerString(std::uint64_t matches) { _matchesPerString = matches; }
+	void setArrayLength(std::uint64_t length) { _arrayLength = length; }
+	void setUnknownIterations(std::uint64_t iterations) { _unknownIterations = iterations; }
+	/// @}
+
+	/// @name Visit methods
+	/// @{
+	virtual VisitResult visit(StringExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(StringWildcardExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(StringAtExpression* expr) override;
+	virtual VisitResult visit(StringInRangeExpression* expr) override;
+	virtual VisitResult visit(StringCountExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(StringOffsetExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(StringLengthExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(NotExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(UnaryMinusExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(BitwiseNotExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(AndExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(OrExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(LtExpression* expr) override { return comparison(expr); }
+	virtual VisitResult visit(GtExpression* expr) override { return comparison(expr); }
+	virtual VisitResult visit(LeExpression* expr) override { return comparison(expr); }
+	virtual VisitResult visit(GeExpression* expr) override { return comparison(expr); }
+	virtual VisitResult visit(EqExpression* expr) override { return comparison(expr); }
+	virtual VisitResult visit(NeqExpression* expr) override { return comparison(expr); }
+	virtual VisitResult visit(ContainsExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(MatchesExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(PlusExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(MinusExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(MultiplyExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(DivideExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(ModuloExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(BitwiseXorExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(BitwiseAndExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(BitwiseOrExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(ShiftLeftExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(ShiftRightExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(ForDictExpression* expr) override;
+	virtual VisitResult visit(ForArrayExpression* expr) override;
+	virtual VisitResult visit(ForStringExpression* expr) override;
+	virtual VisitResult visit(OfExpression* expr) override;
+	virtual VisitResult visit(IterableExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(SetExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(RangeExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(IdExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(StructAccessExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(ArrayAccessExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(FunctionCallExpression* expr) override;
+	virtual VisitResult visit(BoolLiteralExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(StringLiteralExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(IntLiteralExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(DoubleLiteralExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(FilesizeExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(EntrypointExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(AllExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(AnyExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(ThemExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(ParenthesesExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(IntFunctionExpression* expr) override { return simple(expr); }
+	virtual VisitResult visit(RegexpExpression* expr) override { return simple(expr); }
+	/// @}
+
+private:
+	/**
+	 * Adds cost of the expression itself and visits its subexpressions.
+	 */
+	template <typename ExpressionType>
+	VisitResult simple(ExpressionType* expr)
+	{
+		_cost += 1.0;
+		return ObservingVisitor::visit(expr);
+	}
+
+	VisitResult comparison(BinaryOpExpression* expr);
+	VisitResult loop(ForExpression* expr, std::uint64_t iterations, double iterationCost);
+
+	double estimateSubexpression(Expression* expr);
+	std::optional<double> evaluate(const Expression* expr) const;
+	std::uint64_t getIterationCount(const Expression* iterable) const;
+	std::uint64_t getStringCount(const Expression* set) const;
+
+	std::unordered_map<std::string, FunctionCost> _functionCosts; ///< Costs of module functions by their qualified names or names of modules
+	std::uint64_t _fileSize = 1024 * 1024; ///< Assumed size of the scanned file
+	std::uint64_t _matchesPerString = 16; ///< Assumed number of matches of each string
+	std::uint64_t _arrayLength = 16; ///< Assumed length of module arrays and dictionaries
+	std::uint64_t _unknownIterations = 256; ///< Assumed number of iterations over ranges with bounds which can't be evaluated
+
+	const Rule* _rule = nullptr; ///< Rule whose condition is estimated
+	double _cost = 0.0; ///< Cost of the currently estimated expression
+};
+
+/**
+ * Estimated cost of condition of a rule.
+ */
+struct RuleCost
+{
+	std::string name;
+	double cost;
+};
+
+std::vector<RuleCost> estimateConditionCosts(const YaraFile& file, ConditionCostEstimator estimator = {});
+
+}
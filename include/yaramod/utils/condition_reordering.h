@@ -0,0 +1,68 @@
+/**
+ * @file src/utils/condition_reordering.h
+ * @brief Declaration of cost-aware reordering of operands of conditions.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#pragma once
+
+#include "yaramod/types/yara_file.h"
+#include "yaramod/utils/condition_cost.h"
+#include "yaramod/utils/modifying_visitor.h"
+
+namespace yaramod {
+
+/**
+ * Modifying visitor which reorders operands of chains of `and` and `or` so the cheap
+ * ones are evaluated first and expensive ones can be skipped thanks to short-circuit
+ * evaluation. Costs of operands are estimated by ConditionCostEstimator. Operands
+ * cheaper than the cheap cost are considered equally cheap and keep their order, all
+ * other operands are sorted by their cost while operands with the same cost keep their order.
+ *
+ * Reordering does not change the meaning of conditions because evaluation of expressions
+ * has no side effects and undefined operands are treated as false regardless of their
+ * position. Tokens of the operands are moved in the token stream together with their
+ * comments and the layout between operands stays in place.
+ */
+class ConditionReorderer : public ModifyingVisitor
+{
+public:
+	/// @name Constructors
+	/// @{
+	ConditionReorderer(ConditionCostEstimator estimator = {});
+	/// @}
+
+	/// @name Reordering methods
+	/// @{
+	bool reorder(Rule& rule);
+	std::size_t reorder(YaraFile& file);
+	/// @}
+
+	/// @name Getter methods
+	/// @{
+	const ConditionCostEstimator& getEstimator() const { return _estimator; }
+	double getCheapCost() const { return _cheapCost; }
+	/// @}
+
+	/// @name Setter methods
+	/// @{
+	void setEstimator(const ConditionCostEstimator& estimator) { _estimator = estimator; }
+	void setCheapCost(double cost) { _cheapCost = cost; }
+	/// @}
+
+	/// @name Visit methods
+	/// @{
+	virtual VisitResult visit(AndExpression* expr) override;
+	virtual VisitResult visit(OrExpression* expr) override;
+	/// @}
+
+private:
+	VisitResult reorderChain(BinaryOpExpression* expr);
+
+	ConditionCostEstimator _estimator; ///< Estimator of costs of operands
+	double _cheapCost = 10.0; ///< Operands cheaper than this keep their order
+	const Rule* _rule = nullptr; ///< Rule whose condition is reordered
+	bool _reordered = false; ///< Whether any chain was reordered during the current reordering
+};
+
+}
@@ -0,0 +1,55 @@
+/**
+ * @file src/utils/flat_expression.h
+ * @brief Declaration of flattened representation of expressions.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "yaramod/types/expression.h"
+
+namespace yaramod {
+
+/**
+ * Single expression of the flattened expression. Its layout has no padding
+ * so the array of nodes can be directly shared as a buffer of records.
+ */
+struct FlatExpressionNode
+{
+	/// Value of integer and boolean literals, index into FlatExpression::texts
+	/// for expressions with identifier or textual value, otherwise @c 0
+	std::int64_t value;
+	/// Index of the parent node, @c -1 for the root
+	std::int32_t parent;
+	/// Index of the first token of the expression relative to the first token of the root
+	std::uint32_t firstToken;
+	/// Kind of the expression, one of Expression::Kind values
+	std::uint32_t kind;
+	/// Number of nodes of the expression including itself, so the next sibling starts at index + size
+	std::uint32_t size;
+};
+
+static_assert(sizeof(FlatExpressionNode) == 24, "FlatExpressionNode needs to be 24 bytes long without padding");
+
+/**
+ * Expression and all its subexpressions stored in preorder in an array of nodes.
+ * Texts of the nodes, like identifiers of strings or symbols and values of string literals,
+ * are stored separately and nodes refer to them by index.
+ */
+struct FlatExpression
+{
+	static constexpr std::uint32_t NoToken = std::numeric_limits<std::uint32_t>::max();
+
+	std::vector<FlatExpressionNode> nodes;
+	std::vector<std::string> texts;
+};
+
+FlatExpression flatten(const Expression* expr);
+FlatExpression flatten(const Expression::Ptr& expr);
+
+}
@@ -0,0 +1,73 @@
+/**
+ * @file src/utils/hex_string_optimizer.h
+ * @brief Declaration of optimization of hex strings.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "yaramod/types/hex_string.h"
+#include "yaramod/types/yara_file.h"
+
+namespace yaramod {
+
+/**
+ * Rewrites hex strings into equivalent forms which are faster to scan for.
+ *
+ * - Adjacent jumps and `??` wildcards next to them are merged into a single jump,
+ *   so `[2] ?? [3-4]` becomes `[6-7]`.
+ * - Repeated alternatives are removed, alternations with a single alternative are
+ *   replaced with its content and bytes common to the beginning or the end of all
+ *   alternatives are moved out of the alternation, so `( AA BB | AA CC )` becomes `AA ( BB | CC )`.
+ * - If enabled by setTrimWildcards(), leading and trailing `??` wildcards and jumps are removed,
+ *   so `{ ?? AA BB [2] ?? }` becomes `{ AA BB }`. This is not equivalent, since trimmed strings
+ *   can newly match at the very beginning or end of the data, so it is disabled by default.
+ *   Removal of leading wildcards also changes the offset of matches and removal of trailing wildcards
+ *   changes their length. Wildcards are therefore never removed from strings whose offset (`@s`,
+ *   `$s at`, `$s in`) or length (`!s`) is used in the condition of the rule and a diagnostic
+ *   is recorded instead.
+ *
+ * Hex strings containing comments are not rewritten to not lose them.
+ */
+class HexStringOptimizer
+{
+public:
+	/**
+	 * Note about a hex string which was not fully optimized.
+	 */
+	struct Diagnostic
+	{
+		std::string rule;
+		std::string string;
+		std::string message;
+	};
+
+	/// @name Optimization methods
+	/// @{
+	bool optimize(Rule& rule);
+	std::size_t optimize(YaraFile& file);
+	/// @}
+
+	/// @name Getter methods
+	/// @{
+	const std::vector<Diagnostic>& getDiagnostics() const { return _diagnostics; }
+	bool getTrimWildcards() const { return _trimWildcards; }
+	/// @}
+
+	/// @name Setter methods
+	/// @{
+	void setTrimWildcards(bool trim) { _trimWildcards = trim; }
+	/// @}
+
+private:
+	bool optimize(const Rule& rule, HexString& string, bool offsetUsed, bool lengthUsed);
+	void addDiagnostic(const Rule& rule, const HexString& string, const std::string& message);
+
+	std::vector<Diagnostic> _diagnostics; ///< Diagnostics of all optimized rules
+	bool _trimWildcards = false; ///< Whether wildcards and jumps at the edges of hex strings are removed
+};
+
+}
@@ -6,6 +6,11 @@
 
 #pragma once
 
+#include <algorithm>
+#include <optional>
+#include <utility>
+#include <vector>
+
 #include "yaramod/builder/yara_expression_builder.h"
 #include "yaramod/types/expressions.h"
 #include "yaramod/utils/visitor.h"
@@ -72,6 +77,11 @@ private:
  * defaultHandler() and passing it the current expression together with results from visited child nodes.
  * Not every type of expression has defaultHandler() and you will get compilation error if you
  * try to call one if it does not exist.
+ *
+ * Chains of binary operations of the same kind, like `a or b or c`, are visited in a loop
+ * instead of recursively. Overriding visit() methods of the operations in the chain are
+ * called from the innermost operation to the outermost one, each after the left operand
+ * has been visited, so calling the default visit() method from them visits only the right operand.
  */
 class ModifyingVisitor : public Visitor
 {
@@ -88,7 +98,9 @@ public:
 	{
 		TokenStreamContext context{expr.get()};
 
+		_knownBounds = {expr.get(), expr->getTokenStream(), context.oldBeforeFirst(), context.oldAfterLast()};
 		auto result = expr->accept(this);
+		_knownBounds = {};
 		if (auto newExpr = std::get_if<Expression::Ptr>(&result))
 		{
 			return *newExpr ? *newExpr : expr;
@@ -477,17 +489,9 @@ public:
 		if (!expr->getLeftOperand() && !expr->getRightOperand())
 			return VisitAction::Delete;
 		else if (!expr->getLeftOperand() && expr->getRightOperand())
-		{
-			auto output = YaraExpressionBuilder{expr->getRightOperand()}.get();
-			cleanUpTokenStreams(context, output.get());
-			return output;
-		}
+			return _replaceWithOperand(context, expr->getRightOperand());
 		else if (expr->getLeftOperand() && !expr->getRightOperand())
-		{
-			auto output = YaraExpressionBuilder{expr->getLeftOperand()}.get();
-			cleanUpTokenStreams(context, output.get());
-			return output;
-		}
+			return _replaceWithOperand(context, expr->getLeftOperand());
 
 		return {};
 	}
@@ -749,26 +753,244 @@ public:
 	}
 
 protected:
+	/**
+	 * Operations and operands of a chain of the same operations, like `a and b and c`.
+	 */
+	struct OperationChain
+	{
+		std::vector<BinaryOpExpression*> operations; ///< Operations from the innermost one to the outermost one
+		std::vector<Expression::Ptr> operationPtrs; ///< Pointers to the operations, empty for the outermost one
+		std::vector<Expression::Ptr> operands; ///< Operands in the order of their appearance
+
+		/**
+		 * Replaces the operand at the given position in the chain.
+		 */
+		void setOperand(std::size_t i, const Expression::Ptr& operand)
+		{
+			operands[i] = operand;
+			if (i == 0)
+				operations.front()->setLeftOperand(operand);
+			else
+				operations[i - 1]->setRightOperand(operand);
+		}
+	};
+
 	ModifyingVisitor() = default;
 
+	/**
+	 * Collects operations and operands of the chain of operations of the same kind as the given one.
+	 * Chain `a and b and c` is parsed as `(a and b) and c` so operations are collected from the top
+	 * through left operands.
+	 */
+	static OperationChain collectChain(BinaryOpExpression* expr)
+	{
+		OperationChain chain;
+		for (Expression* current = expr; current->getKind() == expr->getKind(); )
+		{
+			auto operation = static_cast<BinaryOpExpression*>(current);
+			chain.operations.push_back(operation);
+			chain.operationPtrs.push_back(operation->getLeftOperand());
+			chain.operands.push_back(operation->getRightOperand());
+			current = operation->getLeftOperand().get();
+		}
+		chain.operands.push_back(chain.operations.back()->getLeftOperand());
+		chain.operationPtrs.pop_back();
+		chain.operationPtrs.insert(chain.operationPtrs.begin(), nullptr);
+		std::reverse(chain.operations.begin(), chain.operations.end());
+		std::reverse(chain.operationPtrs.begin(), chain.operationPtrs.end());
+		std::reverse(chain.operands.begin(), chain.operands.end());
+		return chain;
+	}
+
 private:
+	/**
+	 * Bounds of the expression which is about to be visited, known from the context of its parent.
+	 */
+	struct KnownBounds
+	{
+		const Expression* expr = nullptr; ///< Expression the bounds belong to
+		const TokenStream* tokenStream = nullptr; ///< Token stream the bounds belong to
+		std::optional<TokenIt> beforeFirst; ///< Token preceding the first token of the expression
+		std::optional<TokenIt> afterLast; ///< Token following the last token of the expression
+	};
+
+	/**
+	 * First token of the expression returned from the visit of an operation.
+	 */
+	struct KnownFirstToken
+	{
+		const Expression* expr = nullptr; ///< Expression the token belongs to
+		const TokenStream* tokenStream = nullptr; ///< Token stream the token belongs to
+		TokenIt token; ///< First token of the expression
+	};
+
+	/**
+	 * Creates context of the expression in the same way as TokenStreamContext constructor does
+	 * but reuses bounds already known from the context of its parent. Operations share their first
+	 * or last token with their operands so searching for them on each level of long chains
+	 * like `a or b or c or ...` would make the visit quadratic.
+	 */
+	TokenStreamContext _createContext(Expression* expr)
+	{
+		auto bounds = std::exchange(_knownBounds, {});
+		if (bounds.expr != expr || bounds.tokenStream != expr->getTokenStream())
+			bounds = {};
+
+		return {
+			expr->getTokenStreamSharedPtr(),
+			bounds.beforeFirst ? *bounds.beforeFirst : std::prev(expr->getFirstTokenIt()),
+			bounds.afterLast ? *bounds.afterLast : std::next(expr->getLastTokenIt())
+		};
+	}
+
+	/**
+	 * Returns the first token of the expression. It is known without searching for it
+	 * if the expression was just returned from the visit of an operation.
+	 */
+	TokenIt _getFirstTokenIt(const Expression::Ptr& expr) const
+	{
+		if (_knownFirstToken.expr == expr.get() && _knownFirstToken.tokenStream == expr->getTokenStream())
+			return _knownFirstToken.token;
+
+		return expr->getFirstTokenIt();
+	}
+
+	/**
+	 * Replaces the expression with one of its operands. If the operand still has its tokens
+	 * in the original token stream, they are left in place and only the tokens around them
+	 * are removed instead of moving them into a builder and back.
+	 */
+	Expression::Ptr _replaceWithOperand(const TokenStreamContext& context, const Expression::Ptr& operand)
+	{
+		const auto& tokenStream = context.oldTokenStream();
+		if (operand->getTokenStream() != tokenStream.get())
+		{
+			auto output = YaraExpressionBuilder{operand}.get();
+			cleanUpTokenStreams(context, output.get());
+			return output;
+		}
+
+		tokenStream->erase(std::next(context.oldBeforeFirst()), _getFirstTokenIt(operand));
+		tokenStream->erase(std::next(operand->getLastTokenIt()), context.oldAfterLast());
+		return operand;
+	}
+
 	template <typename T>
 	VisitResult _handleUnaryOperation(T* expr)
 	{
-		TokenStreamContext context{expr};
+		auto context = _createContext(expr);
+		_knownBounds = {expr->getOperand().get(), expr->getTokenStream(), std::nullopt, context.oldAfterLast()};
 		auto operandRet = expr->getOperand()->accept(this);
+		_knownBounds = {};
 		return defaultHandler(context, expr, operandRet);
 	}
 
+	/**
+	 * Visits operands of the operation. Chain `a or b or c` is parsed as `(a or b) or c` so long chains
+	 * would make the recursion as deep as the chain is long. Operations of the same kind are therefore
+	 * collected through left operands and visited from the innermost one to the outermost one in a loop.
+	 * Each of them is still visited through accept() so overriding visit() methods are called for it,
+	 * but its left operand has already been visited at that point and calling this default visit()
+	 * method from the override visits only the right operand and finishes the operation.
+	 */
 	template <typename T>
 	VisitResult _handleBinaryOperation(T* expr)
 	{
+		if (_resumedOperation && _resumedOperation->expr == expr)
+		{
+			auto resumed = std::exchange(_resumedOperation, nullptr);
+			return _finishBinaryOperation(expr, resumed->context, resumed->leftOperand, resumed->leftFirstToken);
+		}
 
-		TokenStreamContext context{expr};
-		auto leftOperand = expr->getLeftOperand()->accept(this);
+		auto context = _createContext(expr);
+
+		// Operations in the chain share the first token with the outermost one
+		std::vector<T*> operations;
+		std::vector<TokenStreamContext> contexts;
+		Expression* innermostLeft = expr->getLeftOperand().get();
+		while (innermostLeft->getKind() == expr->getKind())
+		{
+			auto operation = static_cast<T*>(innermostLeft);
+			if (operation->getTokenStream() == expr->getTokenStream())
+				contexts.emplace_back(operation->getTokenStreamSharedPtr(), context.oldBeforeFirst(), std::next(operation->getLastTokenIt()));
+			else
+				contexts.emplace_back(operation);
+			operations.push_back(operation);
+			innermostLeft = operation->getLeftOperand().get();
+		}
+
+		ResumedOperationGuard guard{_resumedOperation};
+		const auto& innermostContext = contexts.empty() ? context : contexts.back();
+		_knownBounds = {innermostLeft, innermostContext.oldTokenStream().get(), innermostContext.oldBeforeFirst(), std::nullopt};
+		auto leftOperand = innermostLeft->accept(this);
+		auto leftFirstToken = std::exchange(_knownFirstToken, {});
+		for (std::size_t i = operations.size(); i-- > 0; )
+		{
+			ResumedOperation resumed{operations[i], contexts[i], std::move(leftOperand), leftFirstToken};
+			_knownBounds = {};
+			_resumedOperation = &resumed;
+			auto result = operations[i]->accept(this);
+			_resumedOperation = nullptr;
+			leftOperand = std::move(result);
+			leftFirstToken = std::exchange(_knownFirstToken, {});
+		}
+
+		return _finishBinaryOperation(expr, context, leftOperand, leftFirstToken);
+	}
+
+	/**
+	 * Visits the right operand of the operation whose left operand has already been visited
+	 * and handles the results of both visits.
+	 */
+	template <typename T>
+	VisitResult _finishBinaryOperation(T* expr, const TokenStreamContext& context, const VisitResult& leftOperand, KnownFirstToken leftFirstToken)
+	{
+		_knownBounds = {expr->getRightOperand().get(), expr->getTokenStream(), std::nullopt, context.oldAfterLast()};
 		auto rightOperand = expr->getRightOperand()->accept(this);
-		return defaultHandler(context, expr, leftOperand, rightOperand);
+		_knownBounds = {};
+
+		_knownFirstToken = leftFirstToken;
+		auto result = defaultHandler(context, expr, leftOperand, rightOperand);
+		_knownFirstToken = {};
+
+		// Remember where the result starts so the parent operation does not need to search for it
+		if (auto newExpr = std::get_if<Expression::Ptr>(&result))
+		{
+			if (*newExpr)
+				_knownFirstToken = {newExpr->get(), (*newExpr)->getTokenStream(), std::next(context.oldBeforeFirst())};
+			else if (leftFirstToken.expr && leftFirstToken.expr == expr->getLeftOperand().get())
+				_knownFirstToken = {expr, expr->getTokenStream(), leftFirstToken.token};
+		}
+
+		return result;
 	}
+
+	/**
+	 * Operation in a chain whose left operand has already been visited.
+	 */
+	struct ResumedOperation
+	{
+		const Expression* expr; ///< Operation
+		const TokenStreamContext& context; ///< Context of the operation
+		VisitResult leftOperand; ///< Result of the visit of the left operand
+		KnownFirstToken leftFirstToken; ///< First token of the left operand if it is known
+	};
+
+	/**
+	 * Restores the operation which was being resumed before a nested chain of operations was visited.
+	 */
+	struct ResumedOperationGuard
+	{
+		ResumedOperationGuard(ResumedOperation*& resumed) : resumed(resumed), outer(std::exchange(resumed, nullptr)) {}
+		~ResumedOperationGuard() { resumed = outer; }
+
+		ResumedOperation*& resumed;
+		ResumedOperation* outer;
+	};
+
+	KnownBounds _knownBounds; ///< Bounds of the expression which is about to be visited
+	KnownFirstToken _knownFirstToken; ///< First token of the expression returned from the last visit of an operation
+	ResumedOperation* _resumedOperation = nullptr; ///< Operation whose left operand has already been visited
 };
 
 } // namespace yaramod
@@ -6,6 +6,9 @@
 
 #pragma once
 
+#include <utility>
+#include <vector>
+
 #include "yaramod/types/expressions.h"
 #include "yaramod/types/regexp.h"
 #include "yaramod/utils/visitor.h"
@@ -19,6 +22,11 @@ namespace yaramod {
  * used to pass around information when collecting data, not directly for modification
  * of AST. If you implement all the logic of modification youself, you can do that but there
  * is no reason to do it on your own and not use ModifyingVisitor.
+ *
+ * Chains of binary operations of the same kind, like `a or b or c`, are visited in a loop
+ * instead of recursively. Overriding visit() methods of the operations in the chain are
+ * called from the innermost operation to the outermost one, each after the left operand
+ * has been visited, so calling the default visit() method from them visits only the right operand.
  */
 class ObservingVisitor : public Visitor
 {
@@ -86,142 +94,102 @@ public:
 
 	virtual VisitResult visit(AndExpression* expr) override
 	{
-		expr->getLeftOperand()->accept(this);
-		expr->getRightOperand()->accept(this);
-		return {};
+		return _handleBinaryOperation(expr);
 	}
 
 	virtual VisitResult visit(OrExpression* expr) override
 	{
-		expr->getLeftOperand()->accept(this);
-		expr->getRightOperand()->accept(this);
-		return {};
+		return _handleBinaryOperation(expr);
 	}
 
 	virtual VisitResult visit(LtExpression* expr) override
 	{
-		expr->getLeftOperand()->accept(this);
-		expr->getRightOperand()->accept(this);
-		return {};
+		return _handleBinaryOperation(expr);
 	}
 
 	virtual VisitResult visit(GtExpression* expr) override
 	{
-		expr->getLeftOperand()->accept(this);
-		expr->getRightOperand()->accept(this);
-		return {};
+		return _handleBinaryOperation(expr);
 	}
 
 	virtual VisitResult visit(LeExpression* expr) override
 	{
-		expr->getLeftOperand()->accept(this);
-		expr->getRightOperand()->accept(this);
-		return {};
+		return _handleBinaryOperation(expr);
 	}
 
 	virtual VisitResult visit(GeExpression* expr) override
 	{
-		expr->getLeftOperand()->accept(this);
-		expr->getRightOperand()->accept(this);
-		return {};
+		return _handleBinaryOperation(expr);
 	}
 
 	virtual VisitResult visit(EqExpression* expr) override
 	{
-		expr->getLeftOperand()->accept(this);
-		expr->getRightOperand()->accept(this);
-		return {};
+		return _handleBinaryOperation(expr);
 	}
 
 	virtual VisitResult visit(NeqExpression* expr) override
 	{
-		expr->getLeftOperand()->accept(this);
-		expr->getRightOperand()->accept(this);
-		return {};
+		return _handleBinaryOperation(expr);
 	}
 
 	virtual VisitResult visit(ContainsExpression* expr) override
 	{
-		expr->getLeftOperand()->accept(this);
-		expr->getRightOperand()->accept(this);
-		return {};
+		return _handleBinaryOperation(expr);
 	}
 
 	virtual VisitResult visit(MatchesExpression* expr) override
 	{
-		expr->getLeftOperand()->accept(this);
-		expr->getRightOperand()->accept(this);
-		return {};
+		return _handleBinaryOperation(expr);
 	}
 
 	virtual VisitResult visit(PlusExpression* expr) override
 	{
-		expr->getLeftOperand()->accept(this);
-		expr->getRightOperand()->accept(this);
-		return {};
+		return _handleBinaryOperation(expr);
 	}
 
 	virtual VisitResult visit(MinusExpression* expr) override
 	{
-		expr->getLeftOperand()->accept(this);
-		expr->getRightOperand()->accept(this);
-		return {};
+		return _handleBinaryOperation(expr);
 	}
 
 	virtual VisitResult visit(MultiplyExpression* expr) override
 	{
-		expr->getLeftOperand()->accept(this);
-		expr->getRightOperand()->accept(this);
-		return {};
+		return _handleBinaryOperation(expr);
 	}
 
 	virtual VisitResult visit(DivideExpression* expr) override
 	{
-		expr->getLeftOperand()->accept(this);
-		expr->getRightOperand()->accept(this);
-		return {};
+		return _handleBinaryOperation(expr);
 	}
 
 	virtual VisitResult visit(ModuloExpression* expr) override
 	{
-		expr->getLeftOperand()->accept(this);
-		expr->getRightOperand()->accept(this);
-		return {};
+		return _handleBinaryOperation(expr);
 	}
 
 	virtual VisitResult visit(BitwiseXorExpression* expr) override
 	{
-		expr->getLeftOperand()->accept(this);
-		expr->getRightOperand()->accept(this);
-		return {};
+		return _handleBinaryOperation(expr);
 	}
 
 	virtual VisitResult visit(BitwiseAndExpression* expr) override
 	{
-		expr->getLeftOperand()->accept(this);
-		expr->getRightOperand()->accept(this);
-		return {};
+		return _handleBinaryOperation(expr);
 	}
 
 	virtual VisitResult visit(BitwiseOrExpression* expr) override
 	{
-		expr->getLeftOperand()->accept(this);
-		expr->getRightOperand()->accept(this);
-		return {};
+		return _handleBinaryOperation(expr);
 	}
 
 	virtual VisitResult visit(ShiftLeftExpression* expr) override
 	{
-		expr->getLeftOperand()->accept(this);
-		expr->getRightOperand()->accept(this);
-		return {};
+		return _handleBinaryOperation(expr);
 	}
 
 	virtual VisitResult visit(ShiftRightExpression* expr) override
 	{
-		expr->getLeftOperand()->accept(this);
-		expr->getRightOperand()->accept(this);
-		return {};
+		return _handleBinaryOperation(expr);
 	}
 
 	virtual VisitResult visit(ForDictExpression* expr) override
@@ -326,6 +294,60 @@ public:
 
 protected:
 	ObservingVisitor() = default;
+
+private:
+	/**
+	 * Restores the operation which was being resumed before a nested chain of operations was visited.
+	 */
+	struct ResumedOperationGuard
+	{
+		ResumedOperationGuard(const Expression*& resumed) : resumed(resumed), outer(std::exchange(resumed, nullptr)) {}
+		~ResumedOperationGuard() { resumed = outer; }
+
+		const Expression*& resumed;
+		const Expression* outer;
+	};
+
+	/**
+	 * Visits operands of the operation. Chain `a or b or c` is parsed as `(a or b) or c` so long chains
+	 * would make the recursion as deep as the chain is long. Operations of the same kind are therefore
+	 * collected through left operands and visited from the innermost one to the outermost one in a loop.
+	 * Each of them is still visited through accept() so overriding visit() methods are called for it,
+	 * but its left operand has already been visited at that point and calling this default visit()
+	 * method from the override visits only the right operand.
+	 */
+	template <typename T>
+	VisitResult _handleBinaryOperation(T* expr)
+	{
+		if (_resumedOperation == expr)
+		{
+			_resumedOperation = nullptr;
+			expr->getRightOperand()->accept(this);
+			return {};
+		}
+
+		std::vector<BinaryOpExpression*> operations;
+		Expression* innermostLeft = expr->getLeftOperand().get();
+		while (innermostLeft->getKind() == expr->getKind())
+		{
+			operations.push_back(static_cast<BinaryOpExpression*>(innermostLeft));
+			innermostLeft = operations.back()->getLeftOperand().get();
+		}
+
+		ResumedOperationGuard guard{_resumedOperation};
+		innermostLeft->accept(this);
+		for (auto itr = operations.rbegin(), end = operations.rend(); itr != end; ++itr)
+		{
+			_resumedOperation = *itr;
+			(*itr)->accept(this);
+			_resumedOperation = nullptr;
+		}
+
+		expr->getRightOperand()->accept(this);
+		return {};
+	}
+
+	const Expression* _resumedOperation = nullptr; ///< Operation whose left operand has already been visited
 };
 
 /**
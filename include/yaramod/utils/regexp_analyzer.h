@@ -0,0 +1,97 @@
+/**
+ * @file src/utils/regexp_analyzer.h
+ * @brief Declaration of analysis of complexity of regular expressions.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "yaramod/types/regexp.h"
+#include "yaramod/types/yara_file.h"
+
+namespace yaramod {
+
+/**
+ * Analyzer of regular expressions which finds constructs that are expensive
+ * to compile or match for the regular expression engine of YARA.
+ *
+ * The analysis estimates the size of the automaton, where counted ranges like `a{2,5}`
+ * are unrolled the same way as YARA does, computes the longest literal which has to be
+ * present in every match and reports these issues:
+ *
+ * - Unbounded repetition which can match the same character as what follows it, like `.*a` or `\w+\d`.
+ * - Unbounded repetition of expression which already contains unbounded repetition, like `(a+)*`.
+ * - Unbounded repetition of alternatives which can start with the same character, like `(a|ab)*`.
+ * - Counted range with bound greater than the configured limit, like `a{1,1000}`.
+ * - Automaton with more states than the configured limit.
+ * - Some alternative has no literal with the configured minimal length, so YARA has no good atom for it.
+ *   Alternatives like `(abc|def)` are fine since YARA chooses atoms for each of them.
+ */
+class RegexpAnalyzer
+{
+public:
+	/**
+	 * Issue found in regular expression.
+	 */
+	struct Issue
+	{
+		enum class Kind
+		{
+			AmbiguousRepetition,
+			NestedRepetition,
+			AmbiguousAlternation,
+			LargeRange,
+			LargeAutomaton,
+			MissingLiteral
+		};
+
+		Kind kind;
+		std::string unit; ///< Text of the part of regular expression with the issue
+		std::string message;
+	};
+
+	/**
+	 * Result of analysis of a single regular expression.
+	 */
+	struct Report
+	{
+		std::string rule; ///< Name of the rule
+		std::string string; ///< Identifier of the string, empty for regular expressions in condition
+		std::string text; ///< Text of the regular expression
+		std::uint64_t automatonSize = 0; ///< Estimated number of states of the automaton
+		std::string requiredLiteral; ///< Longest sequence of bytes present in every match
+		std::vector<Issue> issues;
+	};
+
+	/// @name Analysis methods
+	/// @{
+	Report analyze(const Regexp& regexp, bool nocase = false) const;
+	std::vector<Report> analyze(const Rule& rule) const;
+	std::vector<Report> analyze(const YaraFile& file) const;
+	/// @}
+
+	/// @name Getter methods
+	/// @{
+	std::uint64_t getMaxRange() const { return _maxRange; }
+	std::uint64_t getMaxAutomatonSize() const { return _maxAutomatonSize; }
+	std::size_t getMinLiteralLength() const { return _minLiteralLength; }
+	/// @}
+
+	/// @name Setter methods
+	/// @{
+	void setMaxRange(std::uint64_t maxRange) { _maxRange = maxRange; }
+	void setMaxAutomatonSize(std::uint64_t maxAutomatonSize) { _maxAutomatonSize = maxAutomatonSize; }
+	void setMinLiteralLength(std::size_t minLiteralLength) { _minLiteralLength = minLiteralLength; }
+	/// @}
+
+private:
+	std::uint64_t _maxRange = 256; ///< Maximal bound of counted range which is not reported
+	std::uint64_t _maxAutomatonSize = 10000; ///< Maximal number of states of automaton which is not reported
+	std::size_t _minLiteralLength = 3; ///< Minimal length of required literal which is not reported
+};
+
+}
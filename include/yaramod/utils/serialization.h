@@ -0,0 +1,30 @@
+/**
+ * @file src/utils/serialization.h
+ * @brief Declaration of binary serialization of YARA files and rules.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "yaramod/types/yara_file.h"
+
+namespace yaramod {
+
+/// @name Serialization
+/// @{
+std::string serialize(const YaraFile& file);
+std::string serialize(const Rule& rule, Features features = Features::AllCurrent);
+/// @}
+
+/// @name Deserialization
+/// @{
+std::unique_ptr<YaraFile> deserializeYaraFile(std::string_view data);
+std::unique_ptr<YaraFile> deserializeYaraFile(std::string_view data, Features features);
+std::shared_ptr<Rule> deserializeRule(std::string_view data);
+/// @}
+
+}
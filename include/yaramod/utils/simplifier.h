@@ -0,0 +1,86 @@
+/**
+ * @file src/utils/simplifier.h
+ * @brief Declaration of simplification of conditions.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+
+#include "yaramod/types/yara_file.h"
+#include "yaramod/utils/modifying_visitor.h"
+
+namespace yaramod {
+
+/**
+ * Modifying visitor which simplifies conditions without changing their meaning.
+ *
+ * - Integer arithmetic, bitwise operations and shifts with constant operands are folded.
+ *   Operations which YARA refuses to compile, like overflowing `+`, `-` and `*` or division
+ *   by zero, and operations with undefined result, like shift by negative number, are kept.
+ *   Literals with `KB` and `MB` multipliers are never folded because yaramod stores their values
+ *   multiplied by 1000 and 1000000 while YARA multiplies them by 1024 and 1048576.
+ * - Comparisons of integer constants are replaced with `true` or `false`.
+ * - `true` and `false` are removed from `and` and `or`, chains containing `false` in `and`
+ *   or `true` in `or` are replaced with the constant, `not` of constant is folded and double
+ *   negation of boolean expression is removed.
+ * - Repeated operands of `and` and `or` are removed.
+ * - Parentheses around expressions which bind tighter than any operator, around the whole condition
+ *   and around operands of `and` and `or` unless they enclose another `and` or `or` are removed.
+ *
+ * Tokens of expressions which stay in the condition are kept in the token stream together
+ * with their formatting, only removed and folded parts are rewritten.
+ */
+class Simplifier : public ModifyingVisitor
+{
+public:
+	/// @name Simplification methods
+	/// @{
+	bool simplify(Rule& rule);
+	std::size_t simplify(YaraFile& file);
+	/// @}
+
+	/// @name Visit methods
+	/// @{
+	virtual VisitResult visit(NotExpression* expr) override;
+	virtual VisitResult visit(UnaryMinusExpression* expr) override;
+	virtual VisitResult visit(BitwiseNotExpression* expr) override;
+	virtual VisitResult visit(AndExpression* expr) override;
+	virtual VisitResult visit(OrExpression* expr) override;
+	virtual VisitResult visit(LtExpression* expr) override;
+	virtual VisitResult visit(GtExpression* expr) override;
+	virtual VisitResult visit(LeExpression* expr) override;
+	virtual VisitResult visit(GeExpression* expr) override;
+	virtual VisitResult visit(EqExpression* expr) override;
+	virtual VisitResult visit(NeqExpression* expr) override;
+	virtual VisitResult visit(PlusExpression* expr) override;
+	virtual VisitResult visit(MinusExpression* expr) override;
+	virtual VisitResult visit(MultiplyExpression* expr) override;
+	virtual VisitResult visit(DivideExpression* expr) override;
+	virtual VisitResult visit(ModuloExpression* expr) override;
+	virtual VisitResult visit(BitwiseXorExpression* expr) override;
+	virtual VisitResult visit(BitwiseAndExpression* expr) override;
+	virtual VisitResult visit(BitwiseOrExpression* expr) override;
+	virtual VisitResult visit(ShiftLeftExpression* expr) override;
+	virtual VisitResult visit(ShiftRightExpression* expr) override;
+	virtual VisitResult visit(ParenthesesExpression* expr) override;
+	/// @}
+
+private:
+	template <typename T, typename Op>
+	VisitResult foldInteger(T* expr, Op&& op);
+	template <typename T, typename Op>
+	VisitResult foldComparison(T* expr, Op&& op);
+
+	VisitResult simplifyChain(BinaryOpExpression* expr);
+	Expression::Ptr replaceWith(Expression* expr, const YaraExpressionBuilder& builder);
+	Expression::Ptr replaceWithOperand(Expression* expr, const Expression::Ptr& operand);
+
+	static std::optional<std::int64_t> getConstant(const Expression* expr);
+
+	bool _simplified = false; ///< Whether anything was simplified during the current simplification
+};
+
+}
@@ -0,0 +1,89 @@
+/**
+ * @file src/utils/static_visitor.h
+ * @brief Declaration of StaticVisitor class.
+ * @copyright (c) 2017 Avast Software, licensed under the MIT license
+ */
+
+#pragma once
+
+#include "yaramod/types/expressions.h"
+#include "yaramod/utils/traversal.h"
+
+namespace yaramod {
+
+/**
+ * Class representing observing visitor of condition expression in YARA files
+ * with visit() methods resolved at compile time. It is the counterpart of ObservingVisitor
+ * for traversals which are performance critical. Expressions are dispatched by switch over
+ * Expression::Kind instead of virtual Expression::accept() and Visitor::visit() methods so
+ * compiler is able to inline whole traversal.
+ *
+ * Visitor is implemented using CRTP. Derived class hides the visit() methods it is interested in
+ * and brings the rest in by using declaration. Hidden visit() methods need to call the visit()
+ * method of StaticVisitor explicitly to continue traversal into subexpressions.
+ *
+ * @code
+ * class AndCounter : public StaticVisitor<AndCounter>
+ * {
+ * public:
+ *     using StaticVisitor<AndCounter>::visit;
+ *
+ *     void visit(AndExpression* expr)
+ *     {
+ *         count++;
+ *         StaticVisitor<AndCounter>::visit(expr);
+ *     }
+ *
+ *     std::size_t count = 0;
+ * };
+ * @endcode
+ */
+template <typename Derived>
+class StaticVisitor
+{
+public:
+	/**
+	 * Observes the specified expression.
+	 */
+	void observe(const Expression::Ptr& expr)
+	{
+		dispatch(expr.get());
+	}
+
+	/**
+	 * Calls visit() method of the derived class for the class of the expression.
+	 *
+	 * @param expr Expression to visit.
+	 */
+	void dispatch(Expression* expr)
+	{
+		dispatchByKind(expr, [this](auto* concrete) { derived().visit(concrete); });
+	}
+
+	void dispatch(const Expression::Ptr& expr)
+	{
+		dispatch(expr.get());
+	}
+
+	/// @name Visit methods
+	/// @{
+	/**
+	 * Visits subexpressions of the expression.
+	 *
+	 * @param expr Expression of any class.
+	 */
+	template <typename T>
+	void visit(T* expr)
+	{
+		forEachSubexpression(expr, [this](const Expression::Ptr& subexpr) { dispatch(subexpr); });
+	}
+	/// @}
+
+protected:
+	StaticVisitor() = default;
+
+private:
+	Derived& derived() { return *static_cast<Derived*>(this); }
+};
+
+}
@@ -0,0 +1,109 @@
+/**
+ * @file src/utils/string_index.h
+ * @brief Declaration of index of duplicate strings.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "yaramod/types/yara_file.h"
+
+namespace yaramod {
+
+/**
+ * Index of strings of one or more YARA files which finds strings looking for the same
+ * bytes even though they have different identifiers, modifiers or formatting.
+ *
+ * Every string is normalized into a set of byte sequences with masks, one for each
+ * sequence of bytes it can match. Plain strings have a sequence for `ascii` and for `wide`
+ * and letters in `nocase` strings are masked so they match in both cases, so `"AbC" nocase`
+ * is the same as `"abc" nocase ascii`. Hex strings with nibble wildcards and fixed jumps are
+ * masked the same way and their alternatives are expanded. Hex strings with variable jumps,
+ * hex strings with too many alternatives and regular expressions are compared by their text.
+ * Modifiers `xor`, `base64`, `base64wide` and `fullword` have to be the same, `private` is ignored.
+ *
+ * Normalization and hashing run in parallel, so the index can process millions of strings.
+ */
+class StringIndex
+{
+public:
+	/**
+	 * Identification of a single string in the index.
+	 */
+	struct StringReference
+	{
+		std::size_t file; ///< Index of the file in order of addition
+		std::string rule; ///< Name of the rule
+		std::string string; ///< Identifier of the string
+	};
+
+	/**
+	 * Pair of strings where the inner one is matched everywhere where the outer one is.
+	 */
+	struct Containment
+	{
+		StringReference outer;
+		StringReference inner;
+	};
+
+	/// @name Addition methods
+	/// @{
+	std::size_t add(const YaraFile& file);
+	/// @}
+
+	/// @name Detection methods
+	/// @{
+	std::vector<std::vector<StringReference>> findDuplicates() const;
+	std::vector<Containment> findContainments() const;
+	/// @}
+
+	/// @name Getter methods
+	/// @{
+	std::size_t getStringsCount() const { return _entries.size(); }
+	std::size_t getThreads() const { return _threads; }
+	/// @}
+
+	/// @name Setter methods
+	/// @{
+	void setThreads(std::size_t threads) { _threads = threads; }
+	/// @}
+
+private:
+	/**
+	 * Sequence of bytes with masks, bytes are already masked.
+	 */
+	struct Form
+	{
+		std::vector<std::uint8_t> bytes;
+		std::vector<std::uint8_t> masks;
+
+		bool operator==(const Form& other) const { return bytes == other.bytes && masks == other.masks; }
+		bool operator<(const Form& other) const { return bytes < other.bytes || (bytes == other.bytes && masks < other.masks); }
+	};
+
+	/**
+	 * Normalized string.
+	 */
+	struct Entry
+	{
+		StringReference reference;
+		std::string key; ///< Modifiers which have to be the same, text of strings which are not normalized into forms
+		std::vector<Form> forms; ///< Sorted forms, empty if the string is compared only by its key
+		std::uint64_t hash = 0;
+		bool containable = false; ///< Whether the string can be checked for containment
+
+		bool operator==(const Entry& other) const { return hash == other.hash && key == other.key && forms == other.forms; }
+	};
+
+	std::vector<std::size_t> findRepresentatives() const;
+
+	std::vector<Entry> _entries; ///< Entries of all strings in order of addition
+	std::size_t _files = 0; ///< Number of added files
+	std::size_t _threads = 0; ///< Number of threads, 0 means the number of hardware threads
+};
+
+}
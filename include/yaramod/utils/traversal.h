@@ -0,0 +1,251 @@
+/**
+ * @file src/utils/traversal.h
+ * @brief Declaration of functions for traversal of expressions.
+ * @copyright (c) 2017 Avast Software, licensed under the MIT license
+ */
+
+#pragma once
+
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "yaramod/types/expressions.h"
+#include "yaramod/yaramod_error.h"
+
+namespace yaramod {
+
+/**
+ * Calls @p fn with the expression cast to its class determined by Expression::getKind().
+ *
+ * @param expr Expression.
+ * @param fn Callable accepting pointer to any class of expression.
+ *
+ * @return Value returned from @p fn.
+ */
+template <typename Fn>
+decltype(auto) dispatchByKind(Expression* expr, Fn&& fn)
+{
+	switch (expr->getKind())
+	{
+		case Expression::Kind::String: return fn(static_cast<StringExpression*>(expr));
+		case Expression::Kind::StringWildcard: return fn(static_cast<StringWildcardExpression*>(expr));
+		case Expression::Kind::StringAt: return fn(static_cast<StringAtExpression*>(expr));
+		case Expression::Kind::StringInRange: return fn(static_cast<StringInRangeExpression*>(expr));
+		case Expression::Kind::StringCount: return fn(static_cast<StringCountExpression*>(expr));
+		case Expression::Kind::StringOffset: return fn(static_cast<StringOffsetExpression*>(expr));
+		case Expression::Kind::StringLength: return fn(static_cast<StringLengthExpression*>(expr));
+		case Expression::Kind::Not: return fn(static_cast<NotExpression*>(expr));
+		case Expression::Kind::UnaryMinus: return fn(static_cast<UnaryMinusExpression*>(expr));
+		case Expression::Kind::BitwiseNot: return fn(static_cast<BitwiseNotExpression*>(expr));
+		case Expression::Kind::And: return fn(static_cast<AndExpression*>(expr));
+		case Expression::Kind::Or: return fn(static_cast<OrExpression*>(expr));
+		case Expression::Kind::Lt: return fn(static_cast<LtExpression*>(expr));
+		case Expression::Kind::Gt: return fn(static_cast<GtExpression*>(expr));
+		case Expression::Kind::Le: return fn(static_cast<LeExpression*>(expr));
+		case Expression::Kind::Ge: return fn(static_cast<GeExpression*>(expr));
+		case Expression::Kind::Eq: return fn(static_cast<EqExpression*>(expr));
+		case Expression::Kind::Neq: return fn(static_cast<NeqExpression*>(expr));
+		case Expression::Kind::Contains: return fn(static_cast<ContainsExpression*>(expr));
+		case Expression::Kind::Matches: return fn(static_cast<MatchesExpression*>(expr));
+		case Expression::Kind::Plus: return fn(static_cast<PlusExpression*>(expr));
+		case Expression::Kind::Minus: return fn(static_cast<MinusExpression*>(expr));
+		case Expression::Kind::Multiply: return fn(static_cast<MultiplyExpression*>(expr));
+		case Expression::Kind::Divide: return fn(static_cast<DivideExpression*>(expr));
+		case Expression::Kind::Modulo: return fn(static_cast<ModuloExpression*>(expr));
+		case Expression::Kind::BitwiseXor: return fn(static_cast<BitwiseXorExpression*>(expr));
+		case Expression::Kind::BitwiseAnd: return fn(static_cast<BitwiseAndExpression*>(expr));
+		case Expression::Kind::BitwiseOr: return fn(static_cast<BitwiseOrExpression*>(expr));
+		case Expression::Kind::ShiftLeft: return fn(static_cast<ShiftLeftExpression*>(expr));
+		case Expression::Kind::ShiftRight: return fn(static_cast<ShiftRightExpression*>(expr));
+		case Expression::Kind::ForDict: return fn(static_cast<ForDictExpression*>(expr));
+		case Expression::Kind::ForArray: return fn(static_cast<ForArrayExpression*>(expr));
+		case Expression::Kind::ForString: return fn(static_cast<ForStringExpression*>(expr));
+		case Expression::Kind::Of: return fn(static_cast<OfExpression*>(expr));
+		case Expression::Kind::Iterable: return fn(static_cast<IterableExpression*>(expr));
+		case Expression::Kind::Set: return fn(static_cast<SetExpression*>(expr));
+		case Expression::Kind::Range: return fn(static_cast<RangeExpression*>(expr));
+		case Expression::Kind::Id: return fn(static_cast<IdExpression*>(expr));
+		case Expression::Kind::StructAccess: return fn(static_cast<StructAccessExpression*>(expr));
+		case Expression::Kind::ArrayAccess: return fn(static_cast<ArrayAccessExpression*>(expr));
+		case Expression::Kind::FunctionCall: return fn(static_cast<FunctionCallExpression*>(expr));
+		case Expression::Kind::BoolLiteral: return fn(static_cast<BoolLiteralExpression*>(expr));
+		case Expression::Kind::StringLiteral: return fn(static_cast<StringLiteralExpression*>(expr));
+		case Expression::Kind::IntLiteral: return fn(static_cast<IntLiteralExpression*>(expr));
+		case Expression::Kind::DoubleLiteral: return fn(static_cast<DoubleLiteralExpression*>(expr));
+		case Expression::Kind::Filesize: return fn(static_cast<FilesizeExpression*>(expr));
+		case Expression::Kind::Entrypoint: return fn(static_cast<EntrypointExpression*>(expr));
+		case Expression::Kind::All: return fn(static_cast<AllExpression*>(expr));
+		case Expression::Kind::Any: return fn(static_cast<AnyExpression*>(expr));
+		case Expression::Kind::Them: return fn(static_cast<ThemExpression*>(expr));
+		case Expression::Kind::Parentheses: return fn(static_cast<ParenthesesExpression*>(expr));
+		case Expression::Kind::IntFunction: return fn(static_cast<IntFunctionExpression*>(expr));
+		case Expression::Kind::Regexp: return fn(static_cast<RegexpExpression*>(expr));
+		default:
+			throw YaramodError("Error: Expression of unknown kind can not be dispatched");
+	}
+}
+
+/**
+ * Calls @p fn for each direct subexpression of the expression in the order
+ * in which they appear in the condition. Subexpressions which are not present,
+ * like index of `@str`, are skipped.
+ *
+ * @param expr Expression, either of its exact class or just `Expression`.
+ * @param fn Callable accepting `const Expression::Ptr&`.
+ */
+template <typename T, typename Fn>
+void forEachSubexpression(T* expr, Fn&& fn)
+{
+	auto call = [&](const Expression::Ptr& subexpr) {
+		if (subexpr)
+			fn(subexpr);
+	};
+
+	if constexpr (std::is_same_v<T, Expression>)
+		dispatchByKind(expr, [&](auto* concrete) { forEachSubexpression(concrete, fn); });
+	else if constexpr (std::is_same_v<T, StringAtExpression>)
+		call(expr->getAtExpression());
+	else if constexpr (std::is_same_v<T, StringInRangeExpression>)
+		call(expr->getRangeExpression());
+	else if constexpr (std::is_same_v<T, StringOffsetExpression> || std::is_same_v<T, StringLengthExpression>)
+		call(expr->getIndexExpression());
+	else if constexpr (std::is_base_of_v<UnaryOpExpression, T>)
+		call(expr->getOperand());
+	else if constexpr (std::is_base_of_v<BinaryOpExpression, T>)
+	{
+		call(expr->getLeftOperand());
+		call(expr->getRightOperand());
+	}
+	else if constexpr (std::is_base_of_v<ForExpression, T>)
+	{
+		call(expr->getVariable());
+		call(expr->getIterable());
+		call(expr->getBody());
+	}
+	else if constexpr (std::is_same_v<T, IterableExpression> || std::is_same_v<T, SetExpression>)
+	{
+		for (const auto& element : expr->getElements())
+			call(element);
+	}
+	else if constexpr (std::is_same_v<T, RangeExpression>)
+	{
+		call(expr->getLow());
+		call(expr->getHigh());
+	}
+	else if constexpr (std::is_same_v<T, StructAccessExpression>)
+		call(expr->getStructure());
+	else if constexpr (std::is_same_v<T, ArrayAccessExpression>)
+	{
+		call(expr->getArray());
+		call(expr->getAccessor());
+	}
+	else if constexpr (std::is_same_v<T, FunctionCallExpression>)
+	{
+		call(expr->getFunction());
+		for (const auto& arg : expr->getArguments())
+			call(arg);
+	}
+	else if constexpr (std::is_same_v<T, ParenthesesExpression>)
+		call(expr->getEnclosedExpression());
+	else if constexpr (std::is_same_v<T, IntFunctionExpression>)
+		call(expr->getArgument());
+}
+
+/**
+ * Traverses the expression and all its subexpressions in depth-first order using explicit
+ * stack instead of recursion, so even conditions nested millions of levels deep can be traversed.
+ * @p pre is called when the expression is entered and if it returns @c false, subexpressions
+ * of the expression are skipped. @p post is called when the expression is left after all
+ * its subexpressions were traversed. It is called even if the subexpressions were skipped.
+ *
+ * @param root Expression to traverse.
+ * @param pre Callable accepting `Expression*` and returning `bool`.
+ * @param post Callable accepting `Expression*`.
+ */
+template <typename Pre, typename Post>
+void traverse(Expression* root, Pre&& pre, Post&& post)
+{
+	// Each expression is pushed twice, once to be entered and once to be left
+	std::vector<std::pair<Expression*, bool>> stack{{root, false}};
+	std::vector<Expression*> subexpressions;
+	while (!stack.empty())
+	{
+		auto [expr, entered] = stack.back();
+		stack.pop_back();
+		if (entered)
+		{
+			post(expr);
+			continue;
+		}
+
+		stack.emplace_back(expr, true);
+		if (!pre(expr))
+			continue;
+
+		subexpressions.clear();
+		forEachSubexpression(expr, [&](const Expression::Ptr& subexpr) { subexpressions.push_back(subexpr.get()); });
+		for (auto itr = subexpressions.rbegin(), end = subexpressions.rend(); itr != end; ++itr)
+			stack.emplace_back(*itr, false);
+	}
+}
+
+template <typename Pre, typename Post>
+void traverse(const Expression::Ptr& root, Pre&& pre, Post&& post)
+{
+	traverse(root.get(), std::forward<Pre>(pre), std::forward<Post>(post));
+}
+
+/**
+ * Class representing observing visitor of condition expression which traverses it using
+ * explicit stack instead of recursion. Unlike ObservingVisitor and StaticVisitor, the visitor
+ * does not descend into subexpressions on its own in visit() methods. Instead, it gets notified
+ * when it enters and leaves each expression, so there is no limit on depth of the condition.
+ *
+ * Visitor is implemented using CRTP. Derived class hides enter() and leave() methods for classes
+ * of expressions it is interested in and brings the rest in by using declarations. Returning
+ * @c false from enter() skips subexpressions of the expression.
+ *
+ * @code
+ * class DepthMeter : public IterativeVisitor<DepthMeter>
+ * {
+ * public:
+ *     using IterativeVisitor<DepthMeter>::enter;
+ *     using IterativeVisitor<DepthMeter>::leave;
+ *
+ *     bool enter(ParenthesesExpression*) { maxDepth = std::max(maxDepth, ++depth); return true; }
+ *     void leave(ParenthesesExpression*) { --depth; }
+ *
+ *     std::size_t depth = 0, maxDepth = 0;
+ * };
+ * @endcode
+ */
+template <typename Derived>
+class IterativeVisitor
+{
+public:
+	/**
+	 * Observes the specified expression.
+	 */
+	void observe(const Expression::Ptr& expr)
+	{
+		traverse(expr.get(),
+			[this](Expression* e) { return dispatchByKind(e, [this](auto* concrete) -> bool { return derived().enter(concrete); }); },
+			[this](Expression* e) { dispatchByKind(e, [this](auto* concrete) { derived().leave(concrete); }); }
+		);
+	}
+
+	/// @name Hook methods
+	/// @{
+	template <typename T> bool enter(T*) { return true; }
+	template <typename T> void leave(T*) {}
+	/// @}
+
+protected:
+	IterativeVisitor() = default;
+
+private:
+	Derived& derived() { return *static_cast<Derived*>(this); }
+};
+
+}
@@ -343,6 +343,18 @@ public:
 		return result;
 	}
 
+	/**
+	 * Returns the value at the specified position in the order of insertion.
+	 *
+	 * @param index Position of the value, needs to be less than size().
+	 *
+	 * @return Value.
+	 */
+	const ValueType& getValueAt(std::size_t index) const
+	{
+		return *_values[index];
+	}
+
 	/**
 	 * Returns set values with the specified prefix ordered according to their key alphabetical order.
 	 *
@@ -382,6 +394,16 @@ public:
 	{
 		return _nodes.empty();
 	}
+
+	/**
+	 * Returns the number of set values.
+	 *
+	 * @return Number of values.
+	 */
+	std::size_t size() const
+	{
+		return _values.size();
+	}
 	/// @}
 
 private:
@@ -7,14 +7,23 @@
 #pragma once
 
 #include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
 
 namespace yaramod {
 
 bool isValidIdentifier(const std::string& id);
 std::string escapeString(const std::string& str);
 std::string unescapeString(std::string_view str);
+std::optional<std::uint8_t> nibbleToByte(char nibble);
+std::optional<std::uint8_t> decodeRegexpEscape(const std::string& text, std::size_t& i);
+std::vector<std::optional<std::uint8_t>> decodeRegexpText(const std::string& text);
 
 bool endsWith(const std::string& str, const std::string& withWhat);
 bool endsWith(const std::string& str, char withWhat);
@@ -35,8 +44,17 @@ bool startsWith(const std::string& str, const T& withWhat)
 	return str.find(withWhat) == 0;
 }
 
+/**
+ * Determines whether number of type `T` can be converted using `std::from_chars` and `std::to_chars`.
+ * Character types are excluded because streams treat them as characters and not as numbers.
+ */
+template <typename T>
+constexpr bool isCharconvIntegral = std::is_integral_v<T> && !std::is_same_v<T, bool> && sizeof(T) > 1;
+
 /**
  * Converts number to string according to the specified format. Prepends base of number if requested.
+ * Decimal and hexadecimal integers are converted by locale-free `std::to_chars`,
+ * other numbers fall back to `std::ostringstream`.
  *
  * @param num Number to convert.
  * @param format Format to use when converting.
@@ -47,6 +65,49 @@ bool startsWith(const std::string& str, const T& withWhat)
 template <typename T>
 std::string numToStr(const T num, std::ios_base &(*format)(std::ios_base&) = std::dec, bool showbase = false, bool toUpper = false)
 {
+	if constexpr (isCharconvIntegral<T>)
+	{
+		if (format == std::dec || format == std::hex)
+		{
+			// 0x prefix + 64 binary digits + sign is more than enough for any integral type
+			char buffer[2 + 64 + 1];
+			char* first = buffer + 2;
+			std::to_chars_result result;
+			if (format == std::dec)
+				result = std::to_chars(first, std::end(buffer), num);
+			else
+			{
+				// Streams print hexadecimal representation of negative numbers in two's complement
+				result = std::to_chars(first, std::end(buffer), static_cast<std::make_unsigned_t<T>>(num), 16);
+				if (toUpper)
+				{
+					for (auto c = first; c != result.ptr; ++c)
+						*c = static_cast<char>(std::toupper(static_cast<unsigned char>(*c)));
+				}
+				// Streams do not prepend base to zero
+				if (showbase && num != 0)
+				{
+					*--first = toUpper ? 'X' : 'x';
+					*--first = '0';
+				}
+			}
+			return std::string(first, result.ptr);
+		}
+	}
+#if defined(__cpp_lib_to_chars)
+	else if constexpr (std::is_floating_point_v<T>)
+	{
+		if (format == std::dec && !showbase && !toUpper)
+		{
+			// Precision 6 in general format is what streams output by default
+			char buffer[64];
+			auto result = std::to_chars(std::begin(buffer), std::end(buffer), num, std::chars_format::general, 6);
+			if (result.ec == std::errc{})
+				return std::string(std::begin(buffer), result.ptr);
+		}
+	}
+#endif
+
 	std::ostringstream os;
 	if (toUpper)
 		os << std::uppercase;
@@ -59,6 +120,9 @@ std::string numToStr(const T num, std::ios_base &(*format)(std::ios_base&) = std
 
 /**
  * Converts string to number according to the specified format.
+ * Decimal and hexadecimal integers are converted by locale-free `std::from_chars`,
+ * inputs it does not accept (leading whitespace or sign) are handed over to `std::istringstream`
+ * so the accepted syntax stays the same.
  *
  * @param str String to convert.
  * @param[out] num Numeric result.
@@ -67,9 +131,50 @@ std::string numToStr(const T num, std::ios_base &(*format)(std::ios_base&) = std
  * @return `true` if conversion was successful, otherwise `false`.
  */
 template <typename T>
-bool strToNum(const std::string& str, T& num, std::ios_base &(*format)(std::ios_base&) = std::dec)
+bool strToNum(std::string_view str, T& num, std::ios_base &(*format)(std::ios_base&) = std::dec)
 {
-	std::istringstream is(str);
+	if constexpr (isCharconvIntegral<T>)
+	{
+		if (format == std::dec || format == std::hex)
+		{
+			int base = 10;
+			auto digits = str;
+			if (format == std::hex)
+			{
+				base = 16;
+				// Streams accept optional base prefix in hexadecimal format
+				if (digits.size() > 2 && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X'))
+					digits.remove_prefix(2);
+			}
+
+			T tmp = 0;
+			auto last = digits.data() + digits.size();
+			auto [ptr, ec] = std::from_chars(digits.data(), last, tmp, base);
+			if (ec == std::errc{} && ptr == last)
+			{
+				num = tmp;
+				return true;
+			}
+		}
+	}
+#if defined(__cpp_lib_to_chars)
+	else if constexpr (std::is_floating_point_v<T>)
+	{
+		if (format == std::dec)
+		{
+			T tmp = 0;
+			auto last = str.data() + str.size();
+			auto [ptr, ec] = std::from_chars(str.data(), last, tmp);
+			if (ec == std::errc{} && ptr == last)
+			{
+				num = tmp;
+				return true;
+			}
+		}
+	}
+#endif
+
+	std::istringstream is{std::string{str}};
 	T tmp = 0;
 	is >> format >> tmp;
 	if (!is.fail() && is.eof())
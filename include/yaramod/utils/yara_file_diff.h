@@ -0,0 +1,62 @@
+/**
+ * @file src/utils/yara_file_diff.h
+ * @brief Declaration of structural diff of YARA files.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "yaramod/types/yara_file.h"
+
+namespace yaramod {
+
+/**
+ * Change of a single rule between two versions of YARA file.
+ */
+struct RuleChange
+{
+	/**
+	 * Sections of rule which can be changed, combined into bit mask.
+	 */
+	enum Section
+	{
+		None = 0x00,
+		Modifiers = 0x01, // `private` and `global`
+		Tags = 0x02,
+		Metas = 0x04,
+		Strings = 0x08,
+		Condition = 0x10, // Condition and variables
+		All = 0x1F
+	};
+
+	std::optional<std::size_t> oldIndex; ///< Index of the rule in the old file, empty if the rule was added
+	std::optional<std::size_t> newIndex; ///< Index of the rule in the new file, empty if the rule was removed
+	std::string oldName; ///< Name of the rule in the old file, empty if the rule was added
+	std::string newName; ///< Name of the rule in the new file, empty if the rule was removed
+	std::uint32_t sections = None; ///< Changed sections, all of them if the rule was added or removed
+
+	bool isAdded() const { return !oldIndex; }
+	bool isRemoved() const { return !newIndex; }
+	bool isRenamed() const { return oldIndex && newIndex && oldName != newName; }
+	bool isChanged(Section section) const { return sections & section; }
+};
+
+/**
+ * Differences between two versions of YARA file.
+ */
+struct YaraFileDiff
+{
+	std::vector<RuleChange> changes; ///< Removed, changed and renamed rules in order of the old file followed by added rules
+	std::size_t unchangedRules = 0; ///< Number of rules which are the same in both files
+
+	bool empty() const { return changes.empty(); }
+};
+
+YaraFileDiff diff(const YaraFile& oldFile, const YaraFile& newFile);
+
+}
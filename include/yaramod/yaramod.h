@@ -19,6 +19,9 @@
 #define YARA_SYNTAX_VERSION "4.0"
 
 #include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
 
 #include "yaramod/builder/yara_file_builder.h"
 #include "yaramod/parser/parser_driver.h"
@@ -26,6 +29,10 @@
 
 namespace yaramod {
 
+/**
+ * Parser of YARA files. Parsing methods can be called from multiple threads at once
+ * but they parse one input after another. Use parseFiles() to parse files in parallel.
+ */
 class Yaramod
 {
 public:
@@ -33,6 +40,8 @@ public:
 	 * @param ParserMode
 	 * Regular -- regular YARA parser
 	 * IncludeGuarded -- protection against inclusion of the same file multiple times
+	 * Lean -- comments and layout tokens are not stored, getTextFormatted() falls back to getText()
+	 * LazyConditions -- conditions of rules are parsed on their first access
 	 *
 	 * @param features determines iff we want to use aditional Avast-specific symbols or VirusTotal-specific symbols in the imported modules
 	 */
@@ -55,11 +64,37 @@ public:
 	 * @return Valid @c YaraFile instance if parsing succeeded, otherwise @c nullptr.
 	 */
 	std::unique_ptr<YaraFile> parseStream(std::istream& inputStream, ParserMode parserMode = ParserMode::Regular);
+	/**
+	 * Parses input in the memory. Unlike parseStream() with string stream,
+	 * the input does not need to be copied into the stream first.
+	 *
+	 * @param input Input.
+	 * @param parserMode Parsing mode.
+	 *
+	 * @return Valid @c YaraFile instance if parsing succeeded, otherwise @c nullptr.
+	 */
+	std::unique_ptr<YaraFile> parseString(std::string_view input, ParserMode parserMode = ParserMode::Regular);
 
 	const YaraFile& getParsedFile() const;
 
 private:
 	ParserDriver _driver;
+	std::mutex _mutex; ///< Serializes parsing, the parser driver parses only one input at once
 };
 
+/**
+ * Parses files in parallel. Each thread parses files with its own instance of Yaramod,
+ * taking the next unparsed file whenever it finishes the previous one. If parsing of any
+ * file throws, the exception of the first such file is rethrown once all threads finish.
+ *
+ * @param filePaths Paths to the files.
+ * @param threads Number of threads, @c 0 means the number of hardware threads.
+ * @param parserMode Parsing mode.
+ * @param features Features used by parsers.
+ *
+ * @return Parsed files in the order of @p filePaths, @c nullptr for files which failed to parse.
+ */
+std::vector<std::unique_ptr<YaraFile>> parseFiles(const std::vector<std::string>& filePaths, std::size_t threads = 0,
+	ParserMode parserMode = ParserMode::Regular, Features features = Features::AllCurrent);
+
 }
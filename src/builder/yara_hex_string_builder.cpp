@@ -403,6 +403,7 @@ YaraHexStringBuilder alt(const std::vector<YaraHexStringBuilder>& units)
 	hexStrings.reserve(units.size());
 
 	auto ts = std::make_shared<TokenStream>();
+	ts->emplace_back(TokenType::HEX_ALT_LEFT_BRACKET, "(");
 	for (std::size_t i = 0; i < units.size(); ++i)
 	{
 		hexStrings.push_back(units[i].get(ts, false)); //filling up ts while getting the hexStrings
@@ -410,6 +411,7 @@ YaraHexStringBuilder alt(const std::vector<YaraHexStringBuilder>& units)
 			ts->emplace_back(TokenType::HEX_ALT, "|"); // add '|' in between the hexStrings
 		}
 	}
+	ts->emplace_back(TokenType::HEX_ALT_RIGHT_BRACKET, ")");
 	return YaraHexStringBuilder(ts, std::make_shared< HexStringOr >(hexStrings));
 }
 
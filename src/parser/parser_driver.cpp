@@ -4,6 +4,8 @@
  * @copyright (c) 2017 Avast Software, licensed under the MIT license
  */
 
+#include <mutex>
+
 #include "yaramod/parser/parser_driver.h"
 #include "yaramod/types/expressions.h"
 #include "yaramod/types/plain_string.h"
@@ -24,6 +26,47 @@ void error_handle(const Location& location, const std::string& msg)
 	throw ParserError(err.str());
 }
 
+/**
+ * Creates hex string units out of tokens carried by HEX_NIBBLE symbol.
+ * Single HEX_NIBBLE symbol may represent odd-length run of nibbles
+ * so the parity checked by grammar stays the same as with single nibble.
+ */
+void appendHexNibbles(std::vector<std::shared_ptr<HexStringUnit>>& output, std::vector<TokenIt>&& nibbles)
+{
+	for (auto nibble : nibbles)
+		output.push_back(std::make_shared<HexStringNibble>(nibble));
+}
+
+/**
+ * Context retained after parsing in ParserMode::LazyConditions. It stores imports
+ * and rule symbols of the parsed file together with the parser driver which parses
+ * the recorded conditions once they are accessed.
+ */
+class LazyConditionContext
+{
+public:
+	LazyConditionContext(Features features, bool lean) : imports(), rules(), _features(features), _lean(lean), _driver(), _mutex() {}
+
+	Expression::Ptr parse(const Rule& rule, const std::shared_ptr<TokenStream>& tokenStream, const LazyCondition& condition)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (!_driver)
+			_driver = std::make_unique<ParserDriver>(_features);
+		return _driver->parseLazyCondition(rule, tokenStream, condition, *this);
+	}
+
+	std::vector<std::pair<std::size_t, std::string>> imports; ///< Imported modules with the number of rules preceding them
+	std::unordered_map<std::string, std::pair<std::size_t, std::shared_ptr<Symbol>>> rules; ///< Rule symbols with the index of their rule
+
+	bool isLean() const { return _lean; }
+
+private:
+	Features _features; ///< Features of the parser which recorded the conditions
+	bool _lean; ///< Whether the conditions are parsed without comments and layout tokens like the rest of the file
+	std::unique_ptr<ParserDriver> _driver; ///< Driver used for parsing of conditions, created on first use
+	std::mutex _mutex; ///< Guards the driver
+};
+
 template <typename... Args>
 TokenIt ParserDriver::emplace_back(Args&&... args)
 {
@@ -40,21 +83,26 @@ void ParserDriver::defineTokens()
 	});
 
 	_parser.token("\r\n").action([&](std::string_view) -> Value {
+		currentFileContext()->getLocation().addLine();
+		if (isLean())
+			return {};
 		currentFileContext()->getTokenStream()->setNewLineChar("\r\n");
 		TokenIt t = emplace_back(TokenType::NEW_LINE, "\r\n");
 		_indent.clear();
-		currentFileContext()->getLocation().addLine();
 		return t;
 	});
 	_parser.token("\n").action([&](std::string_view) -> Value {
+		currentFileContext()->getLocation().addLine();
+		if (isLean())
+			return {};
 		currentFileContext()->getTokenStream()->setNewLineChar("\n");
 		TokenIt t = emplace_back(TokenType::NEW_LINE, "\n");
 		_indent.clear();
-		currentFileContext()->getLocation().addLine();
 		return t;
 	});
 	_parser.token("[ \t]+").states("@default", "$hexstr_jump", "$hexstr").action([&](std::string_view str) -> Value { // spaces, tabulators
-		_indent += std::string{str};
+		if (!isLean())
+			_indent += std::string{str};
 		return {};
 	});
 
@@ -107,7 +155,12 @@ void ParserDriver::defineTokens()
 	_parser.token("\\[").symbol("LSQB").description("[").action([&](std::string_view str) -> Value { return emplace_back(TokenType::LSQB, std::string{str}); });
 	_parser.token("\\]").symbol("RSQB").description("]").action([&](std::string_view str) -> Value { return emplace_back(TokenType::RSQB, std::string{str}); });
 	_parser.token("=").symbol("ASSIGN").description("=").action([&](std::string_view str) -> Value { return emplace_back(TokenType::ASSIGN, std::string{str}); });
-	_parser.token(":").symbol("COLON").description(":").action([&](std::string_view str) -> Value { return emplace_back(TokenType::COLON, std::string{str}); });
+	_parser.token(":").symbol("COLON").description(":").action([&](std::string_view str) -> Value {
+		TokenIt colon = emplace_back(TokenType::COLON, std::string{str});
+		if (_conditionColon)
+			conditionEnter();
+		return colon;
+	});
 	_parser.token(",").symbol("COMMA").description(",").action([&](std::string_view str) -> Value { return emplace_back(TokenType::COMMA, std::string{str}); })
 		.precedence(1, pog::Associativity::Left);
 	_parser.token("/").states("@default").symbol("SLASH").description("/").action([&](std::string_view str) -> Value {
@@ -121,7 +174,11 @@ void ParserDriver::defineTokens()
 	if (_features & Features::AvastOnly)
 		_parser.token("variables").symbol("VARIABLES").description("variables").action([&](std::string_view str) -> Value { return emplace_back(TokenType::VARIABLES, std::string{str}); });
 	_parser.token("strings").symbol("STRINGS").description("strings").action([&](std::string_view str) -> Value { sectionStrings(true); return emplace_back(TokenType::STRINGS, std::string{str}); });
-	_parser.token("condition").symbol("CONDITION").description("condition").action([&](std::string_view str) -> Value { sectionStrings(false); return emplace_back(TokenType::CONDITION, std::string{str}); });
+	_parser.token("condition").symbol("CONDITION").description("condition").action([&](std::string_view str) -> Value {
+		sectionStrings(false);
+		_conditionColon = isLazy() || _lazyRule;
+		return emplace_back(TokenType::CONDITION, std::string{str});
+	});
 	_parser.token("ascii").symbol("ASCII").description("ascii").action([&](std::string_view str) -> Value { return emplace_back(TokenType::ASCII, std::string{str}); });
 	_parser.token("nocase").symbol("NOCASE").description("nocase").action([&](std::string_view str) -> Value { return emplace_back(TokenType::NOCASE, std::string{str}); });
 	_parser.token("wide").symbol("WIDE").description("wide").action([&](std::string_view str) -> Value { return emplace_back(TokenType::WIDE, std::string{str}); });
@@ -156,6 +213,8 @@ void ParserDriver::defineTokens()
 	});
 	_parser.token("\r\n|\n").states("$include").action([&](std::string_view str) -> Value {
 		currentFileContext()->getLocation().addLine();
+		if (isLean())
+			return {};
 		currentFileContext()->getTokenStream()->setNewLineChar(std::string{str});
 		return emplace_back(TokenType::NEW_LINE, std::string{str});
 	});
@@ -175,26 +234,28 @@ void ParserDriver::defineTokens()
 
 	_parser.token(R"(0x[0-9a-fA-F]+)").symbol("INTEGER").description("integer").action([&](std::string_view str) -> Value {
 		int64_t n = 0;
-		strToNum(std::string{str}, n, std::hex);
+		strToNum(str, n, std::hex);
 		return emplace_back(TokenType::INTEGER, n, std::make_optional(std::string{str}));
 	});
 	_parser.token(R"([0-9]+KB)").symbol("INTEGER").description("integer").action([&](std::string_view str) -> Value {
 		int64_t n = 0;
-		strToNum(std::string{str}.substr(0, str.size()-2), n);
+		strToNum(str.substr(0, str.size()-2), n);
 		return emplace_back(TokenType::INTEGER, 1000 * n, std::make_optional(std::string{str}));
 	});
 	_parser.token(R"([0-9]+MB)").symbol("INTEGER").description("integer").action([&](std::string_view str) -> Value {
 		int64_t n = 0;
-		strToNum(std::string{str}.substr(0, str.size()-2), n);
+		strToNum(str.substr(0, str.size()-2), n);
 		return emplace_back(TokenType::INTEGER, 1000000 * n, std::make_optional(std::string{str}));
 	});
 	_parser.token(R"([0-9]+)").symbol("INTEGER").description("integer").action([&](std::string_view str) -> Value {
 		int64_t n = 0;
-		strToNum(std::string{str}, n);
+		strToNum(str, n);
 		return emplace_back(TokenType::INTEGER, n, std::make_optional(std::string{str}));
 	});
 
 	_parser.token(R"(\/\/[^\n]*)").states("@default", "$hexstr", "@hexstr_jump").action([&](std::string_view str) -> Value {
+		if (isLean())
+			return {};
 		auto it = emplace_back(TokenType::ONELINE_COMMENT, std::string{str}, _indent);
 		addComment(it);
 		return {};
@@ -202,10 +263,13 @@ void ParserDriver::defineTokens()
 	// $multiline_comment
 	// Comment tokens are not delegated with return Value but stored in _comment
 	_parser.token(R"(/\*)").states("@default").enter_state("$multiline_comment").action([&](std::string_view str) -> Value {
-		_comment.append(std::string{str});
+		if (!isLean())
+			_comment.append(std::string{str});
 		return {};
 	});
 	_parser.token(R"(\*/)").states("$multiline_comment").enter_state("@default").action([&](std::string_view str) -> Value {
+		if (isLean())
+			return {};
 		_comment.append(std::string{str});
 		auto it = emplace_back(TokenType::COMMENT, _comment, _indent);
 		addComment(it);
@@ -215,15 +279,18 @@ void ParserDriver::defineTokens()
 	});
 	_parser.token(R"(\n)").states("$multiline_comment").action([&](std::string_view str) -> Value {
 		currentFileContext()->getLocation().addLine();
-		_comment.append(std::string{str});
+		if (!isLean())
+			_comment.append(std::string{str});
 		return {};
 	});
 	_parser.token(R"([^\n*]*)").states("$multiline_comment").action([&](std::string_view str) -> Value {
-		_comment.append(std::string{str});
+		if (!isLean())
+			_comment.append(std::string{str});
 		return {};
 	});
 	_parser.token(R"(\*)").states("$multiline_comment").action([&](std::string_view str) -> Value {
-		_comment.append(std::string{str});
+		if (!isLean())
+			_comment.append(std::string{str});
 		return {};
 	});
 	// $multiline_comment end
@@ -237,15 +304,24 @@ void ParserDriver::defineTokens()
 		return {};
 	});
 
-	_parser.token(R"(\\x[0-9a-fA-F]{2})").states("$str").action([&](std::string_view str) -> Value {
-		_strLiteral += "\\x";
-		_strLiteral += std::string{str}.substr(2);
-		_escapedContent = true;
+	// Whole run of regular characters and valid escape sequences ('\n', '\t', '\"', '\\', '\xXX') is matched at once
+	_parser.token(R"((?:[^\\"]|\\[tn\"\\]|\\x[0-9a-fA-F]{2})+)").states("$str").action([&](std::string_view str) -> Value {
+		_strLiteral.append(str);
+		if (!_escapedContent)
+		{
+			// Only hexadecimal escape sequences need to be unescaped in getPureText()
+			for (auto pos = str.find('\\'); pos != std::string_view::npos; pos = str.find('\\', pos + 2))
+			{
+				if (str[pos + 1] == 'x')
+				{
+					_escapedContent = true;
+					break;
+				}
+			}
+		}
 		return {};
 	});
-	_parser.token(R"(\\[tn\"\\])").states("$str").action([&](std::string_view str) -> Value { _strLiteral += std::string{str}; return {}; }); //  '\n',  '\t'
 	_parser.token(R"(\\[^\"tnx\\])").states("$str").action([&](std::string_view str) -> Value { error_handle(currentFileContext()->getLocation(), "Syntax error: Unknown escaped sequence '" + std::string{str} + "'"); return {}; });
-	_parser.token(R"(([^\\"])+)").states("$str").action([&](std::string_view str) -> Value { _strLiteral += std::string{str}; return {}; });
 	_parser.token(R"(\")").states("$str").symbol("STRING_LITERAL").description("\"").enter_state("@default").action([&](std::string_view) -> Value {
 		currentFileContext()->getLocation().setBegin(_positionBegin);
 		auto strIt = emplace_back(TokenType::STRING_LITERAL, _strLiteral);
@@ -265,7 +341,11 @@ void ParserDriver::defineTokens()
 	_parser.token(R"(\![0-9a-zA-Z_]*)").symbol("STRING_LENGTH").description("string length").action([&](std::string_view str) -> Value { return emplace_back(TokenType::STRING_LENGTH, std::string{str}); });
 	_parser.token("[a-zA-Z_][0-9a-zA-Z_]*").symbol("ID").description("identifier").action([&](std::string_view str) -> Value { return emplace_back(TokenType::ID, std::string{str}); });
 
-	_parser.token(R"([0-9]+\.[0-9]+)").symbol("DOUBLE").description("float").action([&](std::string_view str) -> Value { return emplace_back(TokenType::DOUBLE, std::stod(std::string(str))); });
+	_parser.token(R"([0-9]+\.[0-9]+)").symbol("DOUBLE").description("float").action([&](std::string_view str) -> Value {
+		double n = 0.0;
+		strToNum(str, n);
+		return emplace_back(TokenType::DOUBLE, n);
+	});
 
 	// $hexstr
 	_parser.token(R"(\|)").states("$hexstr").symbol("HEX_OR").description("hex string |").action([&](std::string_view str) -> Value { return emplace_back(TokenType::HEX_ALT, std::string{str}); });
@@ -273,16 +353,38 @@ void ParserDriver::defineTokens()
 	_parser.token(R"(\))").states("$hexstr").symbol("RP").description("hex string )").action([&](std::string_view str) -> Value { return emplace_back(TokenType::RP, std::string{str}); });
 	_parser.token(R"(\?)").states("$hexstr").symbol("HEX_WILDCARD").description("hex string ?").action([&](std::string_view str) -> Value { return emplace_back(TokenType::HEX_WILDCARD, std::string{str}); });
 	_parser.token(R"(\})").states("$hexstr").enter_state("@default").symbol("RCB").description("}").action([&](std::string_view) -> Value { return emplace_back(TokenType::RCB, "}"); });
+	// Runs of plain hex bytes are matched at once instead of nibble by nibble. Run always has odd number
+	// of nibbles so it can be passed as a single HEX_NIBBLE symbol without changing the structure of hex_byte rules.
+	_parser.token(R"([0-9a-fA-F](?:[ \v\t]*[0-9a-fA-F][ \v\t]*[0-9a-fA-F])+)").states("$hexstr").symbol("HEX_NIBBLE").description("hex string nibble").action([&](std::string_view str) -> Value {
+		const auto location = currentFileContext()->getLocation();
+		const auto line = location.end().line;
+		const auto runStart = location.end().column - str.length();
+
+		std::vector<TokenIt> nibbles;
+		nibbles.reserve(str.length());
+		for (std::size_t i = 0; i < str.length(); ++i)
+		{
+			auto digit = nibbleToByte(str[i]);
+			if (!digit)
+				continue;
+
+			auto nibble = currentFileContext()->getTokenStream()->emplace_back(TokenType::HEX_NIBBLE, static_cast<std::uint64_t>(digit.value()), std::string(1, str[i]));
+			nibble->setLocation(Location(location.getFilePath(), {line, runStart + i}, {line, runStart + i + 1}));
+			nibbles.push_back(nibble);
+		}
+		// Current location points to the last nibble as if it was matched separately
+		currentFileContext()->getLocation().setBegin({line, runStart + str.length()});
+		return nibbles;
+	});
 	_parser.token("[0-9a-fA-F]").states("$hexstr").symbol("HEX_NIBBLE").description("hex string nibble").action([&](std::string_view str) -> Value {
-		std::uint8_t digit = ('A' <= std::toupper(str[0]) && std::toupper(str[0]) <= 'F') ? std::toupper(str[0]) - 'A' + 10 : str[0] - '0';
-		return emplace_back(TokenType::HEX_NIBBLE, static_cast<std::uint64_t>(digit), std::string{str});
+		std::uint8_t digit = nibbleToByte(str[0]).value();
+		return std::vector<TokenIt>{emplace_back(TokenType::HEX_NIBBLE, static_cast<std::uint64_t>(digit), std::string{str})};
 	});
 	_parser.token(R"(\[)").states("$hexstr").enter_state("$hexstr_jump").symbol("LSQB").description("hex string [").action([&](std::string_view str) -> Value { return emplace_back(TokenType::HEX_JUMP_LEFT_BRACKET, std::string{str}); });
 	_parser.token("[0-9]*").states("$hexstr_jump").symbol("HEX_INTEGER").description("hex string integer").action([&](std::string_view str) -> Value {
-		std::string numStr = std::string{str};
 		std::uint64_t num = 0;
-		strToNum(numStr, num, std::dec);
-		return emplace_back(TokenType::INTEGER, num, numStr);
+		strToNum(str, num, std::dec);
+		return emplace_back(TokenType::INTEGER, num, std::string{str});
 	});
 	_parser.token(R"(\-)").states("$hexstr_jump").symbol("DASH").description("hex string -").action([&](std::string_view str) -> Value { return emplace_back(TokenType::DASH, std::string{str}); });
 	_parser.token(R"(\])").states("$hexstr_jump").symbol("RSQB").description("hex string ]").enter_state("$hexstr").action([&](std::string_view str) -> Value { return emplace_back(TokenType::HEX_JUMP_RIGHT_BRACKET, std::string{str}); });
@@ -291,10 +393,13 @@ void ParserDriver::defineTokens()
 	_parser.token(R"(//[^\n]*)").states("$hexstr_jump").action([](std::string_view str) -> Value { return std::string{str}; });
 	// $hexstr multiline comment
 	_parser.token(R"(/\*)").states("$hexstr").enter_state("$hexstr_multiline_comment").action([&](std::string_view str) -> Value {
-		_comment.append(std::string{str});
+		if (!isLean())
+			_comment.append(std::string{str});
 		return {};
 	});
 	_parser.token(R"(\*/)").states("$hexstr_multiline_comment").enter_state("$hexstr").action([&](std::string_view str) -> Value {
+		if (isLean())
+			return {};
 		_comment.append(std::string{str});
 		auto it = emplace_back(TokenType::COMMENT, _comment, _indent);
 		addComment(it);
@@ -304,11 +409,13 @@ void ParserDriver::defineTokens()
 	});
 	_parser.token(R"(\n)").states("$hexstr_multiline_comment").action([&](std::string_view str) -> Value {
 		currentFileContext()->getLocation().addLine();
-		_comment.append(std::string{str});
+		if (!isLean())
+			_comment.append(std::string{str});
 		return {};
 	});
 	_parser.token(R"(.)").states("$hexstr_multiline_comment").action([&](std::string_view str) -> Value {
-		_comment.append(std::string{str});
+		if (!isLean())
+			_comment.append(std::string{str});
 		return {};
 	});
 	// $hexstr multiline comment end
@@ -316,6 +423,8 @@ void ParserDriver::defineTokens()
 	_parser.token(R"({[ \v\t]}*)").states("$hexstr", "@hexstr_jump").action([](std::string_view) -> Value { return {}; });;
 	_parser.token(R"([\n])").states("$hexstr", "@hexstr_jump").action([&](std::string_view) -> Value {
 		currentFileContext()->getLocation().addLine();
+		if (isLean())
+			return {};
 		_indent.clear();
 		return emplace_back(TokenType::NEW_LINE, currentFileContext()->getTokenStream()->getNewLineStyle());
 	});
@@ -337,10 +446,10 @@ void ParserDriver::defineTokens()
 	_parser.token(R"(\$)").states("$regexp").symbol("REGEXP_END_OF_LINE").description("regexp $").action([](std::string_view str) -> Value { return std::string{str}; });
 	_parser.token(R"(\.)").states("$regexp").symbol("REGEXP_ANY_CHAR").description("regexp .").action([](std::string_view str) -> Value { return std::string{str}; });
 	_parser.token(R"(\{[0-9]*,[0-9]*\})").states("$regexp").symbol("REGEXP_RANGE").description("regexp range").action([&](std::string_view str) -> Value {
-		std::string rangeStr = std::string{str};
-		std::string lowStr = rangeStr.substr(1, rangeStr.find(',') - 1);
-		std::string highStr = rangeStr.substr(rangeStr.find(',') + 1);
-		highStr.pop_back(); // Remove '}' at the end
+		auto comma = str.find(',');
+		auto lowStr = str.substr(1, comma - 1);
+		auto highStr = str.substr(comma + 1);
+		highStr.remove_suffix(1); // Remove '}' at the end
 
 		std::uint64_t lowNum = 0;
 		std::optional<std::uint64_t> low;
@@ -355,7 +464,7 @@ void ParserDriver::defineTokens()
 		return std::make_pair(low, high);
 	});
 	_parser.token(R"({[0-9]+})").states("$regexp").symbol("REGEXP_RANGE").description("regexp range").action([&](std::string_view str) -> Value {
-		std::string numStr = std::string(str.substr(1, str.size()-2));
+		auto numStr = str.substr(1, str.size()-2);
 
 		std::optional<std::uint64_t> range;
 		std::uint64_t num = 0;
@@ -403,7 +512,22 @@ void ParserDriver::defineTokens()
 	_parser.token(R"([^\]\[])").states("$regexp_class").action([&](std::string_view str) -> Value { _regexpClass += std::string{str}[0]; return {}; });
 	// $regexp end
 
-	_parser.end_token().states("@default", "$str", "$include", "$hexstr", "hexstr_jump", "$regexp", "$regexp_class").action([&](std::string_view) -> Value {
+	// $lazy_condition
+	// Whole condition up to the closing brace of the rule. String literals, comments and regular expressions
+	// may contain closing brace so they are matched as a whole.
+	_parser.token(R"((?:matches\s*/(?:\[(?:[^\]\\\n]|\\.)*\]|[^/\\\n\[]|\\.)*/[is]*|"(?:[^"\\\n]|\\.)*"|//[^\n]*|/\*(?:[^*]|\*+[^*/])*\*+/|[^}])+)").states("$lazy_condition").symbol("LAZY_CONDITION").description("condition").action([&](std::string_view str) -> Value {
+		auto& location = currentFileContext()->getLocation();
+		if (auto newLines = static_cast<std::size_t>(std::count(str.begin(), str.end(), '\n')); newLines > 0)
+		{
+			Location::Position end{location.end().getLine() + newLines, str.length() - str.rfind('\n') - 1};
+			location = Location(location.getFilePath(), end, end);
+		}
+		_lazyCondition->text = std::string{str};
+		return {};
+	});
+	_parser.token("\\}").states("$lazy_condition").symbol("RCB").description("}").enter_state("@default").action([&](std::string_view str) -> Value { return emplace_back(TokenType::RCB, std::string{str}); });
+
+	_parser.end_token().states("@default", "$str", "$include", "$hexstr", "hexstr_jump", "$regexp", "$regexp_class", "$lazy_condition").action([&](std::string_view) -> Value {
 		_errorLocation = currentFileContext()->getLocation();
 		includeEnd();
 		return {};
@@ -425,6 +549,8 @@ void ParserDriver::defineGrammar()
 			import->setType(TokenType::IMPORT_MODULE);
 			if (!_file.addImport(import, _modules))
 				error_handle(import->getLocation(), "Unrecognized module '" + import->getString() + "' imported");
+			if (_lazyContext)
+				_lazyContext->imports.emplace_back(_file.getRules().size(), import->getString());
 			return {};
 		})
 		;
@@ -777,20 +903,20 @@ void ParserDriver::defineGrammar()
 	_parser.rule("hex_byte") // vector<shared_ptr<HexStringUnit>>
 		.production("HEX_NIBBLE", "HEX_NIBBLE", [](auto&& args) -> Value {
 			std::vector<std::shared_ptr<HexStringUnit>> output;
-			auto first = std::make_shared<HexStringNibble>(args[0].getTokenIt());
-			auto second = std::make_shared<HexStringNibble>(args[1].getTokenIt());
-			output.reserve(2);
-			output.push_back(std::move(first));
-			output.push_back(std::move(second));
+			auto first = std::move(args[0].getMultipleTokenIt());
+			auto second = std::move(args[1].getMultipleTokenIt());
+			output.reserve(first.size() + second.size());
+			appendHexNibbles(output, std::move(first));
+			appendHexNibbles(output, std::move(second));
 			return output;
 		})
 		.production("HEX_NIBBLE", "HEX_WILDCARD", [](auto&& args) -> Value {
 			std::vector<std::shared_ptr<HexStringUnit>> output;
-			auto first = std::make_shared<HexStringNibble>(args[0].getTokenIt());
+			auto first = std::move(args[0].getMultipleTokenIt());
 			args[1].getTokenIt()->setType(TokenType::HEX_WILDCARD_HIGH);
 			auto second = std::make_shared<HexStringWildcard>(args[1].getTokenIt());
-			output.reserve(2);
-			output.push_back(std::move(first));
+			output.reserve(first.size() + 1);
+			appendHexNibbles(output, std::move(first));
 			output.push_back(std::move(second));
 			return output;
 		})
@@ -798,10 +924,10 @@ void ParserDriver::defineGrammar()
 			std::vector<std::shared_ptr<HexStringUnit>> output;
 			args[0].getTokenIt()->setType(TokenType::HEX_WILDCARD_LOW);
 			auto first = std::make_shared<HexStringWildcard>(args[0].getTokenIt());
-			auto second = std::make_shared<HexStringNibble>(args[1].getTokenIt());
-			output.reserve(2);
+			auto second = std::move(args[1].getMultipleTokenIt());
+			output.reserve(1 + second.size());
 			output.push_back(std::move(first));
-			output.push_back(std::move(second));
+			appendHexNibbles(output, std::move(second));
 			return output;
 		})
 		.production("HEX_WILDCARD", "HEX_WILDCARD", [](auto&& args) -> Value {
@@ -983,6 +1109,11 @@ void ParserDriver::defineGrammar()
 			args[1].getTokenIt()->setType(TokenType::COLON_BEFORE_NEWLINE);
 			return std::move(args[2]);
 		})
+		.production("CONDITION", "COLON", "LAZY_CONDITION", [](auto&& args) -> Value {
+			// Expression is created on demand from the recorded source when the rule is added
+			args[1].getTokenIt()->setType(TokenType::COLON_BEFORE_NEWLINE);
+			return Expression::Ptr{};
+		})
 		;
 
 	auto& expr = _parser.rule("expression") // Expression::Ptr
@@ -1894,7 +2025,7 @@ ParserDriver::ParserDriver(Features features)
 	_escapedContent(false), _mode(ParserMode::Regular), _features(features), _modules(),
 	_fileContexts(), _comments(), _includedFiles(), _includedFilesCache(), _valid(false),
 	_file(), _currentStrings(), _stringLoop(false), _localSymbols(), _lastRuleLocation(),
-	_lastRuleTokenStream(), _anonStringCounter(0)
+	_lastRuleTokenStream(), _anonStringCounter(0), _lazyContext(), _lazyCondition()
 {
 	initialize();
 }
@@ -1926,6 +2057,7 @@ bool ParserDriver::parse(std::istream& stream, ParserMode parserMode)
 
 	_fileContexts.emplace_back(&stream);
 	_file = YaraFile(currentFileContext()->getTokenStream(), _features);
+	_file.setLean(isLean());
 	return parseImpl();
 }
 
@@ -1938,6 +2070,7 @@ bool ParserDriver::parse(const std::string& filePath, ParserMode parserMode)
 		return false;
 
 	_file = YaraFile(currentFileContext()->getTokenStream(), _features);
+	_file.setLean(isLean());
 	return parseImpl();
 }
 
@@ -1989,6 +2122,9 @@ void ParserDriver::reset(ParserMode parserMode)
 	_lastRuleLocation.reset();
 	_lastRuleTokenStream.reset();
 	_anonStringCounter = 0;
+	_conditionColon = false;
+	_lazyContext = isLazy() ? std::make_shared<LazyConditionContext>(_features, isLean()) : nullptr;
+	_lazyCondition.reset();
 }
 
 /**
@@ -2084,6 +2220,18 @@ void ParserDriver::addRule(std::unique_ptr<Rule>&& rule)
 	if (ruleExists(rule->getName()))
 		throw ParserError("Error: Redefinition of rule " + rule->getName());
 
+	if (_lazyContext)
+	{
+		_lazyContext->rules.emplace(rule->getName(), std::make_pair(_file.getRules().size(), rule->getSymbol()));
+		if (_lazyCondition)
+		{
+			rule->setConditionLoader([context = _lazyContext, tokenStream = _lastRuleTokenStream, condition = std::move(*_lazyCondition)](const Rule& rule) {
+				return context->parse(rule, tokenStream, condition);
+			});
+			_lazyCondition.reset();
+		}
+	}
+
 	_file.addRule(std::move(rule));
 }
 
@@ -2139,6 +2287,94 @@ void ParserDriver::setCurrentStrings(const std::shared_ptr<Rule::StringsTrie>& c
 	_currentStrings = currentStrings;
 }
 
+/**
+ * Handles the colon which starts the rule condition. In lazy mode, the source of the condition
+ * is recorded instead of being parsed. When the recorded condition is parsed, context of
+ * its rule is restored so the condition is parsed the same way as in regular mode.
+ */
+void ParserDriver::conditionEnter()
+{
+	_conditionColon = false;
+	if (isLazy())
+	{
+		_lazyCondition = LazyCondition{std::string{}, currentFileContext()->getLocation(), _file.getRules().size()};
+		enter_state("$lazy_condition");
+	}
+	else if (_lazyRule)
+	{
+		setCurrentStrings(_lazyRule->getStringsTrie());
+		for (const auto& variable : _lazyRule->getVariables())
+		{
+			const auto& expr = variable.getValue();
+			std::shared_ptr<Symbol> symbol;
+			if (expr->isObject())
+				symbol = std::make_shared<ReferenceSymbol>(variable.getKey(), std::static_pointer_cast<const IdExpression>(expr)->getSymbol());
+			else
+				symbol = std::make_shared<ValueSymbol>(variable.getKey(), expr->getType());
+			addLocalSymbol(symbol);
+		}
+		currentFileContext()->getLocation() = _lazyRuleCondition->location;
+	}
+}
+
+/**
+ * Parses the condition recorded in lazy mode. Tokens of the condition are
+ * placed into the token stream of the rule at the place of the condition.
+ *
+ * @param rule Rule the condition belongs to.
+ * @param tokenStream Token stream of the rule.
+ * @param condition Recorded source of the condition.
+ * @param context Context of the file the rule was parsed from.
+ *
+ * @return Condition expression.
+ */
+Expression::Ptr ParserDriver::parseLazyCondition(const Rule& rule, const std::shared_ptr<TokenStream>& tokenStream, const LazyCondition& condition, const LazyConditionContext& context)
+{
+	// Modules need to be imported, symbols of rules are taken from the context
+	std::ostringstream source;
+	for (const auto& [ruleCount, module] : context.imports)
+	{
+		if (ruleCount <= condition.ruleIndex)
+			source << "import \"" << module << "\" ";
+	}
+	source << "rule " << rule.getName() << " { condition:" << condition.text << '}';
+	std::istringstream input(source.str());
+
+	reset(context.isLean() ? ParserMode::Lean : ParserMode::Regular);
+	_lazyRule = &rule;
+	_lazyRuleCondition = &condition;
+	_lazyRuleContext = &context;
+
+	auto lastToken = std::prev(tokenStream->end());
+	auto cleanUp = [&]() {
+		tokenStream->erase(std::next(lastToken), tokenStream->end());
+		_file = YaraFile(_features);
+		_lazyRule = nullptr;
+		_lazyRuleCondition = nullptr;
+		_lazyRuleContext = nullptr;
+	};
+
+	Expression::Ptr result;
+	try
+	{
+		_fileContexts.emplace_back(condition.location.getFilePath(), &input, tokenStream);
+		_file = YaraFile(tokenStream, _features);
+		parseImpl();
+
+		result = _file.getRules().back()->getCondition();
+		auto colon = std::next(tokenStream->find(TokenType::CONDITION, std::next(lastToken)));
+		tokenStream->moveAppend(rule.getLastTokenIt(), tokenStream.get(), std::next(colon), std::prev(tokenStream->end()));
+	}
+	catch (...)
+	{
+		cleanUp();
+		throw;
+	}
+
+	cleanUp();
+	return result;
+}
+
 /**
  * Returns whether parser is in string-based for loop.
  *
@@ -2178,6 +2414,14 @@ std::shared_ptr<Symbol> ParserDriver::findSymbol(const std::string& name) const
 	if (itr != _localSymbols.end())
 		return itr->second;
 
+	// Only rules preceding the rule with lazily parsed condition are visible from it
+	if (_lazyRuleContext)
+	{
+		auto ruleItr = _lazyRuleContext->rules.find(name);
+		if (ruleItr != _lazyRuleContext->rules.end() && ruleItr->second.first < _lazyRuleCondition->ruleIndex)
+			return ruleItr->second.second;
+	}
+
 	return _file.findSymbol(name);
 }
 
@@ -2245,7 +2489,7 @@ bool ParserDriver::isAlreadyIncluded(const std::string& includePath)
 
 IncludeResult ParserDriver::includeFileImpl(const std::string& includePath, std::optional<std::shared_ptr<TokenStream>> tokenStream)
 {
-	if (_mode == ParserMode::IncludeGuarded && isAlreadyIncluded(includePath))
+	if (isIncludeGuarded() && isAlreadyIncluded(includePath))
 		return IncludeResult::AlreadyIncluded;
 
 	// We need to allocate ifstreams dynamically because they are not copyable and we need to store them
@@ -0,0 +1,101 @@
+/**
+ * @file src/python/sequence_view.h
+ * @brief Declaration of lazy sequence views for yaramod python bindings.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <string>
+
+#include <pybind11/pybind11.h>
+
+/**
+ * Read-only sequence over a C++ container which converts its elements
+ * into Python objects only when they are accessed. The view doesn't copy
+ * the container, each access goes through the getters so the view always
+ * reflects the current contents of the container.
+ */
+template <typename T>
+class SequenceView
+{
+public:
+	using SizeFn = std::function<std::size_t()>;
+	using GetFn = std::function<T(std::size_t)>;
+
+	class Iterator
+	{
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = T;
+		using difference_type = std::ptrdiff_t;
+		using pointer = void;
+		using reference = T;
+
+		Iterator(const SequenceView* view, std::size_t index) : _view(view), _index(index) {}
+
+		T operator*() const { return _view->_get(_index); }
+		Iterator& operator++() { ++_index; return *this; }
+		bool operator==(const Iterator& other) const { return _index == other._index; }
+		bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+	private:
+		const SequenceView* _view;
+		std::size_t _index;
+	};
+
+	SequenceView(SizeFn size, GetFn get) : _size(std::move(size)), _get(std::move(get)) {}
+
+	std::size_t size() const { return _size(); }
+
+	T get(std::ptrdiff_t index) const
+	{
+		auto count = static_cast<std::ptrdiff_t>(size());
+		if (index < 0)
+			index += count;
+		if (index < 0 || index >= count)
+			throw pybind11::index_error();
+		return _get(static_cast<std::size_t>(index));
+	}
+
+	// The end is determined once when the iteration starts
+	Iterator begin() const { return {this, 0}; }
+	Iterator end() const { return {this, size()}; }
+
+private:
+	SizeFn _size;
+	GetFn _get;
+};
+
+/**
+ * Registers Python class of SequenceView of elements of type @p T.
+ * Elements returned by the view keep the view and therefore also the owner
+ * of the underlying container alive.
+ */
+template <typename T>
+void sequenceViewClass(pybind11::module& module, const std::string& name)
+{
+	namespace py = pybind11;
+
+	py::class_<SequenceView<T>>(module, name.c_str())
+		.def("__len__", &SequenceView<T>::size)
+		.def("__bool__", [](const SequenceView<T>& self) { return self.size() != 0; })
+		.def("__getitem__", &SequenceView<T>::get, py::return_value_policy::reference_internal)
+		.def("__getitem__", [](const py::object& self, const py::slice& slice) {
+				const auto& view = self.cast<const SequenceView<T>&>();
+				std::size_t start, stop, step, length;
+				if (!slice.compute(view.size(), &start, &stop, &step, &length))
+					throw py::error_already_set();
+
+				py::list result;
+				for (std::size_t i = 0; i < length; ++i, start += step)
+					result.append(py::cast(view.get(static_cast<std::ptrdiff_t>(start)), py::return_value_policy::reference_internal, self));
+				return result;
+			})
+		.def("__iter__", [](const SequenceView<T>& self) {
+				return py::make_iterator<py::return_value_policy::reference_internal>(self.begin(), self.end());
+			}, py::keep_alive<0, 1>());
+}
@@ -9,6 +9,7 @@
 
 #include <pybind11/pybind11.h>
 #include <pybind11/functional.h>
+#include <pybind11/operators.h>
 #include <pybind11/stl.h>
 
 #include <yaramod/builder/yara_expression_builder.h>
@@ -16,10 +17,22 @@
 #include <yaramod/builder/yara_rule_builder.h>
 #include <yaramod/types/plain_string.h>
 #include <yaramod/types/token_type.h>
+#include <yaramod/utils/atoms.h>
+#include <yaramod/utils/columnar_export.h>
+#include <yaramod/utils/condition_cost.h>
+#include <yaramod/utils/condition_reordering.h>
+#include <yaramod/utils/flat_expression.h>
+#include <yaramod/utils/hex_string_optimizer.h>
+#include <yaramod/utils/regexp_analyzer.h>
+#include <yaramod/utils/serialization.h>
+#include <yaramod/utils/simplifier.h>
+#include <yaramod/utils/string_index.h>
+#include <yaramod/utils/yara_file_diff.h>
 #include <yaramod/yaramod.h>
 
 #include "yaramod_python.h"
 #include "py_visitor.h"
+#include "sequence_view.h"
 
 namespace py = pybind11;
 using namespace py::literals;
@@ -63,7 +76,11 @@ void addEnums(py::module& module)
 {
 	py::enum_<ParserMode>(module, "ParserMode")
 		.value("Regular", ParserMode::Regular)
-		.value("IncludeGuarded", ParserMode::IncludeGuarded);
+		.value("IncludeGuarded", ParserMode::IncludeGuarded)
+		.value("Lean", ParserMode::Lean)
+		.value("LazyConditions", ParserMode::LazyConditions)
+		.def("__or__", [](ParserMode lhs, ParserMode rhs) { return lhs | rhs; })
+		.def("__and__", [](ParserMode lhs, ParserMode rhs) { return lhs & rhs; });
 
 	py::enum_<Features>(module, "Features", py::arithmetic())
 		.value("Basic", Features::Basic)
@@ -109,6 +126,62 @@ void addEnums(py::module& module)
 		.value("Object", Expression::Type::Object)
 		.value("Float", Expression::Type::Float);
 
+	py::enum_<Expression::Kind>(module, "ExpressionKind")
+		.value("Undefined", Expression::Kind::Undefined)
+		.value("String", Expression::Kind::String)
+		.value("StringWildcard", Expression::Kind::StringWildcard)
+		.value("StringAt", Expression::Kind::StringAt)
+		.value("StringInRange", Expression::Kind::StringInRange)
+		.value("StringCount", Expression::Kind::StringCount)
+		.value("StringOffset", Expression::Kind::StringOffset)
+		.value("StringLength", Expression::Kind::StringLength)
+		.value("Not", Expression::Kind::Not)
+		.value("UnaryMinus", Expression::Kind::UnaryMinus)
+		.value("BitwiseNot", Expression::Kind::BitwiseNot)
+		.value("And", Expression::Kind::And)
+		.value("Or", Expression::Kind::Or)
+		.value("Lt", Expression::Kind::Lt)
+		.value("Gt", Expression::Kind::Gt)
+		.value("Le", Expression::Kind::Le)
+		.value("Ge", Expression::Kind::Ge)
+		.value("Eq", Expression::Kind::Eq)
+		.value("Neq", Expression::Kind::Neq)
+		.value("Contains", Expression::Kind::Contains)
+		.value("Matches", Expression::Kind::Matches)
+		.value("Plus", Expression::Kind::Plus)
+		.value("Minus", Expression::Kind::Minus)
+		.value("Multiply", Expression::Kind::Multiply)
+		.value("Divide", Expression::Kind::Divide)
+		.value("Modulo", Expression::Kind::Modulo)
+		.value("BitwiseXor", Expression::Kind::BitwiseXor)
+		.value("BitwiseAnd", Expression::Kind::BitwiseAnd)
+		.value("BitwiseOr", Expression::Kind::BitwiseOr)
+		.value("ShiftLeft", Expression::Kind::ShiftLeft)
+		.value("ShiftRight", Expression::Kind::ShiftRight)
+		.value("ForDict", Expression::Kind::ForDict)
+		.value("ForArray", Expression::Kind::ForArray)
+		.value("ForString", Expression::Kind::ForString)
+		.value("Of", Expression::Kind::Of)
+		.value("Iterable", Expression::Kind::Iterable)
+		.value("Set", Expression::Kind::Set)
+		.value("Range", Expression::Kind::Range)
+		.value("Id", Expression::Kind::Id)
+		.value("StructAccess", Expression::Kind::StructAccess)
+		.value("ArrayAccess", Expression::Kind::ArrayAccess)
+		.value("FunctionCall", Expression::Kind::FunctionCall)
+		.value("BoolLiteral", Expression::Kind::BoolLiteral)
+		.value("StringLiteral", Expression::Kind::StringLiteral)
+		.value("IntLiteral", Expression::Kind::IntLiteral)
+		.value("DoubleLiteral", Expression::Kind::DoubleLiteral)
+		.value("Filesize", Expression::Kind::Filesize)
+		.value("Entrypoint", Expression::Kind::Entrypoint)
+		.value("All", Expression::Kind::All)
+		.value("Any", Expression::Kind::Any)
+		.value("Them", Expression::Kind::Them)
+		.value("Parentheses", Expression::Kind::Parentheses)
+		.value("IntFunction", Expression::Kind::IntFunction)
+		.value("Regexp", Expression::Kind::Regexp);
+
 	py::enum_<VisitAction>(module, "VisitAction")
 		.value("Delete", VisitAction::Delete);
 
@@ -248,13 +321,85 @@ void addEnums(py::module& module)
 
 void addBasicClasses(py::module& module)
 {
+	sequenceViewClass<std::shared_ptr<Rule>>(module, "RuleSequence");
+	sequenceViewClass<Meta*>(module, "MetaSequence");
+	sequenceViewClass<std::shared_ptr<String>>(module, "StringSequence");
+
 	py::class_<YaraFile>(module, "YaraFile")
-		.def_property_readonly("text", &YaraFile::getText)
-		.def_property_readonly("rules", &YaraFile::getRules)
+		.def_property_readonly("text", [](const YaraFile& self) {
+				// Lazily parsed conditions modify the token stream so they are loaded while still holding GIL
+				self.loadConditions();
+				py::gil_scoped_release release;
+				return self.getText();
+			})
+		// Extra attributes of properties are not applied on their getters so keep_alive needs to be passed directly to the getter
+		.def_property_readonly("rules", py::cpp_function([](const YaraFile& self) {
+				return SequenceView<std::shared_ptr<Rule>>(
+					[&self]() { return self.getRules().size(); },
+					[&self](std::size_t i) { return self.getRules()[i]; }
+				);
+			}, py::keep_alive<0, 1>()))
 		.def_property_readonly("imports", &YaraFile::getImports)
-		.def_property_readonly("text_formatted", [](const YaraFile& self) { return self.getTextFormatted(); })
+		.def_property_readonly("text_formatted", [](const YaraFile& self) {
+				self.loadConditions();
+				py::gil_scoped_release release;
+				return self.getTextFormatted();
+			})
 		.def_property_readonly("tokenstream", [](const YaraFile& self) { return self.getTokenStream();} )
+		.def_property_readonly("is_lean", &YaraFile::isLean)
+		.def_property_readonly("dependency_graph", py::overload_cast<>(&YaraFile::getDependencyGraph), py::return_value_policy::reference_internal)
 		.def("find_symbol", &YaraFile::findSymbol)
+		.def("export_columns", [](const YaraFile& self) {
+				self.loadConditions();
+				YaraFileColumns columns;
+				{
+					py::gil_scoped_release release;
+					columns = exportColumns(self);
+				}
+
+				return py::dict(
+					"rules"_a = py::dict("name"_a = columns.ruleNames, "modifier"_a = columns.ruleModifiers),
+					"tags"_a = py::dict("rule"_a = columns.tagRules, "tag"_a = columns.tags),
+					"metas"_a = py::dict("rule"_a = columns.metaRules, "key"_a = columns.metaKeys, "value"_a = columns.metaValues),
+					"strings"_a = py::dict("rule"_a = columns.stringRules, "id"_a = columns.stringIds, "type"_a = columns.stringTypes,
+						"modifiers"_a = columns.stringModifiers, "text"_a = columns.stringTexts),
+					"modules"_a = py::dict("rule"_a = columns.moduleRules, "module"_a = columns.modules)
+				);
+			})
+		.def("extract_atoms", [](const YaraFile& self) {
+				return extractAtoms(self);
+			}, py::call_guard<py::gil_scoped_release>())
+		.def("estimate_condition_costs", [](const YaraFile& self) {
+				return estimateConditionCosts(self);
+			}, py::call_guard<py::gil_scoped_release>())
+		.def("estimate_condition_costs", [](const YaraFile& self, const ConditionCostEstimator& estimator) {
+				return estimateConditionCosts(self, estimator);
+			}, py::arg("estimator"), py::call_guard<py::gil_scoped_release>())
+		.def("reorder_conditions", [](YaraFile& self) {
+				return ConditionReorderer{}.reorder(self);
+			})
+		.def("simplify_conditions", [](YaraFile& self) {
+				return Simplifier{}.simplify(self);
+			})
+		.def("optimize_hex_strings", [](YaraFile& self, bool trimWildcards) {
+				HexStringOptimizer optimizer;
+				optimizer.setTrimWildcards(trimWildcards);
+				return optimizer.optimize(self);
+			}, py::arg("trim_wildcards") = false)
+		.def("analyze_regexps", [](const YaraFile& self) {
+				return RegexpAnalyzer{}.analyze(self);
+			})
+		.def("find_duplicate_strings", [](const YaraFile& self) {
+				StringIndex index;
+				index.add(self);
+				return index.findDuplicates();
+			})
+		.def("diff", [](const YaraFile& self, const YaraFile& newFile) {
+				self.loadConditions();
+				newFile.loadConditions();
+				py::gil_scoped_release release;
+				return diff(self, newFile);
+			}, py::arg("new_file"))
 		.def("add_rule", [](YaraFile& self, const std::shared_ptr<Rule>& rule) {
 				self.addRule(rule, true);
 			})
@@ -264,7 +409,30 @@ void addBasicClasses(py::module& module)
 			})
 		.def("remove_imports", [](YaraFile& self, const std::function<bool(const std::shared_ptr<Module>&)>& pred) {
 				self.removeImports(pred);
-			});
+			})
+		.def("save_snapshot", [](const YaraFile& self, const std::string& path) {
+				self.loadConditions();
+				py::gil_scoped_release release;
+				self.saveSnapshot(path);
+			})
+		.def_static("load_snapshot", &YaraFile::loadSnapshot, py::arg("path"), py::arg("features") = Features::AllCurrent,
+			py::call_guard<py::gil_scoped_release>())
+		.def(py::pickle(
+			[](const YaraFile& self) {
+				self.loadConditions();
+				std::string data;
+				{
+					py::gil_scoped_release release;
+					data = serialize(self);
+				}
+				return py::bytes(data);
+			},
+			[](const py::bytes& state) {
+				std::string_view data{PyBytes_AsString(state.ptr()), static_cast<std::size_t>(PyBytes_Size(state.ptr()))};
+				py::gil_scoped_release release;
+				return deserializeYaraFile(data);
+			}
+		));
 
 	py::class_<Location>(module, "Location")
 		.def_property_readonly("file_path", &Location::getFilePath)
@@ -278,16 +446,44 @@ void addBasicClasses(py::module& module)
 		.def_property_readonly("line", &Location::Position::getLine)
 		.def_property_readonly("column", &Location::Position::getColumn);
 
+	py::class_<StructuralHash>(module, "StructuralHash")
+		.def_readonly("high", &StructuralHash::high)
+		.def_readonly("low", &StructuralHash::low)
+		.def_property_readonly("text", &StructuralHash::getText)
+		.def("__str__", &StructuralHash::getText)
+		.def("__repr__", [](const StructuralHash& self) { return "<StructuralHash " + self.getText() + ">"; })
+		.def("__hash__", [](const StructuralHash& self) { return static_cast<py::ssize_t>(self.low); })
+		.def(py::self == py::self)
+		.def(py::self != py::self)
+		.def(py::self < py::self);
+
 	py::class_<Rule, std::shared_ptr<Rule>>(module, "Rule")
 		.def_property_readonly("text", &Rule::getText)
 		.def_property("name", &Rule::getName, &Rule::setName)
-		.def_property("metas", py::overload_cast<>(&Rule::getMetas), &Rule::setMetas, py::return_value_policy::reference)
+		.def_property("metas", [](const std::shared_ptr<Rule>& self) {
+				return SequenceView<Meta*>(
+					[self]() { return self->getMetas().size(); },
+					[self](std::size_t i) { return &self->getMetas()[i]; }
+				);
+			}, &Rule::setMetas)
 		.def_property("variables", py::overload_cast<>(&Rule::getVariables), &Rule::setVariables, py::return_value_policy::reference)
-		.def_property("tags", &Rule::getTags, &Rule::setTags)
+		.def_property("tags", [](const Rule& self) {
+				// Built directly from tokens so no intermediate vector of strings is needed
+				py::list tags;
+				for (const auto& tag : self.getTagTokens())
+					tags.append(tag->getPureText());
+				return tags;
+			}, &Rule::setTags)
 		.def_property("modifier", &Rule::getModifier, &Rule::setModifier)
-		.def_property_readonly("strings", &Rule::getStrings, py::return_value_policy::reference)
+		.def_property_readonly("strings", [](const std::shared_ptr<Rule>& self) {
+				return SequenceView<std::shared_ptr<String>>(
+					[self]() { return self->getStringsTrie()->size(); },
+					[self](std::size_t i) { return self->getStringsTrie()->getValueAt(i); }
+				);
+			})
 		.def_property_readonly("is_private", &Rule::isPrivate)
 		.def_property_readonly("is_global", &Rule::isGlobal)
+		.def_property_readonly("is_condition_loaded", &Rule::isConditionLoaded)
 		.def_property_readonly("location", &Rule::getLocation)
 		.def_property_readonly("symbol", &Rule::getSymbol)
 		.def_property_readonly("token_first", [](Rule& self) {
@@ -297,12 +493,32 @@ void addBasicClasses(py::module& module)
 				return *self.getLastTokenIt();
 			})
 		.def_property("condition", &Rule::getCondition, &Rule::setCondition)
+		.def("extract_atoms", [](const Rule& self) {
+				return extractAtoms(self);
+			}, py::call_guard<py::gil_scoped_release>())
+		.def("fingerprint", &Rule::fingerprint)
 		.def("add_meta", &Rule::addMeta)
 		.def("remove_metas", &Rule::removeMetas)
 		.def("remove_string", &Rule::removeString)
 		.def("get_meta_with_name", py::overload_cast<const std::string&>(&Rule::getMetaWithName), py::return_value_policy::reference)
 		.def("add_tag", &Rule::addTag)
-		.def("remove_tags", py::overload_cast<const std::string&>(&Rule::removeTags));
+		.def("remove_tags", py::overload_cast<const std::string&>(&Rule::removeTags))
+		.def(py::pickle(
+			[](const Rule& self) {
+				self.getCondition();
+				std::string data;
+				{
+					py::gil_scoped_release release;
+					data = serialize(self);
+				}
+				return py::bytes(data);
+			},
+			[](const py::bytes& state) {
+				std::string_view data{PyBytes_AsString(state.ptr()), static_cast<std::size_t>(PyBytes_Size(state.ptr()))};
+				py::gil_scoped_release release;
+				return deserializeRule(data);
+			}
+		));
 
 	py::class_<Meta>(module, "Meta")
 		.def_property("key", &Meta::getKey, &Meta::setKey)
@@ -366,6 +582,9 @@ void addBasicClasses(py::module& module)
 			})
 		.def_property_readonly("token_last", [](String& self) {
 				return *self.getLastTokenIt();
+			})
+		.def("extract_atoms", [](const String& self) {
+				return extractAtoms(self);
 			});
 
 	py::class_<PlainString, String, std::shared_ptr<PlainString>>(module, "PlainString");
@@ -504,8 +723,28 @@ void addTokenStreamClass(py::module& module)
 
 void addExpressionClasses(py::module& module)
 {
+	// Nodes are exposed as buffer of records so they can be read without creating Python object for each of them
+	py::class_<FlatExpression>(module, "FlatExpression", py::buffer_protocol())
+		.def_buffer([](FlatExpression& self) {
+				return py::buffer_info(
+					self.nodes.data(),
+					sizeof(FlatExpressionNode),
+					"T{q:value:i:parent:I:first_token:I:kind:I:size:}",
+					static_cast<py::ssize_t>(self.nodes.size())
+				);
+			})
+		.def("__len__", [](const FlatExpression& self) { return self.nodes.size(); })
+		.def_readonly("texts", &FlatExpression::texts);
+
 	py::class_<Expression, std::shared_ptr<Expression>>(module, "Expression")
 		.def("accept", &Expression::accept)
+		.def("flatten", [](const Expression& self) {
+				py::gil_scoped_release release;
+				return flatten(&self);
+			})
+		.def("structural_hash", py::overload_cast<>(&Expression::structuralHash, py::const_))
+		.def("structural_hash", py::overload_cast<const std::vector<std::string>&>(&Expression::structuralHash, py::const_), py::arg("string_ids"))
+		.def_property_readonly("kind", &Expression::getKind)
 		.def("get_text", &Expression::getText, py::arg("indent") = std::string{})
 		.def("exchange_tokens", py::overload_cast<Expression*>(&Expression::exchangeTokens))
 		.def_property_readonly("text",
@@ -888,16 +1127,205 @@ void addBuilderClasses(py::module& module)
 	module.def("alt", &alt<std::vector<YaraHexStringBuilder>>);
 }
 
+void addAnalysisClasses(py::module& module)
+{
+	py::class_<Atom>(module, "Atom")
+		.def_property_readonly("bytes", [](const Atom& self) {
+				return py::bytes(reinterpret_cast<const char*>(self.bytes.data()), self.bytes.size());
+			})
+		.def_property_readonly("masks", [](const Atom& self) {
+				return py::bytes(reinterpret_cast<const char*>(self.masks.data()), self.masks.size());
+			})
+		.def_readonly("quality", &Atom::quality)
+		.def_property_readonly("text", &Atom::getText)
+		.def_readonly_static("MAX_QUALITY", &Atom::MaxQuality);
+
+	py::class_<StringAtoms>(module, "StringAtoms")
+		.def_readonly("id", &StringAtoms::id)
+		.def_readonly("atoms", &StringAtoms::atoms)
+		.def_readonly("quality", &StringAtoms::quality);
+
+	py::class_<RuleAtoms>(module, "RuleAtoms")
+		.def_readonly("name", &RuleAtoms::name)
+		.def_readonly("strings", &RuleAtoms::strings)
+		.def_readonly("quality", &RuleAtoms::quality);
+
+	py::class_<ConditionCostEstimator::FunctionCost>(module, "FunctionCost")
+		.def(py::init<>())
+		.def(py::init([](double base, double perByte) {
+				return ConditionCostEstimator::FunctionCost{base, perByte};
+			}), py::arg("base"), py::arg("per_byte") = 0.0)
+		.def_readwrite("base", &ConditionCostEstimator::FunctionCost::base)
+		.def_readwrite("per_byte", &ConditionCostEstimator::FunctionCost::perByte);
+
+	py::class_<ConditionCostEstimator>(module, "ConditionCostEstimator")
+		.def(py::init<>())
+		.def("estimate", py::overload_cast<const Rule&>(&ConditionCostEstimator::estimate))
+		.def("estimate", py::overload_cast<const Expression::Ptr&>(&ConditionCostEstimator::estimate))
+		.def("estimate", py::overload_cast<const Expression::Ptr&, const Rule&>(&ConditionCostEstimator::estimate))
+		.def("get_function_cost", &ConditionCostEstimator::getFunctionCost)
+		.def("set_function_cost", &ConditionCostEstimator::setFunctionCost)
+		.def_property("file_size", &ConditionCostEstimator::getFileSize, &ConditionCostEstimator::setFileSize)
+		.def_property("matches_per_string", &ConditionCostEstimator::getMatchesPerString, &ConditionCostEstimator::setMatchesPerString)
+		.def_property("array_length", &ConditionCostEstimator::getArrayLength, &ConditionCostEstimator::setArrayLength)
+		.def_property("unknown_iterations", &ConditionCostEstimator::getUnknownIterations, &ConditionCostEstimator::setUnknownIterations);
+
+	py::class_<RuleCost>(module, "RuleCost")
+		.def_readonly("name", &RuleCost::name)
+		.def_readonly("cost", &RuleCost::cost);
+
+	py::class_<ConditionReorderer>(module, "ConditionReorderer")
+		.def(py::init<>())
+		.def(py::init<ConditionCostEstimator>(), py::arg("estimator"))
+		.def("reorder", py::overload_cast<Rule&>(&ConditionReorderer::reorder))
+		.def("reorder", py::overload_cast<YaraFile&>(&ConditionReorderer::reorder))
+		.def_property("estimator", &ConditionReorderer::getEstimator, &ConditionReorderer::setEstimator)
+		.def_property("cheap_cost", &ConditionReorderer::getCheapCost, &ConditionReorderer::setCheapCost);
+
+	py::class_<Simplifier>(module, "Simplifier")
+		.def(py::init<>())
+		.def("simplify", py::overload_cast<Rule&>(&Simplifier::simplify))
+		.def("simplify", py::overload_cast<YaraFile&>(&Simplifier::simplify));
+
+	py::class_<HexStringOptimizer::Diagnostic>(module, "HexStringDiagnostic")
+		.def_readonly("rule", &HexStringOptimizer::Diagnostic::rule)
+		.def_readonly("string", &HexStringOptimizer::Diagnostic::string)
+		.def_readonly("message", &HexStringOptimizer::Diagnostic::message);
+
+	py::class_<HexStringOptimizer>(module, "HexStringOptimizer")
+		.def(py::init<>())
+		.def("optimize", py::overload_cast<Rule&>(&HexStringOptimizer::optimize))
+		.def("optimize", py::overload_cast<YaraFile&>(&HexStringOptimizer::optimize))
+		.def_property_readonly("diagnostics", &HexStringOptimizer::getDiagnostics)
+		.def_property("trim_wildcards", &HexStringOptimizer::getTrimWildcards, &HexStringOptimizer::setTrimWildcards);
+
+	py::class_<RegexpAnalyzer> regexpAnalyzer(module, "RegexpAnalyzer");
+
+	py::class_<RegexpAnalyzer::Issue> regexpIssue(module, "RegexpIssue");
+	py::enum_<RegexpAnalyzer::Issue::Kind>(regexpIssue, "Kind")
+		.value("AmbiguousRepetition", RegexpAnalyzer::Issue::Kind::AmbiguousRepetition)
+		.value("NestedRepetition", RegexpAnalyzer::Issue::Kind::NestedRepetition)
+		.value("AmbiguousAlternation", RegexpAnalyzer::Issue::Kind::AmbiguousAlternation)
+		.value("LargeRange", RegexpAnalyzer::Issue::Kind::LargeRange)
+		.value("LargeAutomaton", RegexpAnalyzer::Issue::Kind::LargeAutomaton)
+		.value("MissingLiteral", RegexpAnalyzer::Issue::Kind::MissingLiteral);
+	regexpIssue
+		.def_readonly("kind", &RegexpAnalyzer::Issue::kind)
+		.def_readonly("unit", &RegexpAnalyzer::Issue::unit)
+		.def_readonly("message", &RegexpAnalyzer::Issue::message);
+
+	py::class_<RegexpAnalyzer::Report>(module, "RegexpReport")
+		.def_readonly("rule", &RegexpAnalyzer::Report::rule)
+		.def_readonly("string", &RegexpAnalyzer::Report::string)
+		.def_readonly("text", &RegexpAnalyzer::Report::text)
+		.def_readonly("automaton_size", &RegexpAnalyzer::Report::automatonSize)
+		.def_property_readonly("required_literal", [](const RegexpAnalyzer::Report& self) {
+				return py::bytes(self.requiredLiteral);
+			})
+		.def_readonly("issues", &RegexpAnalyzer::Report::issues);
+
+	regexpAnalyzer
+		.def(py::init<>())
+		.def("analyze", py::overload_cast<const Regexp&, bool>(&RegexpAnalyzer::analyze, py::const_), py::arg("regexp"), py::arg("nocase") = false)
+		.def("analyze", py::overload_cast<const Rule&>(&RegexpAnalyzer::analyze, py::const_))
+		.def("analyze", py::overload_cast<const YaraFile&>(&RegexpAnalyzer::analyze, py::const_))
+		.def_property("max_range", &RegexpAnalyzer::getMaxRange, &RegexpAnalyzer::setMaxRange)
+		.def_property("max_automaton_size", &RegexpAnalyzer::getMaxAutomatonSize, &RegexpAnalyzer::setMaxAutomatonSize)
+		.def_property("min_literal_length", &RegexpAnalyzer::getMinLiteralLength, &RegexpAnalyzer::setMinLiteralLength);
+
+	py::class_<StringIndex> stringIndex(module, "StringIndex");
+
+	py::class_<StringIndex::StringReference>(stringIndex, "StringReference")
+		.def_readonly("file", &StringIndex::StringReference::file)
+		.def_readonly("rule", &StringIndex::StringReference::rule)
+		.def_readonly("string", &StringIndex::StringReference::string);
+
+	py::class_<StringIndex::Containment>(stringIndex, "Containment")
+		.def_readonly("outer", &StringIndex::Containment::outer)
+		.def_readonly("inner", &StringIndex::Containment::inner);
+
+	stringIndex
+		.def(py::init<>())
+		.def("add", &StringIndex::add, py::call_guard<py::gil_scoped_release>())
+		.def("find_duplicates", &StringIndex::findDuplicates, py::call_guard<py::gil_scoped_release>())
+		.def("find_containments", &StringIndex::findContainments, py::call_guard<py::gil_scoped_release>())
+		.def_property_readonly("strings_count", &StringIndex::getStringsCount)
+		.def_property("threads", &StringIndex::getThreads, &StringIndex::setThreads);
+
+	py::class_<RuleChange> ruleChange(module, "RuleChange");
+
+	py::enum_<RuleChange::Section>(ruleChange, "Section", py::arithmetic())
+		.value("Empty", RuleChange::Section::None)
+		.value("Modifiers", RuleChange::Section::Modifiers)
+		.value("Tags", RuleChange::Section::Tags)
+		.value("Metas", RuleChange::Section::Metas)
+		.value("Strings", RuleChange::Section::Strings)
+		.value("Condition", RuleChange::Section::Condition)
+		.value("All", RuleChange::Section::All);
+
+	ruleChange
+		.def_readonly("old_index", &RuleChange::oldIndex)
+		.def_readonly("new_index", &RuleChange::newIndex)
+		.def_readonly("old_name", &RuleChange::oldName)
+		.def_readonly("new_name", &RuleChange::newName)
+		.def_readonly("sections", &RuleChange::sections)
+		.def_property_readonly("is_added", &RuleChange::isAdded)
+		.def_property_readonly("is_removed", &RuleChange::isRemoved)
+		.def_property_readonly("is_renamed", &RuleChange::isRenamed)
+		.def("is_changed", &RuleChange::isChanged);
+
+	py::class_<YaraFileDiff>(module, "YaraFileDiff")
+		.def_readonly("changes", &YaraFileDiff::changes)
+		.def_readonly("unchanged_rules", &YaraFileDiff::unchangedRules)
+		.def_property_readonly("empty", &YaraFileDiff::empty);
+
+	py::class_<RuleDependencyGraph> ruleDependencyGraph(module, "RuleDependencyGraph");
+
+	py::class_<RuleDependencyGraph::UndefinedReference>(ruleDependencyGraph, "UndefinedReference")
+		.def_readonly("rule", &RuleDependencyGraph::UndefinedReference::rule)
+		.def_readonly("name", &RuleDependencyGraph::UndefinedReference::name);
+
+	ruleDependencyGraph
+		.def(py::init<>())
+		.def(py::init<const YaraFile&>(), py::keep_alive<1, 2>())
+		.def("add_rule", &RuleDependencyGraph::addRule)
+		.def("update_rule", &RuleDependencyGraph::updateRule)
+		.def("remove_rule", &RuleDependencyGraph::removeRule)
+		.def("refresh", &RuleDependencyGraph::refresh)
+		.def_property_readonly("rules_count", &RuleDependencyGraph::getRulesCount)
+		.def("get_dependencies", &RuleDependencyGraph::getDependencies)
+		.def("get_dependents", &RuleDependencyGraph::getDependents)
+		.def("get_transitive_dependencies", &RuleDependencyGraph::getTransitiveDependencies)
+		.def("get_transitive_dependents", &RuleDependencyGraph::getTransitiveDependents)
+		.def_property_readonly("topological_order", &RuleDependencyGraph::getTopologicalOrder)
+		.def("has_rule", &RuleDependencyGraph::hasRule)
+		.def("find_cycles", &RuleDependencyGraph::findCycles)
+		.def("find_undefined_references", &RuleDependencyGraph::findUndefinedReferences)
+		.def("find_unreferenced_private_rules", &RuleDependencyGraph::findUnreferencedPrivateRules);
+}
+
 void addMainClass(py::module& module)
 {
 	py::class_<Yaramod>(module, "Yaramod")
 		.def(py::init<Features>(), py::arg("import_features") = Features::AllCurrent)
-		.def("parse_file", &Yaramod::parseFile, py::arg("file_path"), py::arg("parser_mode") = ParserMode::Regular)
-		.def("parse_string", [](Yaramod& self, const std::string& str, ParserMode parserMode) {
-				std::istringstream stream(str);
-				return self.parseStream(stream, parserMode);
+		.def("parse_file", &Yaramod::parseFile, py::arg("file_path"), py::arg("parser_mode") = ParserMode::Regular,
+			py::call_guard<py::gil_scoped_release>())
+		// Objects supporting buffer protocol like bytes or memoryview are parsed without copying them
+		.def("parse_string", [](Yaramod& self, py::buffer buffer, ParserMode parserMode) {
+				auto info = buffer.request();
+				if (info.ndim != 1 || info.strides[0] != info.itemsize)
+					throw py::value_error("Parsed buffer must be one-dimensional and contiguous");
+
+				py::gil_scoped_release release;
+				return self.parseString({static_cast<const char*>(info.ptr), static_cast<std::size_t>(info.size * info.itemsize)}, parserMode);
 			}, py::arg("str"), py::arg("parser_mode") = ParserMode::Regular)
+		.def("parse_string", [](Yaramod& self, const std::string& str, ParserMode parserMode) {
+				return self.parseString(str, parserMode);
+			}, py::arg("str"), py::arg("parser_mode") = ParserMode::Regular, py::call_guard<py::gil_scoped_release>())
 		.def_property_readonly("yara_file", &Yaramod::getParsedFile);
+
+	module.def("parse_files", &parseFiles, py::arg("file_paths"), py::arg("threads") = 0, py::arg("parser_mode") = ParserMode::Regular,
+		py::arg("features") = Features::AllCurrent, py::call_guard<py::gil_scoped_release>());
 }
 
 PYBIND11_MODULE(yaramod, module)
@@ -925,4 +1353,5 @@ PYBIND11_MODULE(yaramod, module)
 	addVisitorClasses(module);
 	addRegexpVisitorClasses(module);
 	addBuilderClasses(module);
+	addAnalysisClasses(module);
 }
@@ -9,6 +9,39 @@
 
 namespace yaramod {
 
+HexStringElement HexStringElement::byte(std::uint8_t value, std::uint8_t mask)
+{
+	HexStringElement result(Kind::Byte);
+	result.value = value & mask;
+	result.mask = mask;
+	return result;
+}
+
+HexStringElement HexStringElement::jump(std::uint64_t low, std::optional<std::uint64_t> high)
+{
+	HexStringElement result(Kind::Jump);
+	result.jumpLow = low;
+	result.jumpHigh = high;
+	return result;
+}
+
+bool HexStringElement::operator==(const HexStringElement& other) const
+{
+	if (kind != other.kind)
+		return false;
+
+	switch (kind)
+	{
+		case Kind::Byte:
+			return value == other.value && mask == other.mask;
+		case Kind::Jump:
+			return jumpLow == other.jumpLow && jumpHigh == other.jumpHigh;
+		case Kind::Alternation:
+			return alternatives == other.alternatives;
+	}
+	return false;
+}
+
 /**
  * Constructor.
  *
@@ -110,6 +143,50 @@ TokenIt HexString::getLastTokenIt() const
 		return _units.back()->getLastTokenIt();
 }
 
+/**
+ * Returns the normalized elements of the hex string.
+ *
+ * @return Elements of hex string.
+ */
+std::vector<HexStringElement> HexString::getElements() const
+{
+	auto nibble = [](const auto& unit) -> std::pair<std::uint8_t, std::uint8_t> {
+		if (unit->isNibble())
+			return {static_cast<const HexStringNibble*>(unit.get())->getValue(), 0xF};
+		return {0x0, 0x0};
+	};
+
+	std::vector<HexStringElement> result;
+	for (auto itr = _units.begin(), end = _units.end(); itr != end; )
+	{
+		const auto& unit = *itr;
+		// Nibbles and wildcards are always in pairs
+		if (unit->isNibble() || unit->isWildcard())
+		{
+			auto [high, highMask] = nibble(unit);
+			auto [low, lowMask] = nibble(*(itr + 1));
+			result.push_back(HexStringElement::byte(high << 4 | low, highMask << 4 | lowMask));
+			itr += 2;
+			continue;
+		}
+
+		if (unit->isJump())
+		{
+			const auto* jump = static_cast<const HexStringJump*>(unit.get());
+			result.push_back(HexStringElement::jump(jump->getLow().value_or(0), jump->getHigh()));
+		}
+		else if (unit->isOr())
+		{
+			HexStringElement alternation(HexStringElement::Kind::Alternation);
+			for (const auto& substring : static_cast<const HexStringOr*>(unit.get())->getSubstrings())
+				alternation.alternatives.push_back(substring->getElements());
+			result.push_back(std::move(alternation));
+		}
+		++itr;
+	}
+	return result;
+}
+
 /**
  * Returns the length of the hex string as the number of nibbles.
  * Jumps and wildcards are not counted towards the length.
@@ -9,6 +9,7 @@
 #include <stack>
 
 #include "yaramod/types/literal.h"
+#include "yaramod/types/structural_hash.h"
 #include "yaramod/utils/utils.h"
 
 
@@ -130,9 +131,12 @@ Literal::Literal(ReferenceType value)
 /**
  * Setter methods
  *
+ * Structural hashes of expressions depend on values of their tokens, so cached hashes are invalidated
+ * if they used the value.
  */
 void Literal::setValue(const std::string& s)
 {
+	invalidateStructuralHashes();
 	if (isLiteralReference())
 		const_cast<Literal*>(getLiteralReference())->setValue(s);
 	else
@@ -141,6 +145,7 @@ void Literal::setValue(const std::string& s)
 
 void Literal::setValue(std::string&& s)
 {
+	invalidateStructuralHashes();
 	if (isLiteralReference())
 		const_cast<Literal*>(getLiteralReference())->setValue(std::move(s));
 	else
@@ -149,6 +154,7 @@ void Literal::setValue(std::string&& s)
 
 void Literal::setValue(bool b)
 {
+	invalidateStructuralHashes();
 	if (isLiteralReference())
 		const_cast<Literal*>(getLiteralReference())->setValue(b);
 	else
@@ -157,6 +163,7 @@ void Literal::setValue(bool b)
 
 void Literal::setValue(std::int64_t i, const std::optional<std::string>& integral_formatted_value/*= std::nullopt*/)
 {
+	invalidateStructuralHashes();
 	if (isLiteralReference())
 		const_cast<Literal*>(getLiteralReference())->setValue(i, integral_formatted_value);
 	else
@@ -168,6 +175,7 @@ void Literal::setValue(std::int64_t i, const std::optional<std::string>& integra
 
 void Literal::setValue(std::uint64_t i, const std::optional<std::string>& integral_formatted_value/*= std::nullopt*/)
 {
+	invalidateStructuralHashes();
 	if (isLiteralReference())
 		const_cast<Literal*>(getLiteralReference())->setValue(i, integral_formatted_value);
 	else
@@ -179,6 +187,7 @@ void Literal::setValue(std::uint64_t i, const std::optional<std::string>& integr
 
 void Literal::setValue(double d, const std::optional<std::string>& integral_formatted_value/*= std::nullopt*/)
 {
+	invalidateStructuralHashes();
 	if (isLiteralReference())
 		const_cast<Literal*>(getLiteralReference())->setValue(d, integral_formatted_value);
 	else
@@ -190,6 +199,7 @@ void Literal::setValue(double d, const std::optional<std::string>& integral_form
 
 void Literal::setValue(const std::shared_ptr<Symbol>& s)
 {
+	invalidateStructuralHashes();
 	if (isLiteralReference())
 		const_cast<Literal*>(getLiteralReference())->setValue(s);
 	else
@@ -198,6 +208,7 @@ void Literal::setValue(const std::shared_ptr<Symbol>& s)
 
 void Literal::setValue(std::shared_ptr<Symbol>&& s)
 {
+	invalidateStructuralHashes();
 	if (isLiteralReference())
 		const_cast<Literal*>(getLiteralReference())->setValue(std::move(s));
 	else
@@ -206,9 +217,20 @@ void Literal::setValue(std::shared_ptr<Symbol>&& s)
 
 void Literal::setValue(ReferenceType l)
 {
+	invalidateStructuralHashes();
 	_value = l;
 }
 
+/**
+ * Marks the value as used by cached structural hashes, so its modification invalidates them.
+ */
+void Literal::useInStructuralHash() const
+{
+	_structuralHashDependency.use();
+	if (isLiteralReference())
+		getLiteralReference()->useInStructuralHash();
+}
+
 std::string Literal::getFormattedValue() const
 {
 	return _formatted_value.value_or(std::string());
@@ -234,9 +256,7 @@ std::string Literal::getText(bool pure/* = false*/) const
 	{
 		if (_formatted_value.has_value())
 			return _formatted_value.value();
-		std::ostringstream ss;
-		ss << std::boolalpha << getBool();
-		return ss.str();
+		return getBool() ? "true" : "false";
 	}
 	else if (isInt())
 	{
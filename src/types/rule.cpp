@@ -198,6 +198,49 @@ std::vector<const String*> Rule::getStrings() const
 	return result;
 }
 
+/**
+ * Returns the strings of the YARA rule in the order in which they are defined.
+ *
+ * @return Strings.
+ */
+std::vector<const String*> Rule::getStringsInDefinitionOrder() const
+{
+	auto strings = getStrings();
+	std::vector<std::pair<const Token*, std::size_t>> positions;
+	positions.reserve(strings.size());
+	for (std::size_t i = 0; i < strings.size(); ++i)
+	{
+		if (const auto& id = strings[i]->getIdentifierIt())
+			positions.emplace_back(&*id.value(), i);
+	}
+	std::sort(positions.begin(), positions.end());
+
+	// Identifiers of strings are looked up in tokens following the name of the rule until all of them are found
+	std::vector<std::size_t> order;
+	order.reserve(positions.size());
+	for (auto itr = _name, end = _tokenStream->end(); itr != end && order.size() < positions.size(); ++itr)
+	{
+		auto position = std::lower_bound(positions.begin(), positions.end(), std::make_pair(static_cast<const Token*>(&*itr), std::size_t{0}));
+		if (position != positions.end() && position->first == &*itr)
+			order.push_back(position->second);
+	}
+
+	std::vector<const String*> result;
+	result.reserve(strings.size());
+	std::vector<bool> used(strings.size());
+	for (auto index : order)
+	{
+		result.push_back(strings[index]);
+		used[index] = true;
+	}
+	for (std::size_t i = 0; i < strings.size(); ++i)
+	{
+		if (!used[i])
+			result.push_back(strings[i]);
+	}
+	return result;
+}
+
 /**
  * Returns the strings of the YARA rule.
  *
@@ -210,12 +253,23 @@ const std::shared_ptr<Rule::StringsTrie>& Rule::getStringsTrie() const
 
 /**
  * Returns the condition expression of the YARA rule.
+ * Condition which was not parsed yet (see ParserMode::LazyConditions)
+ * is parsed now and errors in it are thrown as ParserError.
  *
  * @return Condition expression.
  */
 const Expression::Ptr& Rule::getCondition() const
 {
-	return _condition;
+	if (!_pendingCondition)
+		return _condition;
+
+	// Loading is retried when it fails so the same error is reported on the next access
+	std::call_once(_pendingCondition->once, [this]() {
+		_pendingCondition->condition = _pendingCondition->loader(*this);
+		_pendingCondition->loader = nullptr;
+		_pendingCondition->loaded.store(true, std::memory_order_release);
+	});
+	return _pendingCondition->condition;
 }
 
 /**
@@ -289,6 +343,36 @@ TokenIt Rule::getLastTokenIt() const
 	return _tokenStream->find(TokenType::RULE_END, _name);
 }
 
+/**
+ * Returns the hash of the structure of the rule which can be used to find the same rules
+ * with different names or formatting. It covers the modifiers of the rule, contents and modifiers
+ * of strings in order of their definition and the structural hash of the condition where strings
+ * are referenced by their position (see Expression::structuralHash()). Name, metas, tags and
+ * identifiers of strings are not covered.
+ *
+ * @return Fingerprint of the rule.
+ */
+StructuralHash Rule::fingerprint() const
+{
+	StructuralHasher hasher;
+	hasher.add(isPrivate());
+	hasher.add(isGlobal());
+
+	auto strings = getStringsInDefinitionOrder();
+	std::vector<std::string> stringIds;
+	stringIds.reserve(strings.size());
+	hasher.add(strings.size());
+	for (const auto* string : strings)
+	{
+		stringIds.push_back(string->getIdentifier());
+		hasher.add(string->structuralHash());
+	}
+
+	if (const auto& condition = getCondition())
+		hasher.add(condition->structuralHash(stringIds));
+	return hasher.get();
+}
+
 /**
  * Sets the name of the rule.
  *
@@ -303,6 +387,7 @@ void Rule::setName(const std::string& name)
 		assert(_name->isSymbol());
 		_name->getSymbol()->setName(name);
 	}
+	StructuralModificationCounter::increment();
 }
 
 /**
@@ -323,6 +408,7 @@ void Rule::setMetas(const std::vector<Meta>& metas)
 void Rule::setVariables(const std::vector<Variable>& variables)
 {
 	_variables = variables;
+	StructuralModificationCounter::increment();
 }
 
 /**
@@ -364,6 +450,21 @@ void Rule::setTags(const std::vector<std::string>& tags)
 void Rule::setCondition(const Expression::Ptr& condition)
 {
 	_condition = condition;
+	_pendingCondition.reset();
+	StructuralModificationCounter::increment();
+}
+
+/**
+ * Sets the loader of the condition which was not parsed yet.
+ * Loader is invoked on the first access to the condition.
+ *
+ * @param loader Loader of the condition.
+ */
+void Rule::setConditionLoader(ConditionLoader&& loader)
+{
+	_condition.reset();
+	_pendingCondition = std::make_shared<PendingCondition>(std::move(loader));
+	StructuralModificationCounter::increment();
 }
 
 void Rule::setModifier(const Modifier& modifier)
@@ -418,6 +519,7 @@ void Rule::setModifier(const Modifier& modifier)
 		if (addGlobal)
 			_mod_global = _tokenStream->emplace(rule_token, TokenType::GLOBAL, "global");
 	}
+	StructuralModificationCounter::increment();
 }
 
 /**
@@ -440,6 +542,17 @@ bool Rule::isPrivate() const
 	return _mod_private.has_value();
 }
 
+/**
+ * Returns whether the condition of the rule is already parsed.
+ * Condition of rule parsed in lazy mode is parsed on its first access.
+ *
+ * @return @c true if is loaded, otherwise @c false.
+ */
+bool Rule::isConditionLoaded() const
+{
+	return !_pendingCondition || _pendingCondition->loaded.load(std::memory_order_acquire);
+}
+
 /**
  * Adds meta with specified name and value.
  *
@@ -0,0 +1,516 @@
+/**
+ * @file src/types/rule_dependency_graph.cpp
+ * @brief Implementation of class RuleDependencyGraph.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#include <algorithm>
+#include <limits>
+#include <unordered_set>
+
+#include "yaramod/types/rule_dependency_graph.h"
+#include "yaramod/types/yara_file.h"
+#include "yaramod/utils/traversal.h"
+
+namespace yaramod {
+
+/**
+ * Builds the graph of all rules of the YARA file. Conditions which were not parsed yet are parsed.
+ *
+ * @param file YARA file.
+ */
+RuleDependencyGraph::RuleDependencyGraph(const YaraFile& file)
+	: _file(&file)
+{
+	_nodes.reserve(file.getRules().size());
+	for (const auto& rule : file.getRules())
+		addRule(*rule);
+}
+
+/**
+ * Adds the rule into the graph. If the rule with the same name is already
+ * in the graph, it is updated.
+ *
+ * @param rule Rule to add.
+ */
+void RuleDependencyGraph::addRule(const Rule& rule)
+{
+	auto name = rule.getName();
+	if (hasRule(name))
+	{
+		updateRule(rule);
+		return;
+	}
+
+	auto& node = _nodes[name];
+	node.sequence = _nextSequence++;
+	node.rule = &rule;
+	node.state = getState(rule);
+	node.isPrivate = rule.isPrivate();
+	node.isGlobal = rule.isGlobal();
+	node.dependencies = getReferencedRules(rule);
+	for (const auto& dependency : node.dependencies)
+		_dependents[dependency].push_back(name);
+}
+
+/**
+ * Updates references and modifiers of the rule which is already in the graph.
+ * Rule which is not in the graph yet is added.
+ *
+ * @param rule Rule to update.
+ */
+void RuleDependencyGraph::updateRule(const Rule& rule)
+{
+	if (!hasRule(rule.getName()))
+	{
+		addRule(rule);
+		return;
+	}
+
+	replaceRule(rule.getName(), rule);
+}
+
+/**
+ * Removes the rule from the graph. References to the removed rule from other rules
+ * become undefined references.
+ *
+ * @param name Name of the rule to remove.
+ */
+void RuleDependencyGraph::removeRule(const std::string& name)
+{
+	auto itr = _nodes.find(name);
+	if (itr == _nodes.end())
+		return;
+
+	for (const auto& dependency : itr->second.dependencies)
+	{
+		auto dependentsItr = _dependents.find(dependency);
+		auto& dependents = dependentsItr->second;
+		dependents.erase(std::find(dependents.begin(), dependents.end(), name));
+		if (dependents.empty())
+			_dependents.erase(dependentsItr);
+	}
+	_nodes.erase(itr);
+}
+
+/**
+ * Updates rules which were renamed or whose modifiers, conditions or variables were modified
+ * since they were added into the graph. This covers Rule::setName(), Rule::setCondition()
+ * and also conditions modified in place, for example by Simplifier or ConditionReorderer.
+ * Rules which are not in the graph are added.
+ *
+ * @param rules Rules which were added into the graph.
+ */
+void RuleDependencyGraph::refresh(const std::vector<std::shared_ptr<Rule>>& rules)
+{
+	std::unordered_map<const Rule*, const std::string*> names;
+	names.reserve(_nodes.size());
+	for (const auto& [name, node] : _nodes)
+		names.emplace(node.rule, &name);
+
+	for (const auto& rule : rules)
+	{
+		auto itr = names.find(rule.get());
+		if (itr == names.end())
+			addRule(*rule);
+		else if (*itr->second != rule->getName())
+			replaceRule(*itr->second, *rule);
+		else
+		{
+			const auto& node = _nodes[*itr->second];
+			if (node.isPrivate != rule->isPrivate() || node.isGlobal != rule->isGlobal() || node.state != getState(*rule))
+				replaceRule(*itr->second, *rule);
+		}
+	}
+}
+
+/**
+ * Returns names of rules directly referenced from the condition of the rule,
+ * including rules which are not in the graph.
+ *
+ * @param name Name of the rule.
+ *
+ * @return Names of referenced rules.
+ */
+std::vector<std::string> RuleDependencyGraph::getDependencies(const std::string& name) const
+{
+	auto itr = _nodes.find(name);
+	return itr != _nodes.end() ? itr->second.dependencies : std::vector<std::string>{};
+}
+
+/**
+ * Returns names of rules whose conditions directly reference the rule.
+ *
+ * @param name Name of the rule, it does not need to be in the graph.
+ *
+ * @return Names of referencing rules.
+ */
+std::vector<std::string> RuleDependencyGraph::getDependents(const std::string& name) const
+{
+	auto itr = _dependents.find(name);
+	return itr != _dependents.end() ? itr->second : std::vector<std::string>{};
+}
+
+/**
+ * Returns names of all rules in the graph which the rule depends on directly or through other rules.
+ *
+ * @param name Name of the rule.
+ *
+ * @return Names of rules in breadth-first order.
+ */
+std::vector<std::string> RuleDependencyGraph::getTransitiveDependencies(const std::string& name) const
+{
+	return getReachable(name, false);
+}
+
+/**
+ * Returns names of all rules in the graph which depend on the rule directly or through other rules.
+ *
+ * @param name Name of the rule.
+ *
+ * @return Names of rules in breadth-first order.
+ */
+std::vector<std::string> RuleDependencyGraph::getTransitiveDependents(const std::string& name) const
+{
+	return getReachable(name, true);
+}
+
+/**
+ * Returns names of rules ordered so each rule follows all rules it depends on.
+ * Rules which are already in such order stay in it. Rules in cycles are left out.
+ *
+ * @return Names of rules.
+ */
+std::vector<std::string> RuleDependencyGraph::getTopologicalOrder() const
+{
+	auto nodes = getNodesInOrder();
+	auto edges = getEdges(nodes);
+
+	std::vector<std::string> result;
+	result.reserve(nodes.size());
+	for (const auto& component : getComponents(edges))
+	{
+		auto index = component.front();
+		if (component.size() == 1 && std::find(edges[index].begin(), edges[index].end(), index) == edges[index].end())
+			result.push_back(nodes[index]->first);
+	}
+	return result;
+}
+
+/**
+ * Finds groups of rules which reference each other in a cycle. YARA refuses to compile them.
+ *
+ * @return Groups of rules, each in order of rules.
+ */
+std::vector<std::vector<std::string>> RuleDependencyGraph::findCycles() const
+{
+	auto nodes = getNodesInOrder();
+	auto edges = getEdges(nodes);
+
+	std::vector<std::vector<std::string>> result;
+	for (auto& component : getComponents(edges))
+	{
+		auto index = component.front();
+		if (component.size() == 1 && std::find(edges[index].begin(), edges[index].end(), index) == edges[index].end())
+			continue;
+
+		std::sort(component.begin(), component.end());
+		std::vector<std::string> cycle;
+		cycle.reserve(component.size());
+		for (auto member : component)
+			cycle.push_back(nodes[member]->first);
+		result.push_back(std::move(cycle));
+	}
+
+	std::sort(result.begin(), result.end(), [&](const auto& lhs, const auto& rhs) {
+		return _nodes.at(lhs.front()).sequence < _nodes.at(rhs.front()).sequence;
+	});
+	return result;
+}
+
+/**
+ * Finds references to rules which are not in the graph, for example
+ * because they were removed.
+ *
+ * @return Undefined references in order of rules.
+ */
+std::vector<RuleDependencyGraph::UndefinedReference> RuleDependencyGraph::findUndefinedReferences() const
+{
+	std::vector<UndefinedReference> result;
+	for (const auto* node : getNodesInOrder())
+	{
+		for (const auto& dependency : node->second.dependencies)
+		{
+			if (!hasRule(dependency))
+				result.push_back({node->first, dependency});
+		}
+	}
+	return result;
+}
+
+/**
+ * Finds private rules which can't affect result of scanning because no public
+ * or global rule depends on them, not even through other rules. They can be
+ * removed together without breaking any reference of the remaining rules.
+ *
+ * @return Names of private rules in order of rules.
+ */
+std::vector<std::string> RuleDependencyGraph::findUnreferencedPrivateRules() const
+{
+	auto nodes = getNodesInOrder();
+	auto edges = getEdges(nodes);
+
+	std::vector<bool> used(nodes.size());
+	std::vector<std::size_t> pending;
+	for (std::size_t i = 0; i < nodes.size(); ++i)
+	{
+		if (!nodes[i]->second.isPrivate || nodes[i]->second.isGlobal)
+		{
+			used[i] = true;
+			pending.push_back(i);
+		}
+	}
+
+	while (!pending.empty())
+	{
+		auto index = pending.back();
+		pending.pop_back();
+		for (auto dependency : edges[index])
+		{
+			if (!used[dependency])
+			{
+				used[dependency] = true;
+				pending.push_back(dependency);
+			}
+		}
+	}
+
+	std::vector<std::string> result;
+	for (std::size_t i = 0; i < nodes.size(); ++i)
+	{
+		if (!used[i])
+			result.push_back(nodes[i]->first);
+	}
+	return result;
+}
+
+/**
+ * Replaces the node of the rule which may have been renamed, the node keeps its position in results.
+ *
+ * @param name Name of the rule in the graph.
+ * @param rule Rule to replace it with.
+ */
+void RuleDependencyGraph::replaceRule(const std::string& name, const Rule& rule)
+{
+	auto sequence = _nodes[name].sequence;
+	removeRule(name);
+	addRule(rule);
+	_nodes[rule.getName()].sequence = sequence;
+}
+
+/**
+ * Returns the hash of everything which references of the rule depend on besides its modifiers.
+ * Structural hashes of conditions are cached, so the check of unmodified rules is cheap.
+ */
+StructuralHash RuleDependencyGraph::getState(const Rule& rule) const
+{
+	StructuralHasher hasher;
+	for (const auto& variable : rule.getVariables())
+		hasher.add(variable.getKey());
+	if (const auto& condition = rule.getCondition())
+		hasher.add(condition->structuralHash());
+	return hasher.get();
+}
+
+/**
+ * Returns names of rules referenced from the condition of the rule. References to rules
+ * are identifiers which are not variables of the rule, identifiers of loops, modules
+ * or other global symbols of the YARA file.
+ */
+std::vector<std::string> RuleDependencyGraph::getReferencedRules(const Rule& rule) const
+{
+	const auto& condition = rule.getCondition();
+	if (!condition)
+		return {};
+
+	std::unordered_set<std::string> locals;
+	for (const auto& variable : rule.getVariables())
+		locals.insert(variable.getKey());
+
+	// Identifiers of structures, arrays and functions are never references to rules
+	std::unordered_set<const Expression*> objects;
+	std::vector<const IdExpression*> identifiers;
+	traverse(condition, [&](Expression* expr) {
+		switch (expr->getKind())
+		{
+			case Expression::Kind::Id:
+				identifiers.push_back(static_cast<const IdExpression*>(expr));
+				break;
+			case Expression::Kind::StructAccess:
+				objects.insert(static_cast<const StructAccessExpression*>(expr)->getStructure().get());
+				break;
+			case Expression::Kind::ArrayAccess:
+				objects.insert(static_cast<const ArrayAccessExpression*>(expr)->getArray().get());
+				break;
+			case Expression::Kind::FunctionCall:
+				objects.insert(static_cast<const FunctionCallExpression*>(expr)->getFunction().get());
+				break;
+			case Expression::Kind::ForDict:
+				locals.insert(static_cast<const ForDictExpression*>(expr)->getId1());
+				locals.insert(static_cast<const ForDictExpression*>(expr)->getId2());
+				break;
+			case Expression::Kind::ForArray:
+				locals.insert(static_cast<const ForArrayExpression*>(expr)->getId());
+				break;
+			default:
+				break;
+		}
+		return true;
+	}, [](Expression*) {});
+
+	std::vector<std::string> result;
+	for (const auto* identifier : identifiers)
+	{
+		if (objects.count(identifier))
+			continue;
+
+		const auto& name = identifier->getSymbol()->getName();
+		if (locals.count(name) || (_file && _file->findSymbol(name) && !_file->hasRule(name)))
+			continue;
+
+		if (std::find(result.begin(), result.end(), name) == result.end())
+			result.push_back(name);
+	}
+	return result;
+}
+
+std::vector<const RuleDependencyGraph::NodeEntry*> RuleDependencyGraph::getNodesInOrder() const
+{
+	std::vector<const NodeEntry*> result;
+	result.reserve(_nodes.size());
+	for (const auto& entry : _nodes)
+		result.push_back(&entry);
+	std::sort(result.begin(), result.end(), [](const auto* lhs, const auto* rhs) {
+		return lhs->second.sequence < rhs->second.sequence;
+	});
+	return result;
+}
+
+/**
+ * Returns indices of dependencies of nodes, undefined references are left out.
+ */
+std::vector<std::vector<std::size_t>> RuleDependencyGraph::getEdges(const std::vector<const NodeEntry*>& nodes) const
+{
+	std::unordered_map<const NodeEntry*, std::size_t> indices;
+	indices.reserve(nodes.size());
+	for (std::size_t i = 0; i < nodes.size(); ++i)
+		indices.emplace(nodes[i], i);
+
+	std::vector<std::vector<std::size_t>> edges(nodes.size());
+	for (std::size_t i = 0; i < nodes.size(); ++i)
+	{
+		for (const auto& dependency : nodes[i]->second.dependencies)
+		{
+			if (auto itr = _nodes.find(dependency); itr != _nodes.end())
+				edges[i].push_back(indices.at(&*itr));
+		}
+	}
+	return edges;
+}
+
+/**
+ * Finds strongly connected components using Tarjan's algorithm with explicit stack.
+ * Components are returned so each component follows all components it depends on.
+ */
+std::vector<std::vector<std::size_t>> RuleDependencyGraph::getComponents(const std::vector<std::vector<std::size_t>>& edges) const
+{
+	constexpr auto Unvisited = std::numeric_limits<std::size_t>::max();
+
+	std::vector<std::size_t> order(edges.size(), Unvisited);
+	std::vector<std::size_t> lowLinks(edges.size());
+	std::vector<bool> onStack(edges.size());
+	std::vector<std::size_t> stack;
+	std::vector<std::pair<std::size_t, std::size_t>> calls; ///< Visited node and index of its next edge
+	std::size_t counter = 0;
+
+	std::vector<std::vector<std::size_t>> result;
+	auto enter = [&](std::size_t node) {
+		order[node] = lowLinks[node] = counter++;
+		stack.push_back(node);
+		onStack[node] = true;
+		calls.emplace_back(node, 0);
+	};
+
+	for (std::size_t root = 0; root < edges.size(); ++root)
+	{
+		if (order[root] != Unvisited)
+			continue;
+
+		enter(root);
+		while (!calls.empty())
+		{
+			auto [node, edge] = calls.back();
+			if (edge < edges[node].size())
+			{
+				++calls.back().second;
+				auto next = edges[node][edge];
+				if (order[next] == Unvisited)
+					enter(next);
+				else if (onStack[next])
+					lowLinks[node] = std::min(lowLinks[node], order[next]);
+				continue;
+			}
+
+			calls.pop_back();
+			if (!calls.empty())
+				lowLinks[calls.back().first] = std::min(lowLinks[calls.back().first], lowLinks[node]);
+
+			if (lowLinks[node] != order[node])
+				continue;
+
+			std::vector<std::size_t> component;
+			std::size_t member;
+			do
+			{
+				member = stack.back();
+				stack.pop_back();
+				onStack[member] = false;
+				component.push_back(member);
+			} while (member != node);
+			result.push_back(std::move(component));
+		}
+	}
+
+	return result;
+}
+
+std::vector<std::string> RuleDependencyGraph::getReachable(const std::string& name, bool dependents) const
+{
+	std::vector<std::string> result;
+	std::unordered_set<std::string> visited;
+	// Rules are visited in breadth-first order, so the result itself is the queue of pending rules
+	for (std::size_t i = 0; i <= result.size(); ++i)
+	{
+		const auto& current = i == 0 ? name : result[i - 1];
+		const std::vector<std::string>* next = nullptr;
+		if (dependents)
+		{
+			if (auto itr = _dependents.find(current); itr != _dependents.end())
+				next = &itr->second;
+		}
+		else if (auto itr = _nodes.find(current); itr != _nodes.end())
+			next = &itr->second.dependencies;
+
+		if (!next)
+			continue;
+
+		for (const auto& other : *next)
+		{
+			if (hasRule(other) && visited.insert(other).second)
+				result.push_back(other);
+		}
+	}
+	return result;
+}
+
+}
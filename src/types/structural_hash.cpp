@@ -0,0 +1,672 @@
+/**
+ * @file src/types/structural_hash.cpp
+ * @brief Implementation of structural hashes of expressions.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <unordered_map>
+
+#include "yaramod/types/hex_string.h"
+#include "yaramod/types/regexp.h"
+#include "yaramod/types/structural_hash.h"
+#include "yaramod/utils/traversal.h"
+
+namespace yaramod {
+
+namespace {
+
+std::uint64_t mix(std::uint64_t value)
+{
+	value ^= value >> 33;
+	value *= 0xff51afd7ed558ccd;
+	value ^= value >> 33;
+	value *= 0xc4ceb9fe1a85ec53;
+	value ^= value >> 33;
+	return value;
+}
+
+bool isChain(Expression::Kind kind)
+{
+	switch (kind)
+	{
+		case Expression::Kind::And:
+		case Expression::Kind::Or:
+		case Expression::Kind::Plus:
+		case Expression::Kind::Multiply:
+		case Expression::Kind::BitwiseAnd:
+		case Expression::Kind::BitwiseOr:
+		case Expression::Kind::BitwiseXor:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/**
+ * Returns the kind under which the expression is hashed. Greater than comparisons
+ * are hashed as less than comparisons with swapped operands.
+ */
+Expression::Kind getCanonicalKind(Expression::Kind kind)
+{
+	switch (kind)
+	{
+		case Expression::Kind::Gt: return Expression::Kind::Lt;
+		case Expression::Kind::Ge: return Expression::Kind::Le;
+		default: return kind;
+	}
+}
+
+void addHexUnits(StructuralHasher& hasher, const std::vector<std::shared_ptr<HexStringUnit>>& units)
+{
+	hasher.add(units.size());
+	for (const auto& unit : units)
+	{
+		if (unit->isNibble())
+			hasher.add(static_cast<const HexStringNibble*>(unit.get())->getValue());
+		else if (unit->isWildcard())
+			hasher.add(0x10);
+		else if (unit->isJump())
+		{
+			const auto* jump = static_cast<const HexStringJump*>(unit.get());
+			hasher.add(0x11);
+			hasher.add(jump->getLow().value_or(0));
+			hasher.add(jump->getHigh().value_or(std::numeric_limits<std::uint64_t>::max()));
+		}
+		else if (unit->isOr())
+		{
+			const auto& substrings = static_cast<const HexStringOr*>(unit.get())->getSubstrings();
+			hasher.add(0x12);
+			hasher.add(substrings.size());
+			for (const auto& substring : substrings)
+				addHexUnits(hasher, substring->getUnits());
+		}
+	}
+}
+
+}
+
+/**
+ * Returns the hash as 32 hexadecimal digits.
+ */
+std::string StructuralHash::getText() const
+{
+	static const char digits[] = "0123456789abcdef";
+
+	std::string result(32, '0');
+	for (std::size_t i = 0; i < 16; ++i)
+	{
+		result[15 - i] = digits[(high >> (4 * i)) & 0xF];
+		result[31 - i] = digits[(low >> (4 * i)) & 0xF];
+	}
+	return result;
+}
+
+void StructuralHasher::add(std::uint64_t value)
+{
+	_high = mix(_high + value * 0x9e3779b97f4a7c15);
+	_low = mix((_low ^ value) + 0x632be59bd9b4e019) ^ _high;
+	++_count;
+}
+
+void StructuralHasher::add(const std::string& value)
+{
+	add(value.size());
+	for (std::size_t i = 0; i < value.size(); i += 8)
+	{
+		// Bytes are always taken in the same order, so the hash does not depend on endianness
+		std::uint64_t chunk = 0;
+		for (std::size_t j = i; j < std::min(i + 8, value.size()); ++j)
+			chunk |= static_cast<std::uint64_t>(static_cast<unsigned char>(value[j])) << (8 * (j - i));
+		add(chunk);
+	}
+}
+
+void StructuralHasher::add(const StructuralHash& value)
+{
+	add(value.high);
+	add(value.low);
+}
+
+StructuralHash StructuralHasher::get() const
+{
+	return {mix(_high ^ _count), mix(_low + _count) ^ _high};
+}
+
+/**
+ * Returns the cached hash if it was computed in the same context and nothing which it depends
+ * on was modified since then.
+ */
+std::optional<StructuralHash> StructuralHashCache::get(std::uint64_t context)
+{
+	std::optional<StructuralHash> result;
+	lock();
+	if (_valid && _context == context && _generation == _currentGeneration.load(std::memory_order_relaxed))
+		result = _hash;
+	unlock();
+	return result;
+}
+
+void StructuralHashCache::set(const StructuralHash& hash, std::uint64_t context)
+{
+	lock();
+	_valid = true;
+	_hash = hash;
+	_context = context;
+	_generation = _currentGeneration.load(std::memory_order_relaxed);
+	unlock();
+}
+
+/**
+ * Links the cache to the cache of the expression whose cached hash depends on it. Expression which
+ * is already linked to another expression which still holds it is shared by more expressions,
+ * so its modification could not invalidate all of them and it is never linked again.
+ *
+ * @param parent Cache of the expression whose hash depends on the expression.
+ * @param inner @c true for inner nodes of chains which don't have their own hashes, other
+ *   expressions need to have their hashes cached.
+ *
+ * @return @c true if the hash of the parent can be cached.
+ */
+bool StructuralHashCache::link(StructuralHashCache* parent, bool inner)
+{
+	StructuralHashCache* previous = nullptr;
+	StructuralHashCache* replaced = nullptr;
+	lock();
+	bool result = !_shared && (_valid || inner);
+	if (result && _parent && _parent != parent)
+	{
+		// The previous parent may have been moved or it may not exist anymore
+		_parent->lock();
+		auto owner = _parent->_owner;
+		_parent->unlock();
+
+		bool held = false;
+		if (owner)
+		{
+			forEachSubexpression(const_cast<Expression*>(owner), [&](const Expression::Ptr& subexpr) {
+				held = held || subexpr->_structuralHashCache.get() == this;
+			});
+		}
+		if (held)
+		{
+			_shared = true;
+			_valid = false;
+			previous = std::exchange(_parent, nullptr);
+			result = false;
+		}
+	}
+	if (result)
+	{
+		_valid = true;
+		if (_parent != parent)
+		{
+			parent->acquire();
+			replaced = std::exchange(_parent, parent);
+		}
+	}
+	unlock();
+
+	if (previous)
+	{
+		invalidate(previous);
+		release(previous);
+	}
+	release(replaced);
+	return result;
+}
+
+/**
+ * Removes the link to @p parent after the expression stopped being its subexpression.
+ */
+void StructuralHashCache::unlink(const StructuralHashCache* parent)
+{
+	StructuralHashCache* unlinked = nullptr;
+	lock();
+	if (parent && _parent == parent)
+		unlinked = std::exchange(_parent, nullptr);
+	unlock();
+	release(unlinked);
+}
+
+/**
+ * Invalidates the cached hash and the cached hashes of all expressions which depend on it.
+ * Caches which were invalidated before stop the invalidation, since caches depending on them
+ * were invalidated at the same time.
+ */
+void StructuralHashCache::invalidate(StructuralHashCache* cache)
+{
+	if (!cache)
+		return;
+
+	cache->acquire();
+	while (cache)
+	{
+		cache->lock();
+		auto parent = cache->_valid ? cache->_parent : nullptr;
+		cache->_valid = false;
+		if (parent)
+			parent->acquire();
+		cache->unlock();
+		release(cache);
+		cache = parent;
+	}
+}
+
+/**
+ * Invalidates all cached hashes.
+ */
+void StructuralHashCache::invalidateAll()
+{
+	_currentGeneration.fetch_add(1, std::memory_order_relaxed);
+	StructuralModificationCounter::increment();
+}
+
+void StructuralHashCache::acquire()
+{
+	_references.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * Releases the reference to the cache. Caches of parents referenced only by the released
+ * cache are released in the same loop, so long chains of caches are not released recursively.
+ */
+void StructuralHashCache::release(StructuralHashCache* cache)
+{
+	while (cache && cache->_references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		auto parent = cache->_parent;
+		delete cache;
+		cache = parent;
+	}
+}
+
+void StructuralHashCache::lock()
+{
+	while (_lock.test_and_set(std::memory_order_acquire))
+		std::this_thread::yield();
+}
+
+void StructuralHashCache::unlock()
+{
+	_lock.clear(std::memory_order_release);
+}
+
+StructuralHashCacheRef::~StructuralHashCacheRef()
+{
+	if (auto cache = get())
+	{
+		cache->lock();
+		cache->_owner = nullptr;
+		cache->unlock();
+		StructuralHashCache::release(cache);
+	}
+}
+
+/**
+ * Returns the cache of the expression and allocates it if the expression does not have one yet.
+ */
+StructuralHashCache& StructuralHashCacheRef::getOrCreate(const Expression* owner)
+{
+	auto cache = get();
+	if (!cache)
+	{
+		auto created = new StructuralHashCache(owner);
+		if (_cache.compare_exchange_strong(cache, created, std::memory_order_acq_rel, std::memory_order_acquire))
+			cache = created;
+		else
+			delete created;
+	}
+	return *cache;
+}
+
+/**
+ * Computation of structural hashes of expressions. Expressions are traversed using explicit stack
+ * and hashes of all visited subexpressions are cached in them, so the next computation can stop
+ * at subexpressions which were not modified since then. Hashes of operands are kept on a stack
+ * of their own, so the computation does not depend on caches modified by other threads.
+ *
+ * Parentheses are ignored. Operands of chains of the same commutative and associative operation,
+ * like `a and (b and c)`, are hashed in order of their hashes, so `c and a and b` has the same hash.
+ * Operands of `==` and `!=` are sorted the same way and `a > b` has the same hash as `b < a`.
+ */
+class StructuralHashComputation
+{
+	/**
+	 * Subexpression and the expression which it is subexpression of.
+	 */
+	struct Link
+	{
+		const Expression* expr;
+		const Expression* parent;
+		bool inner; ///< Set for inner nodes of chains which do not have their own hashes
+	};
+
+public:
+	StructuralHashComputation(const std::vector<std::string>* stringIds)
+	{
+		if (!stringIds)
+			return;
+
+		StructuralHasher context;
+		for (std::size_t i = 0; i < stringIds->size(); ++i)
+		{
+			const auto& id = (*stringIds)[i];
+			context.add(id);
+			// Anonymous strings can not be referenced by their identifier
+			if (id.size() > 1)
+				_stringIndices.emplace(id.substr(1), i);
+		}
+		_context = context.get().low | 1;
+	}
+
+	StructuralHash compute(const Expression* root)
+	{
+		std::vector<std::pair<const Expression*, bool>> stack{{root, false}};
+		std::vector<StructuralHash> hashes;
+		std::vector<const Expression*> operands;
+		std::vector<Link> links;
+		while (!stack.empty())
+		{
+			auto [expr, entered] = stack.back();
+			stack.pop_back();
+			if (!entered)
+			{
+				auto cache = expr->_structuralHashCache.get();
+				if (auto hash = cache ? cache->get(_context) : std::nullopt)
+				{
+					hashes.push_back(*hash);
+					continue;
+				}
+			}
+
+			operands.clear();
+			links.clear();
+			collectOperands(expr, operands, links);
+			if (!entered)
+			{
+				stack.emplace_back(expr, true);
+				for (auto itr = operands.rbegin(), end = operands.rend(); itr != end; ++itr)
+					stack.emplace_back(*itr, false);
+				continue;
+			}
+
+			// Hashes of operands are on the top of the stack in order of the operands
+			std::vector<StructuralHash> operandHashes(hashes.end() - operands.size(), hashes.end());
+			hashes.resize(hashes.size() - operands.size());
+			hashes.push_back(combine(expr, operandHashes));
+			// Cache is created even if the hash is not cached, so later modifications are counted
+			auto& cache = expr->_structuralHashCache.getOrCreate(expr);
+			if (link(links) && !isRuleReference(expr))
+				cache.set(hashes.back(), _context);
+			else
+				StructuralHashCache::invalidate(&cache);
+		}
+
+		return hashes.back();
+	}
+
+private:
+	/**
+	 * Collects operands whose hashes are needed for the hash of the expression. Chains of the same
+	 * commutative and associative operation are collected as a whole without their inner nodes.
+	 * All expressions on the way to the operands are collected into @p links together with
+	 * the expressions which they are subexpressions of.
+	 */
+	void collectOperands(const Expression* expr, std::vector<const Expression*>& operands, std::vector<Link>& links) const
+	{
+		auto kind = expr->getKind();
+		if (isChain(kind))
+		{
+			std::vector<std::pair<const Expression*, const Expression*>> pending{{expr, nullptr}};
+			while (!pending.empty())
+			{
+				auto [operand, parent] = pending.back();
+				pending.pop_back();
+				while (operand->getKind() == Expression::Kind::Parentheses)
+				{
+					links.push_back({operand, parent, true});
+					parent = operand;
+					operand = static_cast<const ParenthesesExpression*>(operand)->getEnclosedExpression().get();
+				}
+
+				if (parent)
+					links.push_back({operand, parent, operand->getKind() == kind});
+				if (operand->getKind() != kind)
+				{
+					operands.push_back(operand);
+					continue;
+				}
+
+				const auto* binary = static_cast<const BinaryOpExpression*>(operand);
+				pending.emplace_back(binary->getRightOperand().get(), operand);
+				pending.emplace_back(binary->getLeftOperand().get(), operand);
+			}
+			return;
+		}
+
+		forEachSubexpression(const_cast<Expression*>(expr), [&](const Expression::Ptr& subexpr) {
+			operands.push_back(subexpr.get());
+			links.push_back({subexpr.get(), expr, false});
+		});
+		if (kind != getCanonicalKind(kind))
+			std::reverse(operands.begin(), operands.end());
+	}
+
+	/**
+	 * Links subexpressions to the expressions which they are subexpressions of, so their modifications
+	 * invalidate the hashes of their parents too. Operands need to have their hashes cached and inner
+	 * nodes of chains are marked as not modified.
+	 *
+	 * @return @c true if the hash of the expression can be cached.
+	 */
+	bool link(const std::vector<Link>& links) const
+	{
+		bool result = true;
+		for (const auto& link : links)
+		{
+			auto& parent = link.parent->_structuralHashCache.getOrCreate(link.parent);
+			result = link.expr->_structuralHashCache.getOrCreate(link.expr).link(&parent, link.inner) && result;
+		}
+		return result;
+	}
+
+	/**
+	 * References to other rules are hashed by the names of the rules, which can be changed without
+	 * modification of the referencing expression, so their hashes are never cached.
+	 */
+	static bool isRuleReference(const Expression* expr)
+	{
+		if (expr->getKind() != Expression::Kind::Id)
+			return false;
+
+		const auto& symbol = static_cast<const IdExpression*>(expr)->getSymbol();
+		return symbol->isValue() && symbol->getDataType() == Expression::Type::Bool;
+	}
+
+	StructuralHash combine(const Expression* expr, std::vector<StructuralHash>& hashes) const
+	{
+		auto kind = expr->getKind();
+		if (kind == Expression::Kind::Parentheses)
+			return hashes.front();
+
+		if (isChain(kind) || kind == Expression::Kind::Eq || kind == Expression::Kind::Neq)
+			std::sort(hashes.begin(), hashes.end());
+
+		StructuralHasher hasher;
+		hasher.add(static_cast<std::uint64_t>(getCanonicalKind(kind)));
+		hasher.add(hashes.size());
+		for (const auto& hash : hashes)
+			hasher.add(hash);
+
+		dispatchByKind(const_cast<Expression*>(expr), [&](auto* concrete) {
+			using T = std::decay_t<decltype(*concrete)>;
+			if constexpr (std::is_same_v<T, StringWildcardExpression>)
+			{
+				useToken(concrete->getFirstTokenIt());
+				addWildcard(hasher, concrete->getId());
+			}
+			else if constexpr (std::is_same_v<T, StringExpression> || std::is_same_v<T, StringAtExpression>
+				|| std::is_same_v<T, StringInRangeExpression> || std::is_same_v<T, StringCountExpression>
+				|| std::is_same_v<T, StringOffsetExpression> || std::is_same_v<T, StringLengthExpression>)
+			{
+				useToken(concrete->getFirstTokenIt());
+				addIdentifier(hasher, concrete->getId());
+			}
+			else if constexpr (std::is_same_v<T, IdExpression> || std::is_same_v<T, StructAccessExpression>)
+			{
+				useToken(concrete->getSymbolToken());
+				hasher.add(concrete->getSymbol()->getName());
+			}
+			else if constexpr (std::is_same_v<T, ForDictExpression>)
+			{
+				hasher.add(concrete->getId1());
+				hasher.add(concrete->getId2());
+			}
+			else if constexpr (std::is_same_v<T, ForArrayExpression>)
+				hasher.add(concrete->getId());
+			else if constexpr (std::is_same_v<T, BoolLiteralExpression> || std::is_same_v<T, IntLiteralExpression>)
+			{
+				useToken(concrete->getFirstTokenIt());
+				hasher.add(static_cast<std::uint64_t>(concrete->getValue()));
+			}
+			else if constexpr (std::is_same_v<T, StringLiteralExpression>)
+			{
+				useToken(concrete->getFirstTokenIt());
+				hasher.add(concrete->getValue());
+			}
+			else if constexpr (std::is_same_v<T, DoubleLiteralExpression>)
+			{
+				useToken(concrete->getFirstTokenIt());
+				double value = concrete->getValue();
+				std::uint64_t bits;
+				std::memcpy(&bits, &value, sizeof(bits));
+				hasher.add(bits);
+			}
+			else if constexpr (std::is_same_v<T, IntFunctionExpression>)
+			{
+				useToken(concrete->getFirstTokenIt());
+				hasher.add(concrete->getFunction());
+			}
+			else if constexpr (std::is_same_v<T, RegexpExpression>)
+				hasher.add(concrete->getRegexpString()->getText());
+		});
+
+		return hasher.get();
+	}
+
+	/**
+	 * Marks the value of the token as used by the cached hash, so its modification invalidates it.
+	 */
+	static void useToken(TokenIt token)
+	{
+		token->getLiteral().useInStructuralHash();
+	}
+
+	void addIdentifier(StructuralHasher& hasher, const std::string& id) const
+	{
+		auto name = id.substr(1);
+		if (auto itr = _stringIndices.find(name); itr != _stringIndices.end())
+		{
+			hasher.add(1);
+			hasher.add(itr->second);
+		}
+		else
+		{
+			hasher.add(2);
+			hasher.add(name);
+		}
+	}
+
+	/**
+	 * Wildcards like `$a*` are hashed as the set of strings which they match if they are known.
+	 */
+	void addWildcard(StructuralHasher& hasher, const std::string& id) const
+	{
+		auto prefix = id.substr(1, id.size() - 2);
+		if (_context == 0)
+		{
+			hasher.add(2);
+			hasher.add(prefix);
+			return;
+		}
+
+		std::vector<std::size_t> indices;
+		for (const auto& [name, index] : _stringIndices)
+		{
+			if (name.compare(0, prefix.size(), prefix) == 0)
+				indices.push_back(index);
+		}
+		std::sort(indices.begin(), indices.end());
+
+		hasher.add(3);
+		hasher.add(indices.size());
+		for (auto index : indices)
+			hasher.add(index);
+	}
+
+	std::unordered_map<std::string, std::size_t> _stringIndices; ///< Positions of strings by their names without `$`
+	std::uint64_t _context = 0; ///< Hash of string identifiers, 0 if they are not normalized
+};
+
+/**
+ * Returns the hash of the structure of the expression which does not depend on its formatting,
+ * comments, parentheses and order of operands of commutative operations. Hashes are cached
+ * in the expression and its subexpressions until anything is modified.
+ *
+ * @return Structural hash.
+ */
+StructuralHash Expression::structuralHash() const
+{
+	return StructuralHashComputation(nullptr).compute(this);
+}
+
+/**
+ * Returns the structural hash of the expression where references to strings are replaced
+ * with their positions in @p stringIds, so it does not depend on names of strings.
+ *
+ * @param stringIds Identifiers of strings like `$a` in order of their definition.
+ *
+ * @return Structural hash.
+ */
+StructuralHash Expression::structuralHash(const std::vector<std::string>& stringIds) const
+{
+	return StructuralHashComputation(&stringIds).compute(this);
+}
+
+/**
+ * Returns the hash of the string which does not depend on its identifier, formatting
+ * and order of its modifiers.
+ *
+ * @return Structural hash.
+ */
+StructuralHash String::structuralHash() const
+{
+	StructuralHasher hasher;
+	hasher.add(static_cast<std::uint64_t>(getType()));
+	if (isHex())
+		addHexUnits(hasher, static_cast<const HexString*>(this)->getUnits());
+	else if (isRegexp())
+		hasher.add(getPureText() + "/" + static_cast<const Regexp*>(this)->getSuffixModifiers());
+	else
+		hasher.add(getPureText());
+
+	hasher.add(isAscii() | isWide() << 1 | isNocase() << 2 | isFullword() << 3 | isPrivate() << 4);
+	if (auto itr = _mods.find(StringModifier::Type::Xor); itr != _mods.end())
+	{
+		const auto* xorModifier = static_cast<const XorStringModifier*>(itr->second.get());
+		auto low = xorModifier->getLow().value_or(0);
+		hasher.add(low);
+		hasher.add(xorModifier->getLow() ? xorModifier->getHigh().value_or(low) : 255);
+	}
+	if (auto itr = _mods.find(StringModifier::Type::Base64); itr != _mods.end())
+		hasher.add("base64:" + static_cast<const Base64StringModifier*>(itr->second.get())->getAlphabet().value_or(""));
+	if (auto itr = _mods.find(StringModifier::Type::Base64Wide); itr != _mods.end())
+		hasher.add("base64wide:" + static_cast<const Base64WideStringModifier*>(itr->second.get())->getAlphabet().value_or(""));
+	return hasher.get();
+}
+
+}
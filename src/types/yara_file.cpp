@@ -4,13 +4,99 @@
  * @copyright (c) 2017 Avast Software, licensed under the MIT license
  */
 
+#include <fstream>
 #include <iterator>
+#include <utility>
 
+#include "yaramod/builder/yara_expression_builder.h"
 #include "yaramod/types/yara_file.h"
+#include "yaramod/utils/modifying_visitor.h"
+#include "yaramod/utils/observing_visitor.h"
+#include "yaramod/utils/serialization.h"
 #include "yaramod/utils/utils.h"
 
 namespace yaramod {
 
+namespace {
+
+/**
+ * Assigns the token stream to all expressions of the observed condition.
+ */
+class TokenStreamAssigner : public ObservingVisitor
+{
+public:
+	TokenStreamAssigner(const std::shared_ptr<TokenStream>& tokenStream) : _tokenStream(tokenStream) {}
+
+	/// @name Visit methods
+	/// @{
+	virtual VisitResult visit(StringExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(StringWildcardExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(StringAtExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(StringInRangeExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(StringCountExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(StringOffsetExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(StringLengthExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(NotExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(UnaryMinusExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(BitwiseNotExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(AndExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(OrExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(LtExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(GtExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(LeExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(GeExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(EqExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(NeqExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(ContainsExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(MatchesExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(PlusExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(MinusExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(MultiplyExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(DivideExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(ModuloExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(BitwiseXorExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(BitwiseAndExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(BitwiseOrExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(ShiftLeftExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(ShiftRightExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(ForDictExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(ForArrayExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(ForStringExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(OfExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(IterableExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(SetExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(RangeExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(IdExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(StructAccessExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(ArrayAccessExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(FunctionCallExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(BoolLiteralExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(StringLiteralExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(IntLiteralExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(DoubleLiteralExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(FilesizeExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(EntrypointExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(AllExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(AnyExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(ThemExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(ParenthesesExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(IntFunctionExpression* expr) override { return assign(expr); }
+	virtual VisitResult visit(RegexpExpression* expr) override { return assign(expr); }
+	/// @}
+
+private:
+	template <typename T>
+	VisitResult assign(T* expr)
+	{
+		expr->setTokenStream(_tokenStream);
+		return ObservingVisitor::visit(expr);
+	}
+
+	std::shared_ptr<TokenStream> _tokenStream; ///< Token stream to assign
+};
+
+}
+
 /**
  * Constructor.
  */
@@ -28,6 +114,7 @@ YaraFile::YaraFile(const std::shared_ptr<TokenStream>& tokenStream, Features fea
 	, _importTable()
 	, _ruleTable()
 	, _Features(features)
+	, _lean(false)
 {
 	if (_Features & Features::VirusTotalOnly)
 		initializeVTSymbols();
@@ -41,6 +128,7 @@ YaraFile::YaraFile(YaraFile&& o) noexcept
 	, _ruleTable(std::move(o._ruleTable))
 	, _Features(std::move(o._Features))
 	, _vtSymbols(std::move(o._vtSymbols))
+	, _lean(o._lean)
 {
 }
 
@@ -53,6 +141,10 @@ YaraFile& YaraFile::operator=(YaraFile&& o) noexcept
 	std::swap(_ruleTable, o._ruleTable);
 	std::swap(_Features, o._Features);
 	std::swap(_vtSymbols, o._vtSymbols);
+	std::swap(_lean, o._lean);
+	// Dependency graphs refer to the files they were built from, so they are built again on the next access
+	_dependencyGraph.reset();
+	o._dependencyGraph.reset();
 	return *this;
 }
 
@@ -197,8 +289,23 @@ std::string YaraFile::getText() const
 	return trim(ss.str());
 }
 
+/**
+ * Returns the autoformatted string representation of the whole YARA file
+ * including its comments. Files parsed in `ParserMode::Lean` do not keep comments
+ * and layout tokens so the representation from @c getText() is returned instead.
+ * Conditions which were not parsed yet are parsed first so their tokens are available.
+ *
+ * @param withIncludes Whether to include the content of included files.
+ *
+ * @return Formatted string representation.
+ */
 std::string YaraFile::getTextFormatted(bool withIncludes) const
 {
+	if (_lean)
+		return getText();
+
+	for (const auto& rule : _rules)
+		rule->getCondition();
 	return getTokenStream()->getText(withIncludes);
 }
 
@@ -248,6 +355,9 @@ void YaraFile::addRule(std::unique_ptr<Rule>&& rule, bool extractTokens)
 		_tokenStream->moveAppend(rule->getTokenStream());
 	_rules.emplace_back(std::move(rule));
 	_ruleTable.emplace(_rules.back()->getName(), _rules.back().get());
+	std::lock_guard<std::mutex> lock(_dependencyGraphMutex);
+	if (_dependencyGraph)
+		_dependencyGraph->addRule(*_rules.back());
 }
 
 /**
@@ -262,6 +372,9 @@ void YaraFile::addRule(const std::shared_ptr<Rule>& rule, bool extractTokens)
 		_tokenStream->moveAppend(rule->getTokenStream());
 	_rules.emplace_back(rule);
 	_ruleTable.emplace(_rules.back()->getName(), _rules.back().get());
+	std::lock_guard<std::mutex> lock(_dependencyGraphMutex);
+	if (_dependencyGraph)
+		_dependencyGraph->addRule(*_rules.back());
 }
 
 /**
@@ -317,6 +430,9 @@ void YaraFile::insertRule(std::size_t position, std::unique_ptr<Rule>&& rule)
 
 	_rules.insert(_rules.begin() + position, std::move(rule));
 	_ruleTable.emplace(_rules[position]->getName(), _rules[position].get());
+	std::lock_guard<std::mutex> lock(_dependencyGraphMutex);
+	if (_dependencyGraph)
+		_dependencyGraph->addRule(*_rules[position]);
 }
 
 /**
@@ -341,6 +457,9 @@ void YaraFile::insertRule(std::size_t position, const std::shared_ptr<Rule>& rul
 
 	_rules.insert(_rules.begin() + position, rule);
 	_ruleTable.emplace(_rules[position]->getName(), _rules[position].get());
+	std::lock_guard<std::mutex> lock(_dependencyGraphMutex);
+	if (_dependencyGraph)
+		_dependencyGraph->addRule(*_rules[position]);
 }
 
 /**
@@ -373,6 +492,124 @@ const std::vector<std::shared_ptr<Rule>>& YaraFile::getRules() const
 	return _rules;
 }
 
+/**
+ * Returns the graph of references between rules of the YARA file, see the const overload.
+ *
+ * @return Dependency graph of rules.
+ */
+RuleDependencyGraph& YaraFile::getDependencyGraph()
+{
+	return const_cast<RuleDependencyGraph&>(std::as_const(*this).getDependencyGraph());
+}
+
+/**
+ * Returns the graph of references between rules of the YARA file. The graph is built
+ * on the first access and then it is updated whenever rules are added or removed.
+ * Renamed rules and modified conditions are updated on the next access, see
+ * RuleDependencyGraph::refresh(). Rules are refreshed only if any rule or expression
+ * was modified since the last access, see StructuralModificationCounter. Conditions
+ * which were not parsed yet are parsed. The graph is built, updated and refreshed under
+ * a lock, so it can be accessed from multiple threads as long as no thread modifies the file.
+ *
+ * @return Dependency graph of rules.
+ */
+const RuleDependencyGraph& YaraFile::getDependencyGraph() const
+{
+	std::lock_guard<std::mutex> lock(_dependencyGraphMutex);
+	// Modifications made during the refresh are picked up on the next access
+	auto modifications = StructuralModificationCounter::get();
+	if (!_dependencyGraph)
+		_dependencyGraph = std::make_unique<RuleDependencyGraph>(*this);
+	else if (modifications != _dependencyGraphModifications)
+		_dependencyGraph->refresh(_rules);
+	_dependencyGraphModifications = modifications;
+	return *_dependencyGraph;
+}
+
+/**
+ * Parses all conditions which were not parsed yet.
+ */
+void YaraFile::loadConditions() const
+{
+	for (const auto& rule : _rules)
+		rule->getCondition();
+}
+
+/**
+ * Moves tokens of each condition into its own token stream and assigns it
+ * to the expressions of the condition. Neighbouring tokens are copied into
+ * the new token stream so the condition is never at its boundary.
+ *
+ * @return Detached conditions in the order of rules.
+ */
+std::vector<YaraFile::DetachedCondition> YaraFile::detachConditions()
+{
+	std::vector<DetachedCondition> detached(_rules.size());
+	for (std::size_t i = 0; i < _rules.size(); ++i)
+	{
+		const auto& condition = _rules[i]->getCondition();
+		if (!condition)
+			continue;
+
+		auto tokenStream = condition->getTokenStreamSharedPtr();
+		auto first = condition->getFirstTokenIt();
+		auto position = std::next(condition->getLastTokenIt());
+
+		auto detachedTokenStream = std::make_shared<TokenStream>();
+		detachedTokenStream->push_back(*std::prev(first));
+		auto detachedEnd = detachedTokenStream->push_back(*position);
+		detachedTokenStream->moveAppend(detachedEnd, tokenStream.get(), first, position);
+		TokenStreamAssigner(detachedTokenStream).observe(condition);
+
+		detached[i] = DetachedCondition{std::move(tokenStream), position, std::move(detachedTokenStream)};
+	}
+	return detached;
+}
+
+/**
+ * Moves tokens of detached conditions back to their original token streams.
+ *
+ * @param detached Conditions returned by @c detachConditions().
+ */
+void YaraFile::attachConditions(std::vector<DetachedCondition>&& detached)
+{
+	for (std::size_t i = 0; i < detached.size(); ++i)
+	{
+		const auto& [tokenStream, position, detachedTokenStream] = detached[i];
+		if (!tokenStream)
+			continue;
+
+		tokenStream->moveAppend(position, detachedTokenStream.get(), std::next(detachedTokenStream->begin()), std::prev(detachedTokenStream->end()));
+		const auto& condition = _rules[i]->getCondition();
+		if (condition && condition->getTokenStream() == detachedTokenStream.get())
+			TokenStreamAssigner(tokenStream).observe(condition);
+	}
+}
+
+/**
+ * Lets the visitor observe the condition of the rule.
+ *
+ * @param rule Rule to visit.
+ * @param visitor Visitor.
+ */
+void YaraFile::observeCondition(const Rule& rule, Visitor& visitor)
+{
+	if (const auto& condition = rule.getCondition())
+		condition->accept(&visitor);
+}
+
+/**
+ * Lets the visitor modify the condition of the rule.
+ *
+ * @param rule Rule to visit.
+ * @param visitor Visitor.
+ */
+void YaraFile::modifyCondition(Rule& rule, ModifyingVisitor& visitor)
+{
+	if (const auto& condition = rule.getCondition())
+		rule.setCondition(visitor.modify(condition, boolVal(true).get()));
+}
+
 /**
  * Finds the symbol in the YARA file. Symbol is either rule name or module identifier.
  *
@@ -398,6 +635,48 @@ std::shared_ptr<Symbol> YaraFile::findSymbol(const std::string& name) const
 	return nullptr;
 }
 
+/**
+ * Saves the snapshot of the YARA file into the file at the given path. Snapshot
+ * is the serialized YARA file (see serialize()) which can be loaded with
+ * loadSnapshot() much faster than the YARA file can be parsed. Conditions
+ * which were not parsed yet are parsed.
+ *
+ * @param path Path of the snapshot file.
+ */
+void YaraFile::saveSnapshot(const std::string& path) const
+{
+	auto data = serialize(*this);
+
+	std::ofstream output(path, std::ios::binary | std::ios::trunc);
+	if (!output.write(data.data(), data.size()) || !output.flush())
+		throw YaramodError("Error: Unable to write snapshot '" + path + "'");
+}
+
+/**
+ * Loads the YARA file from the snapshot saved with saveSnapshot(). The whole
+ * snapshot is read into memory at once. Throws YaramodError if the snapshot
+ * cannot be read, was saved by another version of yaramod or from YARA file
+ * with other features.
+ *
+ * @param path Path of the snapshot file.
+ * @param features Features the YARA file of the snapshot was created with.
+ *
+ * @return Loaded YARA file.
+ */
+std::unique_ptr<YaraFile> YaraFile::loadSnapshot(const std::string& path, Features features)
+{
+	std::ifstream input(path, std::ios::binary | std::ios::ate);
+	auto size = input ? static_cast<std::streamoff>(input.tellg()) : -1;
+	if (size < 0)
+		throw YaramodError("Error: Unable to read snapshot '" + path + "'");
+
+	std::string data(static_cast<std::size_t>(size), '\0');
+	if (!input.seekg(0) || !input.read(data.data(), size))
+		throw YaramodError("Error: Unable to read snapshot '" + path + "'");
+
+	return deserializeYaraFile(data, features);
+}
+
 /**
  * Returns whether the YARA file contains any imported modules.
  *
@@ -0,0 +1,445 @@
+/**
+ * @file src/utils/atoms.cpp
+ * @brief Implementation of atom extraction from strings of YARA rules.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#include <algorithm>
+#include <bitset>
+#include <optional>
+
+#include "yaramod/types/hex_string.h"
+#include "yaramod/types/regexp.h"
+#include "yaramod/utils/atoms.h"
+#include "yaramod/utils/utils.h"
+
+namespace yaramod {
+
+namespace {
+
+/**
+ * Sequence of bytes which needs to be matched one after another.
+ */
+struct MaskedBytes
+{
+	void push(std::uint8_t byte, std::uint8_t mask)
+	{
+		bytes.push_back(byte & mask);
+		masks.push_back(mask);
+	}
+
+	std::vector<std::uint8_t> bytes;
+	std::vector<std::uint8_t> masks;
+};
+
+int getAtomsQuality(const std::vector<Atom>& atoms)
+{
+	if (atoms.empty())
+		return 0;
+
+	return std::min_element(atoms.begin(), atoms.end(), [](const auto& a1, const auto& a2) { return a1.quality < a2.quality; })->quality;
+}
+
+/**
+ * Returns the best atom which can be taken from the sequence of bytes.
+ * Atoms neither start nor end with wildcard byte.
+ */
+std::vector<Atom> getBestAtom(const MaskedBytes& sequence, bool wide)
+{
+	const MaskedBytes* source = &sequence;
+	MaskedBytes wideSequence;
+	if (wide)
+	{
+		for (std::size_t i = 0; i < sequence.bytes.size(); ++i)
+		{
+			wideSequence.push(sequence.bytes[i], sequence.masks[i]);
+			wideSequence.push(0x00, 0xFF);
+		}
+		source = &wideSequence;
+	}
+
+	const auto& bytes = source->bytes;
+	const auto& masks = source->masks;
+	std::optional<Atom> best;
+	for (std::size_t start = 0; start < bytes.size(); ++start)
+	{
+		if (masks[start] == 0x00)
+			continue;
+
+		for (std::size_t end = start + 1; end <= std::min(start + Atom::MaxLength, bytes.size()); ++end)
+		{
+			if (masks[end - 1] == 0x00)
+				continue;
+
+			std::vector<std::uint8_t> atomBytes(bytes.begin() + start, bytes.begin() + end);
+			std::vector<std::uint8_t> atomMasks(masks.begin() + start, masks.begin() + end);
+			auto quality = getAtomQuality(atomBytes, atomMasks);
+			if (!best || quality > best->quality)
+				best = Atom{std::move(atomBytes), std::move(atomMasks), quality};
+		}
+	}
+
+	if (!best)
+		return {};
+	return {std::move(best.value())};
+}
+
+/**
+ * Replaces @p best with @p candidate if the candidate has atoms with better quality.
+ */
+void chooseBetterAtoms(std::vector<Atom>& best, std::vector<Atom>&& candidate)
+{
+	if (!candidate.empty() && (best.empty() || getAtomsQuality(candidate) > getAtomsQuality(best)))
+		best = std::move(candidate);
+}
+
+/**
+ * Returns atoms which need to be looked for when any of the alternatives can be matched.
+ * If there is an alternative without atoms, no atoms can be used at all.
+ */
+std::vector<Atom> mergeAlternativeAtoms(std::vector<std::vector<Atom>>&& alternatives)
+{
+	std::vector<Atom> result;
+	for (auto& atoms : alternatives)
+	{
+		if (atoms.empty())
+			return {};
+
+		for (auto& atom : atoms)
+		{
+			auto sameAtom = std::find_if(result.begin(), result.end(), [&](const auto& other) {
+				return atom.bytes == other.bytes && atom.masks == other.masks;
+			});
+			if (sameAtom == result.end())
+				result.push_back(std::move(atom));
+		}
+	}
+
+	return result;
+}
+
+std::vector<Atom> extractHexAtoms(const std::vector<HexStringElement>& elements)
+{
+	std::vector<Atom> best;
+	MaskedBytes sequence;
+	for (const auto& element : elements)
+	{
+		if (element.isByte())
+		{
+			sequence.push(element.value, element.mask);
+			continue;
+		}
+
+		chooseBetterAtoms(best, getBestAtom(sequence, false));
+		sequence = MaskedBytes{};
+
+		if (element.isAlternation())
+		{
+			std::vector<std::vector<Atom>> alternatives;
+			for (const auto& alternative : element.alternatives)
+				alternatives.push_back(extractHexAtoms(alternative));
+			chooseBetterAtoms(best, mergeAlternativeAtoms(std::move(alternatives)));
+		}
+	}
+
+	chooseBetterAtoms(best, getBestAtom(sequence, false));
+	return best;
+}
+
+/**
+ * Decodes text of regular expression into sequence of bytes. Any characters
+ * match any byte so they are decoded as wildcards.
+ */
+MaskedBytes decodeRegexpBytes(const std::string& text)
+{
+	MaskedBytes result;
+	for (const auto& byte : decodeRegexpText(text))
+		result.push(byte.value_or(0x00), byte ? 0xFF : 0x00);
+	return result;
+}
+
+/**
+ * Atoms of a unit of regular expression. Units which match exactly one sequence
+ * of bytes also keep their text so they can be joined with their neighbours
+ * into longer sequences.
+ */
+struct RegexpAtoms
+{
+	bool exact = false;
+	std::string text;
+	std::vector<Atom> atoms; ///< Empty if the unit does not need to match anything
+};
+
+class RegexpAtomExtractor : public RegexpVisitor
+{
+public:
+	RegexpAtomExtractor(bool wide) : _wide(wide) {}
+
+	RegexpAtoms extract(RegexpUnit* unit)
+	{
+		unit->accept(this);
+		return std::move(_result);
+	}
+
+	/// @name Visit methods
+	/// @{
+	virtual RegexpVisitResult visit(RegexpClass*) override { return nothing(); }
+	virtual RegexpVisitResult visit(RegexpText* expr) override
+	{
+		if (expr->isAssertion())
+			return exact({});
+		else if (expr->isClassEscape())
+			return nothing();
+		return exact(expr->getText());
+	}
+	virtual RegexpVisitResult visit(RegexpAnyChar*) override { return exact("."); }
+	virtual RegexpVisitResult visit(RegexpWordChar*) override { return nothing(); }
+	virtual RegexpVisitResult visit(RegexpNonWordChar*) override { return nothing(); }
+	virtual RegexpVisitResult visit(RegexpSpace*) override { return nothing(); }
+	virtual RegexpVisitResult visit(RegexpNonSpace*) override { return nothing(); }
+	virtual RegexpVisitResult visit(RegexpDigit*) override { return nothing(); }
+	virtual RegexpVisitResult visit(RegexpNonDigit*) override { return nothing(); }
+	// Assertions do not match any bytes so they don't break sequences of their neighbours
+	virtual RegexpVisitResult visit(RegexpWordBoundary*) override { return exact({}); }
+	virtual RegexpVisitResult visit(RegexpNonWordBoundary*) override { return exact({}); }
+	virtual RegexpVisitResult visit(RegexpStartOfLine*) override { return exact({}); }
+	virtual RegexpVisitResult visit(RegexpEndOfLine*) override { return exact({}); }
+	virtual RegexpVisitResult visit(RegexpIteration*) override { return nothing(); }
+	virtual RegexpVisitResult visit(RegexpOptional*) override { return nothing(); }
+
+	virtual RegexpVisitResult visit(RegexpPositiveIteration* expr) override
+	{
+		auto operand = extract(expr->getOperand().get());
+		_result = RegexpAtoms{false, {}, std::move(operand.atoms)};
+		return {};
+	}
+
+	virtual RegexpVisitResult visit(RegexpRange* expr) override
+	{
+		auto [low, high] = expr->getRange();
+		if (!low || low.value() == 0)
+			return nothing();
+
+		auto operand = extract(expr->getOperand().get());
+		if (operand.exact && low == high && operand.text.length() * low.value() <= 64)
+		{
+			std::string text;
+			for (std::uint64_t i = 0; i < low.value(); ++i)
+				text += operand.text;
+			return exact(std::move(text));
+		}
+
+		_result = RegexpAtoms{false, {}, std::move(operand.atoms)};
+		return {};
+	}
+
+	virtual RegexpVisitResult visit(RegexpOr* expr) override
+	{
+		std::vector<std::vector<Atom>> alternatives;
+		alternatives.push_back(extract(expr->getLeft().get()).atoms);
+		alternatives.push_back(extract(expr->getRight().get()).atoms);
+		_result = RegexpAtoms{false, {}, mergeAlternativeAtoms(std::move(alternatives))};
+		return {};
+	}
+
+	virtual RegexpVisitResult visit(RegexpGroup* expr) override
+	{
+		_result = extract(expr->getUnit().get());
+		return {};
+	}
+
+	virtual RegexpVisitResult visit(RegexpConcat* expr) override
+	{
+		bool allExact = true;
+		std::string text;
+		std::vector<Atom> best;
+		for (const auto& unit : expr->getUnits())
+		{
+			auto unitAtoms = extract(unit.get());
+			if (unitAtoms.exact)
+			{
+				text += unitAtoms.text;
+				continue;
+			}
+
+			allExact = false;
+			chooseBetterAtoms(best, getBestAtom(decodeRegexpBytes(text), _wide));
+			chooseBetterAtoms(best, std::move(unitAtoms.atoms));
+			text.clear();
+		}
+
+		if (allExact)
+			return exact(std::move(text));
+
+		chooseBetterAtoms(best, getBestAtom(decodeRegexpBytes(text), _wide));
+		_result = RegexpAtoms{false, {}, std::move(best)};
+		return {};
+	}
+	/// @}
+
+private:
+	RegexpVisitResult nothing()
+	{
+		_result = RegexpAtoms{};
+		return {};
+	}
+
+	RegexpVisitResult exact(std::string text)
+	{
+		auto atoms = getBestAtom(decodeRegexpBytes(text), _wide);
+		_result = RegexpAtoms{true, std::move(text), std::move(atoms)};
+		return {};
+	}
+
+	bool _wide;
+	RegexpAtoms _result;
+};
+
+}
+
+/**
+ * Returns hexadecimal representation of the atom with @c ? in place
+ * of masked nibbles, e.g. `4D 5A ?0`.
+ *
+ * @return Text of the atom.
+ */
+std::string Atom::getText() const
+{
+	static const char digits[] = "0123456789ABCDEF";
+
+	std::string result;
+	for (std::size_t i = 0; i < bytes.size(); ++i)
+	{
+		if (i != 0)
+			result += ' ';
+		result += (masks[i] & 0xF0) ? digits[bytes[i] >> 4] : '?';
+		result += (masks[i] & 0x0F) ? digits[bytes[i] & 0xF] : '?';
+	}
+	return result;
+}
+
+/**
+ * Computes quality of the atom in the same way as YARA does. Fixed bytes add
+ * the most to the quality except for common bytes like @c 0x00, @c 0x20, @c 0xCC
+ * and @c 0xFF and letters which add a bit less. Wildcard bytes lower the quality.
+ * Atoms with more distinct bytes are preferred and atoms made of a single common
+ * byte repeated are penalized heavily.
+ *
+ * @param bytes Bytes of the atom.
+ * @param masks Masks of the bytes.
+ *
+ * @return Quality ranging from @c 0 to @c Atom::MaxQuality.
+ */
+int getAtomQuality(const std::vector<std::uint8_t>& bytes, const std::vector<std::uint8_t>& masks)
+{
+	std::bitset<256> seenBytes;
+	int quality = 0;
+	for (std::size_t i = 0; i < bytes.size(); ++i)
+	{
+		switch (masks[i])
+		{
+			case 0x00:
+				quality -= 10;
+				break;
+			case 0xFF:
+				if (bytes[i] == 0x00 || bytes[i] == 0x20 || bytes[i] == 0xCC || bytes[i] == 0xFF)
+					quality += 12;
+				else if ((bytes[i] | 0x20) >= 'a' && (bytes[i] | 0x20) <= 'z')
+					quality += 18;
+				else
+					quality += 20;
+				seenBytes.set(bytes[i]);
+				break;
+			default:
+				quality += 4;
+				break;
+		}
+	}
+
+	auto uniqueBytes = static_cast<int>(seenBytes.count());
+	if (uniqueBytes == 1 && (seenBytes[0x00] || seenBytes[0x20] || seenBytes[0x90] || seenBytes[0xCC] || seenBytes[0xFF]))
+		quality -= 10 * static_cast<int>(bytes.size());
+	else
+		quality += 2 * uniqueBytes;
+
+	return std::clamp(quality, 0, Atom::MaxQuality);
+}
+
+/**
+ * Extracts atoms of the string which YARA would look for in the scanned data.
+ * Plain strings and regular expressions yield separate atoms for their
+ * ASCII and wide variants. Strings with `xor` and `base64` modifiers are scored
+ * by atoms of their original text.
+ *
+ * @param string String.
+ *
+ * @return Atoms of the string.
+ */
+StringAtoms extractAtoms(const String& string)
+{
+	std::vector<bool> wideVariants;
+	if (string.isAscii())
+		wideVariants.push_back(false);
+	if (string.isWide())
+		wideVariants.push_back(true);
+
+	std::vector<std::vector<Atom>> alternatives;
+	if (string.isHex())
+		alternatives.push_back(extractHexAtoms(static_cast<const HexString&>(string).getElements()));
+	else if (string.isRegexp())
+	{
+		for (auto wide : wideVariants)
+			alternatives.push_back(RegexpAtomExtractor(wide).extract(static_cast<const Regexp&>(string).getUnit().get()).atoms);
+	}
+	else
+	{
+		MaskedBytes text;
+		for (auto c : string.getPureText())
+			text.push(c, 0xFF);
+		for (auto wide : wideVariants)
+			alternatives.push_back(getBestAtom(text, wide));
+	}
+
+	StringAtoms result;
+	result.id = string.getIdentifier();
+	result.atoms = mergeAlternativeAtoms(std::move(alternatives));
+	result.quality = getAtomsQuality(result.atoms);
+	return result;
+}
+
+/**
+ * Extracts atoms of all strings of the rule.
+ *
+ * @param rule Rule.
+ *
+ * @return Atoms of the strings of the rule.
+ */
+RuleAtoms extractAtoms(const Rule& rule)
+{
+	RuleAtoms result;
+	result.name = rule.getName();
+	for (const auto* string : rule.getStrings())
+	{
+		result.strings.push_back(extractAtoms(*string));
+		result.quality = std::min(result.quality, result.strings.back().quality);
+	}
+	return result;
+}
+
+/**
+ * Extracts atoms of all strings of all rules in the YARA file.
+ *
+ * @param file YARA file.
+ *
+ * @return Atoms of the rules in the same order as the rules are in the file.
+ */
+std::vector<RuleAtoms> extractAtoms(const YaraFile& file)
+{
+	std::vector<RuleAtoms> result;
+	result.reserve(file.getRules().size());
+	for (const auto& rule : file.getRules())
+		result.push_back(extractAtoms(*rule));
+	return result;
+}
+
+}
@@ -0,0 +1,117 @@
+/**
+ * @file src/utils/columnar_export.cpp
+ * @brief Implementation of columnar export of YARA files.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#include <algorithm>
+#include <unordered_set>
+
+#include "yaramod/utils/columnar_export.h"
+#include "yaramod/utils/traversal.h"
+#include "yaramod/utils/utils.h"
+
+namespace yaramod {
+
+namespace {
+
+std::string modifierText(Rule::Modifier modifier)
+{
+	switch (modifier)
+	{
+		case Rule::Modifier::Global: return "global";
+		case Rule::Modifier::Private: return "private";
+		case Rule::Modifier::PrivateGlobal: return "private global";
+		default: return {};
+	}
+}
+
+std::string stringTypeText(String::Type type)
+{
+	switch (type)
+	{
+		case String::Type::Plain: return "plain";
+		case String::Type::Hex: return "hex";
+		case String::Type::Regexp: return "regexp";
+		default: return {};
+	}
+}
+
+}
+
+/**
+ * Exports contents of all rules of the YARA file into columns in a single pass
+ * over the rules. Conditions which were not parsed yet are parsed in order to
+ * find modules they use.
+ *
+ * @param file YARA file.
+ *
+ * @return Columns with contents of rules.
+ */
+YaraFileColumns exportColumns(const YaraFile& file)
+{
+	std::unordered_set<std::string> importedModules;
+	for (const auto& module : file.getImports())
+		importedModules.insert(module->getName());
+
+	YaraFileColumns columns;
+	const auto& rules = file.getRules();
+	columns.ruleNames.reserve(rules.size());
+	columns.ruleModifiers.reserve(rules.size());
+
+	std::vector<std::string> usedModules;
+	for (std::size_t ruleIndex = 0; ruleIndex < rules.size(); ++ruleIndex)
+	{
+		const auto& rule = rules[ruleIndex];
+		columns.ruleNames.push_back(rule->getName());
+		columns.ruleModifiers.push_back(modifierText(rule->getModifier()));
+
+		for (auto& tag : rule->getTags())
+		{
+			columns.tagRules.push_back(ruleIndex);
+			columns.tags.push_back(std::move(tag));
+		}
+
+		for (const auto& meta : rule->getMetas())
+		{
+			columns.metaRules.push_back(ruleIndex);
+			columns.metaKeys.push_back(meta.getKey());
+			columns.metaValues.push_back(meta.getValue().getPureText());
+		}
+
+		for (const auto* string : rule->getStrings())
+		{
+			columns.stringRules.push_back(ruleIndex);
+			columns.stringIds.push_back(string->getIdentifier());
+			columns.stringTypes.push_back(stringTypeText(string->getType()));
+			columns.stringModifiers.push_back(trim(string->getModifiersText()));
+			columns.stringTexts.push_back(string->getPureText());
+		}
+
+		const auto& condition = rule->getCondition();
+		if (!condition || importedModules.empty())
+			continue;
+
+		// Modules are referenced by identifiers at the start of structure accesses and function calls
+		usedModules.clear();
+		traverse(condition, [&](Expression* expr) {
+			if (expr->getKind() == Expression::Kind::Id)
+			{
+				const auto& name = static_cast<IdExpression*>(expr)->getSymbol()->getName();
+				if (importedModules.count(name) && std::find(usedModules.begin(), usedModules.end(), name) == usedModules.end())
+					usedModules.push_back(name);
+			}
+			return true;
+		}, [](Expression*) {});
+
+		for (auto& module : usedModules)
+		{
+			columns.moduleRules.push_back(ruleIndex);
+			columns.modules.push_back(std::move(module));
+		}
+	}
+
+	return columns;
+}
+
+}
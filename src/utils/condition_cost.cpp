@@ -0,0 +1,407 @@
+/**
+ * @file src/utils/condition_cost.cpp
+ * @brief Implementation of static estimation of cost of conditions.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#include <algorithm>
+
+#include "yaramod/types/modules/modules_pool.h"
+#include "yaramod/utils/condition_cost.h"
+
+namespace yaramod {
+
+namespace {
+
+const ConditionCostEstimator::FunctionCost DefaultFunctionCost = {10.0, 0.0};
+
+/**
+ * Costs of all functions of modules which are more expensive than @c DefaultFunctionCost.
+ */
+const std::unordered_map<std::string, ConditionCostEstimator::FunctionCost> ModuleFunctionCosts = {
+	{"cuckoo", {100.0, 0.0}},
+	{"magic",  {1000.0, 0.0}}
+};
+
+/**
+ * Costs of functions which differ from the costs of the other functions of their module.
+ */
+const std::unordered_map<std::string, ConditionCostEstimator::FunctionCost> FunctionCosts = {
+	{"hash.checksum32",         {10.0, 0.05}},
+	{"hash.crc32",              {10.0, 0.05}},
+	{"hash.md5",                {10.0, 0.2}},
+	{"hash.sha1",               {10.0, 0.2}},
+	{"hash.sha256",             {10.0, 0.3}},
+	{"math.count",              {10.0, 0.05}},
+	{"math.deviation",          {10.0, 0.1}},
+	{"math.entropy",            {10.0, 0.1}},
+	{"math.mean",               {10.0, 0.1}},
+	{"math.mode",               {10.0, 0.1}},
+	{"math.monte_carlo_pi",     {10.0, 0.1}},
+	{"math.percentage",         {10.0, 0.05}},
+	{"math.serial_correlation", {10.0, 0.1}},
+	{"pe.exports",              {50.0, 0.0}},
+	{"pe.exports_index",        {50.0, 0.0}},
+	{"pe.imphash",              {100.0, 0.0}},
+	{"pe.imports",              {50.0, 0.0}}
+};
+
+/**
+ * Collects qualified names of all functions defined in the symbol, functions
+ * of structures in arrays and dictionaries are named without the index.
+ */
+void collectFunctions(const std::shared_ptr<Symbol>& symbol, const std::string& name, std::vector<std::string>& functions)
+{
+	if (symbol->isFunction())
+		functions.push_back(name);
+	else if (symbol->isStructure())
+	{
+		for (const auto& [attributeName, attribute] : std::static_pointer_cast<StructureSymbol>(symbol)->getAttributes())
+			collectFunctions(attribute, name + '.' + attributeName, functions);
+	}
+	else if (symbol->isArray() || symbol->isDictionary())
+	{
+		auto iterable = std::static_pointer_cast<IterableSymbol>(symbol);
+		if (iterable->isStructured())
+			collectFunctions(iterable->getStructuredElementType(), name, functions);
+	}
+}
+
+/**
+ * Returns qualified name of the called function, e.g. `pe.exports` or `pe.signatures.valid_on`.
+ */
+std::string getQualifiedName(const Expression* expr)
+{
+	switch (expr->getKind())
+	{
+		case Expression::Kind::StructAccess:
+		{
+			auto structAccess = static_cast<const StructAccessExpression*>(expr);
+			return getQualifiedName(structAccess->getStructure().get()) + '.' + structAccess->getSymbol()->getName();
+		}
+		case Expression::Kind::ArrayAccess:
+			return getQualifiedName(static_cast<const ArrayAccessExpression*>(expr)->getArray().get());
+		case Expression::Kind::Id:
+			return static_cast<const IdExpression*>(expr)->getSymbol()->getName();
+		default:
+			return expr->getText();
+	}
+}
+
+}
+
+/**
+ * Constructor. Costs are assigned to all functions defined by known modules.
+ */
+ConditionCostEstimator::ConditionCostEstimator()
+{
+	ModulesPool modules;
+	for (const auto& moduleName : modules.getModuleNames())
+	{
+		auto module = modules.load(moduleName, Features::Everything);
+		if (!module)
+			continue;
+
+		auto moduleCost = ModuleFunctionCosts.find(moduleName);
+		_functionCosts[moduleName] = moduleCost != ModuleFunctionCosts.end() ? moduleCost->second : DefaultFunctionCost;
+
+		std::vector<std::string> functions;
+		collectFunctions(module->getStructure(), moduleName, functions);
+		for (const auto& function : functions)
+		{
+			auto functionCost = FunctionCosts.find(function);
+			_functionCosts[function] = functionCost != FunctionCosts.end() ? functionCost->second : _functionCosts[moduleName];
+		}
+	}
+}
+
+/**
+ * Estimates the cost of the condition of the rule. String sets like `them`
+ * are expanded to the strings of the rule.
+ *
+ * @param rule Rule.
+ *
+ * @return Estimated cost.
+ */
+double ConditionCostEstimator::estimate(const Rule& rule)
+{
+	return estimate(rule.getCondition(), rule);
+}
+
+/**
+ * Estimates the cost of the expression.
+ *
+ * @param expr Expression.
+ *
+ * @return Estimated cost.
+ */
+double ConditionCostEstimator::estimate(const Expression::Ptr& expr)
+{
+	if (!expr)
+		return 0.0;
+
+	return estimateSubexpression(expr.get());
+}
+
+/**
+ * Estimates the cost of the expression from the condition of the rule. String sets
+ * like `them` are expanded to the strings of the rule.
+ *
+ * @param expr Expression.
+ * @param rule Rule which the expression belongs to.
+ *
+ * @return Estimated cost.
+ */
+double ConditionCostEstimator::estimate(const Expression::Ptr& expr, const Rule& rule)
+{
+	_rule = &rule;
+	auto result = estimate(expr);
+	_rule = nullptr;
+	return result;
+}
+
+/**
+ * Returns cost of the function with the given qualified name, e.g. `math.entropy`.
+ * Functions which are not defined by any module have the cost of the functions
+ * of their module if there is such module or the default cost.
+ *
+ * @param name Qualified name of the function.
+ *
+ * @return Cost of the function.
+ */
+ConditionCostEstimator::FunctionCost ConditionCostEstimator::getFunctionCost(const std::string& name) const
+{
+	if (auto itr = _functionCosts.find(name); itr != _functionCosts.end())
+		return itr->second;
+
+	if (auto itr = _functionCosts.find(name.substr(0, name.find('.'))); itr != _functionCosts.end())
+		return itr->second;
+
+	return DefaultFunctionCost;
+}
+
+VisitResult ConditionCostEstimator::visit(StringAtExpression* expr)
+{
+	// All matches of the string are checked against the offset
+	_cost += 1.0 + _matchesPerString;
+	return ObservingVisitor::visit(expr);
+}
+
+VisitResult ConditionCostEstimator::visit(StringInRangeExpression* expr)
+{
+	_cost += 1.0 + _matchesPerString;
+	return ObservingVisitor::visit(expr);
+}
+
+VisitResult ConditionCostEstimator::visit(ForDictExpression* expr)
+{
+	return loop(expr, getIterationCount(expr->getIterable().get()), 0.0);
+}
+
+VisitResult ConditionCostEstimator::visit(ForArrayExpression* expr)
+{
+	return loop(expr, getIterationCount(expr->getIterable().get()), 0.0);
+}
+
+VisitResult ConditionCostEstimator::visit(ForStringExpression* expr)
+{
+	return loop(expr, getStringCount(expr->getIterable().get()), 1.0);
+}
+
+VisitResult ConditionCostEstimator::visit(OfExpression* expr)
+{
+	return loop(expr, getStringCount(expr->getIterable().get()), 1.0);
+}
+
+VisitResult ConditionCostEstimator::visit(FunctionCallExpression* expr)
+{
+	_cost += 1.0;
+	for (const auto& arg : expr->getArguments())
+		arg->accept(this);
+
+	auto functionCost = getFunctionCost(getQualifiedName(expr->getFunction().get()));
+	_cost += functionCost.base;
+	if (functionCost.perByte > 0.0)
+	{
+		// Functions processing data are called either with offset and size or with a string
+		const auto& args = expr->getArguments();
+		double size = 0.0;
+		if (args.size() >= 2)
+			size = evaluate(args[1].get()).value_or(_fileSize);
+		else if (args.size() == 1 && args[0]->getKind() == Expression::Kind::StringLiteral)
+			size = static_cast<const StringLiteralExpression*>(args[0].get())->getValue().length();
+		_cost += functionCost.perByte * std::max(size, 0.0);
+	}
+
+	return {};
+}
+
+VisitResult ConditionCostEstimator::comparison(BinaryOpExpression* expr)
+{
+	_cost += 1.0;
+	expr->getLeftOperand()->accept(this);
+	expr->getRightOperand()->accept(this);
+
+	// Comparison of number of matches with a constant like `#a > 1000` needs all those matches to be found
+	const auto* left = expr->getLeftOperand().get();
+	const auto* right = expr->getRightOperand().get();
+	if (left->getKind() == Expression::Kind::IntLiteral)
+		std::swap(left, right);
+	if (left->getKind() == Expression::Kind::StringCount && right->getKind() == Expression::Kind::IntLiteral)
+		_cost += static_cast<const IntLiteralExpression*>(right)->getValue();
+
+	return {};
+}
+
+VisitResult ConditionCostEstimator::loop(ForExpression* expr, std::uint64_t iterations, double iterationCost)
+{
+	_cost += 1.0;
+	expr->getVariable()->accept(this);
+	expr->getIterable()->accept(this);
+
+	double bodyCost = expr->getBody() ? estimateSubexpression(expr->getBody().get()) : 0.0;
+	_cost += iterations * (bodyCost + iterationCost);
+	return {};
+}
+
+double ConditionCostEstimator::estimateSubexpression(Expression* expr)
+{
+	auto outerCost = _cost;
+	_cost = 0.0;
+	expr->accept(this);
+	auto result = _cost;
+	_cost = outerCost;
+	return result;
+}
+
+/**
+ * Evaluates integer expression with assumed values of `filesize` and number of matches.
+ *
+ * @return Value of the expression or @c std::nullopt if it can't be evaluated.
+ */
+std::optional<double> ConditionCostEstimator::evaluate(const Expression* expr) const
+{
+	auto binary = [this, expr](auto&& op) -> std::optional<double> {
+		auto binaryExpr = static_cast<const BinaryOpExpression*>(expr);
+		auto left = evaluate(binaryExpr->getLeftOperand().get());
+		auto right = evaluate(binaryExpr->getRightOperand().get());
+		if (!left || !right)
+			return std::nullopt;
+		return op(left.value(), right.value());
+	};
+
+	switch (expr->getKind())
+	{
+		case Expression::Kind::IntLiteral:
+			return static_cast<const IntLiteralExpression*>(expr)->getValue();
+		case Expression::Kind::Filesize:
+			return _fileSize;
+		case Expression::Kind::StringCount:
+			return _matchesPerString;
+		case Expression::Kind::Parentheses:
+			return evaluate(static_cast<const ParenthesesExpression*>(expr)->getEnclosedExpression().get());
+		case Expression::Kind::UnaryMinus:
+		{
+			auto operand = evaluate(static_cast<const UnaryMinusExpression*>(expr)->getOperand().get());
+			return operand ? std::optional<double>{-operand.value()} : std::nullopt;
+		}
+		case Expression::Kind::Plus:
+			return binary([](double left, double right) { return left + right; });
+		case Expression::Kind::Minus:
+			return binary([](double left, double right) { return left - right; });
+		case Expression::Kind::Multiply:
+			return binary([](double left, double right) { return left * right; });
+		case Expression::Kind::Divide:
+			return binary([](double left, double right) { return right != 0.0 ? left / right : 0.0; });
+		default:
+			return std::nullopt;
+	}
+}
+
+/**
+ * Returns the number of iterations over integer range, set or module array.
+ */
+std::uint64_t ConditionCostEstimator::getIterationCount(const Expression* iterable) const
+{
+	switch (iterable->getKind())
+	{
+		case Expression::Kind::Range:
+		{
+			auto range = static_cast<const RangeExpression*>(iterable);
+			auto low = evaluate(range->getLow().get());
+			auto high = evaluate(range->getHigh().get());
+			if (!low || !high)
+				return _unknownIterations;
+			return high.value() < low.value() ? 0 : static_cast<std::uint64_t>(high.value() - low.value()) + 1;
+		}
+		case Expression::Kind::Set:
+			return static_cast<const SetExpression*>(iterable)->getElements().size();
+		case Expression::Kind::Iterable:
+			return static_cast<const IterableExpression*>(iterable)->getElements().size();
+		default:
+			return _arrayLength;
+	}
+}
+
+/**
+ * Returns the number of strings in the set of strings. Wildcards and `them`
+ * are expanded to the strings of the estimated rule.
+ */
+std::uint64_t ConditionCostEstimator::getStringCount(const Expression* set) const
+{
+	auto countStrings = [this](const std::string& prefix) -> std::uint64_t {
+		if (!_rule)
+			return 1;
+
+		auto strings = _rule->getStrings();
+		return std::count_if(strings.begin(), strings.end(), [&](const auto* string) {
+			return string->getIdentifier().compare(0, prefix.length(), prefix) == 0;
+		});
+	};
+
+	switch (set->getKind())
+	{
+		case Expression::Kind::Them:
+			return countStrings("$");
+		case Expression::Kind::Set:
+		{
+			std::uint64_t result = 0;
+			for (const auto& element : static_cast<const SetExpression*>(set)->getElements())
+			{
+				if (element->getKind() == Expression::Kind::StringWildcard)
+				{
+					auto id = static_cast<const StringWildcardExpression*>(element.get())->getId();
+					result += countStrings(id.substr(0, id.length() - 1));
+				}
+				else
+					result += 1;
+			}
+			return result;
+		}
+		case Expression::Kind::Iterable:
+			return static_cast<const IterableExpression*>(set)->getElements().size();
+		default:
+			return 1;
+	}
+}
+
+/**
+ * Estimates costs of conditions of all rules in the YARA file.
+ *
+ * @param file YARA file.
+ * @param estimator Estimator with assumed properties of scanned files and costs of functions.
+ *
+ * @return Costs of rules sorted from the most expensive one, rules with the same cost keep their order.
+ */
+std::vector<RuleCost> estimateConditionCosts(const YaraFile& file, ConditionCostEstimator estimator)
+{
+	std::vector<RuleCost> result;
+	result.reserve(file.getRules().size());
+	for (const auto& rule : file.getRules())
+		result.push_back(RuleCost{rule->getName(), estimator.estimate(*rule)});
+
+	std::stable_sort(result.begin(), result.end(), [](const auto& cost1, const auto& cost2) { return cost1.cost > cost2.cost; });
+	return result;
+}
+
+}
@@ -0,0 +1,121 @@
+/**
+ * @file src/utils/condition_reordering.cpp
+ * @brief Implementation of cost-aware reordering of operands of conditions.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#include <algorithm>
+#include <numeric>
+
+#include "yaramod/utils/condition_reordering.h"
+
+namespace yaramod {
+
+/**
+ * Constructor.
+ *
+ * @param estimator Estimator of costs of operands.
+ */
+ConditionReorderer::ConditionReorderer(ConditionCostEstimator estimator)
+	: _estimator(std::move(estimator))
+{
+}
+
+/**
+ * Reorders operands in the condition of the rule.
+ *
+ * @param rule Rule.
+ *
+ * @return @c true if any operands were reordered, @c false otherwise.
+ */
+bool ConditionReorderer::reorder(Rule& rule)
+{
+	const auto& condition = rule.getCondition();
+	if (!condition)
+		return false;
+
+	_rule = &rule;
+	_reordered = false;
+	modify(condition);
+	_rule = nullptr;
+	return _reordered;
+}
+
+/**
+ * Reorders operands in conditions of all rules in the YARA file.
+ *
+ * @param file YARA file.
+ *
+ * @return Number of rules with reordered operands.
+ */
+std::size_t ConditionReorderer::reorder(YaraFile& file)
+{
+	return std::count_if(file.getRules().begin(), file.getRules().end(), [this](const auto& rule) {
+		return reorder(*rule);
+	});
+}
+
+VisitResult ConditionReorderer::visit(AndExpression* expr)
+{
+	return reorderChain(expr);
+}
+
+VisitResult ConditionReorderer::visit(OrExpression* expr)
+{
+	return reorderChain(expr);
+}
+
+VisitResult ConditionReorderer::reorderChain(BinaryOpExpression* expr)
+{
+	auto chain = collectChain(expr);
+	const auto& operations = chain.operations;
+	const auto& operands = chain.operands;
+
+	// Nested chains are reordered first because that changes the costs and tokens of operands
+	for (const auto& operand : operands)
+		operand->accept(this);
+
+	auto tokenStream = expr->getTokenStream();
+	if (std::any_of(operands.begin(), operands.end(), [&](const auto& operand) { return operand->getTokenStream() != tokenStream; }))
+		return {};
+
+	std::vector<double> costs;
+	costs.reserve(operands.size());
+	for (const auto& operand : operands)
+	{
+		auto cost = _rule ? _estimator.estimate(operand, *_rule) : _estimator.estimate(operand);
+		costs.push_back(cost < _cheapCost ? 0.0 : cost);
+	}
+
+	std::vector<std::size_t> order(operands.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](auto i, auto j) { return costs[i] < costs[j]; });
+	if (std::is_sorted(order.begin(), order.end()))
+		return {};
+
+	// Tokens between operands, like operators, comments and new lines, stay in place and
+	// tokens of operands are moved between them. Tokens are spliced so iterators pointing
+	// to them from expressions stay valid.
+	std::vector<TokenIt> firsts, lasts, slots;
+	for (const auto& operand : operands)
+	{
+		firsts.push_back(operand->getFirstTokenIt());
+		lasts.push_back(operand->getLastTokenIt());
+		slots.push_back(std::next(lasts.back()));
+	}
+
+	TokenStream parked;
+	for (std::size_t i = 0; i < operands.size(); ++i)
+		parked.moveAppend(tokenStream, firsts[i], slots[i]);
+	for (std::size_t i = 0; i < operands.size(); ++i)
+		tokenStream->moveAppend(slots[i], &parked, firsts[order[i]], std::next(lasts[order[i]]));
+
+	operations.front()->setLeftOperand(operands[order.front()]);
+	for (std::size_t i = 0; i < operations.size(); ++i)
+		operations[i]->setRightOperand(operands[order[i + 1]]);
+
+	_reordered = true;
+	return {};
+}
+
+}
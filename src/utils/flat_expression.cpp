@@ -0,0 +1,120 @@
+/**
+ * @file src/utils/flat_expression.cpp
+ * @brief Implementation of flattened representation of expressions.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#include <unordered_map>
+
+#include "yaramod/utils/flat_expression.h"
+#include "yaramod/utils/traversal.h"
+
+namespace yaramod {
+
+namespace {
+
+bool isBinaryOperation(Expression::Kind kind)
+{
+	return kind >= Expression::Kind::And && kind <= Expression::Kind::ShiftRight;
+}
+
+/**
+ * Returns value of the node and stores its text if it has one.
+ */
+std::int64_t nodeValue(Expression* expr, std::vector<std::string>& texts)
+{
+	auto addText = [&](std::string text) {
+		texts.push_back(std::move(text));
+		return static_cast<std::int64_t>(texts.size() - 1);
+	};
+
+	return dispatchByKind(expr, [&](auto* concrete) -> std::int64_t {
+		using T = std::remove_pointer_t<decltype(concrete)>;
+		if constexpr (std::is_same_v<T, IntLiteralExpression>)
+			return static_cast<std::int64_t>(concrete->getValue());
+		else if constexpr (std::is_same_v<T, BoolLiteralExpression>)
+			return concrete->getValue() ? 1 : 0;
+		else if constexpr (std::is_same_v<T, StringLiteralExpression>)
+			return addText(concrete->getValue());
+		else if constexpr (std::is_same_v<T, DoubleLiteralExpression> || std::is_same_v<T, RegexpExpression>)
+			return addText(concrete->getText());
+		else if constexpr (std::is_same_v<T, IntFunctionExpression>)
+			return addText(concrete->getFunction());
+		else if constexpr (std::is_same_v<T, ForArrayExpression> || std::is_same_v<T, StringWildcardExpression>
+				|| std::is_same_v<T, StringExpression> || std::is_same_v<T, StringAtExpression> || std::is_same_v<T, StringInRangeExpression>
+				|| std::is_same_v<T, StringCountExpression> || std::is_same_v<T, StringOffsetExpression> || std::is_same_v<T, StringLengthExpression>)
+			return addText(concrete->getId());
+		else if constexpr (std::is_same_v<T, IdExpression> || std::is_same_v<T, StructAccessExpression>)
+			return concrete->getSymbol() ? addText(concrete->getSymbol()->getName()) : 0;
+		else
+			return 0;
+	});
+}
+
+}
+
+/**
+ * Flattens the expression into an array of nodes in preorder. Indices of the first tokens
+ * are relative to the first token of @p expr. If the first token of some subexpression
+ * is not among the tokens of @p expr, FlatExpression::NoToken is used instead.
+ *
+ * @param expr Expression to flatten.
+ *
+ * @return Flattened expression.
+ */
+FlatExpression flatten(const Expression* expr)
+{
+	FlatExpression result;
+	if (!expr)
+		return result;
+
+	auto root = const_cast<Expression*>(expr);
+	std::unordered_map<const Token*, std::uint32_t> tokenIndices;
+	auto last = root->getLastTokenIt();
+	std::uint32_t tokenIndex = 0;
+	for (auto itr = root->getFirstTokenIt(); ; ++itr)
+	{
+		tokenIndices.emplace(&*itr, tokenIndex++);
+		if (itr == last)
+			break;
+	}
+
+	std::vector<std::int32_t> parents;
+	traverse(root, [&](Expression* e) {
+		auto parent = parents.empty() ? -1 : parents.back();
+		auto index = static_cast<std::int32_t>(result.nodes.size());
+		result.nodes.push_back({nodeValue(e, result.texts), parent, FlatExpression::NoToken, static_cast<std::uint32_t>(e->getKind()), 0});
+
+		// Operations share the first token with their left operand which is stored right
+		// after them, so it is resolved once all nodes are known to avoid walking long chains
+		if (!isBinaryOperation(e->getKind()))
+		{
+			auto tokenItr = tokenIndices.find(&*e->getFirstTokenIt());
+			if (tokenItr != tokenIndices.end())
+				result.nodes.back().firstToken = tokenItr->second;
+		}
+
+		parents.push_back(index);
+		return true;
+	}, [&](Expression*) {
+		auto index = parents.back();
+		parents.pop_back();
+		result.nodes[index].size = static_cast<std::uint32_t>(result.nodes.size() - index);
+	});
+
+	for (auto i = result.nodes.size(); i-- > 0;)
+	{
+		auto& node = result.nodes[i];
+		if (isBinaryOperation(static_cast<Expression::Kind>(node.kind)) && node.size > 1)
+			node.firstToken = result.nodes[i + 1].firstToken;
+	}
+
+	return result;
+}
+
+FlatExpression flatten(const Expression::Ptr& expr)
+{
+	return flatten(expr.get());
+}
+
+}
@@ -0,0 +1,350 @@
+/**
+ * @file src/utils/hex_string_optimizer.cpp
+ * @brief Implementation of optimization of hex strings.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#include <algorithm>
+#include <optional>
+
+#include "yaramod/builder/yara_hex_string_builder.h"
+#include "yaramod/utils/hex_string_optimizer.h"
+#include "yaramod/utils/observing_visitor.h"
+
+namespace yaramod {
+
+namespace {
+
+using Element = HexStringElement;
+using Sequence = std::vector<Element>;
+
+/**
+ * YARA accepts only bounded jumps of at most this many bytes inside alternatives.
+ */
+constexpr std::uint64_t MaxJumpInAlternation = 200;
+
+YaraHexStringBuilder toBuilder(const Sequence& sequence)
+{
+	YaraHexStringBuilder result;
+	for (const auto& element : sequence)
+	{
+		switch (element.kind)
+		{
+			case Element::Kind::Byte:
+				if (element.mask == 0xFF)
+					result.add(YaraHexStringBuilder(element.value));
+				else if (element.mask == 0xF0)
+					result.add(wildcardLow(element.value >> 4));
+				else if (element.mask == 0x0F)
+					result.add(wildcardHigh(element.value));
+				else
+					result.add(wildcard());
+				break;
+			case Element::Kind::Jump:
+				if (element.jumpHigh == element.jumpLow)
+					result.add(jumpFixed(element.jumpLow));
+				else if (element.jumpHigh)
+					result.add(jumpRange(element.jumpLow, element.jumpHigh.value()));
+				else if (element.jumpLow != 0)
+					result.add(jumpVaryingRange(element.jumpLow));
+				else
+					result.add(jumpVarying());
+				break;
+			case Element::Kind::Alternation:
+			{
+				std::vector<YaraHexStringBuilder> alternatives;
+				for (const auto& alternative : element.alternatives)
+					alternatives.push_back(toBuilder(alternative));
+				result.add(alt(alternatives));
+				break;
+			}
+		}
+	}
+	return result;
+}
+
+/**
+ * Replaces each run of jumps and `??` wildcards containing at least one jump with a single jump.
+ * Neither hex strings nor alternatives can start or end with a jump so runs at the edges of sequence
+ * keep a single wildcard there. Runs inside alternatives are kept as they are if the merged jump
+ * would not be accepted there.
+ */
+void mergeJumps(Sequence& sequence, bool insideAlternation)
+{
+	Sequence result;
+	for (std::size_t i = 0; i < sequence.size(); )
+	{
+		auto end = i;
+		bool hasJump = false;
+		while (end < sequence.size() && (sequence[end].isJump() || sequence[end].isFullWildcard()))
+			hasJump = sequence[end++].isJump() || hasJump;
+
+		if (!hasJump)
+		{
+			end = std::max(end, i + 1);
+			std::move(sequence.begin() + i, sequence.begin() + end, std::back_inserter(result));
+			i = end;
+			continue;
+		}
+
+		const bool atStart = i == 0 && sequence[i].isFullWildcard();
+		const bool atEnd = end == sequence.size() && sequence[end - 1].isFullWildcard();
+		auto first = atStart ? i + 1 : i;
+		auto last = atEnd ? end - 1 : end;
+
+		std::uint64_t low = 0;
+		std::optional<std::uint64_t> high = 0;
+		for (auto j = first; j < last; ++j)
+		{
+			low += sequence[j].isJump() ? sequence[j].jumpLow : 1;
+			if (high && sequence[j].isJump())
+				high = sequence[j].jumpHigh ? std::optional<std::uint64_t>{high.value() + sequence[j].jumpHigh.value()} : std::nullopt;
+			else if (high)
+				high = high.value() + 1;
+		}
+
+		if (insideAlternation && (!high || high.value() > MaxJumpInAlternation))
+		{
+			std::move(sequence.begin() + i, sequence.begin() + end, std::back_inserter(result));
+			i = end;
+			continue;
+		}
+
+		if (atStart)
+			result.push_back(Element::byte(0x00, 0x00));
+		if (first < last)
+			result.push_back(Element::jump(low, high));
+		if (atEnd)
+			result.push_back(Element::byte(0x00, 0x00));
+		i = end;
+	}
+	sequence = std::move(result);
+}
+
+/**
+ * Returns the length of common prefix of bytes of all alternatives which can be moved out of the alternation
+ * so that none of the alternatives becomes empty or starts with a jump.
+ */
+template <typename GetElement>
+std::size_t commonBytes(const std::vector<Sequence>& alternatives, std::size_t maxLength, GetElement&& getElement)
+{
+	std::size_t length = 0;
+	while (length < maxLength)
+	{
+		const auto& element = getElement(alternatives.front(), length);
+		if (!element.isByte() || std::any_of(alternatives.begin() + 1, alternatives.end(), [&](const auto& alternative) {
+				return getElement(alternative, length) != element;
+			}))
+			break;
+		++length;
+	}
+
+	while (length > 0 && std::any_of(alternatives.begin(), alternatives.end(), [&](const auto& alternative) {
+			return getElement(alternative, length).isJump();
+		}))
+		--length;
+	return length;
+}
+
+void optimizeSequence(Sequence& sequence, bool insideAlternation)
+{
+	Sequence result;
+	for (auto& element : sequence)
+	{
+		if (element.kind != Element::Kind::Alternation)
+		{
+			result.push_back(std::move(element));
+			continue;
+		}
+
+		auto& alternatives = element.alternatives;
+		for (auto& alternative : alternatives)
+			optimizeSequence(alternative, true);
+
+		std::vector<Sequence> unique;
+		for (auto& alternative : alternatives)
+		{
+			if (std::find(unique.begin(), unique.end(), alternative) == unique.end())
+				unique.push_back(std::move(alternative));
+		}
+		alternatives = std::move(unique);
+
+		if (alternatives.size() == 1)
+		{
+			std::move(alternatives.front().begin(), alternatives.front().end(), std::back_inserter(result));
+			continue;
+		}
+
+		auto minLength = std::min_element(alternatives.begin(), alternatives.end(), [](const auto& a, const auto& b) {
+			return a.size() < b.size();
+		})->size();
+		auto prefix = commonBytes(alternatives, minLength - 1, [](const Sequence& alternative, std::size_t i) -> const Element& {
+			return alternative[i];
+		});
+		auto suffix = commonBytes(alternatives, minLength - 1 - prefix, [](const Sequence& alternative, std::size_t i) -> const Element& {
+			return alternative[alternative.size() - 1 - i];
+		});
+
+		const auto& front = alternatives.front();
+		std::copy(front.begin(), front.begin() + prefix, std::back_inserter(result));
+		Sequence suffixElements(front.end() - suffix, front.end());
+		for (auto& alternative : alternatives)
+			alternative = Sequence(alternative.begin() + prefix, alternative.end() - suffix);
+		result.push_back(std::move(element));
+		std::move(suffixElements.begin(), suffixElements.end(), std::back_inserter(result));
+	}
+
+	sequence = std::move(result);
+	mergeJumps(sequence, insideAlternation);
+}
+
+/**
+ * Collects strings whose offset or length of matches is used in the condition.
+ * Identifiers are stored without their leading `$`, `@` or `!`, so the empty identifier
+ * stands for anonymous references inside loops over strings which can refer to any string.
+ */
+class StringReferences : public ObservingVisitor
+{
+public:
+	StringReferences(const Rule& rule)
+	{
+		if (rule.getCondition())
+			rule.getCondition()->accept(this);
+	}
+
+	bool isOffsetUsed(const std::string& id) const { return isUsed(_offsets, id); }
+	bool isLengthUsed(const std::string& id) const { return isUsed(_lengths, id); }
+
+	virtual VisitResult visit(StringAtExpression* expr) override
+	{
+		_offsets.push_back(expr->getId().substr(1));
+		return ObservingVisitor::visit(expr);
+	}
+
+	virtual VisitResult visit(StringInRangeExpression* expr) override
+	{
+		_offsets.push_back(expr->getId().substr(1));
+		return ObservingVisitor::visit(expr);
+	}
+
+	virtual VisitResult visit(StringOffsetExpression* expr) override
+	{
+		_offsets.push_back(expr->getId().substr(1));
+		return ObservingVisitor::visit(expr);
+	}
+
+	virtual VisitResult visit(StringLengthExpression* expr) override
+	{
+		_lengths.push_back(expr->getId().substr(1));
+		return ObservingVisitor::visit(expr);
+	}
+
+private:
+	static bool isUsed(const std::vector<std::string>& ids, const std::string& id)
+	{
+		auto name = id.substr(1);
+		return std::any_of(ids.begin(), ids.end(), [&name](const auto& used) {
+			return used.empty() || used == name;
+		});
+	}
+
+	std::vector<std::string> _offsets;
+	std::vector<std::string> _lengths;
+};
+
+}
+
+/**
+ * Optimizes all hex strings of the rule.
+ *
+ * @param rule Rule.
+ *
+ * @return @c true if any of the hex strings was rewritten, @c false otherwise.
+ */
+bool HexStringOptimizer::optimize(Rule& rule)
+{
+	StringReferences references(rule);
+
+	bool optimized = false;
+	for (const auto& string : rule.getStringsTrie()->getAllValues())
+	{
+		if (!string->isHex())
+			continue;
+
+		const auto& id = string->getIdentifier();
+		if (optimize(rule, static_cast<HexString&>(*string), references.isOffsetUsed(id), references.isLengthUsed(id)))
+			optimized = true;
+	}
+	return optimized;
+}
+
+/**
+ * Optimizes hex strings of all rules in the YARA file.
+ *
+ * @param file YARA file.
+ *
+ * @return Number of rules with rewritten hex strings.
+ */
+std::size_t HexStringOptimizer::optimize(YaraFile& file)
+{
+	return std::count_if(file.getRules().begin(), file.getRules().end(), [this](const auto& rule) {
+		return optimize(*rule);
+	});
+}
+
+bool HexStringOptimizer::optimize(const Rule& rule, HexString& string, bool offsetUsed, bool lengthUsed)
+{
+	auto original = string.getElements();
+	auto sequence = original;
+	optimizeSequence(sequence, false);
+
+	auto isTrimmed = [](const Element& element) { return element.isJump() || element.isFullWildcard(); };
+	auto leading = std::find_if_not(sequence.begin(), sequence.end(), isTrimmed);
+	auto trailing = std::find_if_not(sequence.rbegin(), sequence.rend(), isTrimmed).base();
+	// Strings consisting only of wildcards are kept as they are
+	if (_trimWildcards && leading != sequence.end())
+	{
+		if (leading != sequence.begin() && offsetUsed)
+		{
+			addDiagnostic(rule, string, "leading wildcards were not removed because offset of the string is used in the condition");
+			leading = sequence.begin();
+		}
+		if (trailing != sequence.end() && lengthUsed)
+		{
+			addDiagnostic(rule, string, "trailing wildcards were not removed because length of the string is used in the condition");
+			trailing = sequence.end();
+		}
+		sequence = Sequence(leading, trailing);
+	}
+
+	if (sequence == original)
+		return false;
+
+	const auto& tokenStream = string.getTokenStream();
+	auto leftBracket = string.getFirstTokenIt();
+	auto rightBracket = string.getLastTokenIt();
+	if (leftBracket->getType() != TokenType::HEX_START_BRACKET || rightBracket->getType() != TokenType::HEX_END_BRACKET)
+		return false;
+
+	for (auto itr = std::next(leftBracket); itr != rightBracket; ++itr)
+	{
+		if (itr->getType() == TokenType::COMMENT || itr->getType() == TokenType::ONELINE_COMMENT)
+		{
+			addDiagnostic(rule, string, "the string was not optimized because it contains comments");
+			return false;
+		}
+	}
+
+	auto optimizedString = toBuilder(sequence).get(nullptr, false);
+	tokenStream->erase(std::next(leftBracket), rightBracket);
+	tokenStream->moveAppend(rightBracket, optimizedString->getTokenStream().get());
+	string.setUnits(optimizedString->getUnits());
+	return true;
+}
+
+void HexStringOptimizer::addDiagnostic(const Rule& rule, const HexString& string, const std::string& message)
+{
+	_diagnostics.push_back(Diagnostic{rule.getName(), string.getIdentifier(), message});
+}
+
+}
@@ -0,0 +1,570 @@
+/**
+ * @file src/utils/regexp_analyzer.cpp
+ * @brief Implementation of analysis of complexity of regular expressions.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#include <algorithm>
+#include <bitset>
+#include <cctype>
+#include <limits>
+#include <optional>
+
+#include "yaramod/utils/observing_visitor.h"
+#include "yaramod/utils/regexp_analyzer.h"
+#include "yaramod/utils/utils.h"
+
+namespace yaramod {
+
+namespace {
+
+using ByteSet = std::bitset<256>;
+
+constexpr std::size_t MaxLiteralLength = 256;
+
+std::uint64_t saturatingAdd(std::uint64_t a, std::uint64_t b)
+{
+	return a > std::numeric_limits<std::uint64_t>::max() - b ? std::numeric_limits<std::uint64_t>::max() : a + b;
+}
+
+std::uint64_t saturatingMultiply(std::uint64_t a, std::uint64_t b)
+{
+	return b != 0 && a > std::numeric_limits<std::uint64_t>::max() / b ? std::numeric_limits<std::uint64_t>::max() : a * b;
+}
+
+/**
+ * Decodes escape sequence starting after the backslash at position @p i
+ * into a set of bytes and moves @p i behind it.
+ */
+ByteSet decodeEscape(const std::string& text, std::size_t& i, std::optional<std::uint8_t>& byte)
+{
+	ByteSet result;
+	auto c = text[i];
+	byte = decodeRegexpEscape(text, i);
+	if (byte)
+	{
+		result.set(byte.value());
+		return result;
+	}
+
+	auto addRange = [&result](int low, int high) {
+		for (int b = low; b <= high; ++b)
+			result.set(b);
+	};
+
+	switch (c)
+	{
+		case 'w': case 'W':
+			addRange('a', 'z');
+			addRange('A', 'Z');
+			addRange('0', '9');
+			result.set('_');
+			return c == 'w' ? result : ~result;
+		case 's': case 'S':
+			for (auto space : {' ', '\t', '\n', '\v', '\f', '\r'})
+				result.set(static_cast<std::uint8_t>(space));
+			return c == 's' ? result : ~result;
+		default:
+			addRange('0', '9');
+			return c == 'd' ? result : ~result;
+	}
+}
+
+/**
+ * Decodes text of regular expression made only of characters and escape sequences into bytes.
+ */
+std::string decodeText(const std::string& text)
+{
+	std::string result;
+	for (const auto& byte : decodeRegexpText(text))
+	{
+		if (byte)
+			result += static_cast<char>(byte.value());
+	}
+	return result;
+}
+
+/**
+ * Decodes characters of class without enclosing brackets and leading `^`.
+ */
+ByteSet decodeClass(const std::string& characters)
+{
+	ByteSet result;
+	std::optional<std::uint8_t> previous;
+	for (std::size_t i = 0; i < characters.length(); )
+	{
+		std::optional<std::uint8_t> byte;
+		if (characters[i] == '\\' && i + 1 < characters.length())
+		{
+			++i;
+			result |= decodeEscape(characters, i, byte);
+		}
+		else if (characters[i] == '-' && previous && i + 1 < characters.length())
+		{
+			++i;
+			std::optional<std::uint8_t> high;
+			if (characters[i] == '\\' && i + 1 < characters.length())
+			{
+				++i;
+				result |= decodeEscape(characters, i, high);
+			}
+			else
+				high = static_cast<std::uint8_t>(characters[i++]);
+
+			for (int b = previous.value(); high && b <= high.value(); ++b)
+				result.set(b);
+		}
+		else
+		{
+			byte = static_cast<std::uint8_t>(characters[i++]);
+			result.set(byte.value());
+		}
+		previous = byte;
+	}
+	return result;
+}
+
+ByteSet foldCase(ByteSet set)
+{
+	for (int c = 'a'; c <= 'z'; ++c)
+	{
+		if (set.test(c) || set.test(std::toupper(c)))
+		{
+			set.set(c);
+			set.set(std::toupper(c));
+		}
+	}
+	return set;
+}
+
+std::string longestCommonSubstring(const std::string& a, const std::string& b)
+{
+	std::size_t bestLength = 0, bestEnd = 0;
+	std::vector<std::size_t> previous(b.length() + 1), current(b.length() + 1);
+	for (std::size_t i = 1; i <= a.length(); ++i)
+	{
+		for (std::size_t j = 1; j <= b.length(); ++j)
+		{
+			current[j] = a[i - 1] == b[j - 1] ? previous[j - 1] + 1 : 0;
+			if (current[j] > bestLength)
+			{
+				bestLength = current[j];
+				bestEnd = i;
+			}
+		}
+		std::swap(previous, current);
+	}
+	return a.substr(bestEnd - bestLength, bestLength);
+}
+
+/**
+ * Unbounded greedy repetition at the end of a unit which may compete
+ * for characters with units following it.
+ */
+struct Repetition
+{
+	ByteSet set;
+	std::string text;
+};
+
+/**
+ * Properties of a unit of regular expression. Units which match exactly one sequence
+ * of characters also keep their text so they can be joined with their neighbours, because
+ * escape sequences like `\x41` are split into multiple units.
+ */
+struct UnitInfo
+{
+	bool exact = false;
+	std::string text; ///< Text of exact unit
+	std::string literal; ///< Longest sequence of bytes present in every match
+	std::size_t anchor = 0; ///< Length of the shortest of the longest literals of all alternatives
+	ByteSet first; ///< Bytes which can start a match
+	bool nullable = false; ///< Whether the unit can match empty string
+	std::uint64_t size = 0; ///< Estimated number of states of automaton
+	bool unbounded = false; ///< Whether the unit contains unbounded repetition
+	bool ambiguous = false; ///< Whether the unit is alternation of alternatives which can start with the same character
+	std::optional<Repetition> trailing;
+};
+
+class RegexpInfoCollector : public RegexpVisitor
+{
+public:
+	RegexpInfoCollector(const RegexpAnalyzer& analyzer, bool nocase, bool dotAll)
+		: _analyzer(analyzer), _nocase(nocase), _dotAll(dotAll) {}
+
+	UnitInfo collect(RegexpUnit* unit)
+	{
+		unit->accept(this);
+		return std::move(_result);
+	}
+
+	std::vector<RegexpAnalyzer::Issue>& getIssues() { return _issues; }
+
+	/// @name Visit methods
+	/// @{
+	virtual RegexpVisitResult visit(RegexpClass* expr) override
+	{
+		auto set = decodeClass(expr->getCharacters());
+		return single(expr->isNegative() ? ~set : set);
+	}
+
+	virtual RegexpVisitResult visit(RegexpText* expr) override
+	{
+		if (expr->isAssertion())
+			return exact({});
+		else if (expr->isClassEscape())
+			return escaped(expr->getText());
+		return exact(expr->getText());
+	}
+
+	virtual RegexpVisitResult visit(RegexpAnyChar*) override
+	{
+		ByteSet set;
+		set.set();
+		if (!_dotAll)
+			set.reset('\n');
+		return single(set);
+	}
+
+	virtual RegexpVisitResult visit(RegexpWordChar*) override { return escaped("\\w"); }
+	virtual RegexpVisitResult visit(RegexpNonWordChar*) override { return escaped("\\W"); }
+	virtual RegexpVisitResult visit(RegexpSpace*) override { return escaped("\\s"); }
+	virtual RegexpVisitResult visit(RegexpNonSpace*) override { return escaped("\\S"); }
+	virtual RegexpVisitResult visit(RegexpDigit*) override { return escaped("\\d"); }
+	virtual RegexpVisitResult visit(RegexpNonDigit*) override { return escaped("\\D"); }
+	// Assertions do not match any characters so they don't break sequences of their neighbours
+	virtual RegexpVisitResult visit(RegexpWordBoundary*) override { return exact({}); }
+	virtual RegexpVisitResult visit(RegexpNonWordBoundary*) override { return exact({}); }
+	virtual RegexpVisitResult visit(RegexpStartOfLine*) override { return exact({}); }
+	virtual RegexpVisitResult visit(RegexpEndOfLine*) override { return exact({}); }
+
+	virtual RegexpVisitResult visit(RegexpIteration* expr) override
+	{
+		auto operand = collect(expr->getOperand().get());
+		_result = repeat(expr, operand, 0, std::nullopt);
+		return {};
+	}
+
+	virtual RegexpVisitResult visit(RegexpPositiveIteration* expr) override
+	{
+		auto operand = collect(expr->getOperand().get());
+		_result = repeat(expr, operand, 1, std::nullopt);
+		return {};
+	}
+
+	virtual RegexpVisitResult visit(RegexpOptional* expr) override
+	{
+		auto operand = collect(expr->getOperand().get());
+		_result = repeat(expr, operand, 0, 1);
+		return {};
+	}
+
+	virtual RegexpVisitResult visit(RegexpRange* expr) override
+	{
+		auto [low, high] = expr->getRange();
+		auto operand = collect(expr->getOperand().get());
+		if (std::max(low.value_or(0), high.value_or(0)) > _analyzer.getMaxRange())
+			addIssue(RegexpAnalyzer::Issue::Kind::LargeRange, expr->getText(),
+				"counted range has bound greater than " + std::to_string(_analyzer.getMaxRange()));
+
+		// Short repetitions of exact text like `a{3}` are still exact
+		if (operand.exact && low && low == high && decodeText(operand.text).length() * low.value() <= MaxLiteralLength)
+		{
+			std::string text;
+			for (std::uint64_t i = 0; i < low.value(); ++i)
+				text += operand.text;
+			return exact(std::move(text));
+		}
+
+		_result = repeat(expr, operand, low.value_or(0), high);
+		return {};
+	}
+
+	virtual RegexpVisitResult visit(RegexpOr* expr) override
+	{
+		auto left = collect(expr->getLeft().get());
+		if (left.exact)
+			left = makeExact(std::move(left.text));
+		auto right = collect(expr->getRight().get());
+		if (right.exact)
+			right = makeExact(std::move(right.text));
+
+		_result = UnitInfo{};
+		_result.literal = longestCommonSubstring(left.literal, right.literal);
+		_result.anchor = std::min(left.anchor, right.anchor);
+		_result.first = left.first | right.first;
+		_result.nullable = left.nullable || right.nullable;
+		_result.size = saturatingAdd(saturatingAdd(left.size, right.size), 1);
+		_result.unbounded = left.unbounded || right.unbounded;
+		_result.ambiguous = left.ambiguous || right.ambiguous || (left.first & right.first).any();
+		_result.trailing = left.trailing ? left.trailing : right.trailing;
+		return {};
+	}
+
+	virtual RegexpVisitResult visit(RegexpGroup* expr) override
+	{
+		_result = collect(expr->getUnit().get());
+		return {};
+	}
+
+	virtual RegexpVisitResult visit(RegexpConcat* expr) override
+	{
+		// Neighbouring exact units are joined before they are decoded
+		std::vector<UnitInfo> units;
+		for (const auto& unit : expr->getUnits())
+		{
+			auto info = collect(unit.get());
+			if (info.exact && !units.empty() && units.back().exact)
+				units.back().text += info.text;
+			else
+				units.push_back(std::move(info));
+		}
+
+		for (auto& unit : units)
+		{
+			if (unit.exact)
+				unit = makeExact(std::move(unit.text));
+		}
+
+		if (units.size() == 1)
+		{
+			_result = std::move(units.front());
+			return {};
+		}
+
+		_result = UnitInfo{};
+		_result.nullable = true;
+		for (std::size_t i = 0; i < units.size(); ++i)
+		{
+			const auto& unit = units[i];
+			if (_result.nullable)
+				_result.first |= unit.first;
+			_result.nullable = _result.nullable && unit.nullable;
+			_result.size = saturatingAdd(_result.size, unit.size);
+			_result.unbounded = _result.unbounded || unit.unbounded;
+			if (unit.literal.length() > _result.literal.length())
+				_result.literal = unit.literal;
+			_result.anchor = std::max(_result.anchor, unit.anchor);
+
+			if (!unit.trailing)
+				continue;
+
+			ByteSet follow;
+			for (auto j = i + 1; j < units.size(); ++j)
+			{
+				follow |= units[j].first;
+				if (!units[j].nullable)
+					break;
+			}
+			if ((unit.trailing->set & follow).any())
+				addIssue(RegexpAnalyzer::Issue::Kind::AmbiguousRepetition, unit.trailing->text,
+					"unbounded repetition can match the same characters as what follows it");
+		}
+		_result.trailing = units.back().trailing;
+		return {};
+	}
+	/// @}
+
+private:
+	RegexpVisitResult single(const ByteSet& set)
+	{
+		_result = UnitInfo{};
+		_result.first = _nocase ? foldCase(set) : set;
+		_result.size = 1;
+		return {};
+	}
+
+	RegexpVisitResult escaped(const std::string& text)
+	{
+		std::size_t i = 1;
+		std::optional<std::uint8_t> byte;
+		return single(decodeEscape(text, i, byte));
+	}
+
+	RegexpVisitResult exact(std::string text)
+	{
+		_result = UnitInfo{};
+		_result.exact = true;
+		_result.text = std::move(text);
+		return {};
+	}
+
+	UnitInfo makeExact(std::string text)
+	{
+		UnitInfo result;
+		result.exact = true;
+		result.literal = decodeText(text);
+		result.text = std::move(text);
+		result.nullable = result.literal.empty();
+		result.size = result.literal.length();
+		if (!result.literal.empty())
+		{
+			result.first.set(static_cast<std::uint8_t>(result.literal.front()));
+			if (_nocase)
+				result.first = foldCase(result.first);
+		}
+		if (result.literal.length() > MaxLiteralLength)
+			result.literal.resize(MaxLiteralLength);
+		result.anchor = result.literal.length();
+		return result;
+	}
+
+	UnitInfo repeat(RegexpOperation* expr, UnitInfo operand, std::uint64_t low, std::optional<std::uint64_t> high)
+	{
+		if (operand.exact)
+			operand = makeExact(std::move(operand.text));
+
+		UnitInfo result;
+		result.first = operand.first;
+		result.nullable = low == 0 || operand.nullable;
+		result.literal = low == 0 ? std::string{} : operand.literal;
+		result.anchor = low == 0 ? 0 : operand.anchor;
+		result.unbounded = operand.unbounded || !high;
+		result.trailing = operand.trailing;
+		if (high)
+		{
+			// Optional copies of the operand need an extra state each
+			result.size = saturatingAdd(saturatingMultiply(operand.size, high.value()), high.value() - low);
+			return result;
+		}
+
+		result.size = saturatingAdd(saturatingMultiply(operand.size, low + 1), 1);
+		if (operand.unbounded)
+			addIssue(RegexpAnalyzer::Issue::Kind::NestedRepetition, expr->getText(),
+				"unbounded repetition of expression which already contains unbounded repetition");
+		if (operand.ambiguous)
+			addIssue(RegexpAnalyzer::Issue::Kind::AmbiguousAlternation, expr->getText(),
+				"unbounded repetition of alternatives which can start with the same character");
+		if (expr->isGreedy())
+			result.trailing = Repetition{operand.first, expr->getText()};
+		return result;
+	}
+
+	void addIssue(RegexpAnalyzer::Issue::Kind kind, const std::string& unit, std::string message)
+	{
+		auto found = std::find_if(_issues.begin(), _issues.end(), [&](const auto& issue) {
+			return issue.kind == kind && issue.unit == unit;
+		});
+		if (found == _issues.end())
+			_issues.push_back(RegexpAnalyzer::Issue{kind, unit, std::move(message)});
+	}
+
+	const RegexpAnalyzer& _analyzer;
+	bool _nocase;
+	bool _dotAll;
+	UnitInfo _result;
+	std::vector<RegexpAnalyzer::Issue> _issues;
+};
+
+/**
+ * Collects regular expressions used on the right side of `matches`.
+ */
+class MatchesCollector : public ObservingVisitor
+{
+public:
+	std::vector<const Regexp*> collect(const Rule& rule)
+	{
+		if (rule.getCondition())
+			rule.getCondition()->accept(this);
+		return std::move(_regexps);
+	}
+
+	virtual VisitResult visit(MatchesExpression* expr) override
+	{
+		const auto& right = expr->getRightOperand();
+		if (right->getKind() == Expression::Kind::Regexp)
+		{
+			const auto& regexp = static_cast<const RegexpExpression*>(right.get())->getRegexpString();
+			if (regexp && regexp->isRegexp())
+				_regexps.push_back(static_cast<const Regexp*>(regexp.get()));
+		}
+		return ObservingVisitor::visit(expr);
+	}
+
+private:
+	std::vector<const Regexp*> _regexps;
+};
+
+}
+
+/**
+ * Analyzes a single regular expression.
+ *
+ * @param regexp Regular expression.
+ * @param nocase Whether the regular expression is matched case-insensitively
+ *               regardless of its suffix modifiers, like strings with @c nocase modifier.
+ *
+ * @return Report of the analysis.
+ */
+RegexpAnalyzer::Report RegexpAnalyzer::analyze(const Regexp& regexp, bool nocase) const
+{
+	const auto suffixMods = regexp.getSuffixModifiers();
+	nocase = nocase || suffixMods.find('i') != std::string::npos;
+	RegexpInfoCollector collector(*this, nocase, suffixMods.find('s') != std::string::npos);
+	auto info = collector.collect(regexp.getUnit().get());
+
+	Report report;
+	report.text = "/" + regexp.getPureText() + "/" + suffixMods;
+	report.automatonSize = info.exact ? decodeText(info.text).length() : info.size;
+	report.requiredLiteral = info.exact ? decodeText(info.text) : info.literal;
+	report.issues = std::move(collector.getIssues());
+
+	if (report.automatonSize > _maxAutomatonSize)
+		report.issues.push_back(Issue{Issue::Kind::LargeAutomaton, report.text,
+			"automaton has " + std::to_string(report.automatonSize) + " states which is more than " + std::to_string(_maxAutomatonSize)});
+	// Atoms are chosen for each alternative separately, so each of them needs its own literal
+	auto anchor = info.exact ? report.requiredLiteral.length() : info.anchor;
+	if (anchor < _minLiteralLength)
+		report.issues.push_back(Issue{Issue::Kind::MissingLiteral, report.text,
+			"some alternative has no literal of at least " + std::to_string(_minLiteralLength) + " bytes"});
+	return report;
+}
+
+/**
+ * Analyzes regular expressions in strings and condition of the rule.
+ *
+ * @param rule Rule.
+ *
+ * @return Reports of the regular expression strings followed by reports
+ *         of regular expressions used in the condition.
+ */
+std::vector<RegexpAnalyzer::Report> RegexpAnalyzer::analyze(const Rule& rule) const
+{
+	std::vector<Report> result;
+	for (const auto* string : rule.getStrings())
+	{
+		if (!string->isRegexp())
+			continue;
+
+		result.push_back(analyze(static_cast<const Regexp&>(*string), string->isNocase()));
+		result.back().rule = rule.getName();
+		result.back().string = string->getIdentifier();
+	}
+
+	for (const auto* regexp : MatchesCollector{}.collect(rule))
+	{
+		result.push_back(analyze(*regexp));
+		result.back().rule = rule.getName();
+	}
+	return result;
+}
+
+/**
+ * Analyzes regular expressions of all rules in the YARA file.
+ *
+ * @param file YARA file.
+ *
+ * @return Reports of all regular expressions.
+ */
+std::vector<RegexpAnalyzer::Report> RegexpAnalyzer::analyze(const YaraFile& file) const
+{
+	std::vector<Report> result;
+	for (const auto& rule : file.getRules())
+	{
+		auto reports = analyze(*rule);
+		std::move(reports.begin(), reports.end(), std::back_inserter(result));
+	}
+	return result;
+}
+
+}
@@ -0,0 +1,2027 @@
+/**
+ * @file src/utils/serialization.cpp
+ * @brief Implementation of binary serialization of YARA files and rules.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <unordered_map>
+
+#include "yaramod/types/hex_string.h"
+#include "yaramod/types/plain_string.h"
+#include "yaramod/types/regexp.h"
+#include "yaramod/types/symbols.h"
+#include "yaramod/utils/serialization.h"
+#include "yaramod/utils/traversal.h"
+#include "yaramod/yaramod.h"
+
+namespace yaramod {
+
+namespace {
+
+/**
+ * Layout of the serialized data:
+ *
+ * @code
+ * header     = "YRMD" version(varint) yaramod-version(string) content(byte) features(varint)
+ * file       = header lean(byte) stream imports rules
+ * rule       = header stream rule-record
+ * stream     = new-line-style(string) entry* End
+ * entry      = Token token-record [stream if the token is include] | Regexp regexp-record
+ * @endcode
+ *
+ * Tokens of all streams are numbered in the order in which they are written and the rest
+ * of the data refers to them by these numbers. Objects which own tokens (expressions, strings,
+ * rules) only store numbers of the tokens they refer to and are rebuilt from them, so the tokens
+ * keep their identity. Regular expressions are the only exception since their units create their
+ * own tokens, so they are stored as unit trees and their tokens are recreated.
+ *
+ * Numbers of tokens are stored as differences from the previously stored number, locations of tokens
+ * only contain the parts which differ from the previous token and string literals are stored only
+ * at their first occurrence and by their number afterwards.
+ */
+constexpr std::string_view Magic = "YRMD";
+/// Version of the layout, it needs to be increased whenever the layout changes
+constexpr std::uint64_t FormatVersion = 2;
+
+/// Step in the path of module symbol which descends into element of structured array or dictionary
+constexpr std::string_view ElementStep = "[]";
+
+enum class Content : std::uint8_t { File, Rule };
+enum class Entry : std::uint8_t { Token, Regexp, End };
+enum class LiteralTag : std::uint8_t { String, Bool, Int, UInt, Float, Symbol, Reference };
+enum class SymbolTag : std::uint8_t { Backreference, ModuleMember, Global, Value, Array, Dictionary, Function, Structure, Reference };
+enum class HexUnitTag : std::uint8_t { Nibble, Wildcard, Jump, Or };
+enum class RegexpTag : std::uint8_t
+{
+	Text,
+	AnyChar,
+	WordChar,
+	NonWordChar,
+	Space,
+	NonSpace,
+	Digit,
+	NonDigit,
+	WordBoundary,
+	NonWordBoundary,
+	StartOfLine,
+	EndOfLine,
+	Class,
+	Iteration,
+	PositiveIteration,
+	Optional,
+	Range,
+	Or,
+	Group,
+	Concat
+};
+
+/**
+ * Bits of the byte which precedes each token. Besides the properties of the token,
+ * they tell which parts of its location are the same as in the previous token
+ * and are therefore omitted.
+ */
+enum TokenFlags : std::uint8_t
+{
+	Flag = 0x01,
+	Escaped = 0x02,
+	Formatted = 0x04,
+	Include = 0x08,
+	Indented = 0x10,
+	PathChanged = 0x20,
+	LineChanged = 0x40,
+	MultiLine = 0x80
+};
+
+[[noreturn]] void throwMalformed()
+{
+	throw YaramodError("Error: Serialized YARA data are malformed");
+}
+
+bool isBinaryOperation(Expression::Kind kind)
+{
+	return kind >= Expression::Kind::And && kind <= Expression::Kind::ShiftRight;
+}
+
+bool isLayoutToken(const Token& token)
+{
+	auto type = token.getType();
+	return type == TokenType::NEW_LINE || type == TokenType::COMMENT || type == TokenType::ONELINE_COMMENT;
+}
+
+template <typename T>
+bool isUnitOf(const RegexpUnit* unit)
+{
+	return dynamic_cast<const T*>(unit) != nullptr;
+}
+
+class OutputBuffer
+{
+public:
+	void writeByte(std::uint8_t value)
+	{
+		_data.push_back(static_cast<char>(value));
+	}
+
+	template <typename Enum, typename = std::enable_if_t<std::is_enum_v<Enum>>>
+	void writeByte(Enum value)
+	{
+		writeByte(static_cast<std::uint8_t>(value));
+	}
+
+	void writeVarint(std::uint64_t value)
+	{
+		while (value >= 0x80)
+		{
+			writeByte(static_cast<std::uint8_t>(value | 0x80));
+			value >>= 7;
+		}
+		writeByte(static_cast<std::uint8_t>(value));
+	}
+
+	void writeSigned(std::int64_t value)
+	{
+		writeVarint((static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63));
+	}
+
+	void writeDouble(double value)
+	{
+		std::uint64_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		for (int i = 0; i < 8; ++i, bits >>= 8)
+			writeByte(static_cast<std::uint8_t>(bits));
+	}
+
+	void writeString(std::string_view value)
+	{
+		writeVarint(value.size());
+		_data.append(value.data(), value.size());
+	}
+
+	void writeRaw(std::string_view value)
+	{
+		_data.append(value.data(), value.size());
+	}
+
+	std::string release()
+	{
+		return std::move(_data);
+	}
+
+private:
+	std::string _data;
+};
+
+class InputBuffer
+{
+public:
+	InputBuffer(std::string_view data) : _data(data), _pos(0) {}
+
+	std::uint8_t readByte()
+	{
+		if (_pos >= _data.size())
+			throwMalformed();
+		return static_cast<std::uint8_t>(_data[_pos++]);
+	}
+
+	std::uint64_t readVarint()
+	{
+		std::uint64_t result = 0;
+		for (unsigned shift = 0; shift < 64; shift += 7)
+		{
+			auto byte = readByte();
+			result |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+				return result;
+		}
+		throwMalformed();
+	}
+
+	std::int64_t readSigned()
+	{
+		auto value = readVarint();
+		return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+	}
+
+	double readDouble()
+	{
+		std::uint64_t bits = 0;
+		for (int i = 0; i < 8; ++i)
+			bits |= static_cast<std::uint64_t>(readByte()) << (8 * i);
+		double value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	std::string_view readString()
+	{
+		auto size = readVarint();
+		if (size > _data.size() - _pos)
+			throwMalformed();
+		auto result = _data.substr(_pos, size);
+		_pos += size;
+		return result;
+	}
+
+	bool atEnd() const { return _pos == _data.size(); }
+
+private:
+	std::string_view _data;
+	std::size_t _pos;
+};
+
+void writeHeader(OutputBuffer& out, Content content, Features features)
+{
+	out.writeRaw(Magic);
+	out.writeVarint(FormatVersion);
+	out.writeString(YARAMOD_VERSION);
+	out.writeByte(content);
+	out.writeVarint(features);
+}
+
+Features readHeader(InputBuffer& in, Content expected, const std::optional<Features>& expectedFeatures = std::nullopt)
+{
+	for (char c : Magic)
+	{
+		if (in.readByte() != static_cast<std::uint8_t>(c))
+			throw YaramodError("Error: Data are not serialized YARA data");
+	}
+
+	auto version = in.readVarint();
+	if (version != FormatVersion)
+		throw YaramodError("Error: Unsupported version " + std::to_string(version) + " of serialized YARA data");
+
+	auto yaramodVersion = in.readString();
+	if (yaramodVersion != YARAMOD_VERSION)
+		throw YaramodError("Error: Serialized YARA data were created by yaramod " + std::string{yaramodVersion} + " but this is yaramod " YARAMOD_VERSION);
+
+	if (in.readByte() != static_cast<std::uint8_t>(expected))
+		throw YaramodError(expected == Content::File ? "Error: Serialized YARA data do not contain YARA file" : "Error: Serialized YARA data do not contain rule");
+
+	auto features = in.readVarint();
+	if (features & ~static_cast<std::uint64_t>(Features::Everything))
+		throwMalformed();
+	if (expectedFeatures && features != static_cast<std::uint64_t>(expectedFeatures.value()))
+		throw YaramodError("Error: Serialized YARA data were created with features " + std::to_string(features)
+			+ " but features " + std::to_string(static_cast<std::uint64_t>(expectedFeatures.value())) + " were requested");
+	return static_cast<Features>(features);
+}
+
+class Serializer
+{
+public:
+	Serializer(const YaraFile* file, Features features) : _file(file), _features(features) {}
+
+	std::string serializeFile()
+	{
+		_file->loadConditions();
+		writeHeader(_out, Content::File, _features);
+		_out.writeByte(_file->isLean());
+
+		auto ts = _file->getTokenStream();
+		indexStream(ts, ts->begin(), ts->end());
+		for (const auto& module : _file->getImports())
+			addModule(module->getName(), module->getStructure());
+		for (const auto& rule : _file->getRules())
+			collectRule(*rule);
+
+		writeStream(ts, ts->begin(), ts->end());
+		_out.writeVarint(_file->getImports().size());
+		for (const auto& module : _file->getImports())
+			_out.writeString(module->getName());
+		_out.writeVarint(_file->getRules().size());
+		for (const auto& rule : _file->getRules())
+			writeRule(*rule);
+		return _out.release();
+	}
+
+	std::string serializeRule(const Rule& rule)
+	{
+		rule.getCondition();
+		writeHeader(_out, Content::Rule, _features);
+
+		// Modifiers of the rule precede its first token
+		auto ts = rule.getTokenStream();
+		auto first = rule.getFirstTokenIt();
+		auto isModifier = [&](TokenIt it) { return it == rule.getPrivateTokenIt() || it == rule.getGlobalTokenIt(); };
+		while (first != ts->begin() && isModifier(std::prev(first)))
+			--first;
+		auto end = std::next(rule.getLastTokenIt());
+
+		indexStream(ts, first, end);
+		collectRule(rule);
+		writeStream(ts, first, end);
+		writeRule(rule);
+		return _out.release();
+	}
+
+private:
+	/// @name Indexing
+	/// @{
+	void indexStream(TokenStream* ts, TokenIt first, TokenIt end)
+	{
+		_streamIds.emplace(ts, _streamIds.size());
+		_tokenIndices.reserve(_tokenIndices.size() + ts->size());
+		for (auto it = first; it != end; ++it)
+		{
+			_tokenIndices.emplace(&*it, _tokens.size());
+			_tokens.push_back(&*it);
+			if (it->isIncludeToken())
+			{
+				auto sub = it->getSubTokenStream().get();
+				indexStream(sub, sub->begin(), sub->end());
+			}
+		}
+	}
+
+	/**
+	 * Remembers paths to all symbols of the module, so the symbols
+	 * can be stored just as references into the module.
+	 */
+	void addModule(const std::string& name, const std::shared_ptr<Symbol>& structure)
+	{
+		std::vector<std::pair<const Symbol*, std::vector<std::string>>> stack{{structure.get(), {}}};
+		while (!stack.empty())
+		{
+			auto [symbol, steps] = std::move(stack.back());
+			stack.pop_back();
+			if (_modulePaths.find(symbol) != _modulePaths.end())
+				continue;
+
+			if (symbol->isStructure())
+			{
+				for (const auto& [attributeName, attribute] : static_cast<const StructureSymbol*>(symbol)->getAttributes())
+				{
+					auto attributeSteps = steps;
+					attributeSteps.push_back(attributeName);
+					stack.emplace_back(attribute.get(), std::move(attributeSteps));
+				}
+			}
+			else if (symbol->isArray() || symbol->isDictionary())
+			{
+				if (const auto& element = static_cast<const IterableSymbol*>(symbol)->getStructuredElementType())
+				{
+					auto elementSteps = steps;
+					elementSteps.emplace_back(ElementStep);
+					stack.emplace_back(element.get(), std::move(elementSteps));
+				}
+			}
+
+			_modulePaths.emplace(symbol, ModulePath{name, std::move(steps)});
+		}
+	}
+
+	void collectRule(const Rule& rule)
+	{
+		for (const auto* string : rule.getStrings())
+		{
+			if (const auto& id = string->getIdentifierIt())
+				_literalOwners.emplace(&(*id)->getLiteral(), indexOf(*id));
+			if (string->isRegexp())
+				addRegexp(static_cast<const Regexp*>(string));
+		}
+
+		for (const auto& variable : rule.getVariables())
+			collectExpression(variable.getValue());
+		collectExpression(rule.getCondition());
+	}
+
+	void collectExpression(const Expression::Ptr& expr)
+	{
+		if (!expr)
+			return;
+
+		traverse(expr, [&](Expression* subexpr) {
+			if (subexpr->getKind() == Expression::Kind::Id)
+			{
+				// Modules used without import are only possible with rules serialized on their own
+				const auto& symbol = static_cast<IdExpression*>(subexpr)->getSymbol();
+				if (symbol && symbol->isStructure() && _modulePaths.find(symbol.get()) == _modulePaths.end())
+				{
+					if (_modules.load(symbol->getName(), Features::Everything))
+						addModule(symbol->getName(), symbol);
+				}
+			}
+			else if (subexpr->getKind() == Expression::Kind::Regexp)
+			{
+				const auto& regexp = static_cast<RegexpExpression*>(subexpr)->getRegexpString();
+				if (!regexp || !regexp->isRegexp())
+					throw YaramodError("Error: Regular expression '" + subexpr->getText() + "' can not be serialized");
+				addRegexp(static_cast<const Regexp*>(regexp.get()));
+			}
+			return true;
+		}, [](Expression*) {});
+	}
+
+	void addRegexp(const Regexp* regexp)
+	{
+		_regexpStarts.emplace(&*regexp->getFirstTokenIt(), regexp);
+	}
+
+	std::uint64_t indexOf(TokenIt it) const
+	{
+		auto itr = _tokenIndices.find(&*it);
+		if (itr == _tokenIndices.end())
+			throw YaramodError("Error: Token '" + it->getPureText() + "' is not part of serialized token stream");
+		return itr->second;
+	}
+	/// @}
+
+	/// @name Token streams
+	/// @{
+	void writeStream(TokenStream* ts, TokenIt first, TokenIt end)
+	{
+		_out.writeString(ts->getNewLineStyle());
+		for (auto it = first; it != end;)
+		{
+			if (auto itr = _regexpStarts.find(&*it); itr != _regexpStarts.end())
+			{
+				auto last = std::next(itr->second->getLastTokenIt());
+				_out.writeByte(Entry::Regexp);
+				writeRegexp(itr->second, it, last);
+				it = last;
+				continue;
+			}
+
+			_out.writeByte(Entry::Token);
+			writeToken(*it);
+			if (it->isIncludeToken())
+			{
+				auto sub = it->getSubTokenStream().get();
+				writeStream(sub, sub->begin(), sub->end());
+			}
+			++it;
+		}
+		_out.writeByte(Entry::End);
+	}
+
+	void writeToken(const Token& token)
+	{
+		const auto& literal = token.getLiteral();
+
+		std::uint8_t flags = 0;
+		if (literal.isEscaped())
+			flags |= TokenFlags::Escaped;
+		if (literal.hasFormattedValue())
+			flags |= TokenFlags::Formatted;
+		if (token.isIncludeToken())
+			flags |= TokenFlags::Include;
+
+		_out.writeVarint(static_cast<std::uint64_t>(token.getType()));
+		writeLayout(token, flags);
+		if (literal.hasFormattedValue())
+			_out.writeString(literal.getFormattedValue());
+		writeLiteral(literal);
+	}
+
+	void writeLiteral(const Literal& literal)
+	{
+		if (literal.isString())
+		{
+			_out.writeByte(LiteralTag::String);
+			writeInternedString(literal.getString());
+		}
+		else if (literal.isBool())
+		{
+			_out.writeByte(LiteralTag::Bool);
+			_out.writeByte(literal.getBool());
+		}
+		else if (literal.isUInt())
+		{
+			_out.writeByte(LiteralTag::UInt);
+			_out.writeVarint(literal.getUInt());
+		}
+		else if (literal.isInt())
+		{
+			_out.writeByte(LiteralTag::Int);
+			_out.writeSigned(literal.getInt());
+		}
+		else if (literal.isFloat())
+		{
+			_out.writeByte(LiteralTag::Float);
+			_out.writeDouble(literal.getFloat());
+		}
+		else if (literal.isSymbol())
+		{
+			_out.writeByte(LiteralTag::Symbol);
+			writeSymbol(literal.getSymbol());
+		}
+		else
+		{
+			// References usually point to identifiers of strings which are collected in advance,
+			// literals of all tokens are collected only when some other literal is referenced
+			auto itr = _literalOwners.find(literal.getLiteralReference());
+			if (itr == _literalOwners.end() && !_allLiteralOwners)
+			{
+				for (std::uint64_t i = 0; i < _tokens.size(); ++i)
+					_literalOwners.emplace(&_tokens[i]->getLiteral(), i);
+				_allLiteralOwners = true;
+				itr = _literalOwners.find(literal.getLiteralReference());
+			}
+			if (itr == _literalOwners.end())
+				throw YaramodError("Error: Literal referenced from token stream is not part of serialized token stream");
+			_out.writeByte(LiteralTag::Reference);
+			_out.writeVarint(itr->second);
+		}
+	}
+
+	/**
+	 * Writes the byte with @p flags and the bits of location which are the same as in the previous
+	 * token followed by the changed parts of the location and the indentation.
+	 */
+	void writeLayout(const Token& token, std::uint8_t flags)
+	{
+		const auto& location = token.getLocation();
+		const auto& path = location.getFilePath();
+		auto begin = location.begin();
+		const auto& end = location.end();
+
+		if (token.getFlag())
+			flags |= TokenFlags::Flag;
+		if (token.getIndentation() != 0)
+			flags |= TokenFlags::Indented;
+		if (_pathIds.empty() || path != _previousPath)
+			flags |= TokenFlags::PathChanged;
+		if (begin.line != _previousLine)
+			flags |= TokenFlags::LineChanged;
+		if (end.line != begin.line)
+			flags |= TokenFlags::MultiLine;
+
+		_out.writeByte(flags);
+		if (flags & TokenFlags::Indented)
+			_out.writeVarint(token.getIndentation());
+		if (flags & TokenFlags::PathChanged)
+		{
+			auto [pathItr, inserted] = _pathIds.emplace(path, _pathIds.size());
+			_out.writeVarint(pathItr->second);
+			if (inserted)
+				_out.writeString(path);
+			_previousPath = path;
+		}
+		if (flags & TokenFlags::LineChanged)
+			_out.writeSigned(static_cast<std::int64_t>(begin.line - _previousLine));
+		_out.writeVarint(begin.column - 1);
+		if (flags & TokenFlags::MultiLine)
+		{
+			_out.writeSigned(static_cast<std::int64_t>(end.line - begin.line));
+			_out.writeVarint(end.column);
+		}
+		else
+			_out.writeSigned(static_cast<std::int64_t>(end.column - (begin.column - 1)));
+		_previousLine = begin.line;
+	}
+
+	void writeLocation(const Location& location)
+	{
+		auto [pathItr, inserted] = _pathIds.emplace(location.getFilePath(), _pathIds.size());
+		_out.writeVarint(pathItr->second);
+		if (inserted)
+			_out.writeString(location.getFilePath());
+		_out.writeVarint(location.begin().line);
+		_out.writeVarint(location.begin().column - 1);
+		_out.writeVarint(location.end().line);
+		_out.writeVarint(location.end().column);
+	}
+
+	void writeInternedString(const std::string& value)
+	{
+		auto [itr, inserted] = _stringIds.emplace(value, _stringIds.size());
+		_out.writeVarint(itr->second);
+		if (inserted)
+			_out.writeString(value);
+	}
+
+	void writeStreamId(const TokenStream* ts)
+	{
+		auto itr = _streamIds.find(ts);
+		_out.writeVarint(itr != _streamIds.end() ? itr->second + 1 : 0);
+	}
+
+	void writeIndex(TokenIt it)
+	{
+		writeIndex(indexOf(it));
+	}
+
+	void writeIndex(std::uint64_t index)
+	{
+		// Tokens are mostly referred to in the order of the token stream so the differences are small
+		_out.writeSigned(static_cast<std::int64_t>(index - _previousIndex));
+		_previousIndex = index;
+	}
+
+	void writeOptionalIndex(const std::optional<TokenIt>& it)
+	{
+		_out.writeByte(it.has_value());
+		if (it)
+			writeIndex(*it);
+	}
+	/// @}
+
+	/// @name Symbols
+	/// @{
+	void writeSymbol(const std::shared_ptr<Symbol>& symbol)
+	{
+		if (!symbol)
+			throw YaramodError("Error: Missing symbol can not be serialized");
+
+		if (auto itr = _symbolIds.find(symbol.get()); itr != _symbolIds.end())
+		{
+			_out.writeByte(SymbolTag::Backreference);
+			_out.writeVarint(itr->second);
+			return;
+		}
+		_symbolIds.emplace(symbol.get(), _symbolIds.size());
+
+		if (auto itr = _modulePaths.find(symbol.get()); itr != _modulePaths.end())
+		{
+			_out.writeByte(SymbolTag::ModuleMember);
+			_out.writeString(symbol->getName());
+			_out.writeString(itr->second.module);
+			_out.writeVarint(itr->second.steps.size());
+			for (const auto& step : itr->second.steps)
+				_out.writeString(step);
+			return;
+		}
+
+		if (_file && !_file->hasRule(symbol->getName()) && _file->findSymbol(symbol->getName()) == symbol)
+		{
+			_out.writeByte(SymbolTag::Global);
+			_out.writeString(symbol->getName());
+			return;
+		}
+
+		switch (symbol->getType())
+		{
+			case Symbol::Type::Value:
+				_out.writeByte(SymbolTag::Value);
+				_out.writeString(symbol->getName());
+				_out.writeByte(symbol->getDataType());
+				break;
+			case Symbol::Type::Array:
+			case Symbol::Type::Dictionary:
+			{
+				auto iterable = std::static_pointer_cast<IterableSymbol>(symbol);
+				_out.writeByte(symbol->isArray() ? SymbolTag::Array : SymbolTag::Dictionary);
+				_out.writeString(symbol->getName());
+				_out.writeByte(iterable->isStructured());
+				if (iterable->isStructured())
+					writeSymbol(iterable->getStructuredElementType());
+				else
+					_out.writeByte(iterable->getElementType());
+				break;
+			}
+			case Symbol::Type::Function:
+			{
+				auto function = std::static_pointer_cast<FunctionSymbol>(symbol);
+				_out.writeByte(SymbolTag::Function);
+				_out.writeString(symbol->getName());
+				_out.writeByte(function->getReturnType());
+				_out.writeVarint(function->getAllOverloads().size());
+				for (const auto& overload : function->getAllOverloads())
+				{
+					_out.writeVarint(overload.size());
+					for (auto type : overload)
+						_out.writeByte(type);
+				}
+				break;
+			}
+			case Symbol::Type::Structure:
+			{
+				const auto& attributes = std::static_pointer_cast<StructureSymbol>(symbol)->getAttributes();
+				_out.writeByte(SymbolTag::Structure);
+				_out.writeString(symbol->getName());
+				_out.writeVarint(attributes.size());
+				for (const auto& [name, attribute] : attributes)
+					writeSymbol(attribute);
+				break;
+			}
+			case Symbol::Type::Reference:
+				_out.writeByte(SymbolTag::Reference);
+				_out.writeString(symbol->getName());
+				writeSymbol(std::static_pointer_cast<ReferenceSymbol>(symbol)->getSymbol());
+				break;
+			default:
+				throw YaramodError("Error: Symbol '" + symbol->getName() + "' of unknown type can not be serialized");
+		}
+	}
+	/// @}
+
+	/// @name Regular expressions
+	/// @{
+	void writeRegexp(const Regexp* regexp, TokenIt first, TokenIt end)
+	{
+		_regexpIds.emplace(regexp, _regexpIds.size());
+
+		// Tokens are recreated from the units, only their positions are kept
+		_out.writeVarint(indexOf(std::prev(end)) - indexOf(first) + 1);
+		writeRegexpUnit(regexp->getUnit());
+		_out.writeString(regexp->getSuffixModifiers());
+		for (auto it = first; it != end; ++it)
+			writeLayout(*it, 0);
+	}
+
+	void writeRegexpUnit(const std::shared_ptr<RegexpUnit>& unit)
+	{
+		auto* u = unit.get();
+		if (auto* operation = dynamic_cast<const RegexpOperation*>(u))
+		{
+			if (auto* range = dynamic_cast<const RegexpRange*>(u))
+			{
+				const auto& [low, high] = range->getRange();
+				_out.writeByte(RegexpTag::Range);
+				_out.writeByte(static_cast<std::uint8_t>((low ? 1 : 0) | (high ? 2 : 0)));
+				if (low)
+					_out.writeVarint(*low);
+				if (high)
+					_out.writeVarint(*high);
+			}
+			else if (isUnitOf<RegexpIteration>(u))
+				_out.writeByte(RegexpTag::Iteration);
+			else if (isUnitOf<RegexpPositiveIteration>(u))
+				_out.writeByte(RegexpTag::PositiveIteration);
+			else if (isUnitOf<RegexpOptional>(u))
+				_out.writeByte(RegexpTag::Optional);
+			else
+				throw YaramodError("Error: Unknown regular expression operation can not be serialized");
+
+			_out.writeByte(operation->isGreedy());
+			writeRegexpUnit(operation->getOperand());
+		}
+		else if (auto* regexpClass = dynamic_cast<const RegexpClass*>(u))
+		{
+			_out.writeByte(RegexpTag::Class);
+			_out.writeByte(regexpClass->isNegative());
+			_out.writeString(regexpClass->getCharacters());
+		}
+		else if (auto* regexpOr = dynamic_cast<const RegexpOr*>(u))
+		{
+			_out.writeByte(RegexpTag::Or);
+			writeRegexpUnit(regexpOr->getLeft());
+			writeRegexpUnit(regexpOr->getRight());
+		}
+		else if (auto* group = dynamic_cast<const RegexpGroup*>(u))
+		{
+			_out.writeByte(RegexpTag::Group);
+			writeRegexpUnit(group->getUnit());
+		}
+		else if (auto* concat = dynamic_cast<const RegexpConcat*>(u))
+		{
+			_out.writeByte(RegexpTag::Concat);
+			_out.writeVarint(concat->getUnits().size());
+			for (const auto& subunit : concat->getUnits())
+				writeRegexpUnit(subunit);
+		}
+		else if (isUnitOf<RegexpAnyChar>(u))
+			_out.writeByte(RegexpTag::AnyChar);
+		else if (isUnitOf<RegexpWordChar>(u))
+			_out.writeByte(RegexpTag::WordChar);
+		else if (isUnitOf<RegexpNonWordChar>(u))
+			_out.writeByte(RegexpTag::NonWordChar);
+		else if (isUnitOf<RegexpSpace>(u))
+			_out.writeByte(RegexpTag::Space);
+		else if (isUnitOf<RegexpNonSpace>(u))
+			_out.writeByte(RegexpTag::NonSpace);
+		else if (isUnitOf<RegexpDigit>(u))
+			_out.writeByte(RegexpTag::Digit);
+		else if (isUnitOf<RegexpNonDigit>(u))
+			_out.writeByte(RegexpTag::NonDigit);
+		else if (isUnitOf<RegexpWordBoundary>(u))
+			_out.writeByte(RegexpTag::WordBoundary);
+		else if (isUnitOf<RegexpNonWordBoundary>(u))
+			_out.writeByte(RegexpTag::NonWordBoundary);
+		else if (isUnitOf<RegexpStartOfLine>(u))
+			_out.writeByte(RegexpTag::StartOfLine);
+		else if (isUnitOf<RegexpEndOfLine>(u))
+			_out.writeByte(RegexpTag::EndOfLine);
+		else if (isUnitOf<RegexpText>(u))
+		{
+			_out.writeByte(RegexpTag::Text);
+			_out.writeString(u->getText());
+		}
+		else
+			throw YaramodError("Error: Unknown regular expression unit can not be serialized");
+	}
+	/// @}
+
+	/// @name Expressions
+	/// @{
+	void writeExpression(const Expression::Ptr& expr)
+	{
+		if (!expr)
+		{
+			_out.writeByte(Expression::Kind::Undefined);
+			return;
+		}
+
+		traverse(expr, [&](Expression* subexpr) {
+			writeExpressionNode(subexpr);
+			return true;
+		}, [](Expression*) {});
+	}
+
+	void writeExpressionNode(Expression* expr)
+	{
+		auto kind = expr->getKind();
+		_out.writeByte(kind);
+		_out.writeByte(expr->getType());
+		writeStreamId(expr->getTokenStream());
+
+		_children.clear();
+		forEachSubexpression(expr, [&](const Expression::Ptr& subexpr) { _children.push_back(subexpr.get()); });
+
+		if (isBinaryOperation(kind))
+			_out.writeByte(static_cast<BinaryOpExpression*>(expr)->hasLinebreak());
+		else if (kind == Expression::Kind::Parentheses)
+			_out.writeByte(static_cast<ParenthesesExpression*>(expr)->hasLinebreak());
+		else if (kind == Expression::Kind::ArrayAccess)
+			writeSymbol(static_cast<ArrayAccessExpression*>(expr)->getSymbol());
+		else if (kind == Expression::Kind::Regexp)
+		{
+			auto itr = _regexpIds.find(static_cast<const Regexp*>(static_cast<RegexpExpression*>(expr)->getRegexpString().get()));
+			if (itr == _regexpIds.end())
+				throw YaramodError("Error: Regular expression '" + expr->getText() + "' is not part of serialized token stream");
+			_out.writeVarint(itr->second);
+		}
+
+		_out.writeVarint(_children.size());
+		if (kind == Expression::Kind::Regexp)
+			return;
+
+		// Tokens of the expression are those in its range which don't belong to any subexpression.
+		// They are stored in gaps around subexpressions so the gaps can be told apart.
+		auto position = indexOf(expr->getFirstTokenIt());
+		auto end = indexOf(expr->getLastTokenIt()) + 1;
+		auto writeGap = [&](std::uint64_t to) {
+			if (to < position || to > end)
+				throw YaramodError("Error: Expression '" + expr->getText() + "' can not be serialized because its tokens are out of order");
+
+			_gap.clear();
+			for (; position < to; ++position)
+			{
+				if (!isLayoutToken(*_tokens[position]))
+					_gap.push_back(position);
+			}
+			_out.writeVarint(_gap.size());
+			for (auto index : _gap)
+				writeIndex(index);
+		};
+
+		for (auto* child : _children)
+		{
+			writeGap(indexOf(child->getFirstTokenIt()));
+			position = indexOf(child->getLastTokenIt()) + 1;
+		}
+		writeGap(end);
+	}
+	/// @}
+
+	/// @name Rules
+	/// @{
+	void writeRule(const Rule& rule)
+	{
+		if (_streamIds.find(rule.getTokenStream()) == _streamIds.end())
+			throw YaramodError("Error: Rule '" + rule.getName() + "' is not part of serialized token stream");
+
+		writeStreamId(rule.getTokenStream());
+		writeLocation(rule.getLocation());
+		writeIndex(rule.getNameTokenIt());
+		writeOptionalIndex(rule.getPrivateTokenIt());
+		writeOptionalIndex(rule.getGlobalTokenIt());
+
+		_out.writeVarint(rule.getTagTokens().size());
+		for (const auto& tag : rule.getTagTokens())
+			writeIndex(tag);
+
+		_out.writeVarint(rule.getMetas().size());
+		for (const auto& meta : rule.getMetas())
+		{
+			writeIndex(meta.getKeyTokenIt());
+			writeIndex(meta.getValueTokenIt());
+		}
+
+		auto strings = rule.getStrings();
+		_out.writeVarint(strings.size());
+		for (const auto* string : strings)
+			writeString(*string);
+
+		_out.writeVarint(rule.getVariables().size());
+		for (const auto& variable : rule.getVariables())
+		{
+			writeIndex(variable.getKeyTokenIt());
+			writeExpression(variable.getValue());
+		}
+
+		writeExpression(rule.getCondition());
+	}
+
+	void writeString(const String& string)
+	{
+		_out.writeByte(string.getType());
+		writeStreamId(string.getTokenStream().get());
+		writeOptionalIndex(string.getIdentifierIt());
+		writeOptionalIndex(string.getAssignIt());
+
+		// Modifiers are kept in unordered map so they are sorted for the output to be deterministic
+		std::vector<std::pair<StringModifier::Type, const StringModifier*>> modifiers;
+		for (const auto& [type, modifier] : string.getModifiers())
+			modifiers.emplace_back(type, modifier.get());
+		std::sort(modifiers.begin(), modifiers.end());
+
+		_out.writeVarint(modifiers.size());
+		for (const auto& [type, modifier] : modifiers)
+		{
+			_out.writeByte(type);
+			writeIndex(modifier->getTokenRange().first);
+			writeIndex(modifier->getTokenRange().second);
+			if (type == StringModifier::Type::Xor)
+			{
+				auto xorModifier = static_cast<const XorStringModifier*>(modifier);
+				const auto& low = xorModifier->getLow();
+				const auto& high = xorModifier->getHigh();
+				_out.writeByte(static_cast<std::uint8_t>((low ? 1 : 0) | (high ? 2 : 0)));
+				if (low)
+					_out.writeVarint(*low);
+				if (high)
+					_out.writeVarint(*high);
+			}
+			else if (type == StringModifier::Type::Base64 || type == StringModifier::Type::Base64Wide)
+			{
+				const auto& alphabet = type == StringModifier::Type::Base64
+					? static_cast<const Base64StringModifier*>(modifier)->getAlphabet()
+					: static_cast<const Base64WideStringModifier*>(modifier)->getAlphabet();
+				_out.writeByte(alphabet.has_value());
+				if (alphabet)
+					_out.writeString(*alphabet);
+			}
+		}
+
+		if (string.isPlain())
+			writeIndex(string.getFirstTokenIt());
+		else if (string.isHex())
+		{
+			writeIndex(string.getFirstTokenIt());
+			writeIndex(string.getLastTokenIt());
+			writeHexUnits(static_cast<const HexString&>(string).getUnits());
+		}
+		else
+		{
+			auto itr = _regexpIds.find(static_cast<const Regexp*>(&string));
+			if (itr == _regexpIds.end())
+				throw YaramodError("Error: String '" + string.getIdentifier() + "' is not part of serialized token stream");
+			_out.writeVarint(itr->second);
+		}
+	}
+
+	void writeHexUnits(const std::vector<std::shared_ptr<HexStringUnit>>& units)
+	{
+		_out.writeVarint(units.size());
+		for (const auto& unit : units)
+		{
+			if (unit->isNibble())
+			{
+				_out.writeByte(HexUnitTag::Nibble);
+				writeIndex(unit->getFirstTokenIt());
+			}
+			else if (unit->isWildcard())
+			{
+				_out.writeByte(HexUnitTag::Wildcard);
+				writeIndex(unit->getFirstTokenIt());
+			}
+			else if (unit->isJump())
+			{
+				_out.writeByte(HexUnitTag::Jump);
+				writeIndex(unit->getFirstTokenIt());
+				writeIndex(unit->getLastTokenIt());
+			}
+			else
+			{
+				const auto& substrings = std::static_pointer_cast<HexStringOr>(unit)->getSubstrings();
+				_out.writeByte(HexUnitTag::Or);
+				_out.writeVarint(substrings.size());
+				for (const auto& substring : substrings)
+					writeHexUnits(substring->getUnits());
+			}
+		}
+	}
+	/// @}
+
+	struct ModulePath
+	{
+		std::string module; ///< Name of the module
+		std::vector<std::string> steps; ///< Attribute names or element steps leading to the symbol
+	};
+
+	const YaraFile* _file; ///< Serialized file, @c nullptr if only rule is serialized
+	Features _features;
+	OutputBuffer _out;
+	ModulesPool _modules;
+
+	std::vector<const Token*> _tokens;
+	std::unordered_map<const Token*, std::uint64_t> _tokenIndices;
+	std::unordered_map<const Literal*, std::uint64_t> _literalOwners;
+	bool _allLiteralOwners = false; ///< Whether literals of all tokens are in _literalOwners
+	std::unordered_map<const TokenStream*, std::uint64_t> _streamIds;
+	std::unordered_map<std::string, std::uint64_t> _pathIds;
+	std::unordered_map<std::string_view, std::uint64_t> _stringIds; ///< Views into literals of the serialized tokens
+	std::string _previousPath;
+	std::size_t _previousLine = 0;
+	std::uint64_t _previousIndex = 0;
+
+	std::unordered_map<const Symbol*, ModulePath> _modulePaths;
+	std::unordered_map<const Symbol*, std::uint64_t> _symbolIds;
+	std::unordered_map<const Token*, const Regexp*> _regexpStarts;
+	std::unordered_map<const Regexp*, std::uint64_t> _regexpIds;
+
+	std::vector<Expression*> _children;
+	std::vector<std::uint64_t> _gap;
+};
+
+class Deserializer
+{
+public:
+	Deserializer(std::string_view data) : _in(data) {}
+
+	std::unique_ptr<YaraFile> deserializeFile(const std::optional<Features>& expectedFeatures = std::nullopt)
+	{
+		_features = readHeader(_in, Content::File, expectedFeatures);
+		auto lean = _in.readByte() != 0;
+
+		auto ts = std::make_shared<TokenStream>();
+		auto file = std::make_unique<YaraFile>(ts, _features);
+		file->setLean(lean);
+		_file = file.get();
+		readStream(ts);
+		resolveReferences();
+
+		TokenStream importTokens;
+		auto importCount = _in.readVarint();
+		for (std::uint64_t i = 0; i < importCount; ++i)
+		{
+			auto name = std::string{_in.readString()};
+			if (!file->addImport(importTokens.emplace_back(TokenType::IMPORT_MODULE, name), _modules))
+				throw YaramodError("Error: Unrecognized module '" + name + "' in serialized YARA file");
+		}
+
+		auto ruleCount = _in.readVarint();
+		for (std::uint64_t i = 0; i < ruleCount; ++i)
+			file->addRule(readRule());
+
+		if (!_in.atEnd())
+			throwMalformed();
+		return file;
+	}
+
+	std::shared_ptr<Rule> deserializeRule()
+	{
+		_features = readHeader(_in, Content::Rule);
+
+		auto ts = std::make_shared<TokenStream>();
+		readStream(ts);
+		resolveReferences();
+		auto rule = readRule();
+
+		if (!_in.atEnd())
+			throwMalformed();
+		return rule;
+	}
+
+private:
+	/// @name Token streams
+	/// @{
+	void readStream(const std::shared_ptr<TokenStream>& ts)
+	{
+		_streams.push_back(ts);
+		ts->setNewLineChar(std::string{_in.readString()});
+		while (true)
+		{
+			auto entry = static_cast<Entry>(_in.readByte());
+			if (entry == Entry::End)
+				return;
+			else if (entry == Entry::Token)
+				readToken(ts);
+			else if (entry == Entry::Regexp)
+				readRegexp(ts);
+			else
+				throwMalformed();
+		}
+	}
+
+	void readToken(const std::shared_ptr<TokenStream>& ts)
+	{
+		auto type = _in.readVarint();
+		if (type > static_cast<std::uint64_t>(TokenType::INVALID))
+			throwMalformed();
+
+		auto flags = _in.readByte();
+		auto [indentation, location] = readLayout(flags);
+		std::optional<std::string> formatted;
+		if (flags & TokenFlags::Formatted)
+			formatted = std::string{_in.readString()};
+
+		Literal literal;
+		std::optional<std::uint64_t> reference;
+		switch (static_cast<LiteralTag>(_in.readByte()))
+		{
+			case LiteralTag::String:
+				literal = Literal(std::string{readInternedString()}, formatted);
+				break;
+			case LiteralTag::Bool:
+				literal = Literal(_in.readByte() != 0, formatted);
+				break;
+			case LiteralTag::Int:
+				literal = Literal(static_cast<std::int64_t>(_in.readSigned()), formatted);
+				break;
+			case LiteralTag::UInt:
+				literal = Literal(static_cast<std::uint64_t>(_in.readVarint()), formatted);
+				break;
+			case LiteralTag::Float:
+				literal = Literal(_in.readDouble(), formatted);
+				break;
+			case LiteralTag::Symbol:
+				literal = Literal(std::string{}, formatted);
+				literal.setValue(readSymbol());
+				break;
+			case LiteralTag::Reference:
+				// Referenced token may not exist yet so the reference is resolved once all tokens are read
+				literal = Literal(std::string{}, formatted);
+				reference = _in.readVarint();
+				break;
+			default:
+				throwMalformed();
+		}
+		if (flags & TokenFlags::Escaped)
+			literal.markEscaped();
+
+		auto token = ts->emplace_back(static_cast<TokenType>(type), std::move(literal));
+		token->setFlag(flags & TokenFlags::Flag);
+		token->setIndentation(indentation);
+		token->setLocation(location);
+		_tokens.push_back(token);
+		if (reference)
+			_references.emplace_back(token, *reference);
+
+		if (flags & TokenFlags::Include)
+			readStream(token->initializeSubTokenStream());
+	}
+
+	std::pair<std::size_t, Location> readLayout(std::uint8_t flags)
+	{
+		std::size_t indentation = 0;
+		if (flags & TokenFlags::Indented)
+			indentation = _in.readVarint();
+		if (flags & TokenFlags::PathChanged)
+		{
+			_previousPath = _in.readVarint();
+			if (_previousPath == _paths.size())
+				_paths.emplace_back(_in.readString());
+		}
+		if (_previousPath >= _paths.size())
+			throwMalformed();
+
+		if (flags & TokenFlags::LineChanged)
+			_previousLine += _in.readSigned();
+		auto beginColumn = _in.readVarint();
+		auto endLine = _previousLine;
+		std::size_t endColumn;
+		if (flags & TokenFlags::MultiLine)
+		{
+			endLine += _in.readSigned();
+			endColumn = _in.readVarint();
+		}
+		else
+			endColumn = beginColumn + _in.readSigned();
+		return {indentation, Location(_paths[_previousPath], Location::Position(_previousLine, beginColumn), Location::Position(endLine, endColumn))};
+	}
+
+	Location readLocation()
+	{
+		auto pathId = _in.readVarint();
+		if (pathId == _paths.size())
+			_paths.emplace_back(_in.readString());
+		else if (pathId > _paths.size())
+			throwMalformed();
+
+		auto beginLine = _in.readVarint();
+		auto beginColumn = _in.readVarint();
+		auto endLine = _in.readVarint();
+		auto endColumn = _in.readVarint();
+		return Location(_paths[pathId], Location::Position(beginLine, beginColumn), Location::Position(endLine, endColumn));
+	}
+
+	std::string_view readInternedString()
+	{
+		auto id = _in.readVarint();
+		if (id == _strings.size())
+			_strings.push_back(_in.readString());
+		else if (id > _strings.size())
+			throwMalformed();
+		return _strings[id];
+	}
+
+	void resolveReferences()
+	{
+		for (const auto& [token, target] : _references)
+			token->setValue(&tokenAt(target)->getLiteral());
+		_references.clear();
+	}
+
+	TokenIt tokenAt(std::uint64_t index) const
+	{
+		if (index >= _tokens.size())
+			throwMalformed();
+		return _tokens[index];
+	}
+
+	TokenIt readToken()
+	{
+		_previousIndex += _in.readSigned();
+		return tokenAt(_previousIndex);
+	}
+
+	std::optional<TokenIt> readOptionalToken()
+	{
+		if (_in.readByte() == 0)
+			return std::nullopt;
+		return readToken();
+	}
+
+	std::shared_ptr<TokenStream> readStreamId()
+	{
+		auto id = _in.readVarint();
+		if (id == 0)
+			return nullptr;
+		if (id > _streams.size())
+			throwMalformed();
+		return _streams[id - 1];
+	}
+
+	ExpressionType readExpressionType()
+	{
+		auto type = _in.readByte();
+		if (type > static_cast<std::uint8_t>(ExpressionType::Float))
+			throwMalformed();
+		return static_cast<ExpressionType>(type);
+	}
+	/// @}
+
+	/// @name Symbols
+	/// @{
+	std::shared_ptr<Symbol> readSymbol()
+	{
+		auto tag = static_cast<SymbolTag>(_in.readByte());
+		if (tag == SymbolTag::Backreference)
+		{
+			auto id = _in.readVarint();
+			if (id >= _symbols.size() || !_symbols[id])
+				throwMalformed();
+			return _symbols[id];
+		}
+
+		// Slot is reserved in advance because nested symbols are numbered after this one
+		auto id = _symbols.size();
+		_symbols.emplace_back();
+
+		std::shared_ptr<Symbol> symbol;
+		switch (tag)
+		{
+			case SymbolTag::ModuleMember:
+			{
+				// Parser renames element types of structured arrays to the names of loop variables
+				auto name = std::string{_in.readString()};
+				symbol = readModuleMember();
+				if (symbol->getName() != name)
+					symbol->setName(name);
+				break;
+			}
+			case SymbolTag::Global:
+			{
+				auto name = std::string{_in.readString()};
+				if (!_file || !(symbol = _file->findSymbol(name)))
+					throw YaramodError("Error: Unrecognized identifier '" + name + "' in serialized YARA data");
+				break;
+			}
+			case SymbolTag::Value:
+			{
+				auto name = std::string{_in.readString()};
+				symbol = std::make_shared<ValueSymbol>(name, readExpressionType());
+				break;
+			}
+			case SymbolTag::Array:
+			case SymbolTag::Dictionary:
+			{
+				auto name = std::string{_in.readString()};
+				if (_in.readByte())
+				{
+					auto element = readSymbol();
+					if (tag == SymbolTag::Array)
+						symbol = std::make_shared<ArraySymbol>(name, element);
+					else
+						symbol = std::make_shared<DictionarySymbol>(name, element);
+				}
+				else
+				{
+					auto element = readExpressionType();
+					if (tag == SymbolTag::Array)
+						symbol = std::make_shared<ArraySymbol>(name, element);
+					else
+						symbol = std::make_shared<DictionarySymbol>(name, element);
+				}
+				break;
+			}
+			case SymbolTag::Function:
+			{
+				auto name = std::string{_in.readString()};
+				auto returnType = readExpressionType();
+				std::vector<std::vector<ExpressionType>> overloads(_in.readVarint());
+				for (auto& overload : overloads)
+				{
+					auto argumentCount = _in.readVarint();
+					for (std::uint64_t i = 0; i < argumentCount; ++i)
+						overload.push_back(readExpressionType());
+				}
+				symbol = std::make_shared<FunctionSymbol>(name, returnType, overloads);
+				break;
+			}
+			case SymbolTag::Structure:
+			{
+				auto structure = std::make_shared<StructureSymbol>(std::string{_in.readString()});
+				_symbols[id] = structure;
+				auto attributeCount = _in.readVarint();
+				for (std::uint64_t i = 0; i < attributeCount; ++i)
+					structure->addAttribute(readSymbol());
+				symbol = structure;
+				break;
+			}
+			case SymbolTag::Reference:
+			{
+				auto name = std::string{_in.readString()};
+				symbol = std::make_shared<ReferenceSymbol>(name, readSymbol());
+				break;
+			}
+			default:
+				throwMalformed();
+		}
+
+		_symbols[id] = symbol;
+		return symbol;
+	}
+
+	std::shared_ptr<Symbol> readModuleMember()
+	{
+		auto name = std::string{_in.readString()};
+		auto module = _modules.load(name, _features);
+		if (!module)
+			throw YaramodError("Error: Unrecognized module '" + name + "' in serialized YARA data");
+
+		std::shared_ptr<Symbol> symbol = module->getStructure();
+		auto stepCount = _in.readVarint();
+		for (std::uint64_t i = 0; i < stepCount; ++i)
+		{
+			auto step = _in.readString();
+			if (step == ElementStep && (symbol->isArray() || symbol->isDictionary()))
+				symbol = std::static_pointer_cast<IterableSymbol>(symbol)->getStructuredElementType();
+			else if (symbol->isStructure())
+			{
+				auto attribute = std::static_pointer_cast<StructureSymbol>(symbol)->getAttribute(std::string{step});
+				if (!attribute)
+					throw YaramodError("Error: Unrecognized identifier '" + std::string{step} + "' of module '" + name + "' in serialized YARA data");
+				symbol = *attribute;
+			}
+			else
+				throwMalformed();
+
+			if (!symbol)
+				throwMalformed();
+		}
+		return symbol;
+	}
+	/// @}
+
+	/// @name Regular expressions
+	/// @{
+	void readRegexp(const std::shared_ptr<TokenStream>& ts)
+	{
+		auto tokenCount = _in.readVarint();
+		auto unit = readRegexpUnit();
+		auto suffix = std::string{_in.readString()};
+
+		// Regexp appends its tokens to the end of the stream
+		auto wasEmpty = ts->empty();
+		auto last = wasEmpty ? ts->end() : std::prev(ts->end());
+		auto regexp = std::make_shared<Regexp>(ts, std::move(unit));
+		regexp->setSuffixModifiers(suffix);
+
+		std::uint64_t count = 0;
+		for (auto it = wasEmpty ? ts->begin() : std::next(last); it != ts->end(); ++it, ++count)
+		{
+			if (count == tokenCount)
+				throwMalformed();
+			auto flags = _in.readByte();
+			auto [indentation, location] = readLayout(flags);
+			it->setFlag(flags & TokenFlags::Flag);
+			it->setIndentation(indentation);
+			it->setLocation(location);
+			_tokens.push_back(it);
+		}
+		if (count != tokenCount)
+			throwMalformed();
+
+		_regexps.push_back(std::move(regexp));
+	}
+
+	std::shared_ptr<RegexpUnit> readRegexpUnit()
+	{
+		switch (static_cast<RegexpTag>(_in.readByte()))
+		{
+			case RegexpTag::Text: return std::make_shared<RegexpText>(std::string{_in.readString()});
+			case RegexpTag::AnyChar: return std::make_shared<RegexpAnyChar>();
+			case RegexpTag::WordChar: return std::make_shared<RegexpWordChar>();
+			case RegexpTag::NonWordChar: return std::make_shared<RegexpNonWordChar>();
+			case RegexpTag::Space: return std::make_shared<RegexpSpace>();
+			case RegexpTag::NonSpace: return std::make_shared<RegexpNonSpace>();
+			case RegexpTag::Digit: return std::make_shared<RegexpDigit>();
+			case RegexpTag::NonDigit: return std::make_shared<RegexpNonDigit>();
+			case RegexpTag::WordBoundary: return std::make_shared<RegexpWordBoundary>();
+			case RegexpTag::NonWordBoundary: return std::make_shared<RegexpNonWordBoundary>();
+			case RegexpTag::StartOfLine: return std::make_shared<RegexpStartOfLine>();
+			case RegexpTag::EndOfLine: return std::make_shared<RegexpEndOfLine>();
+			case RegexpTag::Class:
+			{
+				auto negative = _in.readByte() != 0;
+				return std::make_shared<RegexpClass>(std::string{_in.readString()}, negative);
+			}
+			case RegexpTag::Iteration:
+			{
+				auto greedy = _in.readByte() != 0;
+				return std::make_shared<RegexpIteration>(readRegexpUnit(), greedy);
+			}
+			case RegexpTag::PositiveIteration:
+			{
+				auto greedy = _in.readByte() != 0;
+				return std::make_shared<RegexpPositiveIteration>(readRegexpUnit(), greedy);
+			}
+			case RegexpTag::Optional:
+			{
+				auto greedy = _in.readByte() != 0;
+				return std::make_shared<RegexpOptional>(readRegexpUnit(), greedy);
+			}
+			case RegexpTag::Range:
+			{
+				auto bounds = _in.readByte();
+				std::pair<std::optional<std::uint64_t>, std::optional<std::uint64_t>> range;
+				if (bounds & 1)
+					range.first = _in.readVarint();
+				if (bounds & 2)
+					range.second = _in.readVarint();
+				auto greedy = _in.readByte() != 0;
+				return std::make_shared<RegexpRange>(readRegexpUnit(), std::move(range), greedy);
+			}
+			case RegexpTag::Or:
+			{
+				auto left = readRegexpUnit();
+				return std::make_shared<RegexpOr>(std::move(left), readRegexpUnit());
+			}
+			case RegexpTag::Group:
+				return std::make_shared<RegexpGroup>(readRegexpUnit());
+			case RegexpTag::Concat:
+			{
+				std::vector<std::shared_ptr<RegexpUnit>> units(_in.readVarint());
+				for (auto& unit : units)
+					unit = readRegexpUnit();
+				return std::make_shared<RegexpConcat>(std::move(units));
+			}
+			default:
+				throwMalformed();
+		}
+	}
+
+	const std::shared_ptr<Regexp>& regexpAt(std::uint64_t index) const
+	{
+		if (index >= _regexps.size())
+			throwMalformed();
+		return _regexps[index];
+	}
+	/// @}
+
+	/// @name Expressions
+	/// @{
+	/**
+	 * Expression which is being read. Expressions are stored in preorder, so
+	 * each one can only be built once all its subexpressions are read. Own tokens
+	 * of the expression are split into gaps before, between and after subexpressions.
+	 *
+	 * Expressions are built in the reverse order than they are read, so their gaps
+	 * and built subexpressions are kept at the ends of vectors shared by all of them.
+	 */
+	struct PendingExpression
+	{
+		Expression::Kind kind;
+		ExpressionType type;
+		std::shared_ptr<TokenStream> tokenStream;
+		bool linebreak = false;
+		std::shared_ptr<Symbol> symbol;
+		std::shared_ptr<Regexp> regexp;
+		std::uint64_t childCount = 0;
+		std::size_t firstGapToken = 0; ///< Index of the first token of the first gap in _gapTokens
+		std::size_t firstGap = 0; ///< Index of the end of the first gap in _gapEnds
+		std::size_t gapCount = 0;
+		std::size_t firstChild = 0; ///< Index of the first subexpression in _children
+	};
+
+	Expression::Ptr readExpression()
+	{
+		// Conditions may be nested arbitrarily deep so they are read without recursion
+		std::vector<PendingExpression> stack;
+		while (true)
+		{
+			stack.push_back(readPendingExpression());
+			if (stack.back().kind == Expression::Kind::Undefined)
+			{
+				if (stack.size() != 1)
+					throwMalformed();
+				return nullptr;
+			}
+
+			while (_children.size() - stack.back().firstChild == stack.back().childCount)
+			{
+				auto expr = buildExpression(stack.back());
+				_gapTokens.resize(stack.back().firstGapToken);
+				_gapEnds.resize(stack.back().firstGap);
+				_children.resize(stack.back().firstChild);
+				stack.pop_back();
+				if (stack.empty())
+					return expr;
+				_children.push_back(std::move(expr));
+			}
+		}
+	}
+
+	PendingExpression readPendingExpression()
+	{
+		PendingExpression pending;
+		pending.firstGapToken = _gapTokens.size();
+		pending.firstGap = _gapEnds.size();
+		pending.firstChild = _children.size();
+		auto kind = _in.readByte();
+		if (kind > static_cast<std::uint8_t>(Expression::Kind::Regexp))
+			throwMalformed();
+		pending.kind = static_cast<Expression::Kind>(kind);
+		if (pending.kind == Expression::Kind::Undefined)
+			return pending;
+
+		pending.type = readExpressionType();
+		pending.tokenStream = readStreamId();
+		if (isBinaryOperation(pending.kind) || pending.kind == Expression::Kind::Parentheses)
+			pending.linebreak = _in.readByte() != 0;
+		else if (pending.kind == Expression::Kind::ArrayAccess)
+			pending.symbol = readSymbol();
+		else if (pending.kind == Expression::Kind::Regexp)
+			pending.regexp = regexpAt(_in.readVarint());
+
+		pending.childCount = _in.readVarint();
+		if (pending.kind == Expression::Kind::Regexp)
+			return pending;
+
+		pending.gapCount = pending.childCount + 1;
+		for (std::size_t gap = 0; gap < pending.gapCount; ++gap)
+		{
+			auto tokenCount = _in.readVarint();
+			for (std::uint64_t i = 0; i < tokenCount; ++i)
+				_gapTokens.push_back(readToken());
+			_gapEnds.push_back(_gapTokens.size());
+		}
+		return pending;
+	}
+
+	Expression::Ptr buildExpression(PendingExpression& pending)
+	{
+		// Tokens before the first subexpression are taken from the front, other tokens from the back of their gaps
+		// because tokens which trail subexpressions without being part of their range (like `]` of `@str[1]`)
+		// end up at the front of the following gap
+		auto gapBegin = [&](std::size_t gap) {
+			return gap == 0 ? pending.firstGapToken : _gapEnds[pending.firstGap + gap - 1];
+		};
+		auto token = [&](std::size_t index) {
+			if (pending.gapCount == 0 || gapBegin(0) + index >= _gapEnds[pending.firstGap])
+				throwMalformed();
+			return _gapTokens[gapBegin(0) + index];
+		};
+		auto tokenBefore = [&](std::size_t child, std::size_t index) {
+			if (child >= pending.gapCount || gapBegin(child) + index >= _gapEnds[pending.firstGap + child])
+				throwMalformed();
+			return _gapTokens[_gapEnds[pending.firstGap + child] - index - 1];
+		};
+		auto child = [&](std::size_t index) {
+			if (index >= pending.childCount)
+				throwMalformed();
+			return std::move(_children[pending.firstChild + index]);
+		};
+		auto children = [&]() {
+			auto first = _children.begin() + pending.firstChild;
+			return std::vector<Expression::Ptr>(std::make_move_iterator(first), std::make_move_iterator(_children.end()));
+		};
+		auto unary = [&](auto* tag) -> Expression::Ptr {
+			using T = std::remove_pointer_t<decltype(tag)>;
+			return std::make_shared<T>(token(0), child(0));
+		};
+		auto binary = [&](auto* tag) -> Expression::Ptr {
+			using T = std::remove_pointer_t<decltype(tag)>;
+			return std::make_shared<T>(child(0), tokenBefore(1, 0), child(1));
+		};
+		auto binaryWithLinebreak = [&](auto* tag) -> Expression::Ptr {
+			using T = std::remove_pointer_t<decltype(tag)>;
+			return std::make_shared<T>(child(0), tokenBefore(1, 0), child(1), pending.linebreak);
+		};
+		auto single = [&](auto* tag) -> Expression::Ptr {
+			using T = std::remove_pointer_t<decltype(tag)>;
+			return std::make_shared<T>(token(0));
+		};
+		auto indexed = [&](auto* tag) -> Expression::Ptr {
+			using T = std::remove_pointer_t<decltype(tag)>;
+			if (pending.childCount == 0)
+				return std::make_shared<T>(token(0));
+			return std::make_shared<T>(token(0), child(0));
+		};
+
+		auto last = pending.childCount;
+		Expression::Ptr expr;
+		switch (pending.kind)
+		{
+			case Expression::Kind::String: expr = single(static_cast<StringExpression*>(nullptr)); break;
+			case Expression::Kind::StringWildcard: expr = single(static_cast<StringWildcardExpression*>(nullptr)); break;
+			case Expression::Kind::StringAt: expr = std::make_shared<StringAtExpression>(token(0), token(1), child(0)); break;
+			case Expression::Kind::StringInRange: expr = std::make_shared<StringInRangeExpression>(token(0), token(1), child(0)); break;
+			case Expression::Kind::StringCount: expr = single(static_cast<StringCountExpression*>(nullptr)); break;
+			case Expression::Kind::StringOffset: expr = indexed(static_cast<StringOffsetExpression*>(nullptr)); break;
+			case Expression::Kind::StringLength: expr = indexed(static_cast<StringLengthExpression*>(nullptr)); break;
+			case Expression::Kind::Not: expr = unary(static_cast<NotExpression*>(nullptr)); break;
+			case Expression::Kind::UnaryMinus: expr = unary(static_cast<UnaryMinusExpression*>(nullptr)); break;
+			case Expression::Kind::BitwiseNot: expr = unary(static_cast<BitwiseNotExpression*>(nullptr)); break;
+			case Expression::Kind::And: expr = binaryWithLinebreak(static_cast<AndExpression*>(nullptr)); break;
+			case Expression::Kind::Or: expr = binaryWithLinebreak(static_cast<OrExpression*>(nullptr)); break;
+			case Expression::Kind::Lt: expr = binary(static_cast<LtExpression*>(nullptr)); break;
+			case Expression::Kind::Gt: expr = binary(static_cast<GtExpression*>(nullptr)); break;
+			case Expression::Kind::Le: expr = binary(static_cast<LeExpression*>(nullptr)); break;
+			case Expression::Kind::Ge: expr = binary(static_cast<GeExpression*>(nullptr)); break;
+			case Expression::Kind::Eq: expr = binary(static_cast<EqExpression*>(nullptr)); break;
+			case Expression::Kind::Neq: expr = binary(static_cast<NeqExpression*>(nullptr)); break;
+			case Expression::Kind::Contains: expr = binary(static_cast<ContainsExpression*>(nullptr)); break;
+			case Expression::Kind::Matches: expr = binary(static_cast<MatchesExpression*>(nullptr)); break;
+			case Expression::Kind::Plus: expr = binary(static_cast<PlusExpression*>(nullptr)); break;
+			case Expression::Kind::Minus: expr = binary(static_cast<MinusExpression*>(nullptr)); break;
+			case Expression::Kind::Multiply: expr = binary(static_cast<MultiplyExpression*>(nullptr)); break;
+			case Expression::Kind::Divide: expr = binary(static_cast<DivideExpression*>(nullptr)); break;
+			case Expression::Kind::Modulo: expr = binary(static_cast<ModuloExpression*>(nullptr)); break;
+			case Expression::Kind::BitwiseXor: expr = binary(static_cast<BitwiseXorExpression*>(nullptr)); break;
+			case Expression::Kind::BitwiseAnd: expr = binary(static_cast<BitwiseAndExpression*>(nullptr)); break;
+			case Expression::Kind::BitwiseOr: expr = binary(static_cast<BitwiseOrExpression*>(nullptr)); break;
+			case Expression::Kind::ShiftLeft: expr = binary(static_cast<ShiftLeftExpression*>(nullptr)); break;
+			case Expression::Kind::ShiftRight: expr = binary(static_cast<ShiftRightExpression*>(nullptr)); break;
+			case Expression::Kind::ForDict:
+				expr = std::make_shared<ForDictExpression>(token(0), child(0), tokenBefore(1, 3), tokenBefore(1, 2), tokenBefore(1, 1), tokenBefore(1, 0),
+					child(1), tokenBefore(2, 0), child(2), tokenBefore(3, 0));
+				break;
+			case Expression::Kind::ForArray:
+				expr = std::make_shared<ForArrayExpression>(token(0), child(0), tokenBefore(1, 1), tokenBefore(1, 0), child(1), tokenBefore(2, 0), child(2), tokenBefore(3, 0));
+				break;
+			case Expression::Kind::ForString:
+				expr = std::make_shared<ForStringExpression>(token(0), child(0), tokenBefore(1, 0), child(1), tokenBefore(2, 0), child(2), tokenBefore(3, 0));
+				break;
+			case Expression::Kind::Of:
+				expr = std::make_shared<OfExpression>(child(0), tokenBefore(1, 0), child(1));
+				break;
+			case Expression::Kind::Iterable:
+				expr = std::make_shared<IterableExpression>(token(0), children(), tokenBefore(last, 0));
+				break;
+			case Expression::Kind::Set:
+				expr = std::make_shared<SetExpression>(token(0), children(), tokenBefore(last, 0));
+				break;
+			case Expression::Kind::Range:
+				expr = std::make_shared<RangeExpression>(token(0), child(0), tokenBefore(1, 0), child(1), tokenBefore(2, 0));
+				break;
+			case Expression::Kind::Id: expr = single(static_cast<IdExpression*>(nullptr)); break;
+			case Expression::Kind::StructAccess: expr = std::make_shared<StructAccessExpression>(child(0), tokenBefore(1, 1), tokenBefore(1, 0)); break;
+			case Expression::Kind::ArrayAccess:
+				expr = std::make_shared<ArrayAccessExpression>(pending.symbol, child(0), tokenBefore(1, 0), child(1), tokenBefore(2, 0));
+				break;
+			case Expression::Kind::FunctionCall:
+			{
+				// Without arguments, both brackets are in the gap after the function
+				auto leftBracket = last == 1 ? tokenBefore(1, 1) : tokenBefore(1, 0);
+				std::vector<Expression::Ptr> arguments;
+				for (std::size_t i = 1; i < pending.childCount; ++i)
+					arguments.push_back(child(i));
+				expr = std::make_shared<FunctionCallExpression>(child(0), leftBracket, std::move(arguments), tokenBefore(last, 0));
+				break;
+			}
+			case Expression::Kind::BoolLiteral: expr = single(static_cast<BoolLiteralExpression*>(nullptr)); break;
+			case Expression::Kind::StringLiteral: expr = single(static_cast<StringLiteralExpression*>(nullptr)); break;
+			case Expression::Kind::IntLiteral: expr = single(static_cast<IntLiteralExpression*>(nullptr)); break;
+			case Expression::Kind::DoubleLiteral: expr = single(static_cast<DoubleLiteralExpression*>(nullptr)); break;
+			case Expression::Kind::Filesize: expr = single(static_cast<FilesizeExpression*>(nullptr)); break;
+			case Expression::Kind::Entrypoint: expr = single(static_cast<EntrypointExpression*>(nullptr)); break;
+			case Expression::Kind::All: expr = single(static_cast<AllExpression*>(nullptr)); break;
+			case Expression::Kind::Any: expr = single(static_cast<AnyExpression*>(nullptr)); break;
+			case Expression::Kind::Them: expr = single(static_cast<ThemExpression*>(nullptr)); break;
+			case Expression::Kind::Parentheses:
+				expr = std::make_shared<ParenthesesExpression>(token(0), child(0), tokenBefore(1, 0), pending.linebreak);
+				break;
+			case Expression::Kind::IntFunction:
+				expr = std::make_shared<IntFunctionExpression>(token(0), token(1), child(0), tokenBefore(1, 0));
+				break;
+			case Expression::Kind::Regexp:
+				expr = std::make_shared<RegexpExpression>(pending.regexp);
+				break;
+			default:
+				throwMalformed();
+		}
+
+		expr->setType(pending.type);
+		if (pending.tokenStream)
+			expr->setTokenStream(pending.tokenStream);
+		return expr;
+	}
+	/// @}
+
+	/// @name Rules
+	/// @{
+	std::shared_ptr<Rule> readRule()
+	{
+		auto ts = readStreamId();
+		if (!ts)
+			throwMalformed();
+
+		auto location = readLocation();
+		auto name = readToken();
+		auto modPrivate = readOptionalToken();
+		auto modGlobal = readOptionalToken();
+
+		std::vector<TokenIt> tags(_in.readVarint());
+		for (auto& tag : tags)
+			tag = readToken();
+
+		std::vector<Meta> metas;
+		auto metaCount = _in.readVarint();
+		for (std::uint64_t i = 0; i < metaCount; ++i)
+		{
+			auto key = readToken();
+			metas.emplace_back(key, readToken());
+		}
+
+		auto strings = std::make_shared<Rule::StringsTrie>();
+		auto stringCount = _in.readVarint();
+		for (std::uint64_t i = 0; i < stringCount; ++i)
+		{
+			auto string = readString();
+			auto key = string->getIdentifier();
+			if (key == "$")
+				key = "anon" + std::to_string(_anonymousStrings++);
+			if (!strings->insert(key, std::move(string)))
+				throwMalformed();
+		}
+
+		std::vector<Variable> variables;
+		auto variableCount = _in.readVarint();
+		for (std::uint64_t i = 0; i < variableCount; ++i)
+		{
+			auto key = readToken();
+			variables.emplace_back(key, readExpression());
+		}
+
+		auto condition = readExpression();
+		auto rule = std::make_shared<Rule>(ts, name, modPrivate, modGlobal, std::move(metas), std::move(strings), std::move(variables), std::move(condition), tags);
+		rule->setLocation(location);
+		return rule;
+	}
+
+	std::shared_ptr<String> readString()
+	{
+		auto type = static_cast<String::Type>(_in.readByte());
+		auto ts = readStreamId();
+		auto id = readOptionalToken();
+		auto assign = readOptionalToken();
+
+		std::vector<std::shared_ptr<StringModifier>> modifiers(_in.readVarint());
+		for (auto& modifier : modifiers)
+			modifier = readStringModifier();
+
+		std::shared_ptr<String> string;
+		if (type == String::Type::Plain && ts)
+			string = std::make_shared<PlainString>(ts, readToken());
+		else if (type == String::Type::Hex && ts)
+		{
+			auto leftBracket = readToken();
+			auto rightBracket = readToken();
+			string = std::make_shared<HexString>(ts, leftBracket, readHexUnits(ts), rightBracket);
+		}
+		else if (type == String::Type::Regexp)
+			string = regexpAt(_in.readVarint());
+		else
+			throwMalformed();
+
+		if (id && assign)
+			string->setIdentifier(*id, *assign);
+		else if (id)
+			string->setIdentifier(*id);
+
+		for (const auto& modifier : modifiers)
+			string->addModifier(modifier);
+		return string;
+	}
+
+	std::shared_ptr<StringModifier> readStringModifier()
+	{
+		auto type = static_cast<StringModifier::Type>(_in.readByte());
+		auto first = readToken();
+		auto last = readToken();
+		switch (type)
+		{
+			case StringModifier::Type::Ascii: return std::make_shared<AsciiStringModifier>(first);
+			case StringModifier::Type::Wide: return std::make_shared<WideStringModifier>(first);
+			case StringModifier::Type::Nocase: return std::make_shared<NocaseStringModifier>(first);
+			case StringModifier::Type::Fullword: return std::make_shared<FullwordStringModifier>(first);
+			case StringModifier::Type::Private: return std::make_shared<PrivateStringModifier>(first);
+			case StringModifier::Type::Xor:
+			{
+				auto bounds = _in.readByte();
+				if (bounds & 2)
+				{
+					auto low = static_cast<std::uint32_t>(_in.readVarint());
+					return std::make_shared<XorStringModifier>(first, last, low, static_cast<std::uint32_t>(_in.readVarint()));
+				}
+				else if (bounds & 1)
+					return std::make_shared<XorStringModifier>(first, last, static_cast<std::uint32_t>(_in.readVarint()));
+				return std::make_shared<XorStringModifier>(first);
+			}
+			case StringModifier::Type::Base64:
+				if (_in.readByte())
+					return std::make_shared<Base64StringModifier>(first, last, std::string{_in.readString()});
+				return std::make_shared<Base64StringModifier>(first);
+			case StringModifier::Type::Base64Wide:
+				if (_in.readByte())
+					return std::make_shared<Base64WideStringModifier>(first, last, std::string{_in.readString()});
+				return std::make_shared<Base64WideStringModifier>(first);
+			default:
+				throwMalformed();
+		}
+	}
+
+	std::vector<std::shared_ptr<HexStringUnit>> readHexUnits(const std::shared_ptr<TokenStream>& ts)
+	{
+		std::vector<std::shared_ptr<HexStringUnit>> units(_in.readVarint());
+		for (auto& unit : units)
+		{
+			switch (static_cast<HexUnitTag>(_in.readByte()))
+			{
+				case HexUnitTag::Nibble:
+					unit = std::make_shared<HexStringNibble>(readToken());
+					break;
+				case HexUnitTag::Wildcard:
+					unit = std::make_shared<HexStringWildcard>(readToken());
+					break;
+				case HexUnitTag::Jump:
+				{
+					// Bounds of the jump are the integers between its brackets
+					auto leftBracket = readToken();
+					auto rightBracket = readToken();
+					std::vector<TokenIt> bounds;
+					bool range = false;
+					for (auto it = std::next(leftBracket); it != rightBracket; ++it)
+					{
+						if (it == ts->end())
+							throwMalformed();
+						else if (it->isInt())
+							bounds.push_back(it);
+						else if (it->getType() == TokenType::DASH)
+							range = true;
+					}
+
+					if (bounds.size() == 2)
+						unit = std::make_shared<HexStringJump>(leftBracket, bounds[0], bounds[1], rightBracket);
+					else if (bounds.size() == 1 && range)
+						unit = std::make_shared<HexStringJump>(leftBracket, bounds[0], rightBracket);
+					else if (bounds.size() == 1)
+						unit = std::make_shared<HexStringJump>(leftBracket, bounds[0], bounds[0], rightBracket);
+					else if (bounds.empty())
+						unit = std::make_shared<HexStringJump>(leftBracket, rightBracket);
+					else
+						throwMalformed();
+					break;
+				}
+				case HexUnitTag::Or:
+				{
+					std::vector<std::shared_ptr<HexString>> substrings(_in.readVarint());
+					for (auto& substring : substrings)
+						substring = std::make_shared<HexString>(ts, readHexUnits(ts));
+					unit = std::make_shared<HexStringOr>(std::move(substrings));
+					break;
+				}
+				default:
+					throwMalformed();
+			}
+		}
+		return units;
+	}
+	/// @}
+
+	InputBuffer _in;
+	Features _features = Features::AllCurrent;
+	const YaraFile* _file = nullptr; ///< Deserialized file, @c nullptr if only rule is deserialized
+	ModulesPool _modules;
+
+	std::vector<TokenIt> _tokens;
+	std::vector<std::shared_ptr<TokenStream>> _streams;
+	std::vector<std::pair<TokenIt, std::uint64_t>> _references;
+	std::vector<std::string> _paths;
+	std::vector<std::string_view> _strings; ///< Views into the serialized data
+	std::uint64_t _previousPath = 0;
+	std::size_t _previousLine = 0;
+	std::uint64_t _previousIndex = 0;
+
+	std::vector<std::shared_ptr<Symbol>> _symbols;
+	std::vector<std::shared_ptr<Regexp>> _regexps;
+	std::uint64_t _anonymousStrings = 0;
+
+	std::vector<TokenIt> _gapTokens; ///< Tokens of gaps of pending expressions
+	std::vector<std::size_t> _gapEnds; ///< Ends of gaps of pending expressions in _gapTokens
+	std::vector<Expression::Ptr> _children; ///< Built subexpressions of pending expressions
+};
+
+}
+
+/**
+ * Serializes the YARA file into binary form. Whole token stream is stored
+ * so deserialized file has the same text including comments and formatting.
+ * Conditions which were not parsed yet are parsed.
+ *
+ * @param file YARA file.
+ *
+ * @return Serialized file.
+ */
+std::string serialize(const YaraFile& file)
+{
+	return Serializer(&file, file.getFeatures()).serializeFile();
+}
+
+/**
+ * Serializes single rule into binary form. Only the tokens of the rule
+ * are stored. Symbols of modules are looked up in modules loaded with
+ * the given features when the rule is deserialized.
+ *
+ * @param rule Rule.
+ * @param features Features of modules used by the rule.
+ *
+ * @return Serialized rule.
+ */
+std::string serialize(const Rule& rule, Features features)
+{
+	return Serializer(nullptr, features).serializeRule(rule);
+}
+
+/**
+ * Deserializes the YARA file serialized with serialize(const YaraFile&).
+ * Throws YaramodError if the data are malformed or were serialized by
+ * another version of yaramod.
+ *
+ * @param data Serialized file.
+ *
+ * @return Deserialized file.
+ */
+std::unique_ptr<YaraFile> deserializeYaraFile(std::string_view data)
+{
+	return Deserializer(data).deserializeFile();
+}
+
+/**
+ * Deserializes the YARA file serialized with serialize(const YaraFile&)
+ * and checks that it was serialized with the given features. Throws YaramodError
+ * if the data are malformed, were serialized by another version of yaramod
+ * or with other features.
+ *
+ * @param data Serialized file.
+ * @param features Expected features.
+ *
+ * @return Deserialized file.
+ */
+std::unique_ptr<YaraFile> deserializeYaraFile(std::string_view data, Features features)
+{
+	return Deserializer(data).deserializeFile(features);
+}
+
+/**
+ * Deserializes the rule serialized with serialize(const Rule&, Features).
+ * Throws YaramodError if the data are malformed or were serialized by
+ * another version of yaramod.
+ *
+ * @param data Serialized rule.
+ *
+ * @return Deserialized rule.
+ */
+std::shared_ptr<Rule> deserializeRule(std::string_view data)
+{
+	return Deserializer(data).deserializeRule();
+}
+
+}
@@ -0,0 +1,509 @@
+/**
+ * @file src/utils/simplifier.cpp
+ * @brief Implementation of simplification of conditions.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#include <algorithm>
+#include <limits>
+#include <unordered_set>
+
+#include "yaramod/utils/simplifier.h"
+
+namespace yaramod {
+
+namespace {
+
+constexpr auto IntMin = std::numeric_limits<std::int64_t>::min();
+constexpr auto IntMax = std::numeric_limits<std::int64_t>::max();
+
+/**
+ * Returns whether the expression binds tighter than any operator so parentheses around it are redundant.
+ */
+bool isAtomic(const Expression* expr)
+{
+	switch (expr->getKind())
+	{
+		case Expression::Kind::String:
+		case Expression::Kind::StringCount:
+		case Expression::Kind::StringOffset:
+		case Expression::Kind::StringLength:
+		case Expression::Kind::UnaryMinus:
+		case Expression::Kind::BitwiseNot:
+		case Expression::Kind::Id:
+		case Expression::Kind::StructAccess:
+		case Expression::Kind::ArrayAccess:
+		case Expression::Kind::FunctionCall:
+		case Expression::Kind::BoolLiteral:
+		case Expression::Kind::StringLiteral:
+		case Expression::Kind::IntLiteral:
+		case Expression::Kind::DoubleLiteral:
+		case Expression::Kind::Filesize:
+		case Expression::Kind::Entrypoint:
+		case Expression::Kind::Parentheses:
+		case Expression::Kind::IntFunction:
+		case Expression::Kind::Regexp:
+			return true;
+		default:
+			return false;
+	}
+}
+
+bool isHexLiteral(const Expression* expr)
+{
+	return expr->getKind() == Expression::Kind::IntLiteral && expr->getText().compare(0, 2, "0x") == 0;
+}
+
+bool hasMultiplier(const Expression* expr)
+{
+	auto text = expr->getText();
+	return text.size() > 2 && (text.compare(text.size() - 2, 2, "KB") == 0 || text.compare(text.size() - 2, 2, "MB") == 0);
+}
+
+bool isBoolLiteral(const Expression* expr, bool value)
+{
+	return expr->getKind() == Expression::Kind::BoolLiteral && static_cast<const BoolLiteralExpression*>(expr)->getValue() == value;
+}
+
+const Expression* skipParentheses(const Expression* expr)
+{
+	while (expr->getKind() == Expression::Kind::Parentheses)
+		expr = static_cast<const ParenthesesExpression*>(expr)->getEnclosedExpression().get();
+	return expr;
+}
+
+bool isUnchanged(const VisitResult& result)
+{
+	auto expr = std::get_if<Expression::Ptr>(&result);
+	return expr && !*expr;
+}
+
+}
+
+/**
+ * Simplifies the condition of the rule.
+ *
+ * @param rule Rule.
+ *
+ * @return @c true if the condition was simplified, @c false otherwise.
+ */
+bool Simplifier::simplify(Rule& rule)
+{
+	auto condition = rule.getCondition();
+	if (!condition)
+		return false;
+
+	_simplified = false;
+	auto result = modify(condition);
+	if (result->getKind() == Expression::Kind::Parentheses)
+		result = replaceWithOperand(result.get(), static_cast<const ParenthesesExpression*>(result.get())->getEnclosedExpression());
+
+	if (result != condition)
+		rule.setCondition(result);
+	return _simplified;
+}
+
+/**
+ * Simplifies conditions of all rules in the YARA file.
+ *
+ * @param file YARA file.
+ *
+ * @return Number of rules with simplified condition.
+ */
+std::size_t Simplifier::simplify(YaraFile& file)
+{
+	return std::count_if(file.getRules().begin(), file.getRules().end(), [this](const auto& rule) {
+		return simplify(*rule);
+	});
+}
+
+VisitResult Simplifier::visit(NotExpression* expr)
+{
+	auto result = ModifyingVisitor::visit(expr);
+	if (!isUnchanged(result))
+		return result;
+
+	const auto* operand = skipParentheses(expr->getOperand().get());
+	if (operand->getKind() == Expression::Kind::BoolLiteral)
+		return replaceWith(expr, boolVal(!static_cast<const BoolLiteralExpression*>(operand)->getValue()));
+
+	// Double negation of integer is not removed because `not not 5` is boolean while `5` is integer
+	if (operand->getKind() == Expression::Kind::Not)
+	{
+		const auto& negated = static_cast<const NotExpression*>(operand)->getOperand();
+		if (skipParentheses(negated.get())->isBool())
+			return replaceWithOperand(expr, negated);
+	}
+
+	return {};
+}
+
+VisitResult Simplifier::visit(UnaryMinusExpression* expr)
+{
+	auto result = ModifyingVisitor::visit(expr);
+	if (!isUnchanged(result))
+		return result;
+
+	// Negative literals like `-5` are already as simple as possible
+	auto value = getConstant(expr->getOperand().get());
+	if (!value || value.value() == IntMin || (expr->getOperand()->getKind() == Expression::Kind::IntLiteral && value.value() >= 0))
+		return {};
+
+	return replaceWith(expr, intVal(-value.value()));
+}
+
+VisitResult Simplifier::visit(BitwiseNotExpression* expr)
+{
+	auto result = ModifyingVisitor::visit(expr);
+	if (!isUnchanged(result))
+		return result;
+
+	auto value = getConstant(expr->getOperand().get());
+	if (!value)
+		return {};
+
+	return replaceWith(expr, intVal(~value.value()));
+}
+
+VisitResult Simplifier::visit(AndExpression* expr)
+{
+	return simplifyChain(expr);
+}
+
+VisitResult Simplifier::visit(OrExpression* expr)
+{
+	return simplifyChain(expr);
+}
+
+VisitResult Simplifier::visit(LtExpression* expr)
+{
+	return foldComparison(expr, [](auto left, auto right) { return left < right; });
+}
+
+VisitResult Simplifier::visit(GtExpression* expr)
+{
+	return foldComparison(expr, [](auto left, auto right) { return left > right; });
+}
+
+VisitResult Simplifier::visit(LeExpression* expr)
+{
+	return foldComparison(expr, [](auto left, auto right) { return left <= right; });
+}
+
+VisitResult Simplifier::visit(GeExpression* expr)
+{
+	return foldComparison(expr, [](auto left, auto right) { return left >= right; });
+}
+
+VisitResult Simplifier::visit(EqExpression* expr)
+{
+	return foldComparison(expr, [](auto left, auto right) { return left == right; });
+}
+
+VisitResult Simplifier::visit(NeqExpression* expr)
+{
+	return foldComparison(expr, [](auto left, auto right) { return left != right; });
+}
+
+VisitResult Simplifier::visit(PlusExpression* expr)
+{
+	return foldInteger(expr, [](std::int64_t left, std::int64_t right) -> std::optional<std::int64_t> {
+		if ((right > 0 && left > IntMax - right) || (right < 0 && left < IntMin - right))
+			return std::nullopt;
+		return left + right;
+	});
+}
+
+VisitResult Simplifier::visit(MinusExpression* expr)
+{
+	return foldInteger(expr, [](std::int64_t left, std::int64_t right) -> std::optional<std::int64_t> {
+		if ((right < 0 && left > IntMax + right) || (right > 0 && left < IntMin + right))
+			return std::nullopt;
+		return left - right;
+	});
+}
+
+VisitResult Simplifier::visit(MultiplyExpression* expr)
+{
+	return foldInteger(expr, [](std::int64_t left, std::int64_t right) -> std::optional<std::int64_t> {
+		if ((left == -1 && right == IntMin) || (right == -1 && left == IntMin))
+			return std::nullopt;
+		auto result = static_cast<std::int64_t>(static_cast<std::uint64_t>(left) * static_cast<std::uint64_t>(right));
+		if (left != 0 && result / left != right)
+			return std::nullopt;
+		return result;
+	});
+}
+
+VisitResult Simplifier::visit(DivideExpression* expr)
+{
+	return foldInteger(expr, [](std::int64_t left, std::int64_t right) -> std::optional<std::int64_t> {
+		if (right == 0 || (left == IntMin && right == -1))
+			return std::nullopt;
+		return left / right;
+	});
+}
+
+VisitResult Simplifier::visit(ModuloExpression* expr)
+{
+	return foldInteger(expr, [](std::int64_t left, std::int64_t right) -> std::optional<std::int64_t> {
+		if (right == 0 || (left == IntMin && right == -1))
+			return std::nullopt;
+		return left % right;
+	});
+}
+
+VisitResult Simplifier::visit(BitwiseXorExpression* expr)
+{
+	return foldInteger(expr, [](std::int64_t left, std::int64_t right) -> std::optional<std::int64_t> { return left ^ right; });
+}
+
+VisitResult Simplifier::visit(BitwiseAndExpression* expr)
+{
+	return foldInteger(expr, [](std::int64_t left, std::int64_t right) -> std::optional<std::int64_t> { return left & right; });
+}
+
+VisitResult Simplifier::visit(BitwiseOrExpression* expr)
+{
+	return foldInteger(expr, [](std::int64_t left, std::int64_t right) -> std::optional<std::int64_t> { return left | right; });
+}
+
+VisitResult Simplifier::visit(ShiftLeftExpression* expr)
+{
+	// YARA shifts by 64 or more bits result in 0, shifts by negative number are undefined
+	return foldInteger(expr, [](std::int64_t left, std::int64_t right) -> std::optional<std::int64_t> {
+		if (right < 0)
+			return std::nullopt;
+		return right < 64 ? static_cast<std::int64_t>(static_cast<std::uint64_t>(left) << right) : 0;
+	});
+}
+
+VisitResult Simplifier::visit(ShiftRightExpression* expr)
+{
+	return foldInteger(expr, [](std::int64_t left, std::int64_t right) -> std::optional<std::int64_t> {
+		if (right < 0)
+			return std::nullopt;
+		return right < 64 ? left >> right : 0;
+	});
+}
+
+VisitResult Simplifier::visit(ParenthesesExpression* expr)
+{
+	auto result = ModifyingVisitor::visit(expr);
+	if (!isUnchanged(result))
+		return result;
+
+	if (isAtomic(expr->getEnclosedExpression().get()))
+		return replaceWithOperand(expr, expr->getEnclosedExpression());
+
+	return {};
+}
+
+template <typename T, typename Op>
+VisitResult Simplifier::foldInteger(T* expr, Op&& op)
+{
+	auto result = ModifyingVisitor::visit(expr);
+	if (!isUnchanged(result))
+		return result;
+
+	auto left = getConstant(expr->getLeftOperand().get());
+	auto right = getConstant(expr->getRightOperand().get());
+	if (!left || !right)
+		return {};
+
+	auto value = op(left.value(), right.value());
+	if (!value)
+		return {};
+
+	// Hexadecimal operands usually mean masks or offsets so the result stays hexadecimal
+	if (value.value() >= 0 && (isHexLiteral(expr->getLeftOperand().get()) || isHexLiteral(expr->getRightOperand().get())))
+		return replaceWith(expr, hexIntVal(value.value()));
+	return replaceWith(expr, intVal(value.value()));
+}
+
+template <typename T, typename Op>
+VisitResult Simplifier::foldComparison(T* expr, Op&& op)
+{
+	auto result = ModifyingVisitor::visit(expr);
+	if (!isUnchanged(result))
+		return result;
+
+	auto left = getConstant(expr->getLeftOperand().get());
+	auto right = getConstant(expr->getRightOperand().get());
+	if (!left || !right)
+		return {};
+
+	return replaceWith(expr, boolVal(op(left.value(), right.value())));
+}
+
+VisitResult Simplifier::simplifyChain(BinaryOpExpression* expr)
+{
+	const bool isAnd = expr->getKind() == Expression::Kind::And;
+
+	auto chain = collectChain(expr);
+	const auto& operations = chain.operations;
+	const auto& operationPtrs = chain.operationPtrs;
+	const auto& operands = chain.operands;
+
+	std::vector<bool> removed(operands.size(), false);
+	for (std::size_t i = 0; i < operands.size(); ++i)
+	{
+		auto result = operands[i]->accept(this);
+		if (auto newOperand = std::get_if<Expression::Ptr>(&result))
+		{
+			if (*newOperand)
+				chain.setOperand(i, *newOperand);
+		}
+		else
+		{
+			removed[i] = true;
+			continue;
+		}
+
+		// Operands bind tighter than `and` and `or` so parentheses around them are redundant unless they enclose `and` or `or`
+		if (operands[i]->getKind() == Expression::Kind::Parentheses)
+		{
+			const auto& enclosed = static_cast<const ParenthesesExpression*>(operands[i].get())->getEnclosedExpression();
+			if (enclosed->getKind() != Expression::Kind::And && enclosed->getKind() != Expression::Kind::Or)
+				chain.setOperand(i, replaceWithOperand(operands[i].get(), enclosed));
+		}
+	}
+
+	if (std::all_of(removed.begin(), removed.end(), [](auto r) { return r; }))
+		return VisitAction::Delete;
+
+	// `false` in `and` and `true` in `or` decide the result of the whole chain
+	for (std::size_t i = 0; i < operands.size(); ++i)
+	{
+		if (!removed[i] && isBoolLiteral(operands[i].get(), !isAnd))
+			return replaceWith(expr, boolVal(!isAnd));
+	}
+
+	bool anyRemoved = std::any_of(removed.begin(), removed.end(), [](auto r) { return r; });
+	std::unordered_set<std::string> texts;
+	std::vector<std::size_t> kept;
+	for (std::size_t i = 0; i < operands.size(); ++i)
+	{
+		if (removed[i])
+			continue;
+
+		if (isBoolLiteral(operands[i].get(), isAnd) || !texts.insert(operands[i]->getText()).second)
+			removed[i] = anyRemoved = true;
+		else
+			kept.push_back(i);
+	}
+
+	if (!anyRemoved)
+		return {};
+	if (kept.empty())
+		return replaceWith(expr, boolVal(isAnd));
+	// Chain with a single non-boolean operand left, like `5 and true`, would change its type
+	if (kept.size() == 1 && !operands[kept.front()]->isBool())
+		return {};
+
+	// Removed operands are erased together with the operator in front of them, the first
+	// operand together with the operator behind it. Operations whose operator is left are reused.
+	std::vector<TokenIt> firsts, lasts;
+	for (const auto& operand : operands)
+	{
+		firsts.push_back(operand->getFirstTokenIt());
+		lasts.push_back(operand->getLastTokenIt());
+	}
+
+	auto tokenStream = expr->getTokenStream();
+	std::vector<bool> operationKept(operations.size(), true);
+	for (std::size_t i = operands.size() - 1; i > 0; --i)
+	{
+		if (removed[i])
+		{
+			tokenStream->erase(std::next(lasts[i - 1]), std::next(lasts[i]));
+			operationKept[i - 1] = false;
+		}
+	}
+	if (removed[0])
+	{
+		tokenStream->erase(firsts[0], firsts[kept.front()]);
+		operationKept[kept.front() - 1] = false;
+	}
+
+	_simplified = true;
+	if (kept.size() == 1)
+		return operands[kept.front()];
+
+	std::vector<std::size_t> keptOperations;
+	for (std::size_t i = 0; i < operations.size(); ++i)
+	{
+		if (operationKept[i])
+			keptOperations.push_back(i);
+	}
+
+	operations[keptOperations.front()]->setLeftOperand(operands[kept[0]]);
+	for (std::size_t i = 0; i < keptOperations.size(); ++i)
+	{
+		if (i > 0)
+			operations[keptOperations[i]]->setLeftOperand(operationPtrs[keptOperations[i - 1]]);
+		operations[keptOperations[i]]->setRightOperand(operands[kept[i + 1]]);
+	}
+
+	if (keptOperations.back() == operations.size() - 1)
+		return {};
+	return operationPtrs[keptOperations.back()];
+}
+
+/**
+ * Replaces the expression with the new one created by the builder.
+ */
+Expression::Ptr Simplifier::replaceWith(Expression* expr, const YaraExpressionBuilder& builder)
+{
+	auto output = builder.get();
+	cleanUpTokenStreams(TokenStreamContext{expr}, output.get());
+	_simplified = true;
+	return output;
+}
+
+/**
+ * Replaces the expression with its operand. Tokens of the operand stay in place
+ * and only the tokens around them are removed.
+ */
+Expression::Ptr Simplifier::replaceWithOperand(Expression* expr, const Expression::Ptr& operand)
+{
+	_simplified = true;
+	auto tokenStream = expr->getTokenStream();
+	if (operand->getTokenStream() != tokenStream)
+	{
+		auto output = YaraExpressionBuilder{operand}.get();
+		cleanUpTokenStreams(TokenStreamContext{expr}, output.get());
+		return output;
+	}
+
+	auto afterLast = std::next(expr->getLastTokenIt());
+	tokenStream->erase(expr->getFirstTokenIt(), operand->getFirstTokenIt());
+	tokenStream->erase(std::next(operand->getLastTokenIt()), afterLast);
+	return operand;
+}
+
+/**
+ * Returns the value of integer literal, possibly negated. Literals with `KB` and `MB`
+ * multipliers are not considered constant because their values are stored
+ * with different multipliers than YARA uses.
+ */
+std::optional<std::int64_t> Simplifier::getConstant(const Expression* expr)
+{
+	if (expr->getKind() == Expression::Kind::IntLiteral && !hasMultiplier(expr))
+		return static_cast<std::int64_t>(static_cast<const IntLiteralExpression*>(expr)->getValue());
+
+	if (expr->getKind() == Expression::Kind::UnaryMinus)
+	{
+		const auto* operand = static_cast<const UnaryMinusExpression*>(expr)->getOperand().get();
+		if (operand->getKind() == Expression::Kind::IntLiteral && !hasMultiplier(operand))
+		{
+			auto value = static_cast<std::int64_t>(static_cast<const IntLiteralExpression*>(operand)->getValue());
+			if (value != IntMin)
+				return -value;
+		}
+	}
+
+	return std::nullopt;
+}
+
+}
@@ -0,0 +1,579 @@
+/**
+ * @file src/utils/string_index.cpp
+ * @brief Implementation of index of duplicate strings.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+
+#include "yaramod/types/hex_string.h"
+#include "yaramod/types/regexp.h"
+#include "yaramod/utils/string_index.h"
+
+namespace yaramod {
+
+namespace {
+
+/**
+ * Maximal number of forms of a single string. Strings with more forms are compared only by their text.
+ */
+constexpr std::size_t MaxForms = 16;
+
+/**
+ * Maximal fixed jump in hex strings which is expanded into wildcards. Strings with longer jumps are compared only by their text.
+ */
+constexpr std::uint64_t MaxJump = 256;
+
+/**
+ * Maximal length of windows used to look up candidates for containment.
+ */
+constexpr std::size_t MaxWindowLength = 4;
+
+/**
+ * Mask of letter in `nocase` string. It ignores the bit which differs between lowercase and uppercase letter.
+ */
+constexpr std::uint8_t NocaseMask = 0xDF;
+
+/**
+ * Runs @p func for each index from 0 to @p count in parallel. Threads take indices in chunks,
+ * so they stay busy even when some indices take longer than others. The first exception
+ * thrown from any thread is rethrown once all threads finish.
+ */
+template <typename Func>
+void parallelFor(std::size_t count, std::size_t threads, Func&& func)
+{
+	constexpr std::size_t chunkSize = 256;
+
+	if (threads == 0)
+		threads = std::max(std::thread::hardware_concurrency(), 1u);
+	threads = std::max<std::size_t>(std::min(threads, (count + chunkSize - 1) / chunkSize), 1);
+
+	std::atomic<std::size_t> nextChunk = 0;
+	std::vector<std::exception_ptr> errors(threads);
+	std::vector<std::thread> workers;
+	workers.reserve(threads);
+	for (std::size_t i = 0; i < threads; ++i)
+	{
+		workers.emplace_back([&, i]() {
+			try
+			{
+				for (auto start = nextChunk++ * chunkSize; start < count; start = nextChunk++ * chunkSize)
+				{
+					auto end = std::min(start + chunkSize, count);
+					for (auto index = start; index < end; ++index)
+						func(index);
+				}
+			}
+			catch (...)
+			{
+				errors[i] = std::current_exception();
+				nextChunk = count;
+			}
+		});
+	}
+
+	for (auto& worker : workers)
+		worker.join();
+
+	for (const auto& error : errors)
+	{
+		if (error)
+			std::rethrow_exception(error);
+	}
+}
+
+/**
+ * Hash index which can be filled from more threads at once. Keys are split into shards
+ * where each shard has its own lock, so threads rarely wait for each other.
+ */
+template <typename Value>
+class ConcurrentIndex
+{
+public:
+	void insert(std::uint64_t key, const Value& value)
+	{
+		auto& shard = _shards[key % ShardsCount];
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		shard.buckets[key].push_back(value);
+	}
+
+	/**
+	 * Finds values with the given key. It must not be called while values are being inserted.
+	 */
+	const std::vector<Value>* find(std::uint64_t key) const
+	{
+		const auto& buckets = _shards[key % ShardsCount].buckets;
+		auto itr = buckets.find(key);
+		return itr != buckets.end() ? &itr->second : nullptr;
+	}
+
+private:
+	static constexpr std::size_t ShardsCount = 256;
+
+	struct Shard
+	{
+		std::mutex mutex;
+		std::unordered_map<std::uint64_t, std::vector<Value>> buckets;
+	};
+
+	std::vector<Shard> _shards = std::vector<Shard>(ShardsCount);
+};
+
+/**
+ * FNV-1a hash which can be fed piece by piece.
+ */
+class Hasher
+{
+public:
+	void add(const std::uint8_t* data, std::size_t size)
+	{
+		for (std::size_t i = 0; i < size; ++i)
+		{
+			_hash ^= data[i];
+			_hash *= 0x100000001b3;
+		}
+	}
+
+	void add(const std::string& text)
+	{
+		add(reinterpret_cast<const std::uint8_t*>(text.data()), text.size());
+		addSeparator(text.size());
+	}
+
+	void add(const std::vector<std::uint8_t>& data)
+	{
+		add(data.data(), data.size());
+		addSeparator(data.size());
+	}
+
+	std::uint64_t get() const { return _hash; }
+
+private:
+	void addSeparator(std::uint64_t size)
+	{
+		add(reinterpret_cast<const std::uint8_t*>(&size), sizeof(size));
+	}
+
+	std::uint64_t _hash = 0xcbf29ce484222325;
+};
+
+/**
+ * Sequence of bytes with masks which is being built.
+ */
+struct MaskedBytes
+{
+	std::vector<std::uint8_t> bytes;
+	std::vector<std::uint8_t> masks;
+
+	void push(std::uint8_t byte, std::uint8_t mask)
+	{
+		bytes.push_back(byte & mask);
+		masks.push_back(mask);
+	}
+
+	void append(const MaskedBytes& other)
+	{
+		bytes.insert(bytes.end(), other.bytes.begin(), other.bytes.end());
+		masks.insert(masks.end(), other.masks.begin(), other.masks.end());
+	}
+};
+
+/**
+ * Returns all forms of the sequence of hex string elements with alternatives expanded.
+ * Returns nothing if the elements contain variable or too long jump or there would be too many forms.
+ */
+std::optional<std::vector<MaskedBytes>> getHexForms(const std::vector<HexStringElement>& elements)
+{
+	std::vector<MaskedBytes> result(1);
+	auto appendToAll = [&](std::uint8_t byte, std::uint8_t mask) {
+		for (auto& form : result)
+			form.push(byte, mask);
+	};
+
+	for (const auto& element : elements)
+	{
+		if (element.isByte())
+			appendToAll(element.value, element.mask);
+		else if (element.isJump())
+		{
+			if (element.jumpHigh != element.jumpLow || element.jumpLow > MaxJump)
+				return std::nullopt;
+
+			for (std::uint64_t i = 0; i < element.jumpLow; ++i)
+				appendToAll(0x00, 0x00);
+		}
+		else
+		{
+			std::vector<MaskedBytes> alternatives;
+			for (const auto& alternative : element.alternatives)
+			{
+				auto alternativeForms = getHexForms(alternative);
+				if (!alternativeForms)
+					return std::nullopt;
+				std::move(alternativeForms->begin(), alternativeForms->end(), std::back_inserter(alternatives));
+			}
+
+			if (result.size() * alternatives.size() > MaxForms)
+				return std::nullopt;
+
+			std::vector<MaskedBytes> expanded;
+			for (const auto& prefix : result)
+			{
+				for (const auto& alternative : alternatives)
+				{
+					expanded.push_back(prefix);
+					expanded.back().append(alternative);
+				}
+			}
+			result = std::move(expanded);
+		}
+	}
+
+	return result;
+}
+
+std::vector<MaskedBytes> getPlainForms(const String& string)
+{
+	MaskedBytes ascii;
+	for (unsigned char c : string.getPureText())
+		ascii.push(c, string.isNocase() && std::isalpha(c) ? NocaseMask : 0xFF);
+
+	std::vector<MaskedBytes> result;
+	if (string.isAscii())
+		result.push_back(ascii);
+	if (string.isWide())
+	{
+		MaskedBytes wide;
+		for (std::size_t i = 0; i < ascii.bytes.size(); ++i)
+		{
+			wide.push(ascii.bytes[i], ascii.masks[i]);
+			wide.push(0x00, 0xFF);
+		}
+		result.push_back(std::move(wide));
+	}
+	return result;
+}
+
+/**
+ * Returns the text of modifiers which change what the string matches and which are not part of forms.
+ */
+std::string getModifiersKey(const String& string, bool withEncoding)
+{
+	std::string result;
+	if (withEncoding)
+	{
+		result += string.isAscii() ? "a" : "";
+		result += string.isWide() ? "w" : "";
+		result += string.isNocase() ? "n" : "";
+	}
+	result += string.isFullword() ? "f" : "";
+
+	// Strings with `xor` are not expanded into their xored forms, so they are the same only with the same range of keys
+	const auto& modifiers = string.getModifiers();
+	if (auto itr = modifiers.find(StringModifier::Type::Xor); itr != modifiers.end())
+	{
+		const auto* xorModifier = static_cast<const XorStringModifier*>(itr->second.get());
+		auto low = xorModifier->getLow().value_or(0);
+		auto high = xorModifier->getLow() ? xorModifier->getHigh().value_or(low) : 255;
+		result += "x" + std::to_string(low) + "-" + std::to_string(high);
+	}
+	if (auto itr = modifiers.find(StringModifier::Type::Base64); itr != modifiers.end())
+		result += "b(" + static_cast<const Base64StringModifier*>(itr->second.get())->getAlphabet().value_or("") + ")";
+	if (auto itr = modifiers.find(StringModifier::Type::Base64Wide); itr != modifiers.end())
+		result += "bw(" + static_cast<const Base64WideStringModifier*>(itr->second.get())->getAlphabet().value_or("") + ")";
+	return result;
+}
+
+/**
+ * Returns the window of at most MaxWindowLength bytes packed into a single key together with its length.
+ * Bytes are masked with NocaseMask so letters of `nocase` strings have the same key as the same letters
+ * in any case. Returns nothing if some byte of the window is masked by more than NocaseMask.
+ */
+std::optional<std::uint64_t> getWindowKey(const std::vector<std::uint8_t>& bytes, const std::vector<std::uint8_t>& masks, std::size_t start, std::size_t length)
+{
+	std::uint64_t result = length;
+	for (auto i = start; i < start + length; ++i)
+	{
+		if ((masks[i] & NocaseMask) != NocaseMask)
+			return std::nullopt;
+		result = result << 8 | (bytes[i] & NocaseMask);
+	}
+	return result;
+}
+
+/**
+ * Returns whether every sequence of bytes matching @p outer at @p offset also matches @p inner.
+ */
+bool containsAt(const std::vector<std::uint8_t>& outerBytes, const std::vector<std::uint8_t>& outerMasks,
+	const std::vector<std::uint8_t>& innerBytes, const std::vector<std::uint8_t>& innerMasks, std::size_t offset)
+{
+	if (offset + innerBytes.size() > outerBytes.size())
+		return false;
+
+	for (std::size_t i = 0; i < innerBytes.size(); ++i)
+	{
+		if ((innerMasks[i] & outerMasks[offset + i]) != innerMasks[i] || (outerBytes[offset + i] & innerMasks[i]) != innerBytes[i])
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Window of a form of string which is looked up in forms of other strings.
+ */
+struct Anchor
+{
+	std::size_t entry;
+	std::size_t form;
+	std::size_t offset; ///< Offset of the window in the form
+};
+
+}
+
+/**
+ * Adds all strings of the file into the index. Strings are normalized in parallel.
+ *
+ * @param file YARA file.
+ * @return Index of the file used in references to its strings.
+ */
+std::size_t StringIndex::add(const YaraFile& file)
+{
+	auto fileIndex = _files++;
+	const auto& rules = file.getRules();
+
+	std::vector<std::vector<Entry>> ruleEntries(rules.size());
+	parallelFor(rules.size(), _threads, [&](std::size_t ruleIndex) {
+		const auto& rule = *rules[ruleIndex];
+		for (const auto* string : rule.getStrings())
+		{
+			Entry entry;
+			entry.reference = {fileIndex, rule.getName(), string->getIdentifier()};
+
+			std::optional<std::vector<MaskedBytes>> forms;
+			if (string->isPlain())
+				forms = getPlainForms(*string);
+			else if (string->isHex())
+				forms = getHexForms(static_cast<const HexString*>(string)->getElements());
+
+			entry.key = getModifiersKey(*string, !forms);
+			if (forms)
+			{
+				for (auto& form : forms.value())
+					entry.forms.push_back({std::move(form.bytes), std::move(form.masks)});
+				std::sort(entry.forms.begin(), entry.forms.end());
+				entry.forms.erase(std::unique(entry.forms.begin(), entry.forms.end()), entry.forms.end());
+				entry.containable = !string->isFullword() && !string->isBase64() && !string->isBase64Wide();
+			}
+			else if (string->isHex())
+				entry.key += "{" + string->getPureText() + "}";
+			else
+			{
+				const auto* regexp = static_cast<const Regexp*>(string);
+				entry.key += "/" + regexp->getPureText() + "/" + regexp->getSuffixModifiers();
+			}
+
+			Hasher hasher;
+			hasher.add(entry.key);
+			for (const auto& form : entry.forms)
+			{
+				hasher.add(form.bytes);
+				hasher.add(form.masks);
+			}
+			entry.hash = hasher.get();
+			ruleEntries[ruleIndex].push_back(std::move(entry));
+		}
+	});
+
+	for (auto& entries : ruleEntries)
+		std::move(entries.begin(), entries.end(), std::back_inserter(_entries));
+	return fileIndex;
+}
+
+/**
+ * Returns the index of the first entry which is the same as the entry for each entry.
+ */
+std::vector<std::size_t> StringIndex::findRepresentatives() const
+{
+	ConcurrentIndex<std::size_t> index;
+	parallelFor(_entries.size(), _threads, [&](std::size_t i) {
+		index.insert(_entries[i].hash, i);
+	});
+
+	std::vector<std::size_t> result(_entries.size());
+	parallelFor(_entries.size(), _threads, [&](std::size_t i) {
+		result[i] = i;
+		for (auto other : *index.find(_entries[i].hash))
+		{
+			if (other < result[i] && _entries[other] == _entries[i])
+				result[i] = other;
+		}
+	});
+	return result;
+}
+
+/**
+ * Finds groups of strings which are the same after normalization.
+ *
+ * @return Groups with at least two strings in order of addition.
+ */
+std::vector<std::vector<StringIndex::StringReference>> StringIndex::findDuplicates() const
+{
+	auto representatives = findRepresentatives();
+
+	std::unordered_map<std::size_t, std::vector<std::size_t>> groups;
+	for (std::size_t i = 0; i < _entries.size(); ++i)
+	{
+		if (representatives[i] != i)
+		{
+			auto& group = groups[representatives[i]];
+			if (group.empty())
+				group.push_back(representatives[i]);
+			group.push_back(i);
+		}
+	}
+
+	std::vector<std::vector<std::size_t>> sortedGroups;
+	sortedGroups.reserve(groups.size());
+	for (auto& [representative, group] : groups)
+		sortedGroups.push_back(std::move(group));
+	std::sort(sortedGroups.begin(), sortedGroups.end());
+
+	std::vector<std::vector<StringReference>> result;
+	result.reserve(sortedGroups.size());
+	for (const auto& group : sortedGroups)
+	{
+		std::vector<StringReference> references;
+		for (auto i : group)
+			references.push_back(_entries[i].reference);
+		result.push_back(std::move(references));
+	}
+	return result;
+}
+
+/**
+ * Finds pairs of strings where one string is a substring of the other one, so the inner
+ * string matches everywhere where the outer string does. If the outer string has more forms,
+ * like `ascii wide` strings, each of them has to contain some form of the inner string.
+ * Strings with different `xor` modifiers, `fullword`, `base64` and `base64wide` strings and strings
+ * compared only by their text are not checked. Duplicate strings are represented by the first of them.
+ *
+ * @return Pairs of strings in order of addition of the outer strings.
+ */
+std::vector<StringIndex::Containment> StringIndex::findContainments() const
+{
+	auto representatives = findRepresentatives();
+
+	std::vector<std::size_t> candidates;
+	for (std::size_t i = 0; i < _entries.size(); ++i)
+	{
+		if (representatives[i] == i && _entries[i].containable)
+			candidates.push_back(i);
+	}
+
+	// Each form of each string is anchored by the window of its bytes with the most distinct values
+	ConcurrentIndex<Anchor> anchors;
+	std::vector<std::atomic<bool>> usedLengths(MaxWindowLength + 1);
+	parallelFor(candidates.size(), _threads, [&](std::size_t candidate) {
+		auto entryIndex = candidates[candidate];
+		const auto& forms = _entries[entryIndex].forms;
+		for (std::size_t formIndex = 0; formIndex < forms.size(); ++formIndex)
+		{
+			const auto& form = forms[formIndex];
+			for (auto length = std::min(MaxWindowLength, form.bytes.size()); length > 0; --length)
+			{
+				std::optional<std::pair<std::size_t, std::uint64_t>> best;
+				std::size_t bestDistinct = 0;
+				for (std::size_t offset = 0; offset + length <= form.bytes.size(); ++offset)
+				{
+					auto key = getWindowKey(form.bytes, form.masks, offset, length);
+					if (!key)
+						continue;
+
+					std::vector<std::uint8_t> window(form.bytes.begin() + offset, form.bytes.begin() + offset + length);
+					std::sort(window.begin(), window.end());
+					std::size_t distinct = std::unique(window.begin(), window.end()) - window.begin();
+					if (!best || distinct > bestDistinct)
+					{
+						best = std::make_pair(offset, key.value());
+						bestDistinct = distinct;
+					}
+				}
+
+				if (best)
+				{
+					anchors.insert(best->second, {entryIndex, formIndex, best->first});
+					usedLengths[length] = true;
+					break;
+				}
+			}
+		}
+	});
+
+	std::vector<std::vector<std::pair<std::size_t, std::size_t>>> found(candidates.size());
+	parallelFor(candidates.size(), _threads, [&](std::size_t candidate) {
+		auto outerIndex = candidates[candidate];
+		const auto& outer = _entries[outerIndex];
+
+		// Inner strings with the set of forms of the outer string which contain them
+		std::unordered_map<std::size_t, std::uint64_t> coveredForms;
+		for (std::size_t formIndex = 0; formIndex < outer.forms.size(); ++formIndex)
+		{
+			const auto& form = outer.forms[formIndex];
+			for (std::size_t length = 1; length <= MaxWindowLength; ++length)
+			{
+				if (!usedLengths[length])
+					continue;
+
+				for (std::size_t offset = 0; offset + length <= form.bytes.size(); ++offset)
+				{
+					auto key = getWindowKey(form.bytes, form.masks, offset, length);
+					if (!key)
+						continue;
+
+					const auto* bucket = anchors.find(key.value());
+					if (!bucket)
+						continue;
+
+					for (const auto& anchor : *bucket)
+					{
+						if (anchor.entry == outerIndex || anchor.offset > offset)
+							continue;
+
+						const auto& inner = _entries[anchor.entry];
+						if (inner.key != outer.key)
+							continue;
+
+						const auto& innerForm = inner.forms[anchor.form];
+						if (containsAt(form.bytes, form.masks, innerForm.bytes, innerForm.masks, offset - anchor.offset))
+							coveredForms[anchor.entry] |= std::uint64_t{1} << formIndex;
+					}
+				}
+			}
+		}
+
+		auto allForms = (std::uint64_t{1} << outer.forms.size()) - 1;
+		for (const auto& [innerIndex, covered] : coveredForms)
+		{
+			if (covered == allForms)
+				found[candidate].emplace_back(outerIndex, innerIndex);
+		}
+		std::sort(found[candidate].begin(), found[candidate].end());
+	});
+
+	std::vector<Containment> result;
+	for (const auto& pairs : found)
+	{
+		for (const auto& [outerIndex, innerIndex] : pairs)
+			result.push_back({_entries[outerIndex].reference, _entries[innerIndex].reference});
+	}
+	return result;
+}
+
+}
@@ -6,10 +6,28 @@
 
 #include <algorithm>
 #include <cctype>
-#include <iomanip>
+#include <cstring>
 #include <locale>
 #include <optional>
-#include <sstream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define YARAMOD_SIMD_SSE2 1
+#	include <emmintrin.h>
+#else
+#	define YARAMOD_SIMD_SSE2 0
+#endif
+
+// AVX2 kernels are compiled separately with target attribute and selected at runtime
+#if YARAMOD_SIMD_SSE2 && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#	define YARAMOD_SIMD_AVX2 1
+#	include <immintrin.h>
+#else
+#	define YARAMOD_SIMD_AVX2 0
+#endif
+
+#if defined(_MSC_VER)
+#	include <intrin.h>
+#endif
 
 #include "yaramod/utils/utils.h"
 
@@ -24,6 +42,24 @@ static std::locale cLocale("C");
 
 namespace yaramod {
 
+namespace {
+
+/**
+ * Returns the index of the lowest set bit. Mask must not be zero.
+ */
+inline unsigned countTrailingZeros(unsigned mask)
+{
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return static_cast<unsigned>(index);
+#else
+	return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+} // anonymous namespace
+
 /**
  * Checks whether the string is valid identifier for meta key or rule name.
  *
@@ -44,24 +80,162 @@ bool isValidIdentifier(const std::string& id)
 			});
 }
 
+namespace {
+
+/**
+ * Checks whether the character has to be escaped by `escapeString`.
+ * Only printable characters of C locale except `\` and `"` are left as they are.
+ */
+inline bool needsEscaping(char c)
+{
+	const auto u = static_cast<unsigned char>(c);
+	return u < 0x20 || u > 0x7E || c == '\\' || c == '\"';
+}
+
+/**
+ * Returns the length of the longest prefix of `data` which does not need escaping.
+ */
+std::size_t cleanPrefixLengthScalar(const char* data, std::size_t size)
+{
+	std::size_t i = 0;
+	while (i < size && !needsEscaping(data[i]))
+		++i;
+	return i;
+}
+
+#if YARAMOD_SIMD_SSE2
+std::size_t cleanPrefixLengthSse2(const char* data, std::size_t size)
+{
+	const __m128i space = _mm_set1_epi8(0x20);
+	const __m128i del = _mm_set1_epi8(0x7F);
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i quote = _mm_set1_epi8('\"');
+
+	std::size_t i = 0;
+	for (; i + 16 <= size; i += 16)
+	{
+		const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+		// Signed comparison also catches all bytes >= 0x80 because they are negative
+		__m128i special = _mm_cmplt_epi8(chunk, space);
+		special = _mm_or_si128(special, _mm_cmpeq_epi8(chunk, del));
+		special = _mm_or_si128(special, _mm_cmpeq_epi8(chunk, backslash));
+		special = _mm_or_si128(special, _mm_cmpeq_epi8(chunk, quote));
+		if (auto mask = static_cast<unsigned>(_mm_movemask_epi8(special)))
+			return i + countTrailingZeros(mask);
+	}
+
+	return i + cleanPrefixLengthScalar(data + i, size - i);
+}
+#endif
+
+#if YARAMOD_SIMD_AVX2
+__attribute__((target("avx2")))
+std::size_t cleanPrefixLengthAvx2(const char* data, std::size_t size)
+{
+	const __m256i space = _mm256_set1_epi8(0x20);
+	const __m256i del = _mm256_set1_epi8(0x7F);
+	const __m256i backslash = _mm256_set1_epi8('\\');
+	const __m256i quote = _mm256_set1_epi8('\"');
+
+	std::size_t i = 0;
+	for (; i + 32 <= size; i += 32)
+	{
+		const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+		// Signed comparison also catches all bytes >= 0x80 because they are negative
+		__m256i special = _mm256_cmpgt_epi8(space, chunk);
+		special = _mm256_or_si256(special, _mm256_cmpeq_epi8(chunk, del));
+		special = _mm256_or_si256(special, _mm256_cmpeq_epi8(chunk, backslash));
+		special = _mm256_or_si256(special, _mm256_cmpeq_epi8(chunk, quote));
+		if (auto mask = static_cast<unsigned>(_mm256_movemask_epi8(special)))
+			return i + countTrailingZeros(mask);
+	}
+
+	return i + cleanPrefixLengthSse2(data + i, size - i);
+}
+#endif
+
+using CleanPrefixLengthFn = std::size_t (*)(const char*, std::size_t);
+
+/**
+ * Selects the fastest implementation of clean prefix search supported by the CPU we run on.
+ */
+CleanPrefixLengthFn selectCleanPrefixLength()
+{
+#if YARAMOD_SIMD_AVX2
+	if (__builtin_cpu_supports("avx2"))
+		return &cleanPrefixLengthAvx2;
+#endif
+#if YARAMOD_SIMD_SSE2
+	return &cleanPrefixLengthSse2;
+#else
+	return &cleanPrefixLengthScalar;
+#endif
+}
+
+std::size_t cleanPrefixLength(const char* data, std::size_t size)
+{
+	static const CleanPrefixLengthFn impl = selectCleanPrefixLength();
+	return impl(data, size);
+}
+
+/**
+ * Table mapping characters to the values of hexadecimal digits. Characters which
+ * are not hexadecimal digits are mapped to `0xFF`.
+ */
+struct NibbleTable
+{
+	constexpr NibbleTable() : values()
+	{
+		for (int i = 0; i < 256; ++i)
+			values[i] = 0xFF;
+		for (int i = 0; i < 10; ++i)
+			values['0' + i] = static_cast<std::uint8_t>(i);
+		for (int i = 0; i < 6; ++i)
+		{
+			values['a' + i] = static_cast<std::uint8_t>(10 + i);
+			values['A' + i] = static_cast<std::uint8_t>(10 + i);
+		}
+	}
+
+	std::uint8_t values[256];
+};
+
+constexpr NibbleTable nibbleTable;
+
+} // anonymous namespace
+
 /**
  * Escapes the string according to the YARA escaping rules. Only escaping sequences are
  * `\n`, `\t`, `\"`, `\\` and `\xXX`.
  * non-printable characters are escaped: 				'\x40' -> "@"
  * printable characters are delegated separately: 	'\n' -> "\n"  ...  string of size 2
  *
+ * Runs of characters which do not need escaping are found using SIMD instructions
+ * (if available) and copied at once.
+ *
  * @param str String to escape.
  *
  * @return Escaped string.
  */
 std::string escapeString(const std::string& str)
 {
-	std::ostringstream writer;
+	static constexpr char hexDigits[] = "0123456789abcdef";
+
 	std::string result;
+	result.reserve(str.length());
 
-	for (auto itr = str.begin(), end = str.end(); itr != end; ++itr)
+	const char* data = str.data();
+	const std::size_t size = str.length();
+	std::size_t i = 0;
+	while (i < size)
 	{
-		const char c = *itr;
+		auto clean = cleanPrefixLength(data + i, size - i);
+		result.append(data + i, clean);
+		i += clean;
+		if (i == size)
+			break;
+
+		const char c = data[i++];
 		switch (c)
 		{
 			case '\n':
@@ -72,109 +246,186 @@ std::string escapeString(const std::string& str)
 				break;
 			case '\\':
 			case '\"':
-				result += "\\";
-				result += *itr;
+				result += '\\';
+				result += c;
 				break;
 			default:
-				if (std::isprint(c, cLocale))
-				{
-					result += c;
-				}
-				else
-				{
-					writer.str({});
-					writer.clear();
-					// At first, we need to get rid of possible sign-extension so cast to uint8_t and then cast to integer type
-					writer << std::setw(2) << std::setfill('0') << std::hex << static_cast<std::uint32_t>(static_cast<std::uint8_t>(c));
-					result += "\\x" + writer.str();
-				}
+			{
+				const auto byte = static_cast<std::uint8_t>(c);
+				const char escaped[] = { '\\', 'x', hexDigits[byte >> 4], hexDigits[byte & 0x0F] };
+				result.append(escaped, sizeof(escaped));
 				break;
+			}
 		}
 	}
 
 	return result;
 }
 
+/**
+ * Converts hexadecimal digit to its value.
+ *
+ * @param nibble Hexadecimal digit.
+ *
+ * @return Value of the digit or empty optional if it is not a hexadecimal digit.
+ */
 std::optional<std::uint8_t> nibbleToByte(char nibble)
 {
-	if ('0' <= nibble && nibble <= '9')
-		return nibble - '0';
-	else if (char nl = std::tolower(nibble); 'a' <= nl && nl <= 'f')
-		return nl - 'a' + 10;
-	else
+	auto value = nibbleTable.values[static_cast<std::uint8_t>(nibble)];
+	if (value == 0xFF)
 		return {};
+	return value;
 }
 
 /**
  * Unescapes the string according to the YARA escaping rules. Only escaping sequences are
  * `\n`, `\t`, `\"`, `\\` and `\xXX`.
  *
+ * Runs of characters between escape sequences are found with `memchr` and copied at once.
+ *
  * @param str String to unescape.
  *
  * @return unescaped string.
  */
 std::string unescapeString(std::string_view str)
 {
-	if (str.length() < 2)
-		return std::string{str.data(), str.length()};
-
 	std::string result;
 	result.reserve(str.length());
 
-	std::size_t i;
-	for (i = 0; i < str.length() - 1; ++i)
+	const char* data = str.data();
+	const std::size_t size = str.length();
+	std::size_t i = 0;
+	while (i < size)
 	{
-		if (str[i] == '\\')
+		auto backslash = static_cast<const char*>(std::memchr(data + i, '\\', size - i));
+		auto next = backslash ? static_cast<std::size_t>(backslash - data) : size;
+		result.append(data + i, next - i);
+		i = next;
+		if (i == size)
+			break;
+
+		// Backslash at the very end is kept as it is
+		if (i + 1 == size)
 		{
-			if (i + 3 < str.length() && str[i + 1] == 'x')
-			{
-				auto high = nibbleToByte(str[i + 2]);
-				auto low = nibbleToByte(str[i + 3]);
-				if (!high || !low)
-					std::copy(str.begin() + i, str.begin() + i + 4, std::back_inserter(result));
+			result.push_back('\\');
+			break;
+		}
+
+		switch (data[i + 1])
+		{
+			case 'x':
+				if (i + 3 < size)
+				{
+					auto high = nibbleTable.values[static_cast<std::uint8_t>(data[i + 2])];
+					auto low = nibbleTable.values[static_cast<std::uint8_t>(data[i + 3])];
+					if (high == 0xFF || low == 0xFF)
+						result.append(data + i, 4);
+					else
+						result.push_back(static_cast<char>((high << 4) | low));
+					i += 4;
+				}
 				else
 				{
-					result.push_back((high.value() << 4) | low.value());
+					result.push_back('\\');
+					i += 1;
 				}
-				i += 3;
-			}
-			else if (str[i + 1] == '\\')
-			{
+				break;
+			case '\\':
 				result.push_back('\\');
-				++i;
-			}
-			else if (str[i + 1] == '\"')
-			{
+				i += 2;
+				break;
+			case '\"':
 				result.push_back('\"');
-				++i;
-			}
-			else if (str[i + 1] == 'n')
-			{
+				i += 2;
+				break;
+			case 'n':
 				result.push_back('\n');
-				++i;
-			}
-			else if (str[i + 1] == 'r')
-			{
+				i += 2;
+				break;
+			case 'r':
 				result.push_back('\r');
-				++i;
-			}
-			else if (str[i + 1] == 't')
-			{
+				i += 2;
+				break;
+			case 't':
 				result.push_back('\t');
-				++i;
-			}
-			else
+				i += 2;
+				break;
+			default:
+				result.push_back('\\');
+				i += 1;
+				break;
+		}
+	}
+
+	return result;
+}
+
+/**
+ * Decodes escape sequence of regular expression into the byte it matches. Escaped
+ * character classes like `\w` or `\d` match more than one byte so they are not decoded.
+ *
+ * @param text Text of regular expression.
+ * @param i Position of the character following the backslash, it is moved behind the escape sequence.
+ *
+ * @return Decoded byte or empty optional for escaped character classes.
+ */
+std::optional<std::uint8_t> decodeRegexpEscape(const std::string& text, std::size_t& i)
+{
+	auto c = text[i++];
+	switch (c)
+	{
+		case 'w': case 'W':
+		case 's': case 'S':
+		case 'd': case 'D':
+			return std::nullopt;
+		case 'n': return '\n';
+		case 't': return '\t';
+		case 'r': return '\r';
+		case 'f': return '\f';
+		case 'v': return '\v';
+		case 'a': return '\a';
+		case 'x':
+			if (i + 1 < text.length())
 			{
-				result.push_back(str[i]);
+				auto high = nibbleToByte(text[i]);
+				auto low = nibbleToByte(text[i + 1]);
+				if (high && low)
+				{
+					i += 2;
+					return static_cast<std::uint8_t>((high.value() << 4) | low.value());
+				}
 			}
-		}
-		else
+			return 'x';
+		default:
+			return static_cast<std::uint8_t>(c);
+	}
+}
+
+/**
+ * Decodes text of regular expression made only of characters, escape sequences
+ * and any character units into bytes.
+ *
+ * @param text Text of regular expression.
+ *
+ * @return Decoded bytes, empty optionals for any characters and escaped character classes.
+ */
+std::vector<std::optional<std::uint8_t>> decodeRegexpText(const std::string& text)
+{
+	std::vector<std::optional<std::uint8_t>> result;
+	result.reserve(text.length());
+	for (std::size_t i = 0; i < text.length(); )
+	{
+		if (text[i] == '.')
 		{
-			result.push_back(str[i]);
+			result.emplace_back();
+			++i;
 		}
+		else if (text[i] != '\\' || i + 1 == text.length())
+			result.emplace_back(static_cast<std::uint8_t>(text[i++]));
+		else
+			result.push_back(decodeRegexpEscape(text, ++i));
 	}
 
-	std::copy(str.begin() + i, str.end(), std::back_inserter(result));
 	return result;
 }
 
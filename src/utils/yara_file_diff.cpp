@@ -0,0 +1,178 @@
+/**
+ * @file src/utils/yara_file_diff.cpp
+ * @brief Implementation of structural diff of YARA files.
+ * @copyright (c) 2021 Avast Software, licensed under the MIT license
+ */
+
+#include <algorithm>
+#include <array>
+#include <map>
+#include <unordered_map>
+
+#include "yaramod/utils/yara_file_diff.h"
+
+namespace yaramod {
+
+namespace {
+
+/**
+ * Hashes of sections of rule in order of bits of RuleChange::Section.
+ */
+using RuleSummary = std::array<StructuralHash, 5>;
+
+RuleSummary summarize(const Rule& rule)
+{
+	RuleSummary summary;
+
+	StructuralHasher modifiers;
+	modifiers.add(rule.isPrivate());
+	modifiers.add(rule.isGlobal());
+	summary[0] = modifiers.get();
+
+	StructuralHasher tags;
+	for (const auto& tag : rule.getTags())
+		tags.add(tag);
+	summary[1] = tags.get();
+
+	StructuralHasher metas;
+	for (const auto& meta : rule.getMetas())
+	{
+		metas.add(meta.getKey());
+		metas.add(meta.getValue().isString());
+		metas.add(meta.getValue().getPureText());
+	}
+	summary[2] = metas.get();
+
+	StructuralHasher strings;
+	for (const auto* string : rule.getStringsInDefinitionOrder())
+	{
+		strings.add(string->getIdentifier());
+		strings.add(string->structuralHash());
+	}
+	summary[3] = strings.get();
+
+	StructuralHasher condition;
+	for (const auto& variable : rule.getVariables())
+	{
+		condition.add(variable.getKey());
+		condition.add(variable.getValue()->structuralHash());
+	}
+	if (const auto& expr = rule.getCondition())
+		condition.add(expr->structuralHash());
+	summary[4] = condition.get();
+
+	return summary;
+}
+
+std::uint32_t getChangedSections(const Rule& oldRule, const Rule& newRule)
+{
+	auto oldSummary = summarize(oldRule);
+	auto newSummary = summarize(newRule);
+
+	std::uint32_t sections = RuleChange::None;
+	for (std::size_t i = 0; i < oldSummary.size(); ++i)
+	{
+		if (oldSummary[i] != newSummary[i])
+			sections |= 1u << i;
+	}
+	return sections;
+}
+
+}
+
+/**
+ * Finds rules which were added, removed, renamed or changed between two versions
+ * of YARA file. Rules are matched by their names first. Rules which were not matched
+ * by their names are matched by their fingerprints, so renamed rules are not reported
+ * as removed and added. Sections of matched rules are compared using their structural
+ * hashes, so changes in formatting and comments are not reported.
+ *
+ * @param oldFile Old version of YARA file.
+ * @param newFile New version of YARA file.
+ *
+ * @return Differences between the files.
+ */
+YaraFileDiff diff(const YaraFile& oldFile, const YaraFile& newFile)
+{
+	const auto& oldRules = oldFile.getRules();
+	const auto& newRules = newFile.getRules();
+
+	std::unordered_map<std::string, std::size_t> newIndices;
+	newIndices.reserve(newRules.size());
+	for (std::size_t i = 0; i < newRules.size(); ++i)
+		newIndices.emplace(newRules[i]->getName(), i);
+
+	std::vector<std::optional<std::size_t>> matches(oldRules.size());
+	std::vector<bool> matched(newRules.size());
+	for (std::size_t i = 0; i < oldRules.size(); ++i)
+	{
+		if (auto itr = newIndices.find(oldRules[i]->getName()); itr != newIndices.end())
+		{
+			matches[i] = itr->second;
+			matched[itr->second] = true;
+		}
+	}
+
+	// Candidates with the same fingerprint are stored in reversed order, so they are taken in order of the new file
+	std::map<StructuralHash, std::vector<std::size_t>> candidates;
+	for (std::size_t i = newRules.size(); i-- > 0;)
+	{
+		if (!matched[i])
+			candidates[newRules[i]->fingerprint()].push_back(i);
+	}
+
+	for (std::size_t i = 0; i < oldRules.size() && !candidates.empty(); ++i)
+	{
+		if (matches[i])
+			continue;
+
+		auto itr = candidates.find(oldRules[i]->fingerprint());
+		if (itr == candidates.end())
+			continue;
+
+		matches[i] = itr->second.back();
+		matched[itr->second.back()] = true;
+		itr->second.pop_back();
+		if (itr->second.empty())
+			candidates.erase(itr);
+	}
+
+	YaraFileDiff result;
+	for (std::size_t i = 0; i < oldRules.size(); ++i)
+	{
+		RuleChange change;
+		change.oldIndex = i;
+		change.oldName = oldRules[i]->getName();
+		if (!matches[i])
+		{
+			change.sections = RuleChange::All;
+			result.changes.push_back(std::move(change));
+			continue;
+		}
+
+		const auto& newRule = newRules[matches[i].value()];
+		change.newIndex = matches[i];
+		change.newName = newRule->getName();
+		change.sections = getChangedSections(*oldRules[i], *newRule);
+		if (change.sections == RuleChange::None && !change.isRenamed())
+			++result.unchangedRules;
+		else
+			result.changes.push_back(std::move(change));
+	}
+
+	for (std::size_t i = 0; i < newRules.size(); ++i)
+	{
+		if (matched[i])
+			continue;
+
+		RuleChange change;
+		change.newIndex = i;
+		change.newName = newRules[i]->getName();
+		change.sections = RuleChange::All;
+		result.changes.push_back(std::move(change));
+	}
+
+	return result;
+}
+
+}
@@ -4,12 +4,37 @@
  * @copyright (c) 2017 Avast Software, licensed under the MIT license
  */
 
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <streambuf>
+#include <thread>
+
 #include "yaramod/yaramod.h"
 
 namespace yaramod {
 
+namespace {
+
+/**
+ * Read-only stream buffer over the memory which is not owned by it.
+ */
+class MemoryBuffer : public std::streambuf
+{
+public:
+	MemoryBuffer(std::string_view input)
+	{
+		auto data = const_cast<char*>(input.data());
+		setg(data, data, data + input.size());
+	}
+};
+
+}
+
 std::unique_ptr<YaraFile> Yaramod::parseFile(const std::string& filePath, ParserMode parserMode)
 {
+	std::lock_guard<std::mutex> lock(_mutex);
 	if (!_driver.isValid())
 		return nullptr;
 
@@ -22,6 +47,7 @@ std::unique_ptr<YaraFile> Yaramod::parseFile(const std::string& filePath, Parser
 
 std::unique_ptr<YaraFile> Yaramod::parseStream(std::istream& inputStream, ParserMode parserMode)
 {
+	std::lock_guard<std::mutex> lock(_mutex);
 	if (!_driver.isValid())
 		return nullptr;
 
@@ -32,9 +58,59 @@ std::unique_ptr<YaraFile> Yaramod::parseStream(std::istream& inputStream, Parser
 	return result;
 }
 
+std::unique_ptr<YaraFile> Yaramod::parseString(std::string_view input, ParserMode parserMode)
+{
+	MemoryBuffer buffer(input);
+	std::istream inputStream(&buffer);
+	return parseStream(inputStream, parserMode);
+}
+
 const YaraFile& Yaramod::getParsedFile() const
 {
 	return _driver.getParsedFile();
 }
 
+std::vector<std::unique_ptr<YaraFile>> parseFiles(const std::vector<std::string>& filePaths, std::size_t threads, ParserMode parserMode, Features features)
+{
+	if (threads == 0)
+		threads = std::max(std::thread::hardware_concurrency(), 1u);
+	threads = std::max<std::size_t>(std::min(threads, filePaths.size()), 1);
+
+	std::vector<std::unique_ptr<YaraFile>> files(filePaths.size());
+	std::vector<std::exception_ptr> errors(filePaths.size());
+	std::atomic<std::size_t> nextFile{0};
+
+	std::vector<std::thread> workers;
+	workers.reserve(threads);
+	for (std::size_t i = 0; i < threads; ++i)
+	{
+		workers.emplace_back([&]() {
+			// Parser drivers are not thread-safe so each thread has its own
+			Yaramod yaramod(features);
+			for (auto fileIndex = nextFile++; fileIndex < filePaths.size(); fileIndex = nextFile++)
+			{
+				try
+				{
+					files[fileIndex] = yaramod.parseFile(filePaths[fileIndex], parserMode);
+				}
+				catch (...)
+				{
+					errors[fileIndex] = std::current_exception();
+				}
+			}
+		});
+	}
+
+	for (auto& worker : workers)
+		worker.join();
+
+	for (const auto& error : errors)
+	{
+		if (error)
+			std::rethrow_exception(error);
+	}
+
+	return files;
+}
+
 }
@@ -0,0 +1,97 @@
+/**
+* @file tests/atoms_tests.cpp
+* @brief Tests for the atom extraction.
+* @copyright (c) 2021 Avast Software, licensed under the MIT license
+*/
+
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "yaramod/parser/parser_driver.h"
+#include "yaramod/utils/atoms.h"
+
+using namespace ::testing;
+
+namespace yaramod {
+namespace tests {
+
+class AtomsTests : public Test {};
+
+TEST_F(AtomsTests,
+AtomQualityFollowsYaraHeuristic) {
+	EXPECT_EQ(Atom::MaxQuality, getAtomQuality({0x01, 0x02, 0x03, 0x04}, {0xFF, 0xFF, 0xFF, 0xFF}));
+	EXPECT_EQ(80, getAtomQuality({'T', 'h', 'i', 's'}, {0xFF, 0xFF, 0xFF, 0xFF}));
+	EXPECT_EQ(36, getAtomQuality({0x40, 0x5A, 0x00, 0x90}, {0xF0, 0xFF, 0x00, 0xFF}));
+	EXPECT_EQ(4, getAtomQuality({0x00, 0x00}, {0xFF, 0xFF}));
+	EXPECT_EQ(0, getAtomQuality({0x00}, {0x00}));
+}
+
+TEST_F(AtomsTests,
+AtomsAreExtractedFromAllKindsOfStrings) {
+	std::istringstream input(R"(
+rule abc
+{
+	strings:
+		$plain = "This program"
+		$wide = "ab" ascii wide
+		$hex_wildcards = { ?? ?? 00 00 }
+		$hex_alternation = { 4D 5A [2-4] ( 01 02 | 03 04 ) }
+		$hex_nothing = { ?? ?? }
+		$regexp = /.*foo/
+		$regexp_or = /abc|de/
+		$regexp_nothing = /\w+/
+		$regexp_range = /md5: [0-9a-f]{32}/
+		$regexp_escapes = /\x4d\vZ\t/
+	condition:
+		any of them
+}
+
+rule def
+{
+	condition:
+		true
+}
+)");
+
+	ParserDriver driver;
+	ASSERT_TRUE(driver.parse(input));
+	auto rules = extractAtoms(driver.getParsedFile());
+	ASSERT_EQ(2u, rules.size());
+
+	const auto& strings = rules[0].strings;
+	std::vector<std::tuple<std::string, int, std::vector<std::string>>> expected = {
+		{"$plain", 80, {"54 68 69 73"}},
+		{"$wide", 40, {"61 62", "61 00 62 00"}},
+		{"$hex_wildcards", 4, {"00 00"}},
+		{"$hex_alternation", 44, {"01 02", "03 04"}},
+		{"$hex_nothing", 0, {}},
+		{"$regexp", 58, {"66 6F 6F"}},
+		{"$regexp_or", 40, {"61 62 63", "64 65"}},
+		{"$regexp_nothing", 0, {}},
+		{"$regexp_range", 84, {"6D 64 35 3A"}},
+		{"$regexp_escapes", 84, {"4D 0B 5A 09"}}
+	};
+	ASSERT_EQ(expected.size(), strings.size());
+	for (std::size_t i = 0; i < expected.size(); ++i)
+	{
+		const auto& [id, quality, atoms] = expected[i];
+		EXPECT_EQ(id, strings[i].id);
+		EXPECT_EQ(quality, strings[i].quality) << id;
+		std::vector<std::string> atomTexts;
+		for (const auto& atom : strings[i].atoms)
+			atomTexts.push_back(atom.getText());
+		EXPECT_EQ(atoms, atomTexts) << id;
+	}
+
+	EXPECT_EQ("abc", rules[0].name);
+	EXPECT_EQ(0, rules[0].quality);
+	EXPECT_EQ("def", rules[1].name);
+	EXPECT_EQ(Atom::MaxQuality, rules[1].quality);
+}
+
+}
+}
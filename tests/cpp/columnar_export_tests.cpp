@@ -0,0 +1,74 @@
+/**
+* @file tests/columnar_export_tests.cpp
+* @brief Tests for the columnar export of YARA files.
+* @copyright (c) 2021 Avast Software, licensed under the MIT license
+*/
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "yaramod/parser/parser_driver.h"
+#include "yaramod/utils/columnar_export.h"
+
+using namespace ::testing;
+
+namespace yaramod {
+namespace tests {
+
+class ColumnarExportTests : public Test {};
+
+TEST_F(ColumnarExportTests,
+ExportColumnsWorks) {
+	std::istringstream input(R"(
+import "pe"
+import "math"
+
+global rule first : tag1 tag2
+{
+	meta:
+		author = "Mr. Avastian"
+		version = 2
+	strings:
+		$s = "text" wide ascii
+		$h = { 01 ?? 02 }
+		$r = /abc/ nocase
+	condition:
+		pe.number_of_sections > 1 and math.entropy(0, filesize) > 7 and pe.is_dll()
+}
+
+rule second
+{
+	condition:
+		first
+}
+)");
+
+	ParserDriver driver;
+	ASSERT_TRUE(driver.parse(input, ParserMode::LazyConditions));
+	auto columns = exportColumns(driver.getParsedFile());
+
+	EXPECT_EQ((std::vector<std::string>{"first", "second"}), columns.ruleNames);
+	EXPECT_EQ((std::vector<std::string>{"global", ""}), columns.ruleModifiers);
+
+	EXPECT_EQ((std::vector<std::size_t>{0, 0}), columns.tagRules);
+	EXPECT_EQ((std::vector<std::string>{"tag1", "tag2"}), columns.tags);
+
+	EXPECT_EQ((std::vector<std::size_t>{0, 0}), columns.metaRules);
+	EXPECT_EQ((std::vector<std::string>{"author", "version"}), columns.metaKeys);
+	EXPECT_EQ((std::vector<std::string>{"Mr. Avastian", "2"}), columns.metaValues);
+
+	EXPECT_EQ((std::vector<std::size_t>{0, 0, 0}), columns.stringRules);
+	EXPECT_EQ((std::vector<std::string>{"$s", "$h", "$r"}), columns.stringIds);
+	EXPECT_EQ((std::vector<std::string>{"plain", "hex", "regexp"}), columns.stringTypes);
+	EXPECT_EQ((std::vector<std::string>{"ascii wide", "", "nocase"}), columns.stringModifiers);
+	EXPECT_EQ((std::vector<std::string>{"text", "01 ?? 02", "abc"}), columns.stringTexts);
+
+	EXPECT_EQ((std::vector<std::size_t>{0, 0}), columns.moduleRules);
+	EXPECT_EQ((std::vector<std::string>{"pe", "math"}), columns.modules);
+}
+
+}
+}
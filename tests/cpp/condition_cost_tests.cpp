@@ -0,0 +1,88 @@
+/**
+* @file tests/condition_cost_tests.cpp
+* @brief Tests for the estimation of cost of conditions.
+* @copyright (c) 2021 Avast Software, licensed under the MIT license
+*/
+
+#include <sstream>
+
+#include <gtest/gtest.h>
+
+#include "yaramod/parser/parser_driver.h"
+#include "yaramod/utils/condition_cost.h"
+
+using namespace ::testing;
+
+namespace yaramod {
+namespace tests {
+
+class ConditionCostTests : public Test {};
+
+TEST_F(ConditionCostTests,
+ConditionCostIsEstimated) {
+	std::istringstream input(R"(
+import "hash"
+
+rule simple
+{
+	strings:
+		$a = "abc"
+	condition:
+		$a and filesize < 100
+}
+
+rule loop
+{
+	strings:
+		$a = "abc"
+	condition:
+		for any i in (1 .. #a) : ( @a[i] < 100 )
+}
+
+rule strings_set
+{
+	strings:
+		$a1 = "abc"
+		$a2 = "def"
+		$b = "ghi"
+	condition:
+		2 of them and all of ($a*)
+}
+
+rule hashed
+{
+	condition:
+		hash.md5(0, filesize) == "d41d8cd98f00b204e9800998ecf8427e"
+}
+)");
+
+	ParserDriver driver;
+	ASSERT_TRUE(driver.parse(input));
+	const auto& rules = driver.getParsedFile().getRules();
+
+	ConditionCostEstimator estimator;
+	EXPECT_DOUBLE_EQ(5.0, estimator.estimate(*rules[0]));
+	// Range (1 .. #a) has 16 iterations with 16 assumed matches of $a
+	EXPECT_DOUBLE_EQ(69.0, estimator.estimate(*rules[1]));
+	EXPECT_DOUBLE_EQ(13.0, estimator.estimate(*rules[2]));
+	EXPECT_DOUBLE_EQ(15.0 + 0.2 * 1024 * 1024, estimator.estimate(*rules[3]));
+
+	EXPECT_DOUBLE_EQ(0.2, estimator.getFunctionCost("hash.md5").perByte);
+	EXPECT_DOUBLE_EQ(10.0, estimator.getFunctionCost("pe.signatures.valid_on").base);
+	EXPECT_DOUBLE_EQ(1000.0, estimator.getFunctionCost("magic.type").base);
+
+	estimator.setFileSize(1000);
+	estimator.setMatchesPerString(4);
+	EXPECT_DOUBLE_EQ(21.0, estimator.estimate(*rules[1]));
+	EXPECT_DOUBLE_EQ(215.0, estimator.estimate(*rules[3]));
+
+	auto costs = estimateConditionCosts(driver.getParsedFile());
+	ASSERT_EQ(4u, costs.size());
+	EXPECT_EQ("hashed", costs[0].name);
+	EXPECT_EQ("loop", costs[1].name);
+	EXPECT_EQ("strings_set", costs[2].name);
+	EXPECT_EQ("simple", costs[3].name);
+}
+
+}
+}
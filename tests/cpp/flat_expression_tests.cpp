@@ -0,0 +1,63 @@
+/**
+* @file tests/flat_expression_tests.cpp
+* @brief Tests for the flattened representation of expressions.
+* @copyright (c) 2021 Avast Software, licensed under the MIT license
+*/
+
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "yaramod/parser/parser_driver.h"
+#include "yaramod/utils/flat_expression.h"
+
+using namespace ::testing;
+
+namespace yaramod {
+namespace tests {
+
+class FlatExpressionTests : public Test {};
+
+TEST_F(FlatExpressionTests,
+FlattenWorks) {
+	std::istringstream input(R"(
+import "pe"
+
+rule abc
+{
+	strings:
+		$s = "text"
+	condition:
+		$s at 10 and pe.number_of_sections > 1
+}
+)");
+
+	ParserDriver driver;
+	ASSERT_TRUE(driver.parse(input));
+	auto flat = flatten(driver.getParsedFile().getRules()[0]->getCondition());
+
+	using Kind = Expression::Kind;
+	auto kind = [](Kind k) { return static_cast<std::uint32_t>(k); };
+	ASSERT_EQ(7u, flat.nodes.size());
+	std::vector<std::tuple<std::int64_t, std::int32_t, std::uint32_t, std::uint32_t, std::uint32_t>> expected = {
+		{0, -1, 0, kind(Kind::And), 7},
+		{0, 0, 0, kind(Kind::StringAt), 2},
+		{10, 1, 2, kind(Kind::IntLiteral), 1},
+		{0, 0, 4, kind(Kind::Gt), 4},
+		{1, 3, 4, kind(Kind::StructAccess), 2},
+		{2, 4, 4, kind(Kind::Id), 1},
+		{1, 3, 8, kind(Kind::IntLiteral), 1}
+	};
+	for (std::size_t i = 0; i < expected.size(); ++i)
+	{
+		const auto& node = flat.nodes[i];
+		EXPECT_EQ(expected[i], std::make_tuple(node.value, node.parent, node.firstToken, node.kind, node.size)) << "node " << i;
+	}
+	EXPECT_EQ((std::vector<std::string>{"$s", "number_of_sections", "pe"}), flat.texts);
+}
+
+}
+}
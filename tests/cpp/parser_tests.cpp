@@ -4,6 +4,8 @@
 * @copyright AVG Technologies s.r.o, All Rights Reserved
 */
 
+#include <thread>
+
 #include <gtest/gtest.h>
 
 #include "yaramod/parser/parser_driver.h"
@@ -624,6 +626,71 @@ rule hex_string_with_plain_nibbles
 	EXPECT_EQ(input_text, driver.getParsedFile().getTextFormatted());
 }
 
+TEST_F(ParserTests,
+HexStringWithLongRunsOfNibblesWorks) {
+	prepareInput(
+R"(
+rule hex_string_with_long_runs_of_nibbles
+{
+	strings:
+		$1 = { 01 23 45 67 89 AB CD EF ?A BC D? EF 0123 ( 45 67 | 8? ) [2] 9ABC }
+	condition:
+		true
+}
+)");
+
+	EXPECT_TRUE(driver.parse(input));
+	ASSERT_EQ(1u, driver.getParsedFile().getRules().size());
+
+	const auto& rule = driver.getParsedFile().getRules()[0];
+	auto strings = rule->getStrings();
+	ASSERT_EQ(1u, strings.size());
+
+	auto hexString = static_cast<const HexString*>(strings[0]);
+	EXPECT_EQ("{ 01 23 45 67 89 AB CD EF ?A BC D? EF 01 23 ( 45 67 | 8? ) [2] 9A BC }", hexString->getText());
+	EXPECT_EQ(34u, hexString->getUnits().size());
+
+	// Every nibble keeps its own token and location
+	std::size_t nibbles = 0;
+	for (const auto& token : *driver.getParsedFile().getTokenStream())
+	{
+		if (token.getType() != TokenType::HEX_NIBBLE)
+			continue;
+		EXPECT_EQ(5u, token.getLocation().begin().getLine());
+		EXPECT_EQ(token.getLocation().begin().getColumn(), token.getLocation().end().getColumn());
+		if (nibbles == 0)
+		{
+			EXPECT_EQ(10u, token.getLocation().begin().getColumn());
+		}
+		++nibbles;
+	}
+	EXPECT_EQ(35u, nibbles);
+}
+
+TEST_F(ParserTests,
+HexStringWithOddRunOfNibblesIsError) {
+	prepareInput(
+R"(
+rule hex_string_with_odd_run_of_nibbles
+{
+	strings:
+		$1 = { 01 23 4 }
+	condition:
+		true
+}
+)");
+
+	try
+	{
+		driver.parse(input);
+		FAIL() << "Parser did not throw an exception.";
+	}
+	catch (const ParserError& err)
+	{
+		EXPECT_EQ("Error at 5.18: Syntax error: Unexpected }, expected one of hex string ?, hex string nibble", err.getErrorMessage());
+	}
+}
+
 TEST_F(ParserTests,
 HexStringWithLowHighJumpWorks) {
 	prepareInput(
@@ -4390,6 +4457,37 @@ R"(rule rule_with_some_hex_string
 	EXPECT_EQ(input_text, driver.getParsedFile().getTextFormatted());
 }
 
+TEST_F(ParserTests,
+HexStringElementsGetterWorks) {
+	prepareInput(
+R"(rule rule_with_some_hex_string
+{
+	strings:
+		$hex_string = { 9F ?A B? ?? [2-] ( 01 | 02 03 ) }
+	condition:
+		$hex_string
+}
+)");
+	EXPECT_TRUE(driver.parse(input));
+	ASSERT_EQ(1u, driver.getParsedFile().getRules().size());
+
+	auto strings = driver.getParsedFile().getRules()[0]->getStrings();
+	ASSERT_EQ(1u, strings.size());
+	ASSERT_TRUE(strings[0]->isHex());
+
+	auto elements = static_cast<const HexString*>(strings[0])->getElements();
+	ASSERT_EQ(6u, elements.size());
+	EXPECT_EQ(HexStringElement::byte(0x9F, 0xFF), elements[0]);
+	EXPECT_EQ(HexStringElement::byte(0x0A, 0x0F), elements[1]);
+	EXPECT_EQ(HexStringElement::byte(0xB0, 0xF0), elements[2]);
+	EXPECT_TRUE(elements[3].isFullWildcard());
+	EXPECT_EQ(HexStringElement::jump(2, std::nullopt), elements[4]);
+	ASSERT_TRUE(elements[5].isAlternation());
+	ASSERT_EQ(2u, elements[5].alternatives.size());
+	EXPECT_EQ(std::vector<HexStringElement>{HexStringElement::byte(0x01, 0xFF)}, elements[5].alternatives[0]);
+	EXPECT_EQ(2u, elements[5].alternatives[1].size());
+}
+
 TEST_F(ParserTests,
 HexEscapeWorks) {
 	prepareInput(
@@ -4462,6 +4560,38 @@ rule rule_with_escaped_meta_works
 	EXPECT_EQ(input_text, driver.getParsedFile().getTextFormatted());
 }
 
+TEST_F(ParserTests,
+EscapedBackslashFollowedByHexDigitsInMetaWorks) {
+	prepareInput(
+R"(
+rule rule_with_escaped_backslash_meta
+{
+	meta:
+		str_meta_0 = "C:\\x41\\Windows"
+		str_meta_1 = "C:\\\x41\\Windows"
+	condition:
+		true
+}
+)");
+	EXPECT_TRUE(driver.parse(input));
+	ASSERT_EQ(1u, driver.getParsedFile().getRules().size());
+
+	const auto& rule = driver.getParsedFile().getRules()[0];
+
+	auto strMeta0 = rule->getMetaWithName("str_meta_0");
+	auto strMeta1 = rule->getMetaWithName("str_meta_1");
+
+	ASSERT_NE(strMeta0, nullptr);
+	EXPECT_EQ(R"("C:\\x41\\Windows")", strMeta0->getValue().getText());
+	EXPECT_EQ(R"(C:\\x41\\Windows)", strMeta0->getValue().getPureText());
+
+	ASSERT_NE(strMeta1, nullptr);
+	EXPECT_EQ(R"("C:\\\x41\\Windows")", strMeta1->getValue().getText());
+	EXPECT_EQ(R"(C:\A\Windows)", strMeta1->getValue().getPureText());
+
+	EXPECT_EQ(input_text, driver.getParsedFile().getTextFormatted());
+}
+
 TEST_F(ParserTests,
 EscapedSequencesWorks) {
 	prepareInput(
@@ -7166,5 +7296,299 @@ rule empty_rule
 	EXPECT_EQ(input_text, driver.getParsedFile().getTextFormatted());
 }
 
+
+TEST_F(ParserTests,
+LeanModeSkipsCommentsAndLayoutTokens) {
+	prepareInput(
+R"(
+import "pe"
+
+/* Multiline
+ * comment */
+rule lean_rule : Tag1 // tag comment
+{
+	meta:
+		author = "Mr. Avastien"
+	strings:
+		$1 = { 01 23 // hex comment
+		       45 67 }
+		$2 = "text"
+	condition:
+		// condition comment
+		pe.number_of_sections > 2 and
+		for any of ($*) : ( $ at entrypoint )
+}
+)");
+
+	EXPECT_TRUE(driver.parse(input, ParserMode::Lean));
+	const auto& file = driver.getParsedFile();
+	EXPECT_TRUE(file.isLean());
+	ASSERT_EQ(1u, file.getRules().size());
+
+	const auto& rule = file.getRules()[0];
+	EXPECT_EQ("lean_rule", rule->getName());
+	EXPECT_EQ(6u, rule->getLocation().begin().getLine());
+	EXPECT_EQ("{ 01 23 45 67 }", rule->getStrings()[0]->getText());
+	EXPECT_EQ("pe.number_of_sections > 2 and for any of ($*) : ( $ at entrypoint )", rule->getCondition()->getText());
+
+	for (const auto& token : *file.getTokenStream())
+	{
+		EXPECT_NE(TokenType::NEW_LINE, token.getType());
+		EXPECT_NE(TokenType::COMMENT, token.getType());
+		EXPECT_NE(TokenType::ONELINE_COMMENT, token.getType());
+	}
+
+	auto expected = R"(import "pe"
+
+rule lean_rule : Tag1 {
+	meta:
+		author = "Mr. Avastien"
+	strings:
+		$1 = { 01 23 45 67 }
+		$2 = "text"
+	condition:
+		pe.number_of_sections > 2 and for any of ($*) : ( $ at entrypoint )
+})";
+	EXPECT_EQ(expected, file.getText());
+	EXPECT_EQ(expected, file.getTextFormatted());
+}
+
+TEST_F(ParserTests,
+LeanModeReportsErrorLocations) {
+	prepareInput(
+R"(
+// comment
+rule lean_rule
+{
+	condition:
+		/* comment
+		*/ unknown_symbol
+}
+)");
+
+	try
+	{
+		driver.parse(input, ParserMode::Lean);
+		FAIL() << "Parser did not throw an exception.";
+	}
+	catch (const ParserError& err)
+	{
+		EXPECT_EQ("Error at 7.6-19: Unrecognized identifier 'unknown_symbol' referenced", err.getErrorMessage());
+	}
+}
+
+TEST_F(ParserTests,
+LazyConditionsModeParsesConditionsOnDemand) {
+	prepareInput(
+R"(
+import "pe"
+
+rule first_rule
+{
+	condition:
+		true
+}
+
+rule second_rule : Tag
+{
+	meta:
+		author = "Mr. Avastian"
+	strings:
+		$1 = "Hello } World"
+		$2 = /ab{2}c/
+	condition:
+		first_rule and // closing } in a comment
+		/* another } */ pe.number_of_sections > 2 and
+		pe.sections[0].name matches /\.t{1}ext/ and
+		for any of ($*) : ( # > 1 ) and
+		$2 at 0x100
+}
+)");
+
+	EXPECT_TRUE(driver.parse(input, ParserMode::LazyConditions));
+	ASSERT_EQ(2u, driver.getParsedFile().getRules().size());
+
+	const auto& rule = driver.getParsedFile().getRules()[1];
+	EXPECT_EQ("second_rule", rule->getName());
+	EXPECT_EQ("Mr. Avastian", rule->getMetaWithName("author")->getValue().getPureText());
+	EXPECT_EQ(2u, rule->getStrings().size());
+	EXPECT_FALSE(rule->isConditionLoaded());
+
+	ASSERT_NE(nullptr, rule->getCondition());
+	EXPECT_TRUE(rule->isConditionLoaded());
+	EXPECT_EQ(R"(first_rule and pe.number_of_sections > 2 and pe.sections[0].name matches /\.t{1}ext/ and for any of ($*) : ( # > 1 ) and $2 at 0x100)", rule->getCondition()->getText());
+	EXPECT_EQ(rule->getCondition()->getFirstTokenIt()->getLocation().begin().getLine(), 18u);
+	EXPECT_EQ(rule->getCondition()->getFirstTokenIt()->getLocation().begin().getColumn(), 3u);
+
+	EXPECT_EQ(input_text, driver.getParsedFile().getTextFormatted());
+}
+
+TEST_F(ParserTests,
+LazyConditionsModeCanBeCombinedWithLeanMode) {
+	prepareInput(
+R"(
+rule lean_lazy_rule
+{
+	strings:
+		$1 = "text" // string comment
+	condition:
+		/* condition comment */
+		$1 and
+		filesize > 10
+}
+)");
+
+	EXPECT_TRUE(driver.parse(input, ParserMode::Lean | ParserMode::LazyConditions));
+	EXPECT_TRUE(driver.isLean());
+	EXPECT_TRUE(driver.isLazy());
+	EXPECT_FALSE(driver.isIncludeGuarded());
+
+	const auto& file = driver.getParsedFile();
+	EXPECT_TRUE(file.isLean());
+	ASSERT_EQ(1u, file.getRules().size());
+
+	const auto& rule = file.getRules()[0];
+	EXPECT_FALSE(rule->isConditionLoaded());
+	ASSERT_NE(nullptr, rule->getCondition());
+	EXPECT_EQ("$1 and filesize > 10", rule->getCondition()->getText());
+
+	for (const auto& token : *file.getTokenStream())
+	{
+		EXPECT_NE(TokenType::NEW_LINE, token.getType());
+		EXPECT_NE(TokenType::COMMENT, token.getType());
+		EXPECT_NE(TokenType::ONELINE_COMMENT, token.getType());
+	}
+
+	EXPECT_EQ(R"(rule lean_lazy_rule {
+	strings:
+		$1 = "text"
+	condition:
+		$1 and filesize > 10
+})", file.getTextFormatted());
+}
+
+TEST_F(ParserTests,
+LazyConditionsModeKeepsRulesVisibility) {
+	prepareInput(
+R"(
+rule first_rule
+{
+	condition:
+		second_rule
+}
+
+rule second_rule
+{
+	condition:
+		true
+}
+)");
+
+	EXPECT_TRUE(driver.parse(input, ParserMode::LazyConditions));
+	ASSERT_EQ(2u, driver.getParsedFile().getRules().size());
+
+	const auto& rule = driver.getParsedFile().getRules()[0];
+	try
+	{
+		rule->getCondition();
+		FAIL() << "Parser did not throw an exception.";
+	}
+	catch (const ParserError& err)
+	{
+		EXPECT_EQ("Error at 5.3-13: Unrecognized identifier 'second_rule' referenced", err.getErrorMessage());
+	}
+	EXPECT_FALSE(rule->isConditionLoaded());
+	EXPECT_EQ("rule second_rule {\n\tcondition:\n\t\ttrue\n}", driver.getParsedFile().getRules()[1]->getText());
+}
+
+TEST_F(ParserTests,
+LazyConditionsModeWithVariablesWorks) {
+	prepareInput(
+R"(
+import "cuckoo"
+
+rule rule_with_variables
+{
+	variables:
+		int_var = 25
+		network = cuckoo.network
+	condition:
+		int_var > 10 and
+		network.http_request(/abc/)
+}
+)");
+
+	EXPECT_TRUE(driver.parse(input, ParserMode::LazyConditions));
+	ASSERT_EQ(1u, driver.getParsedFile().getRules().size());
+
+	const auto& rule = driver.getParsedFile().getRules()[0];
+	ASSERT_EQ(2u, rule->getVariables().size());
+	EXPECT_EQ("int_var > 10 and network.http_request(/abc/)", rule->getCondition()->getText());
+	EXPECT_EQ(input_text, driver.getParsedFile().getTextFormatted());
+}
+
+TEST_F(ParserTests,
+LazyConditionsModeReportsErrorLocations) {
+	prepareInput(
+R"(
+rule lazy_rule
+{
+	strings:
+		$1 = "abc"
+	condition:
+		$1 and
+		/* comment
+		*/ $2
+}
+)");
+
+	EXPECT_TRUE(driver.parse(input, ParserMode::LazyConditions));
+	try
+	{
+		driver.getParsedFile().getRules()[0]->getCondition();
+		FAIL() << "Parser did not throw an exception.";
+	}
+	catch (const ParserError& err)
+	{
+		EXPECT_EQ("Error at 9.6-7: Reference to undefined string '$2'", err.getErrorMessage());
+	}
+}
+
+
+TEST_F(ParserTests,
+LazyConditionsModeLoadsConditionsFromMultipleThreads) {
+	std::ostringstream source;
+	for (int i = 0; i < 50; ++i)
+		source << "rule rule_" << i << "\n{\n\tcondition:\n\t\tfilesize > " << i << " and\n\t\tuint8(0) == 1\n}\n\n";
+	prepareInput(source.str());
+
+	EXPECT_TRUE(driver.parse(input, ParserMode::LazyConditions));
+	const auto& rules = driver.getParsedFile().getRules();
+	ASSERT_EQ(50u, rules.size());
+
+	// All threads race for the first access to each condition and they have to get the same one
+	std::vector<std::vector<const Expression*>> conditions(4);
+	std::vector<std::thread> threads;
+	for (std::size_t i = 0; i < conditions.size(); ++i)
+	{
+		threads.emplace_back([&, i]() {
+			for (const auto& rule : rules)
+				conditions[i].push_back(rule->getCondition().get());
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+
+	for (std::size_t i = 0; i < rules.size(); ++i)
+	{
+		EXPECT_TRUE(rules[i]->isConditionLoaded());
+		ASSERT_NE(nullptr, conditions[0][i]);
+		for (const auto& loaded : conditions)
+			EXPECT_EQ(conditions[0][i], loaded[i]);
+		EXPECT_EQ("filesize > " + std::to_string(i) + " and uint8(0) == 1", conditions[0][i]->getText());
+	}
+	EXPECT_EQ(input_text, driver.getParsedFile().getTextFormatted());
+}
+
 }
 }
@@ -0,0 +1,115 @@
+/**
+* @file tests/regexp_analyzer_tests.cpp
+* @brief Tests for the analysis of regular expressions.
+* @copyright (c) 2021 Avast Software, licensed under the MIT license
+*/
+
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "yaramod/parser/parser_driver.h"
+#include "yaramod/utils/regexp_analyzer.h"
+
+using namespace ::testing;
+
+namespace yaramod {
+namespace tests {
+
+class RegexpAnalyzerTests : public Test {};
+
+TEST_F(RegexpAnalyzerTests,
+RegexpComplexityIsAnalyzed) {
+	std::istringstream input(R"(
+import "pe"
+
+rule regexps
+{
+	strings:
+		$a = /(a|b|ab)*c.*d{1,1000}/
+		$b = /hello\x20world[0-9]+/ nocase
+		$c = /(\w+)+x/
+		$d = /[a-z]*?foo[^x]*x/
+		$e = /((ab){100}){200}/
+		$f = /(abcd|efgh)/
+	condition:
+		any of them and pe.sections[0].name matches /\.te.*t/i
+}
+)");
+
+	ParserDriver driver;
+	ASSERT_TRUE(driver.parse(input));
+	auto yaraFile = driver.getParsedFile();
+
+	using Kind = RegexpAnalyzer::Issue::Kind;
+	auto issues = [](const RegexpAnalyzer::Report& report) {
+		std::vector<std::pair<Kind, std::string>> result;
+		for (const auto& issue : report.issues)
+			result.emplace_back(issue.kind, issue.unit);
+		return result;
+	};
+
+	RegexpAnalyzer analyzer;
+	auto reports = analyzer.analyze(yaraFile);
+	ASSERT_EQ(7u, reports.size());
+
+	EXPECT_EQ("regexps", reports[0].rule);
+	EXPECT_EQ("$a", reports[0].string);
+	EXPECT_EQ("/(a|b|ab)*c.*d{1,1000}/", reports[0].text);
+	EXPECT_EQ(2009u, reports[0].automatonSize);
+	EXPECT_EQ("c", reports[0].requiredLiteral);
+	EXPECT_EQ((std::vector<std::pair<Kind, std::string>>{
+		{Kind::AmbiguousAlternation, "(a|b|ab)*"},
+		{Kind::LargeRange, "d{1,1000}"},
+		{Kind::AmbiguousRepetition, ".*"},
+		{Kind::MissingLiteral, "/(a|b|ab)*c.*d{1,1000}/"}
+	}), issues(reports[0]));
+
+	EXPECT_EQ("$b", reports[1].string);
+	EXPECT_EQ(14u, reports[1].automatonSize);
+	EXPECT_EQ("hello world", reports[1].requiredLiteral);
+	EXPECT_TRUE(reports[1].issues.empty());
+
+	EXPECT_EQ("x", reports[2].requiredLiteral);
+	EXPECT_EQ((std::vector<std::pair<Kind, std::string>>{
+		{Kind::NestedRepetition, "(\\w+)+"},
+		{Kind::AmbiguousRepetition, "(\\w+)+"},
+		{Kind::MissingLiteral, "/(\\w+)+x/"}
+	}), issues(reports[2]));
+
+	// Lazy repetitions and repetitions of classes disjoint with what follows them are fine
+	EXPECT_EQ("foo", reports[3].requiredLiteral);
+	EXPECT_TRUE(reports[3].issues.empty());
+
+	EXPECT_EQ(40000u, reports[4].automatonSize);
+	EXPECT_EQ(200u, reports[4].requiredLiteral.length());
+	EXPECT_EQ((std::vector<std::pair<Kind, std::string>>{
+		{Kind::LargeAutomaton, "/((ab){100}){200}/"}
+	}), issues(reports[4]));
+
+	// Atoms are chosen for each alternative so they don't need common literal
+	EXPECT_EQ("", reports[5].requiredLiteral);
+	EXPECT_TRUE(reports[5].issues.empty());
+
+	EXPECT_EQ("regexps", reports[6].rule);
+	EXPECT_EQ("", reports[6].string);
+	EXPECT_EQ("/\\.te.*t/i", reports[6].text);
+	EXPECT_EQ(".te", reports[6].requiredLiteral);
+	EXPECT_EQ((std::vector<std::pair<Kind, std::string>>{
+		{Kind::AmbiguousRepetition, ".*"}
+	}), issues(reports[6]));
+
+	analyzer.setMaxAutomatonSize(100000);
+	analyzer.setMinLiteralLength(1);
+	analyzer.setMaxRange(1000);
+	EXPECT_EQ((std::vector<std::pair<Kind, std::string>>{
+		{Kind::AmbiguousAlternation, "(a|b|ab)*"},
+		{Kind::AmbiguousRepetition, ".*"}
+	}), issues(analyzer.analyze(*yaraFile.getRules()[0])[0]));
+}
+
+}
+}
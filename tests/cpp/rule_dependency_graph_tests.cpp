@@ -0,0 +1,286 @@
+/**
+* @file tests/rule_dependency_graph_tests.cpp
+* @brief Tests for the dependency graph of rules.
+* @copyright (c) 2021 Avast Software, licensed under the MIT license
+*/
+
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "yaramod/builder/yara_expression_builder.h"
+#include "yaramod/builder/yara_rule_builder.h"
+#include "yaramod/parser/parser_driver.h"
+
+using namespace ::testing;
+
+namespace yaramod {
+namespace tests {
+
+class RuleDependencyGraphTests : public Test {};
+
+TEST_F(RuleDependencyGraphTests,
+RuleDependencyGraphIsUpdated) {
+	std::istringstream input(R"(
+import "pe"
+
+rule base
+{
+	condition:
+		filesize < 100
+}
+
+private rule helper
+{
+	condition:
+		base and pe.number_of_sections > 1
+}
+
+private rule unused_helper
+{
+	condition:
+		true
+}
+
+private rule unused
+{
+	condition:
+		unused_helper and helper
+}
+
+rule main
+{
+	condition:
+		helper and for any i in (0 .. 1) : ( i == 1 )
+}
+
+private global rule global_rule
+{
+	condition:
+		true
+}
+)");
+
+	ParserDriver driver;
+	ASSERT_TRUE(driver.parse(input));
+	auto file = driver.getParsedFile();
+	const auto& graph = file.getDependencyGraph();
+
+	EXPECT_EQ(6u, graph.getRulesCount());
+	EXPECT_EQ(std::vector<std::string>({"base"}), graph.getDependencies("helper"));
+	EXPECT_EQ(std::vector<std::string>({"helper"}), graph.getDependencies("main"));
+	EXPECT_EQ(std::vector<std::string>({"unused", "main"}), graph.getDependents("helper"));
+	EXPECT_EQ(std::vector<std::string>({"helper", "base"}), graph.getTransitiveDependencies("main"));
+	EXPECT_EQ(std::vector<std::string>({"helper", "unused", "main"}), graph.getTransitiveDependents("base"));
+	EXPECT_EQ(std::vector<std::string>({"base", "helper", "unused_helper", "unused", "main", "global_rule"}), graph.getTopologicalOrder());
+	EXPECT_EQ(std::vector<std::string>({"unused_helper", "unused"}), graph.findUnreferencedPrivateRules());
+	EXPECT_TRUE(graph.findCycles().empty());
+	EXPECT_TRUE(graph.findUndefinedReferences().empty());
+
+	file.removeRules([](const auto& rule) { return rule->getName() == "base"; });
+	EXPECT_EQ(5u, graph.getRulesCount());
+	auto undefined = graph.findUndefinedReferences();
+	ASSERT_EQ(1u, undefined.size());
+	EXPECT_EQ("helper", undefined[0].rule);
+	EXPECT_EQ("base", undefined[0].name);
+
+	auto rule = YaraRuleBuilder{}.withName("extra").withCondition(id("unused").get()).get();
+	file.addRule(std::move(rule));
+	EXPECT_EQ(std::vector<std::string>({"unused"}), graph.getDependencies("extra"));
+	EXPECT_TRUE(graph.findUnreferencedPrivateRules().empty());
+
+	auto helper = file.getRules()[0];
+	helper->setCondition(id("main").get());
+	file.getDependencyGraph().updateRule(*helper);
+	EXPECT_EQ(std::vector<std::vector<std::string>>({{"helper", "main"}}), graph.findCycles());
+	EXPECT_EQ(std::vector<std::string>({"unused_helper", "unused", "global_rule", "extra"}), graph.getTopologicalOrder());
+}
+
+TEST_F(RuleDependencyGraphTests,
+RuleDependencyGraphIsRefreshedOnAccess) {
+	std::istringstream input(R"(
+rule first
+{
+	condition:
+		true
+}
+
+rule second
+{
+	condition:
+		first
+}
+
+rule third
+{
+	condition:
+		second and filesize > 10
+}
+)");
+
+	ParserDriver driver;
+	ASSERT_TRUE(driver.parse(input));
+	auto file = driver.getParsedFile();
+	const auto& rules = file.getRules();
+
+	// Concurrent first accesses build the graph only once
+	std::vector<const RuleDependencyGraph*> graphs(4);
+	std::vector<std::thread> threads;
+	for (std::size_t i = 0; i < graphs.size(); ++i)
+		threads.emplace_back([&, i]() { graphs[i] = &std::as_const(file).getDependencyGraph(); });
+	for (auto& thread : threads)
+		thread.join();
+	for (const auto* graph : graphs)
+		EXPECT_EQ(graphs[0], graph);
+	EXPECT_EQ(std::vector<std::string>({"first", "second", "third"}), graphs[0]->getTopologicalOrder());
+
+	rules[1]->setCondition(boolVal(true).get());
+	EXPECT_TRUE(file.getDependencyGraph().getDependencies("second").empty());
+	EXPECT_TRUE(file.getDependencyGraph().getDependents("first").empty());
+
+	// References to renamed rule are renamed too
+	rules[1]->setName("renamed");
+	const auto& graph = file.getDependencyGraph();
+	EXPECT_FALSE(graph.hasRule("second"));
+	EXPECT_EQ(std::vector<std::string>({"renamed"}), graph.getDependencies("third"));
+	EXPECT_EQ(std::vector<std::string>({"first", "renamed", "third"}), graph.getTopologicalOrder());
+
+	// Conditions modified in place
+	auto* andExpr = static_cast<AndExpression*>(rules[2]->getCondition().get());
+	andExpr->setRightOperand(id("first").get());
+	EXPECT_EQ(std::vector<std::string>({"renamed", "first"}), file.getDependencyGraph().getDependencies("third"));
+	EXPECT_EQ(std::vector<std::string>({"third"}), graph.getDependents("first"));
+}
+
+TEST_F(RuleDependencyGraphTests,
+RuleDependencyGraphIsRefreshedOnlyAfterModifications) {
+	std::istringstream input(R"(
+rule first
+{
+	condition:
+		true
+}
+
+rule second
+{
+	condition:
+		(first or filesize > 10) and true
+}
+)");
+
+	ParserDriver driver;
+	ASSERT_TRUE(driver.parse(input));
+	auto file = driver.getParsedFile();
+	const auto& rules = file.getRules();
+
+	// Neither building nor accessing the graph counts as modification
+	file.getDependencyGraph();
+	auto modifications = StructuralModificationCounter::get();
+	for (int i = 0; i < 10; ++i)
+		EXPECT_EQ(std::vector<std::string>({"first"}), file.getDependencyGraph().getDependencies("second"));
+	EXPECT_EQ(modifications, StructuralModificationCounter::get());
+
+	// Modification deep in the condition
+	auto* andExpr = static_cast<AndExpression*>(rules[1]->getCondition().get());
+	auto* parenExpr = static_cast<ParenthesesExpression*>(andExpr->getLeftOperand().get());
+	auto* orExpr = static_cast<OrExpression*>(parenExpr->getEnclosedExpression().get());
+	orExpr->setLeftOperand(boolVal(false).get());
+	EXPECT_NE(modifications, StructuralModificationCounter::get());
+	EXPECT_TRUE(file.getDependencyGraph().getDependencies("second").empty());
+
+	rules[0]->setModifier(Rule::Modifier::Private);
+	EXPECT_EQ(std::vector<std::string>({"first"}), file.getDependencyGraph().findUnreferencedPrivateRules());
+}
+
+TEST_F(RuleDependencyGraphTests,
+EmptyRuleDependencyGraphWorks) {
+	RuleDependencyGraph standalone;
+	YaraFile empty;
+	std::istringstream input(R"(
+import "pe"
+)");
+
+	ParserDriver driver;
+	ASSERT_TRUE(driver.parse(input));
+	auto file = driver.getParsedFile();
+
+	for (const auto* graph : {&standalone, &empty.getDependencyGraph(), &file.getDependencyGraph()})
+	{
+		EXPECT_EQ(0u, graph->getRulesCount());
+		EXPECT_FALSE(graph->hasRule("unknown"));
+		EXPECT_TRUE(graph->getDependencies("unknown").empty());
+		EXPECT_TRUE(graph->getDependents("unknown").empty());
+		EXPECT_TRUE(graph->getTransitiveDependencies("unknown").empty());
+		EXPECT_TRUE(graph->getTransitiveDependents("unknown").empty());
+		EXPECT_TRUE(graph->getTopologicalOrder().empty());
+		EXPECT_TRUE(graph->findCycles().empty());
+		EXPECT_TRUE(graph->findUndefinedReferences().empty());
+		EXPECT_TRUE(graph->findUnreferencedPrivateRules().empty());
+	}
+}
+
+TEST_F(RuleDependencyGraphTests,
+CyclicRuleDependencyGraphWorks) {
+	std::istringstream input(R"(
+rule first
+{
+	condition:
+		true
+}
+
+rule second
+{
+	condition:
+		first
+}
+
+rule third
+{
+	condition:
+		second
+}
+
+rule fourth
+{
+	condition:
+		third and filesize > 10
+}
+
+rule self
+{
+	condition:
+		true
+}
+)");
+
+	ParserDriver driver;
+	ASSERT_TRUE(driver.parse(input));
+	auto file = driver.getParsedFile();
+	const auto& rules = file.getRules();
+
+	// YARA requires rules to be defined before they are referenced, so cycles can only be created by modifications
+	rules[0]->setCondition(id("third").get());
+	rules[4]->setCondition(id("self").get());
+
+	const auto& graph = file.getDependencyGraph();
+	EXPECT_EQ(std::vector<std::vector<std::string>>({{"first", "second", "third"}, {"self"}}), graph.findCycles());
+	EXPECT_EQ(std::vector<std::string>({"fourth"}), graph.getTopologicalOrder());
+	EXPECT_EQ(std::vector<std::string>({"third", "second", "first"}), graph.getTransitiveDependencies("first"));
+	EXPECT_EQ(std::vector<std::string>({"second", "third", "first", "fourth"}), graph.getTransitiveDependents("first"));
+	EXPECT_EQ(std::vector<std::string>({"self"}), graph.getDependencies("self"));
+	EXPECT_EQ(std::vector<std::string>({"self"}), graph.getDependents("self"));
+	EXPECT_TRUE(graph.findUndefinedReferences().empty());
+
+	// Breaking the cycle makes all rules orderable again
+	rules[0]->setCondition(boolVal(true).get());
+	rules[4]->setCondition(boolVal(true).get());
+	EXPECT_TRUE(file.getDependencyGraph().findCycles().empty());
+	EXPECT_EQ(std::vector<std::string>({"first", "second", "third", "fourth", "self"}), file.getDependencyGraph().getTopologicalOrder());
+}
+
+}
+}
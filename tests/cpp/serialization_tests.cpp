@@ -0,0 +1,194 @@
+/**
+* @file tests/serialization_tests.cpp
+* @brief Tests for the binary serialization and snapshots of YARA files.
+* @copyright (c) 2021 Avast Software, licensed under the MIT license
+*/
+
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "yaramod/parser/parser_driver.h"
+#include "yaramod/utils/serialization.h"
+
+using namespace ::testing;
+
+namespace yaramod {
+namespace tests {
+
+class SerializationTests : public Test {};
+
+TEST_F(SerializationTests,
+SerializedYaraFileCanBeDeserialized) {
+	std::istringstream input(R"(
+import "pe"
+import "math"
+
+// Comment before rule
+private global rule abc : tag1 tag2
+{
+	meta:
+		author = "Mr. Avastian"
+		version = 2
+		size = 0x100
+		valid = true
+	strings:
+		$s = "text\n" ascii wide nocase fullword private
+		$x1 = "xored" xor
+		$x2 = "xored" xor(5)
+		$x3 = "xored" xor(1-3)
+		$b1 = "base" base64
+		$b2 = "base" base64wide("!@#$%^&*(){}[].,|ABCDEFGHIJ\x09LMNOPQRSTUVWXYZabcdefghijklmnopqrstu")
+		$h = { 01 ?? 0? [2] ( AA | BB ?? | CC [1-2] DD ) [3-] ?F [-] 02 }
+		$r = /ab\.c[^a-z]+?(d|e){2,3}\w\s\d*$/is
+		$ = "anonymous 1"
+		$ = "anonymous 2"
+	variables:
+		threshold = 7.5
+	condition:
+		$s at pe.entry_point and #x1 > 2 and @x2[1] < 0x100 and !x3 == 5 or
+		for any i in (1 .. pe.number_of_sections) : ( pe.sections[i].name matches /\.text/ ) and
+		for all section in pe.sections : ( section.virtual_size > -1 ) and
+		pe.version_info["CompanyName"] contains "Avast" and
+		math.entropy(0, filesize) >= threshold and
+		for 2 of ($b*) : ( $ in (0 .. filesize \ 2) ) and
+		any of them and not (uint32(0) == 0x5A4D) and
+		pe.exports("ExitProcess") and 1 of ($h, $r)
+}
+
+rule def
+{
+	condition:
+		abc and entrypoint == 0x1000 // Comment after condition
+}
+)");
+
+	ParserDriver driver;
+	ASSERT_TRUE(driver.parse(input));
+	const auto& file = driver.getParsedFile();
+
+	auto data = serialize(file);
+	auto deserialized = deserializeYaraFile(data);
+	// Serialization of the deserialized file must be stable
+	EXPECT_TRUE(data == serialize(*deserialized));
+	EXPECT_EQ(file.getText(), deserialized->getText());
+	EXPECT_EQ(file.getTextFormatted(), deserialized->getTextFormatted());
+	ASSERT_EQ(2u, deserialized->getImports().size());
+	ASSERT_EQ(2u, deserialized->getRules().size());
+
+	const auto& rule = deserialized->getRules()[0];
+	EXPECT_EQ(Rule::Modifier::PrivateGlobal, rule->getModifier());
+	EXPECT_EQ((std::vector<std::string>{"tag1", "tag2"}), rule->getTags());
+	EXPECT_EQ(10u, rule->getStrings().size());
+	EXPECT_EQ(file.getRules()[0]->getLocation().getText(), rule->getLocation().getText());
+	EXPECT_EQ(rule->getSymbol(), deserialized->findSymbol("abc"));
+	EXPECT_EQ(file.getRules()[0]->getCondition()->getText(), rule->getCondition()->getText());
+
+	// References to strings in the condition must follow the renamed string
+	auto strings = rule->getStrings();
+	auto string = std::find_if(strings.begin(), strings.end(), [](const String* s) { return s->getIdentifier() == "$x2"; });
+	ASSERT_NE(strings.end(), string);
+	(*(*string)->getIdentifierIt())->setValue(std::string{"$renamed"});
+	EXPECT_NE(std::string::npos, rule->getCondition()->getText().find("@renamed[1]"));
+}
+
+TEST_F(SerializationTests,
+SerializedRuleCanBeDeserialized) {
+	std::istringstream input(R"(
+import "pe"
+
+rule abc
+{
+	strings:
+		$s = "text"
+	condition:
+		$s
+}
+
+private rule def : tag
+{
+	meta:
+		author = "Mr. Avastian"
+	strings:
+		$h = { 01 02 [4] 03 }
+		$r = /regexp/i
+	condition:
+		$h and $r and pe.is_dll() and abc
+}
+)");
+
+	ParserDriver driver;
+	ASSERT_TRUE(driver.parse(input));
+	const auto& original = driver.getParsedFile().getRules()[1];
+
+	auto rule = deserializeRule(serialize(*original));
+	EXPECT_EQ(original->getText(), rule->getText());
+	EXPECT_EQ(original->getTokenStream()->getText().substr(original->getTokenStream()->getText().find("private")),
+		rule->getTokenStream()->getText());
+	EXPECT_EQ("def", rule->getName());
+	EXPECT_EQ(Rule::Modifier::Private, rule->getModifier());
+	EXPECT_EQ(original->getCondition()->getText(), rule->getCondition()->getText());
+	EXPECT_EQ(2u, rule->getStrings().size());
+}
+
+TEST_F(SerializationTests,
+DeserializationOfMalformedDataThrows) {
+	std::istringstream input(R"(
+rule abc
+{
+	condition:
+		true
+}
+)");
+
+	ParserDriver driver;
+	ASSERT_TRUE(driver.parse(input));
+	auto data = serialize(driver.getParsedFile());
+
+	EXPECT_THROW(deserializeYaraFile(""), YaramodError);
+	EXPECT_THROW(deserializeYaraFile("not yaramod data"), YaramodError);
+	EXPECT_THROW(deserializeYaraFile(data.substr(0, data.size() / 2)), YaramodError);
+	EXPECT_THROW(deserializeYaraFile(data + "x"), YaramodError);
+	EXPECT_THROW(deserializeRule(data), YaramodError);
+	EXPECT_NO_THROW(deserializeYaraFile(data));
+
+	// Data with the first version of the layout, which stored tokens without differences from previous ones
+	auto firstVersion = data;
+	firstVersion[4] = 1;
+	EXPECT_THROW(deserializeYaraFile(firstVersion), YaramodError);
+}
+
+TEST_F(SerializationTests,
+SnapshotOfYaraFileCanBeLoaded) {
+	std::istringstream input(R"(
+import "pe"
+
+rule abc
+{
+	strings:
+		$s = "text" wide
+	condition:
+		$s and pe.number_of_sections > 2 // Comment
+}
+)");
+
+	ParserDriver driver(Features::Avast);
+	ASSERT_TRUE(driver.parse(input));
+	const auto& file = driver.getParsedFile();
+
+	const std::string path = "utils_tests_snapshot.yrmd";
+	file.saveSnapshot(path);
+	auto loaded = YaraFile::loadSnapshot(path, Features::Avast);
+	EXPECT_THROW(YaraFile::loadSnapshot(path), YaramodError);
+	std::remove(path.c_str());
+
+	EXPECT_EQ(file.getTextFormatted(), loaded->getTextFormatted());
+	EXPECT_EQ(Features::Avast, loaded->getFeatures());
+	EXPECT_THROW(YaraFile::loadSnapshot(path, Features::Avast), YaramodError);
+}
+
+}
+}
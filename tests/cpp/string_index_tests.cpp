@@ -0,0 +1,100 @@
+/**
+* @file tests/string_index_tests.cpp
+* @brief Tests for the index of duplicate strings.
+* @copyright (c) 2021 Avast Software, licensed under the MIT license
+*/
+
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "yaramod/parser/parser_driver.h"
+#include "yaramod/utils/string_index.h"
+
+using namespace ::testing;
+
+namespace yaramod {
+namespace tests {
+
+class StringIndexTests : public Test {};
+
+TEST_F(StringIndexTests,
+DuplicateStringsAreFound) {
+	std::istringstream input1(R"(
+rule first
+{
+	strings:
+		$a = "Hello" nocase
+		$b = { 48 65 6C 6C 6F 20 57 6F 72 6C 64 }
+		$c = "abc" ascii wide
+		$d = /ab+c/
+	condition:
+		all of them
+}
+
+rule second
+{
+	strings:
+		$v = "abc" xor
+		$w = { 61 ?? 63 }
+		$x = "hELLO" nocase ascii
+		$y = "Hello\x20World" private
+		$z = "abc" wide ascii
+	condition:
+		all of them
+}
+)");
+	std::istringstream input2(R"(
+rule third
+{
+	strings:
+		$p = /ab+c/
+		$q = "Hello World" fullword
+		$r = { 48 65 [1] 6C }
+	condition:
+		all of them
+}
+)");
+
+	ParserDriver driver1, driver2;
+	ASSERT_TRUE(driver1.parse(input1));
+	ASSERT_TRUE(driver2.parse(input2));
+
+	auto toText = [](const StringIndex::StringReference& reference) {
+		return std::to_string(reference.file) + ":" + reference.rule + ":" + reference.string;
+	};
+
+	StringIndex index;
+	index.setThreads(2);
+	EXPECT_EQ(0u, index.add(driver1.getParsedFile()));
+	EXPECT_EQ(1u, index.add(driver2.getParsedFile()));
+	EXPECT_EQ(12u, index.getStringsCount());
+
+	std::vector<std::vector<std::string>> duplicates;
+	for (const auto& group : index.findDuplicates())
+	{
+		duplicates.emplace_back();
+		std::transform(group.begin(), group.end(), std::back_inserter(duplicates.back()), toText);
+	}
+	EXPECT_EQ((std::vector<std::vector<std::string>>{
+		{"0:first:$a", "0:second:$x"},
+		{"0:first:$b", "0:second:$y"},
+		{"0:first:$c", "0:second:$z"},
+		{"0:first:$d", "1:third:$p"}
+	}), duplicates);
+
+	// Wide form of $c does not contain $w, strings with xor and fullword are not checked
+	std::vector<std::pair<std::string, std::string>> containments;
+	for (const auto& containment : index.findContainments())
+		containments.emplace_back(toText(containment.outer), toText(containment.inner));
+	EXPECT_EQ((std::vector<std::pair<std::string, std::string>>{
+		{"0:first:$b", "0:first:$a"},
+		{"0:first:$b", "1:third:$r"}
+	}), containments);
+}
+
+}
+}
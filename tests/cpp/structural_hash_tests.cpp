@@ -0,0 +1,236 @@
+/**
+* @file tests/structural_hash_tests.cpp
+* @brief Tests for the structural hashes of rules and expressions.
+* @copyright (c) 2021 Avast Software, licensed under the MIT license
+*/
+
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "yaramod/builder/yara_expression_builder.h"
+#include "yaramod/parser/parser_driver.h"
+
+using namespace ::testing;
+
+namespace yaramod {
+namespace tests {
+
+class StructuralHashTests : public Test {};
+
+TEST_F(StructuralHashTests,
+StructuralHashIgnoresFormatting) {
+	std::istringstream input(R"(
+rule first : tag
+{
+	meta:
+		author = "first"
+	strings:
+		$s1 = "abc" wide ascii
+		$s2 = { aa bb }
+	condition:
+		($s1 and #s2 > 2) or filesize < 100
+}
+
+rule second
+{
+	strings:
+		$x = "abc" ascii wide // comment
+		$y = { AA   BB }
+	condition:
+		100 > filesize or (2 < #y and $x)
+}
+
+rule swapped
+{
+	strings:
+		$y = { AA BB }
+		$x = "abc" ascii wide
+	condition:
+		100 > filesize or (2 < #y and $x)
+}
+
+rule different
+{
+	strings:
+		$s1 = "abc" wide ascii
+		$s2 = { aa bb }
+	condition:
+		($s1 and #s2 > 3) or filesize < 100
+}
+)");
+
+	ParserDriver driver;
+	ASSERT_TRUE(driver.parse(input));
+	const auto& rules = driver.getParsedFile().getRules();
+
+	auto fingerprint = rules[0]->fingerprint();
+	EXPECT_EQ(32u, fingerprint.getText().length());
+	EXPECT_EQ(fingerprint, rules[1]->fingerprint());
+	EXPECT_NE(fingerprint, rules[2]->fingerprint());
+	EXPECT_NE(fingerprint, rules[3]->fingerprint());
+
+	// Without identifiers of strings only the names of strings differ
+	const auto& condition = rules[0]->getCondition();
+	EXPECT_NE(condition->structuralHash(), rules[1]->getCondition()->structuralHash());
+	EXPECT_EQ(condition->structuralHash({"$s1", "$s2"}), rules[1]->getCondition()->structuralHash({"$x", "$y"}));
+
+	// Cached hashes are invalidated on modification
+	auto hash = condition->structuralHash();
+	EXPECT_EQ(hash, condition->structuralHash());
+	auto* orExpr = static_cast<OrExpression*>(condition.get());
+	auto* ltExpr = static_cast<LtExpression*>(orExpr->getRightOperand().get());
+	auto literal = ltExpr->getRightOperand()->getFirstTokenIt();
+	literal->setValue(std::uint64_t{200});
+	EXPECT_NE(hash, condition->structuralHash());
+	literal->setValue(std::uint64_t{100});
+	EXPECT_EQ(hash, condition->structuralHash());
+
+	auto left = orExpr->getLeftOperand();
+	orExpr->setLeftOperand(ltExpr->getLeftOperand());
+	EXPECT_NE(hash, condition->structuralHash());
+	orExpr->setLeftOperand(left);
+	EXPECT_EQ(hash, condition->structuralHash());
+	EXPECT_EQ(fingerprint, rules[0]->fingerprint());
+}
+
+TEST_F(StructuralHashTests,
+StructuralHashIsInvalidatedByModificationsOfNestedExpressions) {
+	std::istringstream input(R"(
+rule first
+{
+	condition:
+		filesize > 10 and (uint8(0) == 1 and (uint16(2) > 2 or true))
+}
+
+rule second
+{
+	condition:
+		filesize < 100 or false
+}
+)");
+
+	ParserDriver driver;
+	ASSERT_TRUE(driver.parse(input));
+	const auto& rules = driver.getParsedFile().getRules();
+	const auto& condition = rules[0]->getCondition();
+	auto hash = condition->structuralHash();
+
+	// Operand of the chain nested in parentheses
+	auto* root = static_cast<AndExpression*>(condition.get());
+	auto* innerAnd = static_cast<AndExpression*>(static_cast<ParenthesesExpression*>(root->getRightOperand().get())->getEnclosedExpression().get());
+	auto* orExpr = static_cast<OrExpression*>(static_cast<ParenthesesExpression*>(innerAnd->getRightOperand().get())->getEnclosedExpression().get());
+	auto right = orExpr->getRightOperand();
+	orExpr->setRightOperand(boolVal(false).get());
+	EXPECT_NE(hash, condition->structuralHash());
+	orExpr->setRightOperand(right);
+	EXPECT_EQ(hash, condition->structuralHash());
+
+	// Inner node of the chain
+	auto left = innerAnd->getLeftOperand();
+	innerAnd->setLeftOperand(boolVal(true).get());
+	EXPECT_NE(hash, condition->structuralHash());
+	innerAnd->setLeftOperand(left);
+	EXPECT_EQ(hash, condition->structuralHash());
+
+	// Expression shared by both conditions invalidates both of them
+	auto* secondOr = static_cast<OrExpression*>(rules[1]->getCondition().get());
+	secondOr->setRightOperand(orExpr->getLeftOperand());
+	auto secondHash = rules[1]->getCondition()->structuralHash();
+	EXPECT_EQ(hash, condition->structuralHash());
+	auto* gtExpr = static_cast<GtExpression*>(orExpr->getLeftOperand().get());
+	auto value = gtExpr->getRightOperand();
+	gtExpr->setRightOperand(intVal(3).get());
+	EXPECT_NE(hash, condition->structuralHash());
+	EXPECT_NE(secondHash, rules[1]->getCondition()->structuralHash());
+	gtExpr->setRightOperand(value);
+	EXPECT_EQ(hash, condition->structuralHash());
+	EXPECT_EQ(secondHash, rules[1]->getCondition()->structuralHash());
+
+	// Parsing of another file keeps the hashes valid
+	std::istringstream other("rule third { condition: filesize > 10 }");
+	ParserDriver otherDriver;
+	ASSERT_TRUE(otherDriver.parse(other));
+	EXPECT_EQ(hash, condition->structuralHash());
+}
+
+TEST_F(StructuralHashTests,
+StructuralHashOfRuleReferenceFollowsRenamedRule) {
+	std::istringstream input(R"(
+rule first
+{
+	condition:
+		filesize > 10
+}
+
+rule second
+{
+	condition:
+		first and (uint8(0) == 1 or filesize < 100)
+}
+)");
+
+	ParserDriver driver;
+	ASSERT_TRUE(driver.parse(input));
+	const auto& rules = driver.getParsedFile().getRules();
+	const auto& condition = rules[1]->getCondition();
+	auto hash = condition->structuralHash();
+	auto firstHash = rules[0]->getCondition()->structuralHash();
+
+	rules[0]->setName("renamed");
+	EXPECT_NE(hash, condition->structuralHash());
+	EXPECT_EQ(firstHash, rules[0]->getCondition()->structuralHash());
+	rules[0]->setName("first");
+	EXPECT_EQ(hash, condition->structuralHash());
+}
+
+TEST_F(StructuralHashTests,
+StructuralHashesAreComputedFromMultipleThreads) {
+	std::ostringstream source;
+	for (int i = 0; i < 50; ++i)
+	{
+		source << "rule rule_" << i << " { strings: $a = \"abc\" $b = { 01 02 } condition: "
+			<< "($a and #b > " << i << ") or (filesize < 100 and uint8(0) == " << i % 3 << ") }\n";
+	}
+	std::istringstream input(source.str());
+
+	ParserDriver driver;
+	ASSERT_TRUE(driver.parse(input));
+	const auto& rules = driver.getParsedFile().getRules();
+
+	std::vector<StructuralHash> fingerprints, hashes;
+	for (const auto& rule : rules)
+	{
+		fingerprints.push_back(rule->fingerprint());
+		hashes.push_back(rule->getCondition()->structuralHash());
+	}
+
+	// Threads compute hashes in different contexts, so they replace cached hashes of each other
+	StructuralHashCache::invalidateAll();
+	std::vector<std::vector<StructuralHash>> results(4);
+	std::vector<std::thread> threads;
+	for (std::size_t i = 0; i < results.size(); ++i)
+	{
+		threads.emplace_back([&, i]() {
+			for (int repeat = 0; repeat < 10; ++repeat)
+			{
+				for (const auto& rule : rules)
+					results[i].push_back(i % 2 ? rule->fingerprint() : rule->getCondition()->structuralHash());
+			}
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+
+	for (std::size_t i = 0; i < results.size(); ++i)
+	{
+		const auto& expected = i % 2 ? fingerprints : hashes;
+		for (std::size_t j = 0; j < results[i].size(); ++j)
+			EXPECT_EQ(expected[j % rules.size()], results[i][j]);
+	}
+}
+
+}
+}
@@ -4,6 +4,8 @@
 * @copyright AVG Technologies s.r.o, All Rights Reserved
 */
 
+#include <limits>
+
 #include <gtest/gtest.h>
 
 #include "yaramod/utils/utils.h"
@@ -58,5 +60,87 @@ UnescapeStringWorks) {
 	EXPECT_EQ("\n\t\\\"\x01", unescapeString(R"(\n\t\\\"\x01)"));
 }
 
+TEST_F(UtilsTests,
+EscapeStringOfLongStringsWorks) {
+	// Long enough to be processed in multiple vectorized blocks with special characters at block boundaries
+	std::string clean(100, 'a');
+	EXPECT_EQ(clean, escapeString(clean));
+	for (std::size_t pos : {0, 15, 16, 31, 32, 33, 63, 64, 99})
+	{
+		for (char special : {'\n', '\t', '\\', '\"', '\x7f', '\x80', '\xff', '\x00', '\x1f'})
+		{
+			auto input = clean;
+			input[pos] = special;
+			auto escaped = escapeString(input);
+			EXPECT_EQ(clean.substr(0, pos), escaped.substr(0, pos));
+			EXPECT_EQ(clean.substr(pos + 1), escaped.substr(escaped.length() - (clean.length() - pos - 1)));
+			EXPECT_EQ(input, unescapeString(escaped));
+		}
+	}
+	EXPECT_EQ(R"(\x7f\x80\xff ~)", escapeString("\x7f\x80\xff ~"));
+}
+
+TEST_F(UtilsTests,
+UnescapeStringOfUnknownSequencesWorks) {
+	EXPECT_EQ("\\", unescapeString("\\"));
+	EXPECT_EQ("a\\", unescapeString("a\\"));
+	EXPECT_EQ("\\q", unescapeString(R"(\q)"));
+	EXPECT_EQ("\\x4", unescapeString(R"(\x4)"));
+	EXPECT_EQ("a\\xZZb", unescapeString(R"(a\xZZb)"));
+	EXPECT_EQ("\r", unescapeString(R"(\r)"));
+	EXPECT_EQ("\\\n", unescapeString(R"(\\\n)"));
+	EXPECT_EQ("AB", unescapeString(R"(\x41\x42)"));
+}
+
+TEST_F(UtilsTests,
+NumToStrWorks) {
+	EXPECT_EQ("0", numToStr(0));
+	EXPECT_EQ("42", numToStr(42));
+	EXPECT_EQ("-42", numToStr(std::int64_t{-42}));
+	EXPECT_EQ("18446744073709551615", numToStr(std::uint64_t{18446744073709551615u}));
+	EXPECT_EQ("-9223372036854775808", numToStr(std::numeric_limits<std::int64_t>::min()));
+	EXPECT_EQ("ff", numToStr(255, std::hex));
+	EXPECT_EQ("0xff", numToStr(255, std::hex, true));
+	EXPECT_EQ("0XFF", numToStr(255, std::hex, true, true));
+	EXPECT_EQ("F", numToStr(std::uint64_t{15}, std::hex, false, true));
+	EXPECT_EQ("0", numToStr(0, std::hex, true));
+	EXPECT_EQ("ffffffffffffffff", numToStr(std::int64_t{-1}, std::hex));
+	EXPECT_EQ("17", numToStr(15, std::oct));
+	EXPECT_EQ("1.5", numToStr(1.5));
+	EXPECT_EQ("0.333333", numToStr(1.0 / 3.0));
+	EXPECT_EQ("1e+10", numToStr(1e10));
+	EXPECT_EQ("100", numToStr(100.0));
+}
+
+TEST_F(UtilsTests,
+StrToNumWorks) {
+	std::int64_t i = 0;
+	EXPECT_TRUE(strToNum("42", i));
+	EXPECT_EQ(42, i);
+	EXPECT_TRUE(strToNum("-42", i));
+	EXPECT_EQ(-42, i);
+	EXPECT_TRUE(strToNum("+7", i));
+	EXPECT_EQ(7, i);
+	EXPECT_TRUE(strToNum("0x1F", i, std::hex));
+	EXPECT_EQ(31, i);
+	EXPECT_TRUE(strToNum("abc", i, std::hex));
+	EXPECT_EQ(2748, i);
+	EXPECT_FALSE(strToNum("", i));
+	EXPECT_FALSE(strToNum("12a", i));
+	EXPECT_FALSE(strToNum("99999999999999999999", i));
+	EXPECT_EQ(2748, i);
+
+	std::uint64_t u = 0;
+	EXPECT_TRUE(strToNum(std::string_view{"123KB"}.substr(0, 3), u));
+	EXPECT_EQ(123u, u);
+	EXPECT_TRUE(strToNum("18446744073709551615", u));
+	EXPECT_EQ(18446744073709551615u, u);
+
+	double d = 0.0;
+	EXPECT_TRUE(strToNum("3.25", d));
+	EXPECT_DOUBLE_EQ(3.25, d);
+	EXPECT_FALSE(strToNum("3.25x", d));
+}
+
 }
 }
@@ -5,12 +5,20 @@
 */
 
 #include <clocale>
+#include <functional>
+#include <random>
 
 #include <gtest/gtest.h>
 
 #include "yaramod/builder/yara_expression_builder.h"
 #include "yaramod/parser/parser_driver.h"
+#include "yaramod/utils/condition_reordering.h"
+#include "yaramod/utils/hex_string_optimizer.h"
 #include "yaramod/utils/modifying_visitor.h"
+#include "yaramod/utils/observing_visitor.h"
+#include "yaramod/utils/simplifier.h"
+#include "yaramod/utils/static_visitor.h"
+#include "yaramod/utils/traversal.h"
 
 using namespace ::testing;
 
@@ -1450,5 +1458,1152 @@ rule rule_6
 	EXPECT_EQ(expected, yara_file.getTextFormatted());
 }
 
+
+TEST_F(VisitorTests,
+ParallelObservingVisitorWorks) {
+	class IntSumVisitor : public yaramod::ObservingVisitor
+	{
+	public:
+		virtual yaramod::VisitResult visit(IntLiteralExpression* expr) override
+		{
+			sum += expr->getValue();
+			++count;
+			return {};
+		}
+
+		std::uint64_t sum = 0;
+		std::size_t count = 0;
+	};
+
+	std::ostringstream ruleset;
+	for (std::size_t i = 0; i < 100; ++i)
+		ruleset << "rule rule_" << i << " {\n\tstrings:\n\t\t$s = \"text\"\n\tcondition:\n\t\t$s and filesize > " << i << "\n}\n\n";
+	prepareInput(ruleset.str());
+	EXPECT_TRUE(driver.parse(input));
+	auto yara_file = driver.getParsedFile();
+
+	std::uint64_t sum = 0;
+	std::vector<std::size_t> counts;
+	yara_file.forEachRuleParallel([]() { return IntSumVisitor{}; }, [&](IntSumVisitor& visitor) {
+		sum += visitor.sum;
+		counts.push_back(visitor.count);
+	}, 4);
+
+	EXPECT_EQ(4950u, sum);
+	EXPECT_EQ((std::vector<std::size_t>{25, 25, 25, 25}), counts);
+}
+
+TEST_F(VisitorTests,
+ParallelModifyingVisitorWorks) {
+	class BoolNegatingVisitor : public yaramod::ModifyingVisitor
+	{
+	public:
+		virtual yaramod::VisitResult visit(BoolLiteralExpression* expr) override
+		{
+			auto newExpr = boolVal(!expr->getValue()).get();
+			expr->exchangeTokens(newExpr.get());
+			return newExpr;
+		}
+
+		virtual yaramod::VisitResult visit(IdExpression*) override
+		{
+			return VisitAction::Delete;
+		}
+	};
+
+	std::ostringstream ruleset;
+	std::ostringstream expected;
+	for (std::size_t i = 0; i < 20; ++i)
+	{
+		ruleset << "rule rule_" << i << "\n{\n\tcondition:\n\t\ttrue and\n\t\tfilesize > " << i << "\n}\n\n";
+		expected << "rule rule_" << i << "\n{\n\tcondition:\n\t\tfalse and\n\t\tfilesize > " << i << "\n}\n\n";
+	}
+	ruleset << "rule rule_20\n{\n\tcondition:\n\t\trule_0\n}\n";
+	expected << "rule rule_20\n{\n\tcondition:\n\t\ttrue\n}\n";
+	prepareInput(ruleset.str());
+	EXPECT_TRUE(driver.parse(input));
+	auto yara_file = driver.getParsedFile();
+
+	std::size_t reduced = 0;
+	yara_file.forEachRuleParallel([]() { return BoolNegatingVisitor{}; }, [&](BoolNegatingVisitor&) { ++reduced; }, 3);
+
+	EXPECT_EQ(3u, reduced);
+	EXPECT_EQ("false and filesize > 7", yara_file.getRules()[7]->getCondition()->getText());
+	EXPECT_EQ("true", yara_file.getRules()[20]->getCondition()->getText());
+	EXPECT_EQ(yara_file.getTokenStream(), yara_file.getRules()[7]->getCondition()->getTokenStream());
+	EXPECT_EQ(expected.str(), yara_file.getTextFormatted());
+}
+
+TEST_F(VisitorTests,
+ParallelVisitorRethrowsErrors) {
+	class ThrowingVisitor : public yaramod::ObservingVisitor
+	{
+	public:
+		virtual yaramod::VisitResult visit(FilesizeExpression*) override
+		{
+			throw YaramodError("filesize");
+		}
+	};
+
+	prepareInput(
+R"(
+rule rule_1 { condition: true }
+rule rule_2 { condition: filesize > 10 }
+)");
+	EXPECT_TRUE(driver.parse(input));
+	auto yara_file = driver.getParsedFile();
+
+	EXPECT_THROW(yara_file.forEachRuleParallel([]() { return ThrowingVisitor{}; }, [](ThrowingVisitor&) {}, 2), YaramodError);
+}
+
+TEST_F(VisitorTests,
+ExpressionKindIsSet) {
+	prepareInput(
+R"(
+import "pe"
+
+rule abc
+{
+	strings:
+		$s = "text"
+	condition:
+		not $s at pe.entry_point and for any i in (1 .. 2) : ( @s[i] > 1 ) or "abc" matches /abc/
+}
+)");
+	EXPECT_TRUE(driver.parse(input));
+	auto cond = driver.getParsedFile().getRules()[0]->getCondition();
+
+	ASSERT_EQ(Expression::Kind::Or, cond->getKind());
+	auto orExpr = std::static_pointer_cast<OrExpression>(cond);
+	ASSERT_EQ(Expression::Kind::And, orExpr->getLeftOperand()->getKind());
+	ASSERT_EQ(Expression::Kind::Matches, orExpr->getRightOperand()->getKind());
+	auto andExpr = std::static_pointer_cast<AndExpression>(orExpr->getLeftOperand());
+	ASSERT_EQ(Expression::Kind::Not, andExpr->getLeftOperand()->getKind());
+	ASSERT_EQ(Expression::Kind::ForArray, andExpr->getRightOperand()->getKind());
+	auto notExpr = std::static_pointer_cast<NotExpression>(andExpr->getLeftOperand());
+	ASSERT_EQ(Expression::Kind::StringAt, notExpr->getOperand()->getKind());
+	auto atExpr = std::static_pointer_cast<StringAtExpression>(notExpr->getOperand());
+	EXPECT_EQ(Expression::Kind::StructAccess, atExpr->getAtExpression()->getKind());
+	auto matchesExpr = std::static_pointer_cast<MatchesExpression>(orExpr->getRightOperand());
+	EXPECT_EQ(Expression::Kind::StringLiteral, matchesExpr->getLeftOperand()->getKind());
+	EXPECT_EQ(Expression::Kind::Regexp, matchesExpr->getRightOperand()->getKind());
+
+	EXPECT_EQ(Expression::Kind::BoolLiteral, boolVal(true).get()->getKind());
+	EXPECT_EQ(Expression::Kind::Filesize, filesize().get()->getKind());
+	EXPECT_EQ(Expression::Kind::Id, id("rule_1").get()->getKind());
+	EXPECT_EQ(Expression::Kind::FunctionCall, id("pe").access("imphash")().get()->getKind());
+}
+
+TEST_F(VisitorTests,
+StaticVisitorWorks) {
+	class KindCounter : public StaticVisitor<KindCounter>
+	{
+	public:
+		using StaticVisitor<KindCounter>::visit;
+
+		void visit(AndExpression* expr)
+		{
+			++ands;
+			StaticVisitor<KindCounter>::visit(expr);
+		}
+
+		void visit(IntLiteralExpression* expr)
+		{
+			sum += expr->getValue();
+		}
+
+		void visit(StringExpression* expr)
+		{
+			ids.push_back(expr->getId());
+		}
+
+		void visit(ForStringExpression*)
+		{
+			// Do not descend into the body of the loop
+		}
+
+		std::size_t ands = 0;
+		std::uint64_t sum = 0;
+		std::vector<std::string> ids;
+	};
+
+	prepareInput(
+R"(
+import "math"
+
+rule abc
+{
+	strings:
+		$s1 = "text"
+		$s2 = "other"
+	condition:
+		$s1 and math.max(1, 2) == 2 and (filesize > 10 and #s2 == 3) and for all of ($s*) : ( $ at 100 )
+}
+)");
+	EXPECT_TRUE(driver.parse(input));
+	auto cond = driver.getParsedFile().getRules()[0]->getCondition();
+
+	KindCounter counter;
+	counter.observe(cond);
+
+	EXPECT_EQ(4u, counter.ands);
+	EXPECT_EQ(18u, counter.sum);
+	EXPECT_EQ(std::vector<std::string>{"$s1"}, counter.ids);
+}
+
+TEST_F(VisitorTests,
+TraverseCallsHooksInOrder) {
+	prepareInput(
+R"(
+rule abc
+{
+	condition:
+		(filesize > 10 or not true) and uint8(0) == 1
+}
+)");
+	EXPECT_TRUE(driver.parse(input));
+	auto cond = driver.getParsedFile().getRules()[0]->getCondition();
+
+	std::vector<std::string> events;
+	traverse(cond, [&](Expression* expr) {
+		events.push_back("+" + expr->getText());
+		// Skip subexpressions of function call
+		return expr->getKind() != Expression::Kind::IntFunction;
+	}, [&](Expression* expr) {
+		events.push_back("-" + expr->getText());
+	});
+
+	EXPECT_EQ((std::vector<std::string>{
+		"+(filesize > 10 or not true) and uint8(0) == 1",
+		"+(filesize > 10 or not true)",
+		"+filesize > 10 or not true",
+		"+filesize > 10",
+		"+filesize",
+		"-filesize",
+		"+10",
+		"-10",
+		"-filesize > 10",
+		"+not true",
+		"+true",
+		"-true",
+		"-not true",
+		"-filesize > 10 or not true",
+		"-(filesize > 10 or not true)",
+		"+uint8(0) == 1",
+		"+uint8(0)",
+		"-uint8(0)",
+		"+1",
+		"-1",
+		"-uint8(0) == 1",
+		"-(filesize > 10 or not true) and uint8(0) == 1"
+	}), events);
+}
+
+TEST_F(VisitorTests,
+IterativeVisitorWorks) {
+	class StringCollector : public IterativeVisitor<StringCollector>
+	{
+	public:
+		using IterativeVisitor<StringCollector>::enter;
+		using IterativeVisitor<StringCollector>::leave;
+
+		bool enter(StringExpression* expr)
+		{
+			ids.push_back(expr->getId() + (inLoop ? " in loop" : ""));
+			return true;
+		}
+
+		bool enter(ForStringExpression*)
+		{
+			inLoop = true;
+			return true;
+		}
+
+		void leave(ForStringExpression*)
+		{
+			inLoop = false;
+		}
+
+		bool enter(FunctionCallExpression*)
+		{
+			return false;
+		}
+
+		bool inLoop = false;
+		std::vector<std::string> ids;
+	};
+
+	prepareInput(
+R"(
+import "pe"
+
+rule abc
+{
+	strings:
+		$s1 = "text"
+		$s2 = "other"
+	condition:
+		$s1 and for all of ($s1, $s2) : ( $ and $s2 ) and pe.exports("a") and $s2
+}
+)");
+	EXPECT_TRUE(driver.parse(input));
+	auto cond = driver.getParsedFile().getRules()[0]->getCondition();
+
+	StringCollector collector;
+	collector.observe(cond);
+
+	EXPECT_EQ((std::vector<std::string>{"$s1", "$s1 in loop", "$s2 in loop", "$ in loop", "$s2 in loop", "$s2"}), collector.ids);
+}
+
+TEST_F(VisitorTests,
+DeeplyNestedConditionDoesNotExhaustStack) {
+	class DepthMeter : public IterativeVisitor<DepthMeter>
+	{
+	public:
+		using IterativeVisitor<DepthMeter>::enter;
+		using IterativeVisitor<DepthMeter>::leave;
+
+		bool enter(ParenthesesExpression*)
+		{
+			maxDepth = std::max(maxDepth, ++depth);
+			return true;
+		}
+
+		void leave(ParenthesesExpression*)
+		{
+			--depth;
+		}
+
+		std::size_t depth = 0;
+		std::size_t maxDepth = 0;
+	};
+
+	const std::size_t depth = 1000000;
+	auto condition = std::string(depth, '(') + "not filesize" + std::string(depth, ')');
+	prepareInput("rule abc { condition: " + condition + " }");
+	EXPECT_TRUE(driver.parse(input));
+	auto yaraFile = std::make_unique<YaraFile>(driver.getParsedFile());
+	auto cond = yaraFile->getRules()[0]->getCondition();
+
+	EXPECT_EQ(condition, cond->getText());
+	EXPECT_EQ("(", cond->getFirstTokenIt()->getString());
+	EXPECT_EQ(")", cond->getLastTokenIt()->getString());
+
+	DepthMeter meter;
+	meter.observe(cond);
+	EXPECT_EQ(depth, meter.maxDepth);
+	EXPECT_EQ(0u, meter.depth);
+
+	cond.reset();
+	yaraFile.reset();
+}
+
+TEST_F(VisitorTests,
+WideConditionDoesNotExhaustStack) {
+	const std::size_t width = 1000000;
+	std::string condition;
+	condition.reserve(width * 16);
+	for (std::size_t i = 0; i < width; ++i)
+	{
+		if (i > 0)
+			condition += " or ";
+		condition += i % 2 == 0 ? "filesize" : "not true";
+	}
+	prepareInput("rule abc { condition: " + condition + " }");
+	EXPECT_TRUE(driver.parse(input));
+	auto yaraFile = std::make_unique<YaraFile>(driver.getParsedFile());
+	auto cond = yaraFile->getRules()[0]->getCondition();
+
+	EXPECT_EQ(condition, cond->getText());
+	EXPECT_EQ("filesize", cond->getFirstTokenIt()->getString());
+	EXPECT_EQ("true", cond->getLastTokenIt()->getText());
+
+	std::size_t ors = 0;
+	traverse(cond, [&](Expression* expr) {
+		if (expr->getKind() == Expression::Kind::Or)
+			++ors;
+		return true;
+	}, [](Expression*) {});
+	EXPECT_EQ(width - 1, ors);
+
+	cond.reset();
+	yaraFile.reset();
+}
+
+TEST_F(VisitorTests,
+ModifyingVisitorKeepsOperandInPlace) {
+	class StringDeleter : public yaramod::ModifyingVisitor
+	{
+	public:
+		using ModifyingVisitor::visit;
+
+		virtual VisitResult visit(StringExpression* expr) override
+		{
+			if (expr->getId() == "$str1" || expr->getId() == "$str3")
+				return VisitAction::Delete;
+			return {};
+		}
+	};
+
+	prepareInput(
+R"(
+rule abc {
+	strings:
+		$str0 = "a"
+		$str1 = "b"
+		$str2 = "c"
+		$str3 = "d"
+	condition:
+		$str1 or // first
+		$str0 and $str3 or
+		not ($str2 or $str3) or
+		$str1
+}
+)");
+
+	EXPECT_TRUE(driver.parse(input));
+	auto yaraFile = driver.getParsedFile();
+	auto rule = yaraFile.getRules()[0];
+	auto str0 = rule->getCondition()->as<OrExpression>()->getLeftOperand()->as<OrExpression>()->getLeftOperand()
+		->as<OrExpression>()->getRightOperand()->as<AndExpression>()->getLeftOperand();
+
+	StringDeleter visitor;
+	rule->setCondition(visitor.modify(rule->getCondition(), boolVal(false).get()));
+
+	EXPECT_EQ("$str0 or not ($str2)", rule->getCondition()->getText());
+	EXPECT_EQ(str0, rule->getCondition()->as<OrExpression>()->getLeftOperand());
+	EXPECT_EQ(R"(
+rule abc
+{
+	strings:
+		$str0 = "a"
+		$str1 = "b"
+		$str2 = "c"
+		$str3 = "d"
+	condition:
+		$str0 or
+		not ($str2)
+}
+)", yaraFile.getTextFormatted());
+}
+
+TEST_F(VisitorTests,
+ModifyingVisitorHandlesLongChainsOfOperations) {
+	class OddStringDeleter : public yaramod::ModifyingVisitor
+	{
+	public:
+		using ModifyingVisitor::visit;
+
+		virtual VisitResult visit(StringExpression* expr) override
+		{
+			if ((expr->getId().back() - '0') % 2 == 1)
+				return VisitAction::Delete;
+			return {};
+		}
+	};
+
+	class StringRenamer : public yaramod::ModifyingVisitor
+	{
+	public:
+		using ModifyingVisitor::visit;
+
+		virtual VisitResult visit(StringExpression* expr) override
+		{
+			TokenStreamContext context{expr};
+			auto output = YaraExpressionBuilder{std::make_shared<StringExpression>(expr->getId() + "x")}.get();
+			cleanUpTokenStreams(context, output.get());
+			return output;
+		}
+	};
+
+	// Long enough to notice if each operation in the chain was searched for its bounds
+	const std::size_t length = 20000;
+	std::string condition, expected, expectedFormatted;
+	for (std::size_t i = 0; i < length; ++i)
+	{
+		if (i > 0)
+			condition += " or ";
+		condition += "$s" + std::to_string(i % 10);
+		if (i % 2 == 0)
+		{
+			if (i > 0)
+			{
+				expected += " or ";
+				expectedFormatted += " or\n\t\t";
+			}
+			expected += "$s" + std::to_string(i % 10) + "x";
+			expectedFormatted += "$s" + std::to_string(i % 10) + "x";
+		}
+	}
+
+	prepareInput("rule abc { strings: $s0 = \"a\" $s1 = \"b\" $s2 = \"c\" $s3 = \"d\" $s4 = \"e\" "
+		"$s5 = \"f\" $s6 = \"g\" $s7 = \"h\" $s8 = \"i\" $s9 = \"j\" condition: " + condition + " }");
+	EXPECT_TRUE(driver.parse(input));
+	auto yaraFile = driver.getParsedFile();
+	auto rule = yaraFile.getRules()[0];
+
+	OddStringDeleter deleter;
+	rule->setCondition(deleter.modify(rule->getCondition()));
+	StringRenamer renamer;
+	rule->setCondition(renamer.modify(rule->getCondition()));
+
+	EXPECT_EQ(expected, rule->getCondition()->getText());
+	auto formatted = yaraFile.getTextFormatted();
+	EXPECT_EQ("\tcondition:\n\t\t" + expectedFormatted + "\n}\n", formatted.substr(formatted.find("\tcondition:")));
+}
+
+TEST_F(VisitorTests,
+OverridesAreCalledForOperationsInChains) {
+	class PlusTracer : public yaramod::ObservingVisitor
+	{
+	public:
+		using ObservingVisitor::visit;
+
+		virtual VisitResult visit(PlusExpression* expr) override
+		{
+			trace.push_back("+");
+			if (expr->getRightOperand()->getText() == "3")
+				return {};
+			return ObservingVisitor::visit(expr);
+		}
+
+		virtual VisitResult visit(IntLiteralExpression* expr) override
+		{
+			trace.push_back(expr->getText());
+			return {};
+		}
+
+		std::vector<std::string> trace;
+	};
+
+	prepareInput("rule abc { condition: 1 + 2 + 3 + (4 + 5) + 6 == 21 }");
+	EXPECT_TRUE(driver.parse(input));
+	auto cond = driver.getParsedFile().getRules()[0]->getCondition();
+
+	PlusTracer tracer;
+	tracer.observe(cond);
+	EXPECT_EQ((std::vector<std::string>{"+", "1", "+", "2", "+", "+", "+", "4", "5", "6", "21"}), tracer.trace);
+}
+
+TEST_F(VisitorTests,
+ObservingVisitorHandlesWideConditions) {
+	class OperationCounter : public yaramod::ObservingVisitor
+	{
+	public:
+		using ObservingVisitor::visit;
+
+		virtual VisitResult visit(OrExpression* expr) override
+		{
+			++ors;
+			return ObservingVisitor::visit(expr);
+		}
+
+		virtual VisitResult visit(FilesizeExpression*) override
+		{
+			++filesizes;
+			return {};
+		}
+
+		virtual VisitResult visit(BoolLiteralExpression*) override
+		{
+			++bools;
+			return {};
+		}
+
+		std::size_t ors = 0;
+		std::size_t filesizes = 0;
+		std::size_t bools = 0;
+	};
+
+	class TrivialObserver : public yaramod::ObservingVisitor
+	{
+	};
+
+	const std::size_t width = 1000000;
+	std::string condition;
+	condition.reserve(width * 16);
+	for (std::size_t i = 0; i < width; ++i)
+	{
+		if (i > 0)
+			condition += " or ";
+		condition += i % 2 == 0 ? "filesize" : "not true";
+	}
+	prepareInput("rule abc { condition: " + condition + " }");
+	EXPECT_TRUE(driver.parse(input));
+	auto yaraFile = std::make_unique<YaraFile>(driver.getParsedFile());
+	auto cond = yaraFile->getRules()[0]->getCondition();
+
+	TrivialObserver observer;
+	observer.observe(cond);
+
+	OperationCounter counter;
+	counter.observe(cond);
+	EXPECT_EQ(width - 1, counter.ors);
+	EXPECT_EQ(width / 2, counter.filesizes);
+	EXPECT_EQ(width / 2, counter.bools);
+
+	cond.reset();
+	yaraFile.reset();
+}
+
+TEST_F(VisitorTests,
+ModifyingVisitorHandlesWideConditions) {
+	class NotDeleter : public yaramod::ModifyingVisitor
+	{
+	public:
+		using ModifyingVisitor::visit;
+
+		virtual VisitResult visit(OrExpression* expr) override
+		{
+			++ors;
+			return ModifyingVisitor::visit(expr);
+		}
+
+		virtual VisitResult visit(NotExpression*) override
+		{
+			return VisitAction::Delete;
+		}
+
+		std::size_t ors = 0;
+	};
+
+	class TrivialModifier : public yaramod::ModifyingVisitor
+	{
+	};
+
+	const std::size_t width = 1000000;
+	std::string condition, expected;
+	condition.reserve(width * 16);
+	expected.reserve(width * 8);
+	for (std::size_t i = 0; i < width; ++i)
+	{
+		if (i > 0)
+			condition += " or ";
+		condition += i % 2 == 0 ? "filesize" : "not true";
+		if (i % 2 == 0)
+			expected += i > 0 ? " or filesize" : "filesize";
+	}
+	prepareInput("rule abc { condition: " + condition + " }");
+	EXPECT_TRUE(driver.parse(input));
+	auto yaraFile = std::make_unique<YaraFile>(driver.getParsedFile());
+	auto rule = yaraFile->getRules()[0];
+
+	TrivialModifier modifier;
+	auto cond = rule->getCondition();
+	EXPECT_EQ(cond, modifier.modify(cond));
+	cond.reset();
+
+	NotDeleter deleter;
+	rule->setCondition(deleter.modify(rule->getCondition()));
+	EXPECT_EQ(width - 1, deleter.ors);
+	EXPECT_EQ(expected, rule->getCondition()->getText());
+
+	rule.reset();
+	yaraFile.reset();
+}
+
+TEST_F(VisitorTests,
+ConditionOperandsAreReorderedByCost) {
+	prepareInput(
+R"(
+import "hash"
+import "pe"
+
+rule expensive_first
+{
+	condition:
+		pe.imphash() == "d41d8cd98f00b204e9800998ecf8427e" and // expensive
+		filesize < 100KB and
+		uint16(0) == 0x5A4D
+}
+
+rule nested
+{
+	strings:
+		$a = "abc"
+	condition:
+		(hash.md5(0, filesize) == "d41d8cd98f00b204e9800998ecf8427e" or $a) and filesize < 100
+}
+
+rule cheap
+{
+	strings:
+		$a = "abc"
+	condition:
+		filesize < 100 and $a
+}
+)");
+
+	ASSERT_TRUE(driver.parse(input));
+	auto yaraFile = driver.getParsedFile();
+
+	ConditionReorderer reorderer;
+	EXPECT_EQ(2u, reorderer.reorder(yaraFile));
+	EXPECT_FALSE(reorderer.reorder(*yaraFile.getRules()[0]));
+
+	EXPECT_EQ(R"(filesize < 100KB and uint16(0) == 0x5A4D and pe.imphash() == "d41d8cd98f00b204e9800998ecf8427e")", yaraFile.getRules()[0]->getCondition()->getText());
+	EXPECT_EQ(R"(filesize < 100 and ($a or hash.md5(0, filesize) == "d41d8cd98f00b204e9800998ecf8427e"))", yaraFile.getRules()[1]->getCondition()->getText());
+	EXPECT_EQ(R"(filesize < 100 and $a)", yaraFile.getRules()[2]->getCondition()->getText());
+
+	std::string expected = R"(
+import "hash"
+import "pe"
+
+rule expensive_first
+{
+	condition:
+		filesize < 100KB and // expensive
+		uint16(0) == 0x5A4D and
+		pe.imphash() == "d41d8cd98f00b204e9800998ecf8427e"
+}
+
+rule nested
+{
+	strings:
+		$a = "abc"
+	condition:
+		filesize < 100 and
+		(
+			$a or
+			hash.md5(0, filesize) == "d41d8cd98f00b204e9800998ecf8427e"
+		)
+}
+
+rule cheap
+{
+	strings:
+		$a = "abc"
+	condition:
+		filesize < 100 and
+		$a
+}
+)";
+	EXPECT_EQ(expected, yaraFile.getTextFormatted());
+
+	std::istringstream reordered(expected);
+	ParserDriver reparsed;
+	EXPECT_TRUE(reparsed.parse(reordered));
+}
+
+TEST_F(VisitorTests,
+ConditionOperandsAreReorderedByCostWithStringsOfRule) {
+	prepareInput(
+R"(
+rule referenced
+{
+	condition:
+		filesize > 100
+}
+
+rule many_strings
+{
+	strings:
+		$a0 = "a0"
+		$a1 = "a1"
+		$a2 = "a2"
+		$a3 = "a3"
+		$a4 = "a4"
+		$a5 = "a5"
+		$a6 = "a6"
+		$a7 = "a7"
+		$a8 = "a8"
+		$a9 = "a9"
+		$b = "b"
+	condition:
+		for all of them : ( @ > 100 ) and #b > 30 and referenced and any of ($a*) and filesize < 100
+}
+)");
+
+	ASSERT_TRUE(driver.parse(input));
+	auto yaraFile = driver.getParsedFile();
+
+	ConditionReorderer reorderer;
+	EXPECT_FALSE(reorderer.reorder(*yaraFile.getRules()[0]));
+	EXPECT_TRUE(reorderer.reorder(*yaraFile.getRules()[1]));
+	EXPECT_EQ("referenced and filesize < 100 and any of ($a*) and #b > 30 and for all of them : ( @ > 100 )", yaraFile.getRules()[1]->getCondition()->getText());
+	EXPECT_FALSE(reorderer.reorder(*yaraFile.getRules()[1]));
+
+	std::istringstream reordered(yaraFile.getTextFormatted());
+	ParserDriver reparsed;
+	EXPECT_TRUE(reparsed.parse(reordered));
+}
+
+TEST_F(VisitorTests,
+SimplifierFoldsConstantsAndBooleans) {
+	prepareInput(
+R"(
+rule arithmetic
+{
+	condition:
+		uint32(0x100 * 4 + 0x10) == 0x4550 and filesize > (1KB + 24) and uint8(-(2 - 5)) == ~0
+}
+
+rule overflow
+{
+	condition:
+		filesize > 0x7FFFFFFFFFFFFFFF + 1 and uint8(0) == 1 \ 0 and uint8(0) == 1 << 64
+}
+
+rule booleans
+{
+	strings:
+		$a = "abc"
+		$b = "def"
+	condition:
+		true and ($a or $b or $a) and not not $b and (1 < 2 or $a)
+}
+
+rule decided
+{
+	strings:
+		$a = "abc"
+	condition:
+		$a and // comment
+		not true
+}
+
+rule parentheses
+{
+	strings:
+		$a = "abc"
+	condition:
+		((($a))) and ((#a) > 2)
+}
+
+rule unchanged
+{
+	strings:
+		$a = "abc"
+	condition:
+		$a and (#a > 2 or filesize < 100) and not not #a
+}
+)");
+
+	ASSERT_TRUE(driver.parse(input));
+	auto yaraFile = driver.getParsedFile();
+
+	Simplifier simplifier;
+	EXPECT_EQ(5u, simplifier.simplify(yaraFile));
+	EXPECT_EQ(0u, simplifier.simplify(yaraFile));
+
+	const auto& rules = yaraFile.getRules();
+	EXPECT_EQ("uint32(0x410) == 0x4550 and filesize > (1KB + 24) and uint8(3) == -1", rules[0]->getCondition()->getText());
+	EXPECT_EQ("filesize > 0x7FFFFFFFFFFFFFFF + 1 and uint8(0) == 1 \\ 0 and uint8(0) == 0", rules[1]->getCondition()->getText());
+	EXPECT_EQ("($a or $b) and $b", rules[2]->getCondition()->getText());
+	EXPECT_EQ("false", rules[3]->getCondition()->getText());
+	EXPECT_EQ("$a and #a > 2", rules[4]->getCondition()->getText());
+	EXPECT_EQ("$a and (#a > 2 or filesize < 100) and not not #a", rules[5]->getCondition()->getText());
+
+	std::istringstream simplified(yaraFile.getTextFormatted());
+	ParserDriver reparsed;
+	ASSERT_TRUE(reparsed.parse(simplified));
+	EXPECT_EQ(yaraFile.getTextFormatted(), reparsed.getParsedFile().getTextFormatted());
+}
+
+TEST_F(VisitorTests,
+SimplifierKeepsMeaningOfConditions) {
+	std::mt19937 random(42);
+	auto pick = [&](std::size_t count) { return std::uniform_int_distribution<std::size_t>(0, count - 1)(random); };
+
+	std::function<std::string(int)> generateInt = [&](int depth) -> std::string {
+		if (depth == 0 || pick(3) == 0)
+		{
+			// Multiplied literals are compared with values around both 1000 and 1024 multiples
+			static const std::vector<std::string> literals = {"1KB", "2KB", "1MB", "1000", "1024", "2000", "2048", "1000000", "1048576"};
+			if (pick(2) == 0)
+				return literals[pick(literals.size())];
+			return std::to_string(pick(8));
+		}
+
+		static const std::vector<std::string> operators = {" + ", " - ", " * ", " & ", " | ", " ^ ", " << ", " >> "};
+		switch (pick(4))
+		{
+			case 0:
+				return "-" + std::to_string(pick(8));
+			case 1:
+				return "(" + generateInt(depth - 1) + ")";
+			default:
+				return "(" + generateInt(depth - 1) + operators[pick(operators.size())] + generateInt(depth - 1) + ")";
+		}
+	};
+
+	std::function<std::string(int)> generateBool = [&](int depth) -> std::string {
+		static const std::vector<std::string> atoms = {"$a", "$b", "$c", "true", "false"};
+		if (depth == 0 || pick(4) == 0)
+			return atoms[pick(atoms.size())];
+
+		static const std::vector<std::string> comparisons = {" < ", " > ", " <= ", " >= ", " == ", " != "};
+		switch (pick(6))
+		{
+			case 0:
+				return "not " + generateBool(depth - 1);
+			case 1:
+				return "(" + generateBool(depth - 1) + ")";
+			case 2:
+				return generateInt(2) + comparisons[pick(comparisons.size())] + generateInt(2);
+			case 3:
+				return "(" + generateBool(depth - 1) + " or " + generateBool(depth - 1) + " or " + generateBool(depth - 1) + ")";
+			default:
+				return "(" + generateBool(depth - 1) + " and " + generateBool(depth - 1) + ")";
+		}
+	};
+
+	// Evaluates the condition with matched strings given by bits of the assignment
+	std::function<std::int64_t(const Expression*, unsigned)> evaluate = [&](const Expression* expr, unsigned assignment) -> std::int64_t {
+		auto binary = [&](auto&& op) {
+			auto binaryExpr = static_cast<const BinaryOpExpression*>(expr);
+			return op(evaluate(binaryExpr->getLeftOperand().get(), assignment), evaluate(binaryExpr->getRightOperand().get(), assignment));
+		};
+		auto unary = [&]() {
+			return evaluate(static_cast<const UnaryOpExpression*>(expr)->getOperand().get(), assignment);
+		};
+
+		switch (expr->getKind())
+		{
+			case Expression::Kind::String:
+				return (assignment >> (expr->getText()[1] - 'a')) & 1;
+			case Expression::Kind::BoolLiteral:
+				return static_cast<const BoolLiteralExpression*>(expr)->getValue();
+			case Expression::Kind::IntLiteral:
+			{
+				// YARA multiplies by 1024 and 1048576, so the values are taken from the text
+				auto text = expr->getText();
+				if (text.size() > 2 && text.substr(text.size() - 2) == "KB")
+					return std::stoll(text.substr(0, text.size() - 2)) * 1024;
+				if (text.size() > 2 && text.substr(text.size() - 2) == "MB")
+					return std::stoll(text.substr(0, text.size() - 2)) * 1048576;
+				return static_cast<const IntLiteralExpression*>(expr)->getValue();
+			}
+			case Expression::Kind::Parentheses:
+				return evaluate(static_cast<const ParenthesesExpression*>(expr)->getEnclosedExpression().get(), assignment);
+			case Expression::Kind::Not: return !unary();
+			case Expression::Kind::UnaryMinus: return -unary();
+			case Expression::Kind::BitwiseNot: return ~unary();
+			case Expression::Kind::And: return binary([](auto l, auto r) { return l && r; });
+			case Expression::Kind::Or: return binary([](auto l, auto r) { return l || r; });
+			case Expression::Kind::Lt: return binary([](auto l, auto r) { return l < r; });
+			case Expression::Kind::Gt: return binary([](auto l, auto r) { return l > r; });
+			case Expression::Kind::Le: return binary([](auto l, auto r) { return l <= r; });
+			case Expression::Kind::Ge: return binary([](auto l, auto r) { return l >= r; });
+			case Expression::Kind::Eq: return binary([](auto l, auto r) { return l == r; });
+			case Expression::Kind::Neq: return binary([](auto l, auto r) { return l != r; });
+			case Expression::Kind::Plus: return binary([](auto l, auto r) { return static_cast<std::int64_t>(static_cast<std::uint64_t>(l) + r); });
+			case Expression::Kind::Minus: return binary([](auto l, auto r) { return static_cast<std::int64_t>(static_cast<std::uint64_t>(l) - r); });
+			case Expression::Kind::Multiply: return binary([](auto l, auto r) { return static_cast<std::int64_t>(static_cast<std::uint64_t>(l) * r); });
+			case Expression::Kind::BitwiseAnd: return binary([](auto l, auto r) { return l & r; });
+			case Expression::Kind::BitwiseOr: return binary([](auto l, auto r) { return l | r; });
+			case Expression::Kind::BitwiseXor: return binary([](auto l, auto r) { return l ^ r; });
+			// Shifts by negative number are undefined in YARA, they are evaluated as 0 here
+			case Expression::Kind::ShiftLeft: return binary([](auto l, auto r) { return r < 0 || r >= 64 ? 0 : static_cast<std::int64_t>(static_cast<std::uint64_t>(l) << r); });
+			case Expression::Kind::ShiftRight: return binary([](auto l, auto r) { return r < 0 ? 0 : (r >= 64 ? 0 : l >> r); });
+			default:
+				ADD_FAILURE() << "Unexpected expression " << expr->getText();
+				return 0;
+		}
+	};
+
+	// YARA multiplies `KB` by 1024 and `MB` by 1048576
+	std::vector<std::string> conditions = {
+		"1KB == 1024",
+		"1KB + 24 == 1048",
+		"2MB * 1 == 2097152",
+		"-1KB != -1000",
+		"(1KB | 0) > 1000 and 1MB - 1 >= 1048575"
+	};
+	for (int i = 0; i < 100; ++i)
+		conditions.push_back(generateBool(4));
+
+	for (const auto& condition : conditions)
+	{
+		prepareInput("rule abc { strings: $a = \"a\" $b = \"b\" $c = \"c\" condition: " + condition + " }");
+		ASSERT_TRUE(driver.parse(input)) << condition;
+		auto yaraFile = driver.getParsedFile();
+		const auto& rule = yaraFile.getRules().front();
+
+		std::vector<bool> expected;
+		for (unsigned assignment = 0; assignment < 8; ++assignment)
+			expected.push_back(evaluate(rule->getCondition().get(), assignment) != 0);
+
+		Simplifier simplifier;
+		simplifier.simplify(*rule);
+
+		std::istringstream simplified(yaraFile.getTextFormatted());
+		ParserDriver reparsed;
+		ASSERT_TRUE(reparsed.parse(simplified)) << condition;
+		const auto& simplifiedCondition = reparsed.getParsedFile().getRules().front()->getCondition();
+		for (unsigned assignment = 0; assignment < 8; ++assignment)
+			EXPECT_EQ(expected[assignment], evaluate(simplifiedCondition.get(), assignment) != 0) << condition << " => " << simplifiedCondition->getText();
+	}
+}
+
+TEST_F(VisitorTests,
+HexStringsAreOptimized) {
+	prepareInput(
+R"(rule jumps
+{
+	strings:
+		$a = { AA [2] [3-4] BB ?? [1-] CC ?? ?? DD }
+	condition:
+		$a
+}
+
+rule alternations
+{
+	strings:
+		$a = { 01 ( AA BB CC | AA DD CC | AA BB CC ) 02 }
+		$b = { 01 ( AA BB | AA BB ) 02 }
+		$c = { 01 ( AA [2] BB | AA [3] CC ) 02 }
+	condition:
+		all of them
+}
+
+rule edges
+{
+	strings:
+		$a = { ?? ?? AA BB [2] ?? }
+		$b = { ?? [2] AA BB ?? }
+		$c = { ?? AA BB ?? }
+		$d = { ?? ?? }
+	condition:
+		$a and @b[1] > 10 and !c == 3 and $d
+}
+
+rule comments
+{
+	strings:
+		$a = { AA [2] [3] // comment
+			BB }
+	condition:
+		$a
+}
+)");
+
+	ASSERT_TRUE(driver.parse(input));
+	auto yaraFile = driver.getParsedFile();
+
+	auto text = [&](std::size_t rule, const std::string& id) {
+		std::shared_ptr<String> string;
+		EXPECT_TRUE(yaraFile.getRules()[rule]->getStringsTrie()->find(id, string));
+		return string ? string->getText() : std::string{};
+	};
+
+	HexStringOptimizer defaultOptimizer;
+	EXPECT_FALSE(defaultOptimizer.getTrimWildcards());
+	EXPECT_EQ(2u, defaultOptimizer.optimize(yaraFile));
+	EXPECT_EQ("{ ?? ?? AA BB [2] ?? }", text(2, "$a"));
+	EXPECT_EQ("{ ?? [2] AA BB ?? }", text(2, "$b"));
+	EXPECT_EQ("{ ?? AA BB ?? }", text(2, "$c"));
+	ASSERT_EQ(1u, defaultOptimizer.getDiagnostics().size());
+	EXPECT_EQ("comments", defaultOptimizer.getDiagnostics()[0].rule);
+
+	HexStringOptimizer optimizer;
+	optimizer.setTrimWildcards(true);
+	EXPECT_EQ(1u, optimizer.optimize(yaraFile));
+
+	EXPECT_EQ("{ AA [5-6] BB [2-] CC ?? ?? DD }", text(0, "$a"));
+	EXPECT_EQ("{ 01 AA ( BB | DD ) CC 02 }", text(1, "$a"));
+	EXPECT_EQ("{ 01 AA BB 02 }", text(1, "$b"));
+	EXPECT_EQ("{ 01 ( AA [2] BB | AA [3] CC ) 02 }", text(1, "$c"));
+	EXPECT_EQ("{ AA BB }", text(2, "$a"));
+	EXPECT_EQ("{ ?? [2] AA BB }", text(2, "$b"));
+	EXPECT_EQ("{ AA BB ?? }", text(2, "$c"));
+	EXPECT_EQ("{ ?? ?? }", text(2, "$d"));
+	EXPECT_EQ("{ AA [2] [3] BB }", text(3, "$a"));
+
+	const auto& diagnostics = optimizer.getDiagnostics();
+	ASSERT_EQ(3u, diagnostics.size());
+	EXPECT_EQ("edges", diagnostics[0].rule);
+	EXPECT_EQ("$b", diagnostics[0].string);
+	EXPECT_EQ("edges", diagnostics[1].rule);
+	EXPECT_EQ("$c", diagnostics[1].string);
+	EXPECT_EQ("comments", diagnostics[2].rule);
+	EXPECT_EQ("$a", diagnostics[2].string);
+
+	EXPECT_EQ(R"(rule jumps
+{
+	strings:
+		$a = { AA [5-6] BB [2-] CC ?? ?? DD }
+	condition:
+		$a
+}
+
+rule alternations
+{
+	strings:
+		$a = { 01 AA ( BB | DD ) CC 02 }
+		$b = { 01 AA BB 02 }
+		$c = { 01 ( AA [2] BB | AA [3] CC ) 02 }
+	condition:
+		all of them
+}
+
+rule edges
+{
+	strings:
+		$a = { AA BB }
+		$b = { ?? [2] AA BB }
+		$c = { AA BB ?? }
+		$d = { ?? ?? }
+	condition:
+		$a and
+		@b[1] > 10 and
+		!c == 3 and
+		$d
+}
+
+rule comments
+{
+	strings:
+		$a = {
+			AA [2] [3] // comment
+			BB
+		}
+	condition:
+		$a
+}
+)", yaraFile.getTextFormatted());
+
+	ParserDriver reparsed;
+	std::istringstream output(yaraFile.getTextFormatted());
+	ASSERT_TRUE(reparsed.parse(output));
+	EXPECT_EQ(0u, optimizer.optimize(yaraFile));
+}
+
+TEST_F(VisitorTests,
+HexStringJumpsInAlternativesAreMergedWithinLimit) {
+	prepareInput(
+R"(rule alternations
+{
+	strings:
+		$a = { 01 02 ( AA [150] [100] BB | CC DD ) 03 }
+		$b = { 01 02 ( AA [100] [100] BB | CC DD ) 03 }
+		$c = { 01 ( AA [100] ?? [99] BB | CC ) 02 }
+		$d = { 01 ( AA [150] [100] BB | AA [150] [100] BB ) 02 }
+	condition:
+		all of them
+}
+)");
+
+	ASSERT_TRUE(driver.parse(input));
+	auto yaraFile = driver.getParsedFile();
+
+	auto text = [&](const std::string& id) {
+		std::shared_ptr<String> string;
+		EXPECT_TRUE(yaraFile.getRules()[0]->getStringsTrie()->find(id, string));
+		return string ? string->getText() : std::string{};
+	};
+
+	HexStringOptimizer optimizer;
+	EXPECT_EQ(1u, optimizer.optimize(yaraFile));
+	EXPECT_EQ("{ 01 02 ( AA [150] [100] BB | CC DD ) 03 }", text("$a"));
+	EXPECT_EQ("{ 01 02 ( AA [200] BB | CC DD ) 03 }", text("$b"));
+	EXPECT_EQ("{ 01 ( AA [200] BB | CC ) 02 }", text("$c"));
+	EXPECT_EQ("{ 01 AA [250] BB 02 }", text("$d"));
+
+	ParserDriver reparsed;
+	std::istringstream output(yaraFile.getTextFormatted());
+	ASSERT_TRUE(reparsed.parse(output));
+}
+
 }
 }
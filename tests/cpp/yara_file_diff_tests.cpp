@@ -0,0 +1,135 @@
+/**
+* @file tests/yara_file_diff_tests.cpp
+* @brief Tests for the structural diff of YARA files.
+* @copyright (c) 2021 Avast Software, licensed under the MIT license
+*/
+
+#include <sstream>
+
+#include <gtest/gtest.h>
+
+#include "yaramod/parser/parser_driver.h"
+#include "yaramod/utils/yara_file_diff.h"
+
+using namespace ::testing;
+
+namespace yaramod {
+namespace tests {
+
+class YaraFileDiffTests : public Test {};
+
+TEST_F(YaraFileDiffTests,
+YaraFilesAreDiffed) {
+	std::istringstream oldInput(R"(
+rule same
+{
+	strings:
+		$a = "abc"
+	condition:
+		$a and filesize < 100
+}
+
+rule changed_metas
+{
+	meta:
+		author = "someone"
+	condition:
+		true
+}
+
+rule removed
+{
+	condition:
+		false
+}
+
+rule old_name
+{
+	strings:
+		$a = { 01 02 }
+	condition:
+		#a > 2
+}
+
+rule changed_condition : tag
+{
+	strings:
+		$a = "abc"
+	condition:
+		$a
+}
+)");
+	std::istringstream newInput(R"(
+rule same {
+	strings:
+		$a = "abc"  // Comment
+	condition:
+		filesize < 100 and ($a)
+}
+
+rule changed_metas
+{
+	meta:
+		author = "someone else"
+	condition:
+		true
+}
+
+rule new_name
+{
+	strings:
+		$b = { 01   02 }
+	condition:
+		2 < #b
+}
+
+private rule changed_condition
+{
+	strings:
+		$a = "abc"
+	condition:
+		$a at 0
+}
+
+rule added
+{
+	condition:
+		true
+}
+)");
+
+	ParserDriver oldDriver;
+	ASSERT_TRUE(oldDriver.parse(oldInput));
+	ParserDriver newDriver;
+	ASSERT_TRUE(newDriver.parse(newInput));
+
+	auto result = diff(oldDriver.getParsedFile(), newDriver.getParsedFile());
+	EXPECT_EQ(1u, result.unchangedRules);
+	ASSERT_EQ(5u, result.changes.size());
+
+	EXPECT_EQ("changed_metas", result.changes[0].newName);
+	EXPECT_EQ(RuleChange::Metas, result.changes[0].sections);
+
+	EXPECT_TRUE(result.changes[1].isRemoved());
+	EXPECT_EQ("removed", result.changes[1].oldName);
+	EXPECT_EQ(RuleChange::All, result.changes[1].sections);
+
+	EXPECT_TRUE(result.changes[2].isRenamed());
+	EXPECT_EQ("old_name", result.changes[2].oldName);
+	EXPECT_EQ("new_name", result.changes[2].newName);
+	EXPECT_EQ(2u, result.changes[2].newIndex.value());
+	EXPECT_EQ(RuleChange::Strings | RuleChange::Condition, result.changes[2].sections);
+
+	EXPECT_FALSE(result.changes[3].isRenamed());
+	EXPECT_EQ(RuleChange::Modifiers | RuleChange::Tags | RuleChange::Condition, result.changes[3].sections);
+	EXPECT_FALSE(result.changes[3].isChanged(RuleChange::Strings));
+
+	EXPECT_TRUE(result.changes[4].isAdded());
+	EXPECT_EQ("added", result.changes[4].newName);
+	EXPECT_EQ(4u, result.changes[4].newIndex.value());
+
+	EXPECT_TRUE(diff(newDriver.getParsedFile(), newDriver.getParsedFile()).empty());
+}
+
+}
+}
@@ -5,7 +5,10 @@
 */
 
 #include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <thread>
 
 #include "yaramod/types/plain_string.h"
 #include "yaramod/yaramod.h"
@@ -184,5 +187,82 @@ rule rule_with_added_metas
 )", yarafile->getTextFormatted());
 }
 
+TEST_F(YaramodTests,
+ParseStringWorks) {
+	yaramod::Yaramod ymod;
+	std::string input_text = "rule abc { strings: $1 = \"text\" condition: $1 }";
+	auto yarafile = ymod.parseString(input_text);
+
+	ASSERT_EQ(1u, yarafile->getRules().size());
+	EXPECT_EQ("rule abc {\n\tstrings:\n\t\t$1 = \"text\"\n\tcondition:\n\t\t$1\n}", yarafile->getText());
+
+	// Only the viewed part of the input is parsed
+	input_text = "rule def { condition: true } rule invalid {";
+	yarafile = ymod.parseString(std::string_view{input_text}.substr(0, 28), ParserMode::Lean);
+	ASSERT_EQ(1u, yarafile->getRules().size());
+	EXPECT_EQ("rule def {\n\tcondition:\n\t\ttrue\n}", yarafile->getText());
+}
+
+TEST_F(YaramodTests,
+SingleYaramodParsesFromMultipleThreads) {
+	yaramod::Yaramod ymod;
+	std::vector<std::unique_ptr<YaraFile>> files(8);
+	std::vector<std::thread> threads;
+	for (std::size_t i = 0; i < files.size(); ++i)
+	{
+		threads.emplace_back([&, i]() {
+			files[i] = ymod.parseString("rule rule_" + std::to_string(i) + " { condition: filesize > " + std::to_string(i) + " }");
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+
+	for (std::size_t i = 0; i < files.size(); ++i)
+	{
+		ASSERT_TRUE(files[i]);
+		ASSERT_EQ(1u, files[i]->getRules().size());
+		EXPECT_EQ("rule_" + std::to_string(i), files[i]->getRules()[0]->getName());
+		EXPECT_EQ("filesize > " + std::to_string(i), files[i]->getRules()[0]->getCondition()->getText());
+	}
+}
+
+TEST_F(YaramodTests,
+ParseFilesWorks) {
+	std::vector<std::string> paths;
+	for (std::size_t i = 0; i < 8; ++i)
+	{
+		paths.push_back("parse_files_" + std::to_string(i) + ".yar");
+		std::ofstream file(paths.back());
+		file << "import \"pe\"\nrule rule_" << i << " { condition: pe.number_of_sections > " << i << " }\n";
+	}
+
+	auto files = parseFiles(paths, 3);
+	ASSERT_EQ(paths.size(), files.size());
+	for (std::size_t i = 0; i < files.size(); ++i)
+	{
+		ASSERT_TRUE(files[i]);
+		ASSERT_EQ(1u, files[i]->getRules().size());
+		EXPECT_EQ("rule_" + std::to_string(i), files[i]->getRules()[0]->getName());
+		EXPECT_EQ("pe.number_of_sections > " + std::to_string(i), files[i]->getRules()[0]->getCondition()->getText());
+	}
+
+	{
+		std::ofstream file(paths[5]);
+		file << "rule invalid { condition: $1 }\n";
+	}
+	try
+	{
+		parseFiles(paths, 3);
+		FAIL() << "Parser did not throw an exception.";
+	}
+	catch (const ParserError& err)
+	{
+		EXPECT_NE(std::string::npos, err.getErrorMessage().find("Reference to undefined string '$1'"));
+	}
+
+	for (const auto& path : paths)
+		std::remove(path.c_str());
+}
+
 }
 }
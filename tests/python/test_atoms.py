@@ -0,0 +1,32 @@
+import unittest
+import yaramod
+
+
+class AtomsTests(unittest.TestCase):
+    def test_extract_atoms(self):
+        yara_file = yaramod.Yaramod().parse_string(r'''
+rule abc
+{
+	strings:
+		$s = "This program" ascii wide
+		$h = { ?? ?? 00 00 }
+		$r = /.*foo/
+	condition:
+		any of them
+}
+''')
+        rules = yara_file.extract_atoms()
+
+        self.assertEqual(len(rules), 1)
+        self.assertEqual(rules[0].name, 'abc')
+        self.assertEqual(rules[0].quality, 4)
+        self.assertEqual([s.id for s in rules[0].strings], ['$s', '$h', '$r'])
+        self.assertEqual([a.text for a in rules[0].strings[0].atoms], ['54 68 69 73', '54 00 68 00'])
+        self.assertEqual(rules[0].strings[0].quality, 66)
+
+        atom = yara_file.rules[0].strings[1].extract_atoms().atoms[0]
+        self.assertEqual(atom.bytes, b'\x00\x00')
+        self.assertEqual(atom.masks, b'\xff\xff')
+        self.assertEqual(atom.quality, 4)
+        self.assertEqual(yara_file.rules[0].extract_atoms().strings[2].atoms[0].text, '66 6F 6F')
+        self.assertEqual(yaramod.Atom.MAX_QUALITY, 88)
@@ -0,0 +1,39 @@
+import unittest
+import yaramod
+
+
+class ColumnarExportTests(unittest.TestCase):
+    def test_export_columns(self):
+        yara_file = yaramod.Yaramod().parse_string('''
+import "pe"
+
+private rule first : tag
+{
+	meta:
+		author = "Mr. Avastian"
+	strings:
+		$s = "text" wide
+		$h = { 01 02 }
+	condition:
+		pe.number_of_sections > 1 and $s and $h
+}
+
+rule second
+{
+	condition:
+		first
+}
+''')
+        columns = yara_file.export_columns()
+
+        self.assertEqual({'name': ['first', 'second'], 'modifier': ['private', '']}, columns['rules'])
+        self.assertEqual({'rule': [0], 'tag': ['tag']}, columns['tags'])
+        self.assertEqual({'rule': [0], 'key': ['author'], 'value': ['Mr. Avastian']}, columns['metas'])
+        self.assertEqual({
+            'rule': [0, 0],
+            'id': ['$s', '$h'],
+            'type': ['plain', 'hex'],
+            'modifiers': ['wide', ''],
+            'text': ['text', '01 02']
+        }, columns['strings'])
+        self.assertEqual({'rule': [0], 'module': ['pe']}, columns['modules'])
@@ -0,0 +1,34 @@
+import unittest
+import yaramod
+
+
+class ConditionCostTests(unittest.TestCase):
+    def test_estimate_condition_costs(self):
+        yara_file = yaramod.Yaramod().parse_string(r'''
+import "hash"
+
+rule simple
+{
+	strings:
+		$a = "abc"
+	condition:
+		$a and filesize < 100
+}
+
+rule hashed
+{
+	condition:
+		hash.md5(0, filesize) == "d41d8cd98f00b204e9800998ecf8427e"
+}
+''')
+        costs = yara_file.estimate_condition_costs()
+        self.assertEqual([c.name for c in costs], ['hashed', 'simple'])
+        self.assertEqual(costs[1].cost, 5.0)
+
+        estimator = yaramod.ConditionCostEstimator()
+        estimator.file_size = 1000
+        estimator.set_function_cost('hash.md5', yaramod.FunctionCost(20.0, per_byte=1.0))
+        self.assertEqual(estimator.get_function_cost('hash.md5').base, 20.0)
+        self.assertEqual(estimator.estimate(yara_file.rules[1]), 1025.0)
+        self.assertEqual(estimator.estimate(yara_file.rules[1].condition), 1025.0)
+        self.assertEqual(yara_file.estimate_condition_costs(estimator)[0].cost, 1025.0)
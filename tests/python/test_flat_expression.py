@@ -0,0 +1,34 @@
+import struct
+import unittest
+import yaramod
+
+
+class FlatExpressionTests(unittest.TestCase):
+    def test_flatten_expression(self):
+        yara_file = yaramod.Yaramod().parse_string('''
+import "pe"
+
+rule abc {
+	strings:
+		$s = "text"
+	condition:
+		$s at 10 and pe.number_of_sections > 1
+}
+''')
+        cond = yara_file.rules[0].condition
+        self.assertEqual(cond.kind, yaramod.ExpressionKind.And)
+
+        flat = cond.flatten()
+        view = memoryview(flat)
+        self.assertEqual(len(flat), 7)
+        self.assertEqual(view.itemsize, 24)
+        self.assertEqual(list(struct.iter_unpack('qiIII', view.cast('B'))), [
+            (0, -1, 0, int(yaramod.ExpressionKind.And), 7),
+            (0, 0, 0, int(yaramod.ExpressionKind.StringAt), 2),
+            (10, 1, 2, int(yaramod.ExpressionKind.IntLiteral), 1),
+            (0, 0, 4, int(yaramod.ExpressionKind.Gt), 4),
+            (1, 3, 4, int(yaramod.ExpressionKind.StructAccess), 2),
+            (2, 4, 4, int(yaramod.ExpressionKind.Id), 1),
+            (1, 3, 8, int(yaramod.ExpressionKind.IntLiteral), 1)
+        ])
+        self.assertEqual(flat.texts, ['$s', 'number_of_sections', 'pe'])
@@ -0,0 +1,47 @@
+import unittest
+import yaramod
+
+
+class LazySequencesTests(unittest.TestCase):
+    def test_lazy_sequences(self):
+        yara_file = yaramod.Yaramod().parse_string('''
+rule abc : tag1 tag2 {
+	meta:
+		author = "Mr. Avastian"
+		version = 2
+	strings:
+		$s = "text"
+		$h = { 01 02 }
+	condition:
+		all of them
+}
+
+rule def {
+	condition:
+		abc
+}
+''')
+        rules = yara_file.rules
+        del yara_file
+
+        self.assertEqual(len(rules), 2)
+        self.assertTrue(rules)
+        self.assertEqual(rules[-1].name, 'def')
+        self.assertEqual([rule.name for rule in rules], ['abc', 'def'])
+        self.assertEqual([rule.name for rule in rules[::-1]], ['def', 'abc'])
+        with self.assertRaises(IndexError):
+            rules[2]
+
+        rule = rules[0]
+        del rules
+        self.assertListEqual(rule.tags, ['tag1', 'tag2'])
+
+        metas = rule.metas
+        strings = rule.strings
+        del rule
+        self.assertEqual([meta.key for meta in metas], ['author', 'version'])
+        self.assertEqual(metas[1].value.pure_text, '2')
+        self.assertEqual(len(strings), 2)
+        self.assertEqual([string.identifier for string in strings], ['$s', '$h'])
+        self.assertEqual(strings[1:][0].identifier, '$h')
+        self.assertFalse(yaramod.Yaramod().parse_string('rule empty { condition: true }').rules[0].strings)
@@ -1,3 +1,6 @@
+import os
+import tempfile
+import threading
 import unittest
 import yaramod
 
@@ -1876,3 +1879,148 @@ rule rule1
 }
 '''
         self.assertEqual(expected, yara_file.text_formatted)
+
+    def test_lean_mode(self):
+        input_text = '''
+// comment
+rule lean_rule
+{
+	strings:
+		$1 = { 01 23 /* hex comment */ 45 67 }
+	condition:
+		/* condition comment */
+		$1 and
+		true
+}
+'''
+        yara_file = yaramod.Yaramod().parse_string(input_text, yaramod.ParserMode.Lean)
+
+        expected = '''rule lean_rule {
+	strings:
+		$1 = { 01 23 45 67 }
+	condition:
+		$1 and true
+}'''
+        self.assertTrue(yara_file.is_lean)
+        self.assertEqual(expected, yara_file.text)
+        self.assertEqual(expected, yara_file.text_formatted)
+        self.assertFalse(any(token.type in [yaramod.TokenType.NewLine, yaramod.TokenType.Comment] for token in yara_file.tokenstream.tokens))
+
+    def test_lazy_conditions_mode(self):
+        input_text = '''
+import "pe"
+
+rule lazy_rule
+{
+	meta:
+		author = "Mr. Avastian"
+	strings:
+		$1 = "text with }"
+	condition:
+		$1 at pe.entry_point and
+		$2
+}
+'''
+        yara_file = yaramod.Yaramod().parse_string(input_text, yaramod.ParserMode.LazyConditions)
+
+        rule = yara_file.rules[0]
+        self.assertEqual('lazy_rule', rule.name)
+        self.assertEqual('Mr. Avastian', rule.metas[0].value.pure_text)
+        self.assertFalse(rule.is_condition_loaded)
+        with self.assertRaisesRegex(yaramod.ParserError, r"^Error at 12.3-4: Reference to undefined string '\$2'$"):
+            rule.condition
+        self.assertFalse(rule.is_condition_loaded)
+
+        yara_file = yaramod.Yaramod().parse_string(input_text.replace('\t\t$2', '\t\tfilesize > 10'), yaramod.ParserMode.LazyConditions)
+        self.assertEqual('$1 at pe.entry_point and filesize > 10', yara_file.rules[0].condition.text)
+        self.assertTrue(yara_file.rules[0].is_condition_loaded)
+        self.assertEqual(input_text.replace('\t\t$2', '\t\tfilesize > 10'), yara_file.text_formatted)
+
+    def test_lean_lazy_conditions_mode(self):
+        input_text = '''
+rule lean_lazy_rule
+{
+	strings:
+		$1 = "text"
+	condition:
+		/* condition comment */
+		$1 and
+		filesize > 10
+}
+'''
+        yara_file = yaramod.Yaramod().parse_string(input_text, yaramod.ParserMode.Lean | yaramod.ParserMode.LazyConditions)
+
+        self.assertTrue(yara_file.is_lean)
+        self.assertFalse(yara_file.rules[0].is_condition_loaded)
+        self.assertEqual('$1 and filesize > 10', yara_file.rules[0].condition.text)
+        self.assertFalse(any(token.type in [yaramod.TokenType.NewLine, yaramod.TokenType.Comment] for token in yara_file.tokenstream.tokens))
+
+    def test_parse_buffers(self):
+        input_text = 'rule abc { strings: $1 = "text" condition: $1 }'
+        expected = '''rule abc {
+	strings:
+		$1 = "text"
+	condition:
+		$1
+}'''
+        for data in [input_text.encode(), bytearray(input_text.encode()), memoryview(input_text.encode())]:
+            yara_file = yaramod.Yaramod().parse_string(data)
+            self.assertEqual(expected, yara_file.text)
+
+        yara_file = yaramod.Yaramod().parse_string(memoryview((input_text + ' rule invalid {').encode())[:len(input_text)])
+        self.assertEqual(expected, yara_file.text)
+
+        with self.assertRaises(ValueError):
+            yaramod.Yaramod().parse_string(memoryview(input_text.encode())[::2])
+
+    def test_parse_files(self):
+        with tempfile.TemporaryDirectory() as directory:
+            paths = []
+            for i in range(8):
+                paths.append(os.path.join(directory, 'rule_{}.yar'.format(i)))
+                with open(paths[-1], 'w') as f:
+                    f.write('import "pe"\nrule rule_{} {{ condition: pe.number_of_sections > {} }}\n'.format(i, i))
+
+            yara_files = yaramod.parse_files(paths, threads=3)
+            self.assertEqual(len(paths), len(yara_files))
+            for i, yara_file in enumerate(yara_files):
+                self.assertEqual('rule_{}'.format(i), yara_file.rules[0].name)
+                self.assertEqual('pe.number_of_sections > {}'.format(i), yara_file.rules[0].condition.text)
+
+            with open(paths[5], 'w') as f:
+                f.write('rule invalid { condition: $1 }\n')
+            with self.assertRaisesRegex(yaramod.ParserError, r"Reference to undefined string '\$1'"):
+                yaramod.parse_files(paths, threads=3)
+
+    def test_parse_in_threads(self):
+        input_texts = ['rule rule_{} {{ condition: filesize > {} }}'.format(i, i) for i in range(16)]
+        results = [None] * len(input_texts)
+
+        def parse(index):
+            results[index] = yaramod.Yaramod().parse_string(input_texts[index]).text_formatted
+
+        threads = [threading.Thread(target=parse, args=(i,)) for i in range(len(input_texts))]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+
+        for i, text in enumerate(results):
+            self.assertEqual('rule rule_{}\n{{\n\tcondition:\n\t\tfilesize > {}\n}}\n'.format(i, i), text)
+
+    def test_parse_in_threads_with_single_parser(self):
+        input_texts = ['rule rule_{} {{ condition: filesize > {} }}'.format(i, i) for i in range(16)]
+        results = [None] * len(input_texts)
+        ymod = yaramod.Yaramod()
+
+        def parse(index):
+            results[index] = ymod.parse_string(input_texts[index]).text_formatted
+
+        threads = [threading.Thread(target=parse, args=(i,)) for i in range(len(input_texts))]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+
+        for i, text in enumerate(results):
+            self.assertEqual('rule rule_{}\n{{\n\tcondition:\n\t\tfilesize > {}\n}}\n'.format(i, i), text)
@@ -0,0 +1,38 @@
+import unittest
+import yaramod
+
+
+class RegexpAnalyzerTests(unittest.TestCase):
+    def test_analyze_regexps(self):
+        yara_file = yaramod.Yaramod().parse_string(r'''
+import "pe"
+
+rule abc
+{
+	strings:
+		$a = /(a|b|ab)*c.*d{1,1000}/
+		$b = /hello\x20world[0-9]+/
+	condition:
+		$a and $b and pe.sections[0].name matches /\.text/
+}
+''')
+        reports = yara_file.analyze_regexps()
+        self.assertEqual([(report.string, report.automaton_size, report.required_literal) for report in reports], [
+            ('$a', 2009, b'c'),
+            ('$b', 14, b'hello world'),
+            ('', 5, b'.text'),
+        ])
+        self.assertEqual([issue.kind for issue in reports[0].issues], [
+            yaramod.RegexpIssue.Kind.AmbiguousAlternation,
+            yaramod.RegexpIssue.Kind.LargeRange,
+            yaramod.RegexpIssue.Kind.AmbiguousRepetition,
+            yaramod.RegexpIssue.Kind.MissingLiteral,
+        ])
+        self.assertEqual(reports[0].issues[1].unit, 'd{1,1000}')
+        self.assertEqual(reports[1].issues, [])
+
+        analyzer = yaramod.RegexpAnalyzer()
+        analyzer.max_range = 1000
+        analyzer.min_literal_length = 1
+        report = analyzer.analyze(yara_file.rules[0].strings[0])
+        self.assertEqual([issue.unit for issue in report.issues], ['(a|b|ab)*', '.*'])
@@ -0,0 +1,95 @@
+import unittest
+import yaramod
+
+
+class RuleDependencyGraphTests(unittest.TestCase):
+    def test_rule_dependency_graph(self):
+        yara_file = yaramod.Yaramod().parse_string('''
+rule abc
+{
+	condition:
+		true
+}
+
+private rule def
+{
+	condition:
+		abc
+}
+
+private rule ghi
+{
+	condition:
+		def
+}
+
+rule jkl
+{
+	condition:
+		abc
+}
+''')
+        graph = yara_file.dependency_graph
+        self.assertEqual(graph.rules_count, 4)
+        self.assertEqual(graph.get_dependencies('ghi'), ['def'])
+        self.assertEqual(graph.get_dependents('abc'), ['def', 'jkl'])
+        self.assertEqual(graph.get_transitive_dependencies('ghi'), ['def', 'abc'])
+        self.assertEqual(graph.topological_order, ['abc', 'def', 'ghi', 'jkl'])
+        self.assertEqual(graph.find_unreferenced_private_rules(), ['def', 'ghi'])
+        self.assertEqual(graph.find_cycles(), [])
+
+        yara_file.remove_rules(lambda rule: rule.name == 'abc')
+        self.assertFalse(graph.has_rule('abc'))
+        undefined = graph.find_undefined_references()
+        self.assertEqual([(ref.rule, ref.name) for ref in undefined], [('def', 'abc'), ('jkl', 'abc')])
+
+        yara_file.rules[-1].condition = yaramod.id('ghi').get()
+        self.assertEqual(yara_file.dependency_graph.get_dependencies('jkl'), ['ghi'])
+        self.assertEqual(yara_file.dependency_graph.find_unreferenced_private_rules(), [])
+
+    def test_empty_rule_dependency_graph(self):
+        for graph in [yaramod.RuleDependencyGraph(), yaramod.Yaramod().parse_string('').dependency_graph]:
+            self.assertEqual(graph.rules_count, 0)
+            self.assertFalse(graph.has_rule('abc'))
+            self.assertEqual(graph.get_dependencies('abc'), [])
+            self.assertEqual(graph.get_transitive_dependents('abc'), [])
+            self.assertEqual(graph.topological_order, [])
+            self.assertEqual(graph.find_cycles(), [])
+            self.assertEqual(graph.find_undefined_references(), [])
+            self.assertEqual(graph.find_unreferenced_private_rules(), [])
+
+    def test_cyclic_rule_dependency_graph(self):
+        yara_file = yaramod.Yaramod().parse_string('''
+rule abc
+{
+	condition:
+		true
+}
+
+rule def
+{
+	condition:
+		abc
+}
+
+rule ghi
+{
+	condition:
+		def
+}
+
+rule jkl
+{
+	condition:
+		ghi
+}
+''')
+        yara_file.rules[0].condition = yaramod.id('ghi').get()
+        graph = yara_file.dependency_graph
+        self.assertEqual(graph.find_cycles(), [['abc', 'def', 'ghi']])
+        self.assertEqual(graph.topological_order, ['jkl'])
+        self.assertEqual(graph.get_transitive_dependencies('abc'), ['ghi', 'def', 'abc'])
+
+        yara_file.rules[0].condition = yaramod.id('abc').get()
+        self.assertEqual(yara_file.dependency_graph.find_cycles(), [['abc']])
+        self.assertEqual(yara_file.dependency_graph.topological_order, ['def', 'ghi', 'jkl'])
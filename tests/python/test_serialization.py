@@ -0,0 +1,59 @@
+import os
+import pickle
+import tempfile
+import unittest
+import yaramod
+
+
+class SerializationTests(unittest.TestCase):
+    def test_pickle_yara_file_and_rule(self):
+        yara_file = yaramod.Yaramod().parse_string('''
+import "pe"
+
+private rule abc : tag1 {
+	meta:
+		author = "Mr. Avastian"
+	strings:
+		$s = "text" xor(1-3) wide
+		$h = { 01 ?? [2-4] 02 }
+		$r = /ab[cd]+/i
+	condition:
+		pe.number_of_sections > 2 and
+		for any section in pe.sections : ( section.name == ".text" ) and
+		@s[1] < 100 and all of them
+}
+
+rule def {
+	condition:
+		abc
+}
+''')
+        unpickled = pickle.loads(pickle.dumps(yara_file))
+        self.assertEqual(unpickled.text, yara_file.text)
+        self.assertEqual(unpickled.text_formatted, yara_file.text_formatted)
+        self.assertEqual([module.name for module in unpickled.imports], ['pe'])
+        self.assertTrue(unpickled.rules[0].is_private)
+        self.assertEqual(unpickled.rules[1].condition.text, 'abc')
+
+        rule = pickle.loads(pickle.dumps(yara_file.rules[0]))
+        self.assertEqual(rule.name, 'abc')
+        self.assertEqual(rule.text, yara_file.rules[0].text)
+        self.assertEqual([string.identifier for string in rule.strings], ['$s', '$h', '$r'])
+
+    def test_snapshot_of_yara_file(self):
+        yara_file = yaramod.Yaramod().parse_string('''
+import "pe"
+
+rule abc {
+	condition:
+		pe.number_of_sections > 2 // Comment
+}
+''')
+        with tempfile.TemporaryDirectory() as directory:
+            path = os.path.join(directory, 'rules.yrmd')
+            yara_file.save_snapshot(path)
+            loaded = yaramod.YaraFile.load_snapshot(path)
+            with self.assertRaises(RuntimeError):
+                yaramod.YaraFile.load_snapshot(path, yaramod.Features.Everything)
+
+        self.assertEqual(loaded.text_formatted, yara_file.text_formatted)
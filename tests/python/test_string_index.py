@@ -0,0 +1,40 @@
+import unittest
+import yaramod
+
+
+class StringIndexTests(unittest.TestCase):
+    def test_find_duplicate_strings(self):
+        first = yaramod.Yaramod().parse_string(r'''
+rule abc
+{
+	strings:
+		$a = "Hello" nocase
+		$b = { 48 65 6C 6C 6F 20 57 6F 72 6C 64 }
+	condition:
+		all of them
+}
+''')
+        second = yaramod.Yaramod().parse_string(r'''
+rule def
+{
+	strings:
+		$x = "hELLO" nocase
+		$y = "Hello World" wide
+		$z = "Hello\x20World"
+	condition:
+		all of them
+}
+''')
+        index = yaramod.StringIndex()
+        self.assertEqual(index.add(first), 0)
+        self.assertEqual(index.add(second), 1)
+        self.assertEqual(index.strings_count, 5)
+
+        duplicates = index.find_duplicates()
+        self.assertEqual([[(ref.file, ref.rule, ref.string) for ref in group] for group in duplicates], [
+            [(0, 'abc', '$a'), (1, 'def', '$x')],
+            [(0, 'abc', '$b'), (1, 'def', '$z')],
+        ])
+        containments = index.find_containments()
+        self.assertEqual([(c.outer.string, c.inner.string) for c in containments], [('$b', '$a')])
+        self.assertEqual([[ref.string for ref in group] for group in second.find_duplicate_strings()], [])
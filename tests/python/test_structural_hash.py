@@ -0,0 +1,36 @@
+import unittest
+import yaramod
+
+
+class StructuralHashTests(unittest.TestCase):
+    def test_rule_fingerprint(self):
+        yara_file = yaramod.Yaramod().parse_string(r'''
+rule abc
+{
+	strings:
+		$a = "text" wide
+		$b = { 01 02 }
+	condition:
+		$a and #b > 1
+}
+
+rule def : tag
+{
+	meta:
+		author = "someone"
+	strings:
+		$x = "text" wide
+		$y = { 01   02 }
+	condition:
+		1 < #y and ($x)
+}
+''')
+        first, second = yara_file.rules
+        self.assertEqual(first.fingerprint(), second.fingerprint())
+        self.assertEqual(len(first.fingerprint().text), 32)
+        self.assertEqual(len({first.fingerprint(), second.fingerprint()}), 1)
+        self.assertNotEqual(first.condition.structural_hash(), second.condition.structural_hash())
+        self.assertEqual(first.condition.structural_hash(['$a', '$b']), second.condition.structural_hash(['$x', '$y']))
+
+        first.condition = yaramod.string_ref('$a').get()
+        self.assertNotEqual(first.fingerprint(), second.fingerprint())
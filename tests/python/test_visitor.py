@@ -765,3 +765,121 @@ rule rule_1
 }
 '''
         self.assertEqual(expected, yara_file.text_formatted)
+
+    def test_reorder_conditions(self):
+        yara_file = yaramod.Yaramod().parse_string(r'''
+import "pe"
+
+rule abc
+{
+	condition:
+		pe.imphash() == "d41d8cd98f00b204e9800998ecf8427e" and filesize < 100KB
+}
+
+rule def
+{
+	condition:
+		pe.number_of_sections > 2 or filesize < 100KB
+}
+''')
+        self.assertEqual(yara_file.reorder_conditions(), 1)
+        self.assertEqual(yara_file.rules[0].condition.text, 'filesize < 100KB and pe.imphash() == "d41d8cd98f00b204e9800998ecf8427e"')
+        self.assertEqual(yara_file.rules[1].condition.text, 'pe.number_of_sections > 2 or filesize < 100KB')
+
+        reorderer = yaramod.ConditionReorderer()
+        reorderer.cheap_cost = 1.0
+        self.assertTrue(reorderer.reorder(yara_file.rules[1]))
+        self.assertEqual(yara_file.rules[1].condition.text, 'filesize < 100KB or pe.number_of_sections > 2')
+        self.assertEqual(yara_file.text_formatted, r'''
+import "pe"
+
+rule abc
+{
+	condition:
+		filesize < 100KB and
+		pe.imphash() == "d41d8cd98f00b204e9800998ecf8427e"
+}
+
+rule def
+{
+	condition:
+		filesize < 100KB or
+		pe.number_of_sections > 2
+}
+''')
+
+    def test_simplify_conditions(self):
+        yara_file = yaramod.Yaramod().parse_string(r'''
+rule abc
+{
+	strings:
+		$a = "abc"
+		$b = "def"
+	condition:
+		uint32(0x100 * 4 + 0x10) == 0x4550 and true and ($a or $b or $a)
+}
+
+rule def
+{
+	condition:
+		filesize > 0x7FFFFFFFFFFFFFFF + 1 or not not false
+}
+''')
+        self.assertEqual(yara_file.simplify_conditions(), 2)
+        self.assertEqual(yara_file.rules[0].condition.text, 'uint32(0x410) == 0x4550 and ($a or $b)')
+        self.assertEqual(yara_file.rules[1].condition.text, 'filesize > 0x7FFFFFFFFFFFFFFF + 1')
+        self.assertFalse(yaramod.Simplifier().simplify(yara_file.rules[0]))
+        self.assertEqual(yara_file.text_formatted, r'''
+rule abc
+{
+	strings:
+		$a = "abc"
+		$b = "def"
+	condition:
+		uint32(0x410) == 0x4550 and
+		(
+			$a or
+			$b
+		)
+}
+
+rule def
+{
+	condition:
+		filesize > 0x7FFFFFFFFFFFFFFF + 1
+}
+''')
+
+    def test_optimize_hex_strings(self):
+        yara_file = yaramod.Yaramod().parse_string(r'''
+rule abc
+{
+	strings:
+		$a = { ?? AA [2] [3-4] BB ( CC DD | CC EE ) ?? }
+		$b = { ?? AA BB }
+	condition:
+		$a and @b > 10
+}
+''')
+        self.assertEqual(yara_file.optimize_hex_strings(), 1)
+        self.assertEqual(yara_file.rules[0].strings[0].text, '{ ?? AA [5-6] BB CC ( DD | EE ) ?? }')
+        optimizer = yaramod.HexStringOptimizer()
+        optimizer.trim_wildcards = True
+        self.assertEqual(optimizer.optimize(yara_file), 1)
+        self.assertEqual(yara_file.rules[0].strings[0].text, '{ AA [5-6] BB CC ( DD | EE ) }')
+        self.assertEqual(yara_file.rules[0].strings[1].text, '{ ?? AA BB }')
+        self.assertEqual(len(optimizer.diagnostics), 1)
+        self.assertEqual(optimizer.diagnostics[0].rule, 'abc')
+        self.assertEqual(optimizer.diagnostics[0].string, '$b')
+        self.assertEqual(yara_file.optimize_hex_strings(trim_wildcards=True), 0)
+        self.assertEqual(yara_file.text_formatted, r'''
+rule abc
+{
+	strings:
+		$a = { AA [5-6] BB CC ( DD | EE ) }
+		$b = { ?? AA BB }
+	condition:
+		$a and
+		@b > 10
+}
+''')
@@ -0,0 +1,45 @@
+import unittest
+import yaramod
+
+
+class YaraFileDiffTests(unittest.TestCase):
+    def test_yara_file_diff(self):
+        old_file = yaramod.Yaramod().parse_string('''
+rule abc
+{
+	condition:
+		filesize < 100
+}
+
+rule def
+{
+	condition:
+		true
+}
+''')
+        new_file = yaramod.Yaramod().parse_string('''
+rule abc : tag
+{
+	condition:
+		100 > filesize
+}
+
+rule ghi
+{
+	condition:
+		false
+}
+''')
+        result = old_file.diff(new_file)
+        self.assertFalse(result.empty)
+        self.assertEqual(result.unchanged_rules, 0)
+        self.assertEqual(len(result.changes), 3)
+        self.assertEqual(result.changes[0].old_name, 'abc')
+        self.assertEqual(result.changes[0].sections, yaramod.RuleChange.Section.Tags)
+        self.assertTrue(result.changes[0].is_changed(yaramod.RuleChange.Section.Tags))
+        self.assertFalse(result.changes[0].is_changed(yaramod.RuleChange.Section.Condition))
+        self.assertTrue(result.changes[1].is_removed)
+        self.assertEqual(result.changes[1].new_index, None)
+        self.assertTrue(result.changes[2].is_added)
+        self.assertEqual(result.changes[2].new_name, 'ghi')
+        self.assertTrue(old_file.diff(old_file).empty)